@@ -0,0 +1,371 @@
+#include "bandwidth_estimator.hpp"
+#include "log.hpp"
+
+#include <algorithm>
+#include <cmath>
+
+LOG_MODULE_NAME("BWE");
+
+namespace {
+using milliseconds_f = std::chrono::duration<double, std::milli>;
+
+// Power of two, so that sequence numbers map onto it without a gap at
+// wraparound. Packets not acknowledged by the time their slot is reused are
+// not taken into account.
+constexpr size_t SEND_HISTORY_SIZE = 4096;
+
+// Packets sent within that much of the first one of a group belong to it.
+constexpr double BURST_INTERVAL_MS = 5;
+
+// Trendline estimator, values as in libwebrtc.
+constexpr size_t TRENDLINE_WINDOW_SIZE = 20;
+constexpr double TRENDLINE_SMOOTHING = 0.9;
+constexpr double TRENDLINE_THRESHOLD_GAIN = 4;
+constexpr unsigned MAX_NUM_DELTAS = 60;
+
+// Overuse detector.
+constexpr double INITIAL_THRESHOLD_MS = 12.5;
+constexpr double MIN_THRESHOLD_MS = 6;
+constexpr double MAX_THRESHOLD_MS = 600;
+constexpr double THRESHOLD_K_UP = 0.0087;
+constexpr double THRESHOLD_K_DOWN = 0.039;
+// Spikes further than that above the threshold do not move it.
+constexpr double MAX_ADAPT_OFFSET_MS = 15;
+constexpr double MAX_THRESHOLD_UPDATE_INTERVAL_MS = 100;
+constexpr double OVERUSE_TIME_THRESHOLD_MS = 10;
+
+// Acknowledged bitrate is measured over that much of receiver time.
+constexpr double ACKED_WINDOW_MS = 500;
+constexpr double MIN_ACKED_SPAN_MS = 100;
+
+// Loss is judged over at least that many packets.
+constexpr size_t LOSS_MIN_PACKETS = 20;
+constexpr double HIGH_LOSS_FRACTION = 0.1;
+
+// Rate control.
+constexpr double DECREASE_FACTOR = 0.85;
+constexpr double INCREASE_FACTOR_PER_SECOND = 1.08;
+// Round trip plus the time it takes for overuse to show up. Bounds how often
+// the rate is decreased and paces additive increase.
+constexpr auto RESPONSE_TIME = std::chrono::milliseconds{200};
+constexpr double AVERAGE_PACKET_BITS = 1200 * 8;
+// Rate is not let run away from what the receiver actually gets.
+constexpr double MAX_ACKED_OVERSHOOT = 1.5;
+constexpr double ACKED_OVERSHOOT_SLACK = 10'000;
+
+double linear_fit_slope(const std::deque<std::pair<double, double>>& points) {
+  double sum_x = 0;
+  double sum_y = 0;
+  for (const auto& [x, y] : points) {
+    sum_x += x;
+    sum_y += y;
+  }
+  const double mean_x = sum_x / points.size();
+  const double mean_y = sum_y / points.size();
+  double numerator = 0;
+  double denominator = 0;
+  for (const auto& [x, y] : points) {
+    numerator += (x - mean_x) * (y - mean_y);
+    denominator += (x - mean_x) * (x - mean_x);
+  }
+  return denominator != 0 ? numerator / denominator : 0;
+}
+}  // namespace
+
+BandwidthEstimator::BandwidthEstimator(BandwidthEstimatorConfig config)
+    : m_config(config),
+      m_sent(SEND_HISTORY_SIZE),
+      m_threshold(INITIAL_THRESHOLD_MS),
+      m_rate(config.start_bitrate) {
+  m_estimate.target_bitrate = config.start_bitrate;
+  m_estimate.delay_threshold = m_threshold;
+}
+
+void BandwidthEstimator::on_packet_sent(uint16_t transport_sequence_num,
+                                        size_t size,
+                                        clock::time_point send_time) {
+  if (!m_first_send) {
+    m_first_send = send_time;
+  }
+  m_sent[transport_sequence_num % SEND_HISTORY_SIZE] = {
+      .sequence_num = transport_sequence_num,
+      .valid = true,
+      .size = size,
+      .send_time = send_time};
+}
+
+int64_t BandwidthEstimator::unwrap_reference_time(int32_t reference_time) {
+  if (!m_reference_time) {
+    m_reference_time = reference_time;
+    return reference_time;
+  }
+  // 24-bit difference, sign extended.
+  int32_t delta = (reference_time - static_cast<int32_t>(*m_reference_time)) &
+                  0xFFFFFF;
+  if (delta & 0x800000) {
+    delta -= 0x1000000;
+  }
+  *m_reference_time += delta;
+  return *m_reference_time;
+}
+
+void BandwidthEstimator::on_feedback(const RTCP_TransportFeedback& feedback,
+                                     clock::time_point now) {
+  const double reference =
+      unwrap_reference_time(feedback.reference_time) *
+      milliseconds_f{RTCP_TransportFeedback::ReferenceTimeUnit}.count();
+  const double delta_unit =
+      milliseconds_f{RTCP_TransportFeedback::DeltaUnit}.count();
+
+  // (send, arrival) of packets that made it.
+  std::vector<std::pair<double, double>> arrived;
+  arrived.reserve(feedback.arrivals.size());
+  size_t lost = 0;
+  size_t reported = 0;
+
+  for (size_t i = 0; i < feedback.arrivals.size(); ++i) {
+    const uint16_t sequence_num = feedback.base_sequence_num + i;
+    auto& sent = m_sent[sequence_num % SEND_HISTORY_SIZE];
+    if (!sent.valid || sent.sequence_num != sequence_num) {
+      // Too old, reported already or not ours.
+      continue;
+    }
+    sent.valid = false;
+    reported++;
+    if (!feedback.arrivals[i]) {
+      lost++;
+      continue;
+    }
+    const double arrival = reference + *feedback.arrivals[i] * delta_unit;
+    const double send = milliseconds_f{sent.send_time - *m_first_send}.count();
+    update_acknowledged_bitrate(arrival, sent.size);
+    arrived.emplace_back(send, arrival);
+  }
+  if (reported == 0) {
+    return;
+  }
+
+  update_loss(lost, reported);
+  std::sort(arrived.begin(), arrived.end());
+  for (const auto& [send, arrival] : arrived) {
+    on_packet_arrived(send, arrival);
+  }
+  update_rate(now);
+}
+
+void BandwidthEstimator::update_acknowledged_bitrate(double arrival,
+                                                     size_t size) {
+  m_acked.emplace_back(arrival, size);
+  m_acked_bytes += size;
+  while (m_acked.size() > 1 &&
+         arrival - m_acked.front().first > ACKED_WINDOW_MS) {
+    m_acked_bytes -= m_acked.front().second;
+    m_acked.pop_front();
+  }
+
+  const double span = m_acked.back().first - m_acked.front().first;
+  if (span >= MIN_ACKED_SPAN_MS) {
+    // The first packet marks the beginning of the span, its bytes arrived
+    // before it.
+    const double bits = (m_acked_bytes - m_acked.front().second) * 8.0;
+    m_estimate.acknowledged_bitrate =
+        static_cast<uint64_t>(bits * 1000 / span);
+  }
+}
+
+void BandwidthEstimator::update_loss(size_t lost, size_t reported) {
+  m_loss_lost += lost;
+  m_loss_reported += reported;
+  if (m_loss_reported < LOSS_MIN_PACKETS) {
+    return;
+  }
+  m_estimate.loss_fraction =
+      static_cast<double>(m_loss_lost) / static_cast<double>(m_loss_reported);
+  m_loss_lost = 0;
+  m_loss_reported = 0;
+  m_loss_updated = true;
+}
+
+void BandwidthEstimator::on_packet_arrived(double send, double arrival) {
+  if (!m_current_group) {
+    m_current_group = PacketGroup{send, send, arrival};
+    return;
+  }
+  auto& current = *m_current_group;
+  if (send < current.first_send) {
+    // Sent before the group started, e.g. a retransmission that went ahead
+    // of the queue. Tells nothing about the trend.
+    return;
+  }
+  if (send - current.first_send <= BURST_INTERVAL_MS) {
+    current.last_send = std::max(current.last_send, send);
+    current.last_arrival = std::max(current.last_arrival, arrival);
+    return;
+  }
+
+  if (m_previous_group) {
+    const double send_delta = current.last_send - m_previous_group->last_send;
+    const double arrival_delta =
+        current.last_arrival - m_previous_group->last_arrival;
+    update_trendline(arrival_delta - send_delta, current.last_arrival,
+                     send_delta);
+  }
+  m_previous_group = current;
+  m_current_group = PacketGroup{send, send, arrival};
+}
+
+void BandwidthEstimator::update_trendline(double delay_variation,
+                                          double arrival,
+                                          double send_delta) {
+  if (!m_first_arrival) {
+    m_first_arrival = arrival;
+  }
+  m_num_deltas = std::min(m_num_deltas + 1, MAX_NUM_DELTAS);
+  m_accumulated_delay += delay_variation;
+  m_smoothed_delay = TRENDLINE_SMOOTHING * m_smoothed_delay +
+                     (1 - TRENDLINE_SMOOTHING) * m_accumulated_delay;
+
+  m_trend_window.emplace_back(arrival - *m_first_arrival, m_smoothed_delay);
+  if (m_trend_window.size() > TRENDLINE_WINDOW_SIZE) {
+    m_trend_window.pop_front();
+  }
+  if (m_trend_window.size() == TRENDLINE_WINDOW_SIZE) {
+    m_trend = linear_fit_slope(m_trend_window);
+  }
+  detect_overuse(m_trend, send_delta, arrival);
+}
+
+void BandwidthEstimator::detect_overuse(double trend,
+                                        double send_delta,
+                                        double now) {
+  const double modified_trend =
+      m_num_deltas * trend * TRENDLINE_THRESHOLD_GAIN;
+  m_estimate.delay_trend = modified_trend;
+
+  if (modified_trend > m_threshold) {
+    if (m_time_over_using < 0) {
+      // Assume the overuse started half way between the groups.
+      m_time_over_using = send_delta / 2;
+    } else {
+      m_time_over_using += send_delta;
+    }
+    m_overuse_counter++;
+    // Needs to last a bit and keep growing, single spikes do not count.
+    if (m_time_over_using > OVERUSE_TIME_THRESHOLD_MS &&
+        m_overuse_counter > 1 && trend >= m_previous_trend) {
+      m_time_over_using = 0;
+      m_overuse_counter = 0;
+      m_estimate.usage = BandwidthUsage::overusing;
+    }
+  } else if (modified_trend < -m_threshold) {
+    m_time_over_using = -1;
+    m_overuse_counter = 0;
+    m_estimate.usage = BandwidthUsage::underusing;
+  } else {
+    m_time_over_using = -1;
+    m_overuse_counter = 0;
+    m_estimate.usage = BandwidthUsage::normal;
+  }
+  m_previous_trend = trend;
+  update_threshold(modified_trend, now);
+}
+
+void BandwidthEstimator::update_threshold(double modified_trend, double now) {
+  if (!m_last_threshold_update) {
+    m_last_threshold_update = now;
+  }
+  const double magnitude = std::abs(modified_trend);
+  if (magnitude > m_threshold + MAX_ADAPT_OFFSET_MS) {
+    m_last_threshold_update = now;
+    return;
+  }
+  // Threshold follows the trend, quicker down than up, so that it is neither
+  // stuck below self-inflicted noise nor above real queuing.
+  const double k = magnitude < m_threshold ? THRESHOLD_K_DOWN : THRESHOLD_K_UP;
+  const double elapsed = std::min(now - *m_last_threshold_update,
+                                  MAX_THRESHOLD_UPDATE_INTERVAL_MS);
+  m_threshold += k * (magnitude - m_threshold) * elapsed;
+  m_threshold = std::clamp(m_threshold, MIN_THRESHOLD_MS, MAX_THRESHOLD_MS);
+  m_last_threshold_update = now;
+  m_estimate.delay_threshold = m_threshold;
+}
+
+void BandwidthEstimator::update_rate(clock::time_point now) {
+  const double elapsed =
+      m_last_rate_update
+          ? std::min(std::chrono::duration<double>(now - *m_last_rate_update)
+                         .count(),
+                     1.0)
+          : 0;
+  m_last_rate_update = now;
+  const double acked = m_estimate.acknowledged_bitrate;
+
+  switch (m_estimate.usage) {
+    case BandwidthUsage::overusing:
+      m_rate_state = RateControlState::decrease;
+      break;
+    case BandwidthUsage::underusing:
+      // Queues are draining, wait for them to settle.
+      m_rate_state = RateControlState::hold;
+      break;
+    case BandwidthUsage::normal:
+      if (m_rate_state == RateControlState::hold) {
+        m_rate_state = RateControlState::increase;
+      }
+      break;
+  }
+
+  if (m_link_capacity > 0 && acked > MAX_ACKED_OVERSHOOT * m_link_capacity) {
+    // The link got better, what we knew about it no longer holds.
+    m_link_capacity = 0;
+  }
+
+  switch (m_rate_state) {
+    case RateControlState::hold:
+      break;
+    case RateControlState::increase:
+      if (m_link_capacity > 0) {
+        // Close to where the link choked last time, probe carefully: about
+        // a packet per response time.
+        m_rate += AVERAGE_PACKET_BITS /
+                  std::chrono::duration<double>(RESPONSE_TIME).count() *
+                  elapsed;
+      } else {
+        m_rate *= std::pow(INCREASE_FACTOR_PER_SECOND, elapsed);
+      }
+      if (acked > 0) {
+        m_rate = std::min(m_rate, MAX_ACKED_OVERSHOOT * acked +
+                                      ACKED_OVERSHOOT_SLACK);
+      }
+      break;
+    case RateControlState::decrease:
+      // Once per response time, earlier decreases need time to take effect.
+      if (!m_last_decrease || now - *m_last_decrease >= RESPONSE_TIME) {
+        const double base = acked > 0 ? acked : m_rate;
+        m_rate = std::min(m_rate, DECREASE_FACTOR * base);
+        if (acked > 0) {
+          m_link_capacity = m_link_capacity > 0
+                                ? 0.95 * m_link_capacity + 0.05 * acked
+                                : acked;
+        }
+        m_last_decrease = now;
+        LOG_DEBUG("Overuse, rate decreased to {} bps", m_rate);
+      }
+      m_rate_state = RateControlState::hold;
+      break;
+  }
+
+  if (m_loss_updated) {
+    m_loss_updated = false;
+    if (m_estimate.loss_fraction > HIGH_LOSS_FRACTION) {
+      m_rate *= 1 - 0.5 * m_estimate.loss_fraction;
+      m_rate_state = RateControlState::hold;
+      LOG_DEBUG("Loss {:.2f}, rate decreased to {} bps",
+                m_estimate.loss_fraction, m_rate);
+    }
+  }
+
+  m_rate = std::clamp(m_rate, static_cast<double>(m_config.min_bitrate),
+                      static_cast<double>(m_config.max_bitrate));
+  m_estimate.target_bitrate = static_cast<uint64_t>(m_rate);
+}
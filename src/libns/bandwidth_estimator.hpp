@@ -0,0 +1,132 @@
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+#include <deque>
+#include <optional>
+#include <vector>
+
+#include "rtcp.hpp"
+
+struct BandwidthEstimatorConfig {
+  // All in bits per second. Zero start bitrate disables estimation.
+  uint64_t start_bitrate = 0;
+  uint64_t min_bitrate = 100'000;
+  uint64_t max_bitrate = 20'000'000;
+};
+
+enum class BandwidthUsage { normal, underusing, overusing };
+
+struct BandwidthEstimate {
+  // What the sender should not exceed, FEC and retransmissions included.
+  uint64_t target_bitrate{};
+  // Rate the receiver has been getting packets at lately, zero until known.
+  uint64_t acknowledged_bitrate{};
+  BandwidthUsage usage = BandwidthUsage::normal;
+  // Share of packets lost, over the last few feedback packets.
+  double loss_fraction{};
+  // Queuing delay trend and the threshold it is compared against, in
+  // milliseconds.
+  double delay_trend{};
+  double delay_threshold{};
+};
+
+// Send side bandwidth estimation after Google Congestion Control
+// (draft-ietf-rmcat-gcc-02), the way libwebrtc does it with transport-wide
+// feedback:
+//  - packets are grouped into bursts by send time and the growth of one-way
+//    delay between groups is tracked by a trendline (linear regression over
+//    the smoothed accumulated delay);
+//  - the trend is compared against an adaptive threshold to tell if the link
+//    is being overused;
+//  - the target rate grows multiplicatively (additively near the last known
+//    capacity) while the link is fine and drops below the acknowledged rate
+//    on overuse;
+//  - heavy loss reduces the rate too.
+//
+// Not thread safe. Time is passed in explicitly.
+class BandwidthEstimator {
+ public:
+  using clock = std::chrono::steady_clock;
+
+  explicit BandwidthEstimator(BandwidthEstimatorConfig config);
+
+  // To be called as the packet leaves through the socket, not when it is
+  // queued.
+  void on_packet_sent(uint16_t transport_sequence_num,
+                      size_t size,
+                      clock::time_point send_time);
+
+  void on_feedback(const RTCP_TransportFeedback& feedback,
+                   clock::time_point now);
+
+  const BandwidthEstimate& estimate() const { return m_estimate; }
+
+ private:
+  enum class RateControlState { hold, increase, decrease };
+
+  struct SentPacket {
+    uint16_t sequence_num{};
+    bool valid{};
+    size_t size{};
+    clock::time_point send_time;
+  };
+
+  // Times in milliseconds, send times on our clock, arrival times on the
+  // receiver's.
+  struct PacketGroup {
+    double first_send{};
+    double last_send{};
+    double last_arrival{};
+  };
+
+  int64_t unwrap_reference_time(int32_t reference_time);
+  void update_acknowledged_bitrate(double arrival, size_t size);
+  void update_loss(size_t lost, size_t reported);
+  void on_packet_arrived(double send, double arrival);
+  void update_trendline(double delay_variation,
+                        double arrival,
+                        double send_delta);
+  void detect_overuse(double trend, double send_delta, double now);
+  void update_threshold(double modified_trend, double now);
+  void update_rate(clock::time_point now);
+
+  BandwidthEstimatorConfig m_config;
+  BandwidthEstimate m_estimate;
+
+  std::vector<SentPacket> m_sent;
+  std::optional<clock::time_point> m_first_send;
+  std::optional<int64_t> m_reference_time;
+
+  // (arrival, size) of packets within the acknowledged bitrate window.
+  std::deque<std::pair<double, size_t>> m_acked;
+  size_t m_acked_bytes{};
+
+  size_t m_loss_lost{};
+  size_t m_loss_reported{};
+  bool m_loss_updated{};
+
+  std::optional<PacketGroup> m_current_group;
+  std::optional<PacketGroup> m_previous_group;
+
+  std::optional<double> m_first_arrival;
+  double m_accumulated_delay{};
+  double m_smoothed_delay{};
+  // (arrival since the first one, smoothed delay)
+  std::deque<std::pair<double, double>> m_trend_window;
+  unsigned m_num_deltas{};
+  double m_trend{};
+  double m_previous_trend{};
+
+  double m_threshold;
+  std::optional<double> m_last_threshold_update;
+  double m_time_over_using{-1};
+  unsigned m_overuse_counter{};
+
+  RateControlState m_rate_state = RateControlState::hold;
+  double m_rate{};
+  // Acknowledged bitrate at the last overuse, zero if unknown.
+  double m_link_capacity{};
+  std::optional<clock::time_point> m_last_rate_update;
+  std::optional<clock::time_point> m_last_decrease;
+};
@@ -0,0 +1,41 @@
+#include <benchmark/benchmark.h>
+#include <array>
+#include <span>
+#include <vector>
+
+#include "fec.hpp"
+
+namespace {
+constexpr size_t PACKET_SIZE = 1412;
+
+void BM_XorBytes(benchmark::State& state) {
+  std::vector<uint8_t> dst(state.range(0), 0x5A);
+  const std::vector<uint8_t> src(state.range(0), 0xA5);
+  for (auto _ : state) {
+    xor_bytes(dst.data(), src.data(), src.size());
+    benchmark::DoNotOptimize(dst.data());
+  }
+  state.SetBytesProcessed(state.iterations() * state.range(0));
+}
+BENCHMARK(BM_XorBytes)->Arg(64)->Arg(PACKET_SIZE)->Arg(64 * 1024);
+
+// Cost of protection per media packet for a 10x1 (row only) and a 10x4 block.
+void BM_FecEncoder(benchmark::State& state) {
+  FecEncoder encoder{1500, {.row_size = 10,
+                            .rows = static_cast<unsigned>(state.range(0))}};
+  const std::vector<uint8_t> packet(PACKET_SIZE, 0xAB);
+  const std::array<std::span<const uint8_t>, 1> parts{packet};
+  size_t fec_bytes = 0;
+  const FecEncoder::FecSink sink = [&](std::span<const uint8_t> fec) {
+    fec_bytes += fec.size();
+  };
+
+  uint16_t sequence_num = 0;
+  for (auto _ : state) {
+    encoder.add_packet(sequence_num++, parts, sink);
+  }
+  benchmark::DoNotOptimize(fec_bytes);
+  state.SetBytesProcessed(state.iterations() * PACKET_SIZE);
+}
+BENCHMARK(BM_FecEncoder)->Arg(1)->Arg(4);
+}  // namespace
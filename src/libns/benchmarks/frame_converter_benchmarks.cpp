@@ -0,0 +1,70 @@
+#include <benchmark/benchmark.h>
+#include <vector>
+
+#include "frame_converter.hpp"
+
+namespace {
+// Arguments: frame height (width is 16:9 of it) and SIMD level.
+void convert_yuyv_benchmark(benchmark::State& state, PixelFormat to) {
+  const auto height = static_cast<uint32_t>(state.range(0));
+  const uint32_t width = height * 16 / 9;
+  const auto level = static_cast<SimdLevel>(state.range(1));
+  if (level > simd_level()) {
+    state.SkipWithError("Not supported by the CPU");
+    return;
+  }
+  const std::vector<uint8_t> src(
+      frame_size(PixelFormat::YUV422_packed, width, height), 0x80);
+  std::vector<uint8_t> dst(frame_size(to, width, height));
+  for (auto _ : state) {
+    convert_yuyv(src, width, height, to, dst, level);
+    benchmark::DoNotOptimize(dst.data());
+  }
+  state.SetBytesProcessed(state.iterations() * src.size());
+  state.SetLabel(to_string(level));
+}
+
+void BM_YuyvToI420(benchmark::State& state) {
+  convert_yuyv_benchmark(state, PixelFormat::YUV420_planar);
+}
+BENCHMARK(BM_YuyvToI420)
+    ->ArgsProduct({{720, 1080}, {static_cast<int>(SimdLevel::scalar),
+                                 static_cast<int>(SimdLevel::sse2),
+                                 static_cast<int>(SimdLevel::avx2),
+                                 static_cast<int>(SimdLevel::avx512)}});
+
+void BM_YuyvToNV12(benchmark::State& state) {
+  convert_yuyv_benchmark(state, PixelFormat::NV12);
+}
+BENCHMARK(BM_YuyvToNV12)
+    ->ArgsProduct({{720, 1080}, {static_cast<int>(SimdLevel::scalar),
+                                 static_cast<int>(SimdLevel::sse2),
+                                 static_cast<int>(SimdLevel::avx2),
+                                 static_cast<int>(SimdLevel::avx512)}});
+
+// Arguments as above, of the frame to halve.
+void BM_HalveNV12(benchmark::State& state) {
+  const auto height = static_cast<uint32_t>(state.range(0));
+  const uint32_t width = height * 16 / 9;
+  const auto level = static_cast<SimdLevel>(state.range(1));
+  if (level > simd_level()) {
+    state.SkipWithError("Not supported by the CPU");
+    return;
+  }
+  const std::vector<uint8_t> src(
+      frame_size(PixelFormat::NV12, width, height), 0x80);
+  std::vector<uint8_t> dst(
+      frame_size(PixelFormat::NV12, width / 2, height / 2));
+  for (auto _ : state) {
+    halve_420(src, width, height, PixelFormat::NV12, dst, level);
+    benchmark::DoNotOptimize(dst.data());
+  }
+  state.SetBytesProcessed(state.iterations() * src.size());
+  state.SetLabel(to_string(level));
+}
+BENCHMARK(BM_HalveNV12)
+    ->ArgsProduct({{720, 1080}, {static_cast<int>(SimdLevel::scalar),
+                                 static_cast<int>(SimdLevel::sse2),
+                                 static_cast<int>(SimdLevel::avx2),
+                                 static_cast<int>(SimdLevel::avx512)}});
+}  // namespace
@@ -0,0 +1,110 @@
+#include <benchmark/benchmark.h>
+#include <iomanip>
+#include <iostream>
+#include <mutex>
+#include <streambuf>
+
+// What the transmit and receive paths are built with by default: debug
+// records compiled out, info and above enabled.
+#undef NS_LOG_LEVEL
+#define NS_LOG_LEVEL 1
+#include "log.hpp"
+
+LOG_MODULE_NAME("BENCH");
+
+namespace {
+// Logger as it used to be: formats and writes to std::cout under a global
+// lock, on the calling thread, whatever the level. Kept to compare against.
+namespace legacy {
+std::mutex g_lock;
+
+template <class... Args>
+[[gnu::noinline]] void print_log(const std::string& module_,
+                                 std::string_view fmt,
+                                 Args&&... args) {
+  auto s = std::vformat(fmt, std::make_format_args(args...));
+  std::lock_guard lck{g_lock};
+  std::cout << "  DEBUG: " << std::setw(10) << module_ << s << "\n";
+}
+}  // namespace legacy
+
+// Output goes nowhere, so that the terminal does not set the pace.
+class NullBuffer : public std::streambuf {
+ protected:
+  int_type overflow(int_type c) override { return c; }
+  std::streamsize xsputn(const char*, std::streamsize n) override { return n; }
+};
+
+class NullOutput {
+ public:
+  NullOutput() : m_previous(std::cout.rdbuf(&m_buffer)) {}
+  ~NullOutput() {
+    log_flush();
+    std::cout.rdbuf(m_previous);
+  }
+
+ private:
+  NullBuffer m_buffer;
+  std::streambuf* m_previous;
+};
+
+// What udp_receive logs for every packet.
+struct Packet {
+  unsigned payload_type = 96;
+  uint16_t sequence_num = 0;
+  uint32_t timestamp = 1234;
+  size_t size = 1200;
+};
+
+void BM_LogLegacy(benchmark::State& state) {
+  NullOutput null_output;
+  Packet packet;
+  for (auto _ : state) {
+    legacy::print_log(
+        "BENCH: ", "Got a packet. Payload type: {}, sequence_num: {}, "
+                   "timestamp: {}, size: {}",
+        packet.payload_type, packet.sequence_num++, packet.timestamp,
+        packet.size);
+  }
+  state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_LogLegacy);
+
+// Compiled out, should be indistinguishable from an empty loop.
+void BM_LogDisabled(benchmark::State& state) {
+  Packet packet;
+  for (auto _ : state) {
+    LOG_DEBUG(
+        "Got a packet. Payload type: {}, sequence_num: {}, timestamp: {}, "
+        "size: {}",
+        packet.payload_type, packet.sequence_num++, packet.timestamp,
+        packet.size);
+    benchmark::DoNotOptimize(packet);
+  }
+  state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_LogDisabled);
+
+// Cost on the logging thread: copying the record into the ring. The ring is
+// flushed now and then outside of timing, otherwise the benchmark would
+// measure dropping records rather than writing them.
+void BM_LogEnabled(benchmark::State& state) {
+  NullOutput null_output;
+  Packet packet;
+  int64_t count = 0;
+  for (auto _ : state) {
+    LOG_INFO(
+        "Got a packet. Payload type: {}, sequence_num: {}, timestamp: {}, "
+        "size: {}",
+        packet.payload_type, packet.sequence_num++, packet.timestamp,
+        packet.size);
+    if (++count % 1024 == 0) {
+      state.PauseTiming();
+      log_flush();
+      state.ResumeTiming();
+    }
+  }
+  state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_LogEnabled);
+}  // namespace
@@ -0,0 +1,237 @@
+#include <benchmark/benchmark.h>
+#include <arpa/inet.h>
+#include <array>
+#include <span>
+#include <vector>
+
+#include "log.hpp"
+#include "rtp.hpp"
+
+LOG_MODULE_NAME("BENCH");
+
+namespace {
+// Header as it used to be, with heap allocated CSRC list and logging on errors,
+// kept to compare against. It lived in rtp.cpp, out of reach of the inliner.
+namespace legacy {
+struct RTP_PacketHeader {
+  unsigned version{};
+  bool padding_bit{};
+  bool extension_bit{};
+  bool marker_bit{};
+  unsigned payload_type{};
+  uint16_t sequence_num{};
+  uint32_t timestamp{};
+  uint32_t ssrc{};
+  std::vector<uint32_t> csrc;
+};
+
+[[gnu::noinline]] std::error_code serialize_rtp_header_to(
+    const RTP_PacketHeader& ph,
+    std::span<uint8_t> buffer) {
+  if (buffer.size() < 12) {
+    LOG_ERROR("Minimum buffer size for RTP header is 12, there is: {}",
+              buffer.size());
+    return make_error_code(std::errc::invalid_argument);
+  }
+  if (ph.version > 3) {
+    LOG_ERROR("version cannot exceed 2 bits");
+    return make_error_code(std::errc::invalid_argument);
+  }
+  buffer[0] = 0;
+  buffer[0] |= static_cast<uint8_t>(ph.version) << 6;
+  if (ph.padding_bit)
+    buffer[0] |= (1 << 5);
+  if (ph.extension_bit)
+    buffer[0] |= (1 << 4);
+  if (ph.csrc.size() > 15) {
+    LOG_ERROR("CSRC count cannot exceed value of 15, actual: {}",
+              ph.csrc.size());
+    return make_error_code(std::errc::invalid_argument);
+  }
+  buffer[0] |= static_cast<uint8_t>(ph.csrc.size());
+  buffer[1] = 0;
+  if (ph.marker_bit)
+    buffer[1] |= (1 << 7);
+  if (ph.payload_type > 127) {
+    LOG_ERROR("Payload type cannot exceed 7 bits: {}", ph.payload_type);
+    return make_error_code(std::errc::invalid_argument);
+  }
+  buffer[1] |= static_cast<uint8_t>(ph.payload_type);
+  {
+    const uint16_t n_seq_num = htons(ph.sequence_num);
+    buffer[2] = n_seq_num & 0x00FF;
+    buffer[3] = n_seq_num >> 8;
+  }
+  {
+    const uint32_t n_timestamp = htonl(ph.timestamp);
+    buffer[4] = (n_timestamp & 0x000000FF);
+    buffer[5] = (n_timestamp & 0x0000FFFF) >> 8;
+    buffer[6] = (n_timestamp & 0x00FFFFFF) >> 16;
+    buffer[7] = n_timestamp >> 24;
+  }
+  {
+    const uint32_t n_ssrc = htonl(ph.ssrc);
+    buffer[8] = (n_ssrc & 0x000000FF);
+    buffer[9] = (n_ssrc & 0x0000FFFF) >> 8;
+    buffer[10] = (n_ssrc & 0x00FFFFFF) >> 16;
+    buffer[11] = n_ssrc >> 24;
+  }
+  if (ph.csrc.size() != 0) {
+    LOG_ERROR("CSRC not supported yet");
+    return make_error_code(std::errc::protocol_not_supported);
+  }
+  return {};
+}
+
+[[gnu::noinline]] expected<RTP_PacketHeader> deserialize_rtp_header_from(
+    std::span<const uint8_t> data) {
+  if (data.size() < 12) {
+    LOG_ERROR("rtp header cannot be smaller than 12 bytes, there is {}",
+              data.size());
+    return unexpected(make_error_code(std::errc::invalid_argument));
+  }
+  RTP_PacketHeader new_header;
+  new_header.version = data[0] >> 6;
+  new_header.padding_bit = (data[0] & 0x20) >> 5;
+  new_header.extension_bit = (data[0] & 0x10) >> 4;
+  new_header.marker_bit = data[1] >> 7;
+  new_header.payload_type = data[1] & 0x7F;
+  {
+    const uint16_t n_sequence_num =
+        static_cast<uint16_t>(data[2]) | static_cast<uint16_t>(data[3]) << 8;
+    new_header.sequence_num = ntohs(n_sequence_num);
+  }
+  {
+    const uint32_t n_timestamp = static_cast<uint32_t>(data[4]) |
+                                 static_cast<uint32_t>(data[5]) << 8 |
+                                 static_cast<uint32_t>(data[6]) << 16 |
+                                 static_cast<uint32_t>(data[7]) << 24;
+    new_header.timestamp = ntohl(n_timestamp);
+  }
+  {
+    const uint32_t n_ssrc = static_cast<uint32_t>(data[8]) |
+                            static_cast<uint32_t>(data[9]) << 8 |
+                            static_cast<uint32_t>(data[10]) << 16 |
+                            static_cast<uint32_t>(data[11]) << 24;
+    new_header.ssrc = ntohl(n_ssrc);
+  }
+  return new_header;
+}
+}  // namespace legacy
+
+// What the transmitter does per packet: fill in the header and write it out.
+// Legacy serializer can do neither CSRC nor the extension, so both sides do a
+// plain 12 byte header.
+void BM_SerializeLegacy(benchmark::State& state) {
+  std::array<uint8_t, 64> buffer{};
+  uint16_t sequence_num = 0;
+  for (auto _ : state) {
+    legacy::RTP_PacketHeader header;
+    header.version = 2;
+    header.payload_type = RTP_NaivePayloadType;
+    header.sequence_num = sequence_num++;
+    header.timestamp = sequence_num / 40;
+    header.ssrc = 0x12345678;
+    benchmark::DoNotOptimize(legacy::serialize_rtp_header_to(header, buffer));
+    benchmark::ClobberMemory();
+  }
+  state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_SerializeLegacy);
+
+void BM_Serialize(benchmark::State& state) {
+  std::array<uint8_t, 64> buffer{};
+  uint16_t sequence_num = 0;
+  for (auto _ : state) {
+    RTP_PacketHeader header;
+    header.version = 2;
+    header.payload_type = RTP_NaivePayloadType;
+    header.sequence_num = sequence_num++;
+    header.timestamp = sequence_num / 40;
+    header.ssrc = 0x12345678;
+    benchmark::DoNotOptimize(write_rtp_header(header, buffer));
+    benchmark::ClobberMemory();
+  }
+  state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_Serialize);
+
+// Header with a couple of CSRCs and the transport sequence extension, which
+// the legacy code could not write at all.
+void BM_SerializeFull(benchmark::State& state) {
+  std::array<uint8_t, 64> buffer{};
+  const std::array<uint8_t, 4> extension_data = {0x11, 0x00, 0x01, 0x00};
+  uint16_t sequence_num = 0;
+  for (auto _ : state) {
+    RTP_PacketHeader header;
+    header.version = 2;
+    header.payload_type = RTP_NaivePayloadType;
+    header.sequence_num = sequence_num++;
+    header.timestamp = sequence_num / 40;
+    header.ssrc = 0x12345678;
+    header.add_csrc(1);
+    header.add_csrc(2);
+    header.extension =
+        RTP_HeaderExtension{.profile = 0xBEDE, .data = extension_data};
+    benchmark::DoNotOptimize(write_rtp_header(header, buffer));
+    benchmark::ClobberMemory();
+  }
+  state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_SerializeFull);
+
+std::array<uint8_t, 64> make_packet(unsigned csrc_count, bool extension) {
+  RTP_PacketHeader header;
+  header.version = 2;
+  header.payload_type = RTP_NaivePayloadType;
+  header.sequence_num = 1000;
+  header.timestamp = 25;
+  header.ssrc = 0x12345678;
+  for (unsigned i = 0; i < csrc_count; ++i) {
+    header.add_csrc(i);
+  }
+  static const std::array<uint8_t, 4> extension_data = {0x11, 0x00, 0x01, 0};
+  if (extension) {
+    header.extension =
+        RTP_HeaderExtension{.profile = 0xBEDE, .data = extension_data};
+  }
+  std::array<uint8_t, 64> packet{};
+  write_rtp_header(header, packet);
+  return packet;
+}
+
+// Legacy parser did not look past the fixed header, the receiver had to find
+// the payload with a second pass.
+void BM_ParseLegacy(benchmark::State& state) {
+  const auto packet = make_packet(0, false);
+  for (auto _ : state) {
+    auto header = legacy::deserialize_rtp_header_from(packet);
+    benchmark::DoNotOptimize(header);
+    benchmark::DoNotOptimize(rtp_header_size(packet));
+  }
+  state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_ParseLegacy);
+
+void BM_Parse(benchmark::State& state) {
+  const auto packet = make_packet(0, false);
+  for (auto _ : state) {
+    RTP_PacketHeader header;
+    benchmark::DoNotOptimize(read_rtp_header(packet, header));
+    benchmark::DoNotOptimize(header);
+  }
+  state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_Parse);
+
+void BM_ParseFull(benchmark::State& state) {
+  const auto packet = make_packet(2, true);
+  for (auto _ : state) {
+    RTP_PacketHeader header;
+    benchmark::DoNotOptimize(read_rtp_header(packet, header));
+    benchmark::DoNotOptimize(header);
+  }
+  state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_ParseFull);
+}  // namespace
@@ -0,0 +1,58 @@
+#include <benchmark/benchmark.h>
+#include <asio.hpp>
+#include <vector>
+
+#include "udp_transmit.hpp"
+
+namespace {
+// Matches i_slice_max_size of the encoder, so each NAL makes one datagram.
+constexpr size_t NAL_SIZE = 1400;
+// Roughly what a 720p intra-refresh frame turns into with 1400 byte slices.
+constexpr int PACKETS_PER_FRAME = 40;
+
+void transmit_frames(benchmark::State& state, UDP_TransmitMode mode) {
+  asio::io_context ctx;
+
+  // Nobody reads from this socket, it only exists so that loopback has a
+  // listener on the destination port. Datagrams that do not fit into its
+  // receive buffer are dropped by the kernel which is fine for measuring the
+  // sending side.
+  asio::ip::udp::socket sink{
+      ctx, asio::ip::udp::endpoint{asio::ip::address_v4::loopback(), 0}};
+
+  auto transmit = make_udp_transmit(ctx, "127.0.0.1",
+                                    sink.local_endpoint().port(),
+                                    UDP_TransmitOptions{.mode = mode});
+  if (!transmit) {
+    state.SkipWithError("Failed creating UDP transmit");
+    return;
+  }
+
+  const std::vector<uint8_t> nal(NAL_SIZE, 0xAB);
+
+  for (auto _ : state) {
+    transmit->begin_frame();
+    for (int i = 0; i < PACKETS_PER_FRAME; ++i) {
+      VideoPacket packet;
+      packet.nal_data = nal;
+      packet.nal_meta.nal_type = NAL_Type::slice;
+      transmit->transmit(std::move(packet));
+    }
+    transmit->end_frame();
+  }
+
+  state.SetItemsProcessed(state.iterations() * PACKETS_PER_FRAME);
+  state.SetBytesProcessed(state.iterations() * PACKETS_PER_FRAME * NAL_SIZE);
+}
+
+void BM_transmit_immediate(benchmark::State& state) {
+  transmit_frames(state, UDP_TransmitMode::immediate);
+}
+
+void BM_transmit_batched(benchmark::State& state) {
+  transmit_frames(state, UDP_TransmitMode::batched);
+}
+}  // namespace
+
+BENCHMARK(BM_transmit_immediate);
+BENCHMARK(BM_transmit_batched);
@@ -0,0 +1,188 @@
+#include "capture_reactor.hpp"
+
+#include <pthread.h>
+#include <sched.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <unistd.h>
+#include <array>
+#include <cstring>
+#include <mutex>
+#include <thread>
+#include <type_traits>
+#include <unordered_map>
+
+#include "log.hpp"
+
+LOG_MODULE_NAME("REACTOR");
+
+namespace {
+class CaptureReactorImpl : public CaptureReactor {
+ public:
+  explicit CaptureReactorImpl(CaptureReactorOptions options)
+      : m_options(options) {}
+
+  ~CaptureReactorImpl() override {
+    if (m_thread.joinable()) {
+      m_thread.request_stop();
+      wake_up();
+      m_thread.join();
+    }
+    if (m_wake_fd != -1) {
+      close(m_wake_fd);
+    }
+    if (m_epoll_fd != -1) {
+      close(m_epoll_fd);
+    }
+  }
+
+  bool initialize() {
+    m_epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+    if (m_epoll_fd == -1) {
+      LOG_ERROR("Failed creating epoll: {}", strerror(errno));
+      return false;
+    }
+    m_wake_fd = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+    if (m_wake_fd == -1) {
+      LOG_ERROR("Failed creating eventfd: {}", strerror(errno));
+      return false;
+    }
+    struct epoll_event event {};
+    event.events = EPOLLIN;
+    event.data.fd = m_wake_fd;
+    if (epoll_ctl(m_epoll_fd, EPOLL_CTL_ADD, m_wake_fd, &event) == -1) {
+      LOG_ERROR("Failed adding eventfd to epoll: {}", strerror(errno));
+      return false;
+    }
+    m_thread = std::jthread{[this](std::stop_token stoken) { run(stoken); }};
+    return true;
+  }
+
+  virtual std::error_code add(int fd, Handler on_readable) override {
+    auto handler = std::make_shared<Handler>(std::move(on_readable));
+    return with_lock([&]() -> std::error_code {
+      struct epoll_event event {};
+      event.events = EPOLLIN;
+      event.data.fd = fd;
+      if (epoll_ctl(m_epoll_fd, EPOLL_CTL_ADD, fd, &event) == -1) {
+        return std::error_code{errno, std::system_category()};
+      }
+      m_handlers[fd] = std::move(handler);
+      return {};
+    });
+  }
+
+  virtual void remove(int fd) override {
+    with_lock([&] {
+      if (epoll_ctl(m_epoll_fd, EPOLL_CTL_DEL, fd, nullptr) == -1) {
+        LOG_WARNING("Failed removing {} from epoll: {}", fd,
+                    strerror(errno));
+      }
+      m_handlers.erase(fd);
+    });
+  }
+
+  virtual void set_enabled(int fd, bool enabled) override {
+    struct epoll_event event {};
+    event.events = enabled ? EPOLLIN : 0;
+    event.data.fd = fd;
+    if (epoll_ctl(m_epoll_fd, EPOLL_CTL_MOD, fd, &event) == -1) {
+      LOG_DEBUG("Failed modifying {} in epoll: {}", fd, strerror(errno));
+    }
+  }
+
+ private:
+  // Handlers run under the lock, calls they make must not take it again.
+  template <typename F>
+  std::invoke_result_t<F> with_lock(F&& f) {
+    if (std::this_thread::get_id() == m_thread.get_id()) {
+      return f();
+    }
+    std::lock_guard lock(m_lock);
+    return f();
+  }
+
+  void wake_up() {
+    const uint64_t one = 1;
+    if (write(m_wake_fd, &one, sizeof(one)) == -1) {
+      LOG_ERROR("Failed waking up capture reactor: {}", strerror(errno));
+    }
+  }
+
+  void configure_thread() {
+    pthread_setname_np(pthread_self(), "ns-capture");
+    if (m_options.cpu) {
+      cpu_set_t cpus;
+      CPU_ZERO(&cpus);
+      CPU_SET(*m_options.cpu, &cpus);
+      if (const int err =
+              pthread_setaffinity_np(pthread_self(), sizeof(cpus), &cpus)) {
+        LOG_WARNING("Failed pinning capture thread to CPU {}: {}",
+                    *m_options.cpu, strerror(err));
+      }
+    }
+    if (m_options.realtime_priority) {
+      struct sched_param param {};
+      param.sched_priority = *m_options.realtime_priority;
+      if (const int err =
+              pthread_setschedparam(pthread_self(), SCHED_FIFO, &param)) {
+        LOG_WARNING("Failed setting capture thread priority {}: {}",
+                    *m_options.realtime_priority, strerror(err));
+      }
+    }
+  }
+
+  void run(std::stop_token stoken) {
+    configure_thread();
+    std::array<struct epoll_event, 16> events;
+    while (!stoken.stop_requested()) {
+      const int count =
+          epoll_wait(m_epoll_fd, events.data(), events.size(), -1);
+      if (count == -1) {
+        if (errno == EINTR) {
+          continue;
+        }
+        LOG_ERROR("epoll_wait failed: {}", strerror(errno));
+        return;
+      }
+
+      std::lock_guard lock(m_lock);
+      for (int i = 0; i < count; ++i) {
+        const int fd = events[i].data.fd;
+        if (fd == m_wake_fd) {
+          uint64_t value{};
+          [[maybe_unused]] auto r = read(m_wake_fd, &value, sizeof(value));
+          continue;
+        }
+        // Removed by a handler called before, or since epoll_wait returned.
+        const auto it = m_handlers.find(fd);
+        if (it == m_handlers.end()) {
+          continue;
+        }
+        // The handler may remove itself.
+        const auto handler = it->second;
+        (*handler)();
+      }
+    }
+    LOG_DEBUG("Capture reactor thread has stopped");
+  }
+
+  CaptureReactorOptions m_options;
+  int m_epoll_fd{-1};
+  // Written to stop the thread.
+  int m_wake_fd{-1};
+  std::mutex m_lock;
+  std::unordered_map<int, std::shared_ptr<Handler>> m_handlers;
+  std::jthread m_thread;
+};
+}  // namespace
+
+std::unique_ptr<CaptureReactor> make_capture_reactor(
+    CaptureReactorOptions options) {
+  auto impl = std::make_unique<CaptureReactorImpl>(options);
+  if (!impl->initialize()) {
+    LOG_ERROR("failed initializing capture reactor");
+    return nullptr;
+  }
+  return impl;
+}
@@ -0,0 +1,43 @@
+#pragma once
+
+#include <functional>
+#include <memory>
+#include <optional>
+#include <system_error>
+
+struct CaptureReactorOptions {
+  // CPU the thread is pinned to, any if not set.
+  std::optional<int> cpu;
+  // SCHED_FIFO priority of the thread (1 to 99), normal scheduling if not set.
+  // Needs CAP_SYS_NICE, without it the thread keeps normal scheduling.
+  std::optional<int> realtime_priority;
+};
+
+// Thread waiting on descriptors of any number of video captures with epoll,
+// calling their handlers when they are readable. One thread serves all
+// devices added to it, instead of a thread each.
+//
+// Handlers run on the reactor thread, one at a time, and must not block.
+// Methods may be called from any thread, including from handlers.
+class CaptureReactor {
+ public:
+  using Handler = std::function<void()>;
+
+  virtual ~CaptureReactor() = default;
+
+  // Calls `on_readable` whenever `fd` is readable, till it is removed.
+  virtual std::error_code add(int fd, Handler on_readable) = 0;
+
+  // Once it returns, the handler is not running and is not called again,
+  // unless it is the one removing itself.
+  virtual void remove(int fd) = 0;
+
+  // Stops and resumes waiting on `fd`, e.g. while a capture has no buffers
+  // queued and the driver would report it ready all the time.
+  virtual void set_enabled(int fd, bool enabled) = 0;
+};
+
+// Starts the thread right away. Destroying the reactor wakes it up through an
+// eventfd and joins it.
+std::unique_ptr<CaptureReactor> make_capture_reactor(
+    CaptureReactorOptions options = {});
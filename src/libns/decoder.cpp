@@ -2,8 +2,11 @@
 
 #include <signal.h>
 #include <cassert>
+#include <chrono>
 
+#include "frame_trace.hpp"
 #include "log.hpp"
+#include "metrics.hpp"
 
 LOG_MODULE_NAME("DECODER");
 
@@ -11,6 +14,19 @@ extern "C" {
 #include <libavcodec/avcodec.h>
 }
 
+static_assert(DECODER_INPUT_PADDING >= AV_INPUT_BUFFER_PADDING_SIZE);
+
+namespace {
+// Of all decoders of the process.
+struct DecoderMetrics {
+  Counter& frames_decoded =
+      metrics().counter("ns_frames_decoded_total", "Frames out of ffmpeg.");
+  HdrHistogram& decode_time =
+      metrics().histogram("ns_decode_time_microseconds",
+                          "Time ffmpeg takes to decode a parsed frame.");
+};
+}  // namespace
+
 class DecoderImpl : public Decoder {
  public:
   explicit DecoderImpl(DecoderListener& listener) : m_listener(listener) {}
@@ -53,8 +69,9 @@ class DecoderImpl : public Decoder {
     m_codec_ctx->get_format =
         [](struct AVCodecContext* s,
            const enum AVPixelFormat* fmt) -> AVPixelFormat {
-      for (auto f = fmt; f; f++) {
-        if (*f == AV_PIX_FMT_YUV422P) {
+      // Planar 4:2:2 or 4:2:0, whichever the sender encodes.
+      for (auto f = fmt; *f != AV_PIX_FMT_NONE; f++) {
+        if (*f == AV_PIX_FMT_YUV422P || *f == AV_PIX_FMT_YUV420P) {
           LOG_DEBUG("found format we need");
           return *f;
         }
@@ -82,18 +99,17 @@ class DecoderImpl : public Decoder {
     }
   }
 
-  bool decode_packet_impl(std::optional<VideoPacket> maybe_p) {
+  bool decode_packet_impl(std::span<const uint8_t> nal_data,
+                          uint32_t frame_id) {
     // TODO: check for minimum number of bytes!
 
-    auto& p = *maybe_p;
-    LOG_DEBUG("Parsing packet of size {} bytes", p.nal_data.size());
+    LOG_DEBUG("Parsing packet of size {} bytes", nal_data.size());
 
-    const size_t data_size = p.nal_data.size();
-    p.nal_data.resize(p.nal_data.size() + AV_INPUT_BUFFER_PADDING_SIZE);
-    const uint8_t* data = p.nal_data.data();
+    const size_t data_size = nal_data.size();
+    const uint8_t* data = nal_data.data();
 
     int ret = av_parser_parse2(m_parser_ctx, m_codec_ctx, &m_packet->data,
-                               &m_packet->size, data, data_size, AV_NOPTS_VALUE,
+                               &m_packet->size, data, data_size, frame_id,
                                AV_NOPTS_VALUE, 0);
     LOG_DEBUG("ret: {}", ret);
 
@@ -104,6 +120,7 @@ class DecoderImpl : public Decoder {
 
     LOG_DEBUG("Reassempled full packet, the size is: {}", m_packet->size);
 
+    const auto decode_start = std::chrono::steady_clock::now();
     ret = avcodec_send_packet(m_codec_ctx, m_packet);
     if (ret < 0) {
       LOG_ERROR("Failed sending packet for decoding: {}", ret);
@@ -119,7 +136,8 @@ class DecoderImpl : public Decoder {
         LOG_ERROR("Error during decoding: {}", ret);
         // TODO: fail decoder.
       } else {
-        assert(m_frame->format == AV_PIX_FMT_YUV422P);
+        assert(m_frame->format == AV_PIX_FMT_YUV422P ||
+               m_frame->format == AV_PIX_FMT_YUV420P);
         assert(m_frame->data[0]);
         assert(m_frame->data[1]);
         assert(m_frame->data[2]);
@@ -127,12 +145,25 @@ class DecoderImpl : public Decoder {
         const auto* Y_plane = m_frame->data[0];
         const auto* U_plane = m_frame->data[1];
         const auto* V_plane = m_frame->data[2];
+        m_metrics.frames_decoded.add();
+        m_metrics.decode_time.record(static_cast<uint64_t>(
+            std::chrono::duration_cast<std::chrono::microseconds>(
+                std::chrono::steady_clock::now() - decode_start)
+                .count()));
+        // Frame ID passed to the parser as PTS comes out with the frame.
+        const auto decoded_frame_id = static_cast<uint32_t>(m_frame->pts);
+        if (m_frame->pts != AV_NOPTS_VALUE) {
+          trace_frame(decoded_frame_id, TraceStage::decoded);
+        }
 
-        // TODO: don't hardcode 1280x720
-        VideoFrame frame{.pixel_format = PixelFormat::YUV422_planar,
-                         .width = 1280,
-                         .height = 720,
-                         .planes = {Y_plane, U_plane, V_plane}};
+        VideoFrame frame{.pixel_format =
+                             m_frame->format == AV_PIX_FMT_YUV420P
+                                 ? PixelFormat::YUV420_planar
+                                 : PixelFormat::YUV422_planar,
+                         .width = m_frame->width,
+                         .height = m_frame->height,
+                         .planes = {Y_plane, U_plane, V_plane},
+                         .frame_id = decoded_frame_id};
         m_listener.on_frame(std::move(frame));
       }
     }
@@ -140,8 +171,9 @@ class DecoderImpl : public Decoder {
     return true;
   }
 
-  virtual void decode_packet(VideoPacket p) override {
-    decode_packet_impl(std::move(p));
+  virtual void decode_packet(std::span<const uint8_t> nal_data,
+                             uint32_t frame_id) override {
+    decode_packet_impl(nal_data, frame_id);
   }
 
  private:
@@ -151,6 +183,7 @@ class DecoderImpl : public Decoder {
   AVCodecContext* m_codec_ctx{};
   AVFrame* m_frame{};
   AVPacket* m_packet{};
+  DecoderMetrics m_metrics;
 };
 
 std::unique_ptr<Decoder> make_decoder(DecoderListener& listener) {
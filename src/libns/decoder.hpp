@@ -1,8 +1,13 @@
 #pragma once
 
 #include <memory>
+#include <span>
 #include "types.hpp"
 
+// Number of bytes past the end of the input that decoder may read. They must
+// be readable and zeroed.
+constexpr size_t DECODER_INPUT_PADDING = 64;
+
 class DecoderListener {
  public:
   virtual ~DecoderListener() = default;
@@ -14,7 +19,10 @@ class DecoderListener {
 class Decoder {
  public:
   virtual ~Decoder() = default;
-  virtual void decode_packet(VideoPacket) = 0;
+  // NAL data must be followed by DECODER_INPUT_PADDING zero bytes. Frame ID
+  // (RTP timestamp) of the NAL ends up in VideoFrame decoded from it.
+  virtual void decode_packet(std::span<const uint8_t> nal_data,
+                             uint32_t frame_id) = 0;
 };
 
 std::unique_ptr<Decoder> make_decoder(DecoderListener& listener);
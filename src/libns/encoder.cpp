@@ -1,20 +1,114 @@
 #include "encoder.hpp"
+#include "frame_trace.hpp"
 #include "log.hpp"
+#include "metrics.hpp"
+#include "nal_sequencer.hpp"
 
 #include <x264.h>
-#include <cassert>
+#include <algorithm>
+#include <atomic>
+#include <deque>
 #include <mutex>
+#include <optional>
+#include <utility>
 #include <vector>
 
 LOG_MODULE_NAME("ENCODER");
 
 struct EncoderImpl;
 namespace {
+// Of all encoders of the process.
+struct EncoderMetrics {
+  Counter& frames_encoded =
+      metrics().counter("ns_frames_encoded_total", "Frames out of x264.");
+  HdrHistogram& encode_time = metrics().histogram(
+      "ns_encode_time_microseconds", "Time x264 takes to encode a frame.");
+  HdrHistogram& nal_size =
+      metrics().histogram("ns_nal_size_bytes", "Size of NALs out of x264.");
+  Counter& nals_copied = metrics().counter(
+      "ns_encoder_nals_copied_total",
+      "NALs put in a buffer of the encoder's own, the client gave none big "
+      "enough.");
+};
+
+// Of a frame from process_frame() till x264 is done with it, which may be
+// several calls later with frame threads.
 struct FrameUserData {
   EncoderImpl* this_{};
   CapturedFrameMeta captured_meta;
+  // In the order frames are given, which is also the one they are encoded in:
+  // there are no B-frames.
+  uint64_t index{};
 };
 
+// VBV of a single frame: every frame is about the size of the average one, so
+// there are no bursts for the network to absorb. Intra refresh keeps that
+// possible without keyframes.
+int single_frame_vbv_size(int bitrate_kbps, const x264_param_t& param) {
+  return std::max(1, bitrate_kbps * static_cast<int>(param.i_fps_den) /
+                         static_cast<int>(param.i_fps_num));
+}
+
+// Settings of `config` that may change while encoding.
+void apply_tunables(const EncoderConfig& config, x264_param_t& param) {
+  switch (config.rate_control) {
+    case RateControl::abr:
+      param.rc.i_rc_method = X264_RC_ABR;
+      param.rc.i_bitrate = static_cast<int>(config.bitrate_kbps);
+      param.rc.i_vbv_max_bitrate = param.rc.i_bitrate;
+      break;
+    case RateControl::crf:
+      param.rc.i_rc_method = X264_RC_CRF;
+      param.rc.f_rf_constant = config.crf;
+      param.rc.i_vbv_max_bitrate =
+          static_cast<int>(config.vbv_max_bitrate_kbps);
+      break;
+    case RateControl::cqp:
+      param.rc.i_rc_method = X264_RC_CQP;
+      param.rc.i_qp_constant = config.qp;
+      param.rc.i_vbv_max_bitrate = 0;
+      break;
+  }
+  if (param.rc.i_vbv_max_bitrate == 0) {
+    param.rc.i_vbv_buffer_size = 0;
+  } else if (config.vbv_buffer_kbits) {
+    param.rc.i_vbv_buffer_size = static_cast<int>(config.vbv_buffer_kbits);
+  } else {
+    param.rc.i_vbv_buffer_size =
+        single_frame_vbv_size(param.rc.i_vbv_max_bitrate, param);
+  }
+
+  param.i_slice_max_size = static_cast<int>(config.slice_max_size);
+  param.i_slice_max_mbs = static_cast<int>(config.slice_max_mbs);
+  param.i_slice_count = static_cast<int>(config.slice_count);
+}
+
+// Whether `a` and `b` differ in settings that are fixed once the encoder is
+// open.
+bool fixed_settings_differ(const EncoderConfig& a, const EncoderConfig& b) {
+  return a.width != b.width || a.height != b.height ||
+         a.pixel_format != b.pixel_format || a.interval != b.interval ||
+         a.preset != b.preset || a.tune != b.tune ||
+         a.rate_control != b.rate_control ||
+         (a.vbv_max_bitrate_kbps == 0) != (b.vbv_max_bitrate_kbps == 0) ||
+         a.keyint_max != b.keyint_max || a.intra_refresh != b.intra_refresh ||
+         a.threads != b.threads || a.sliced_threads != b.sliced_threads;
+}
+
+int to_x264_csp(PixelFormat format) {
+  switch (format) {
+    case PixelFormat::YUV422_packed:
+      return X264_CSP_YUYV;
+    case PixelFormat::YUV422_planar:
+      return X264_CSP_I422;
+    case PixelFormat::YUV420_planar:
+      return X264_CSP_I420;
+    case PixelFormat::NV12:
+      return X264_CSP_NV12;
+  }
+  return X264_CSP_NONE;
+}
+
 // We can static cast but it is safer in the long term and in general more
 // correct to have honest mapping.
 NAL_Type map_x264_nal_type_to_internal(int unit) {
@@ -47,10 +141,14 @@ NAL_Type map_x264_nal_type_to_internal(int unit) {
 
 class EncoderImpl : public Encoder {
  public:
-  EncoderImpl(EncoderClient& client) : m_client(client) {}
+  EncoderImpl(EncoderClient& client, EncoderConfig config)
+      : m_client(client), m_initial_config(config), m_config(config) {}
   ~EncoderImpl() override {
     if (m_h) {
       LOG_DEBUG("Closing encoder");
+      // Frames in flight are finished by x264 on the way, the client may be
+      // half gone already.
+      m_closing = true;
       x264_encoder_close(m_h);
     }
   }
@@ -67,86 +165,113 @@ class EncoderImpl : public Encoder {
     x264_nal_t* nal{};
     int i_nal{};
 
-    if (x264_param_default_preset(&param, "faster", "zerolatency") < 0) {
-      LOG_ERROR("Failed applying profile (first) ");
+    if (x264_param_default_preset(&param, m_config.preset.c_str(),
+                                  m_config.tune.c_str()) < 0) {
+      LOG_ERROR("Unknown preset {} or tune {}", m_config.preset,
+                m_config.tune);
       return false;
     }
 
-    // on my laptop the format of RAW is camera YUYV 4:2:2.
-    // TODO: write translation from v4l to internal type and then internal type
-    // to x264 format.
-    LOG_WARNING("encoder input format is hardcoded");
-    LOG_WARNING("dimensions hardcoded");
-
-    param.i_csp = X264_CSP_YUYV;  // yuyv 4:2:2 packed
-    // TODO: take it from settings.
-    param.i_width = 1280;
-    param.i_height = 720;
-    param.i_fps_num = 10;
-    param.i_fps_den = 1;
-    //    param.b_vfr_input = 1;
-    param.b_intra_refresh = 1;
+    param.i_csp = to_x264_csp(m_config.pixel_format);
+    param.i_width = static_cast<int>(m_config.width);
+    param.i_height = static_cast<int>(m_config.height);
+    // Nominal rate, the one of the capture.
+    if (m_config.interval.numerator && m_config.interval.denominator) {
+      param.i_fps_num = m_config.interval.denominator;
+      param.i_fps_den = m_config.interval.numerator;
+    } else {
+      param.i_fps_num = 30;
+      param.i_fps_den = 1;
+    }
+    LOG_INFO("Encoding {} {}x{} at {} fps",
+             to_string(m_config.pixel_format), m_config.width,
+             m_config.height, m_config.interval.fps());
+    // Frames come when the camera delivers them, not at a fixed rate: rate
+    // control goes by their capture timestamps, in microseconds.
+    param.b_vfr_input = 1;
+    param.i_timebase_num = 1;
+    param.i_timebase_den = 1'000'000;
+    param.b_intra_refresh = m_config.intra_refresh;
     param.b_repeat_headers = 1;
     param.b_annexb = 1;
     param.i_frame_total = 0;
 
-    // param.i_keyint_max = 25;
-    // param.rc.i_rc_method = X264_RC_CRF;
-    // param.rc.f_rf_constant = 22;
-    // param.rc.i_vbv_max_bitrate = 2000;
-    // param.rc.i_vbv_buffer_size = 2000 / 30;
+    if (m_config.keyint_max) {
+      param.i_keyint_max = *m_config.keyint_max;
+    }
+
+    // Bitrate and VBV are retuned at runtime from bandwidth estimation. VBV
+    // must be on from the start, x264 does not let reconfiguration turn it
+    // on.
+    apply_tunables(m_config, param);
 
-    param.nalu_process = [](x264_t* h, x264_nal_t* nal, void* opaque) {
-      // WARNING: This is going to be called from internal thread of x264,
-      // depending on multu-threading settings.
-      // In order to make client life simpler and not burden it with
-      // additional locking lets provide serialized callback notifications
-      // as guarantee and see if it works. It should, because I expect that
-      // application will just copy NAL into a buffer and pass it into some
-      // sort of output queue or even into the socket buffer. Anyways, this
-      // should be profiled before planning any optimization.
+    // B-frames would be encoded out of the order frames come in, and add
+    // latency of the frames they wait for.
+    param.i_bframe = 0;
 
+    param.nalu_process = [](x264_t* h, x264_nal_t* nal, void* opaque) {
+      // WARNING: This is going to be called from internal threads of x264,
+      // several at once with multithreading. The sequencer puts NALs back in
+      // order and notifies the client serially.
       auto& user_data = *static_cast<FrameUserData*>(opaque);
       auto this_ = user_data.this_;
-
-      assert((nal->i_payload * 3) / 2 + 5 + 64 <
-             this_->m_nal_encoding_buff.size());
-
-      x264_nal_encode(h, this_->m_nal_encoding_buff.data(), nal);
+      if (this_->m_closing) {
+        return;
+      }
+
+      // Size x264 requires, escaping may grow the payload. The client's
+      // buffer goes all the way to the socket without copying.
+      const size_t required =
+          static_cast<size_t>(nal->i_payload) * 3 / 2 + 5 + 64;
+      auto buffer = this_->m_client.nal_buffer(required);
+      std::vector<uint8_t> data;
+      if (buffer && buffer.capacity() >= required) {
+        x264_nal_encode(h, buffer.data(), nal);
+        buffer.set_size(static_cast<size_t>(nal->i_payload));
+      } else {
+        buffer.reset();
+        data.resize(required);
+        x264_nal_encode(h, data.data(), nal);
+        data.resize(static_cast<size_t>(nal->i_payload));
+        this_->m_metrics.nals_copied.add();
+      }
+      this_->m_metrics.nal_size.record(static_cast<uint64_t>(nal->i_payload));
 
       LOG_DEBUG("Produced NAL of type: {}, size: {}, first MB: {}, last MB: {}",
                 nal->i_type, nal->i_payload, nal->i_first_mb, nal->i_last_mb);
 
-      std::lock_guard lck{this_->m_client_notification_lock};
-
-      // 2^32 milliseconds is ~49 days. As long as we are interested only in
-      // difference between consecutive packets we should be fine.
-      const auto timestamp = static_cast<uint32_t>(
-          std::chrono::duration_cast<std::chrono::milliseconds>(
-              user_data.captured_meta.timestamp -
-              std::chrono::steady_clock::time_point{})
-              .count());
-
-      this_->m_client.on_nal_encoded(
-          std::span{nal->p_payload, nal->p_payload + nal->i_payload},
-          NAL_Metadata{
-              .timestamp = timestamp,
-              .nal_type = map_x264_nal_type_to_internal(nal->i_type),
-              .first_macroblock = static_cast<uint16_t>(nal->i_first_mb),
-              .last_macroblock = static_cast<uint16_t>(nal->i_last_mb),
-              .flags = 0});
+      const auto timestamp = user_data.captured_meta.frame_id;
+      trace_frame(timestamp, TraceStage::encoded);
+
+      const NAL_Metadata meta{
+          .timestamp = timestamp,
+          .nal_type = map_x264_nal_type_to_internal(nal->i_type),
+          .first_macroblock = static_cast<uint16_t>(nal->i_first_mb),
+          .last_macroblock = static_cast<uint16_t>(nal->i_last_mb),
+          .flags = 0};
+      if (buffer) {
+        this_->m_sequencer.push_nal(user_data.index, meta, std::move(buffer));
+      } else {
+        this_->m_sequencer.push_nal(user_data.index, meta, std::move(data));
+      }
     };
 
-    // TODO: calculate this value correctly.
-    m_nal_encoding_buff.resize(1920 * 1080 * 10);
-
-    if (x264_param_apply_profile(&param, "high422") < 0) {
-      LOG_ERROR("Failed applying profile (second)");
+    // Lowest one that takes the input.
+    const bool is_420 = m_config.pixel_format == PixelFormat::YUV420_planar ||
+                        m_config.pixel_format == PixelFormat::NV12;
+    const char* profile = is_420 ? "high" : "high422";
+    if (x264_param_apply_profile(&param, profile) < 0) {
+      LOG_ERROR("Failed applying profile {}", profile);
       return false;
     }
 
     LOG_DEBUG("Profile applied");
 
+    // Zero picks the number by CPU count.
+    param.i_threads = m_config.threads ? static_cast<int>(m_config.threads)
+                                       : X264_THREADS_AUTO;
+    param.b_sliced_threads = m_config.sliced_threads;
+
     // lsem: as far as I understand, there are two ways how we can transmit
     // slices via IP networks: 1) splitting NALs that don't fit into a one
     // packet on protocol level. 2) using slicing and limitting maximum slice
@@ -154,9 +279,6 @@ class EncoderImpl : public Encoder {
     // allowing to not retransmit occasional lost packets.
     //    The client can decide if it needs to ask for retransmition or just
     //    display someting else instead of missed slice.
-    param.i_slice_max_size = 1400;
-    param.i_threads = 1;
-    param.b_sliced_threads = 0;
 
     auto picture = std::make_unique<x264_picture_t>();
 
@@ -166,7 +288,6 @@ class EncoderImpl : public Encoder {
     // param.i_width,
     //                    param.i_height);
     picture->img.i_csp = param.i_csp;
-    picture->img.i_plane = 1;
 
     m_h = x264_encoder_open(&param);
     if (!m_h) {
@@ -175,6 +296,8 @@ class EncoderImpl : public Encoder {
     }
 
     m_pic = std::move(picture);
+    m_frame_size =
+        ::frame_size(m_config.pixel_format, m_config.width, m_config.height);
 
     // LSEM: with current settings we can have as many as 70 delayed frames
     // before we start getting frames. How we are supposed to start streaming
@@ -187,50 +310,61 @@ class EncoderImpl : public Encoder {
     LOG_DEBUG("Sliced Threads: {}", param.b_sliced_threads);
     LOG_DEBUG("FPS: {}", param.i_fps_num);
 
-    assert(param.i_threads == 1);
-    assert(param.b_sliced_threads == 0);
-    assert(param.b_intra_refresh);
-
     return true;
   }
 
   virtual void process_frame(std::span<uint8_t> data,
                              CapturedFrameMeta meta) override {
-    m_client.on_frame_started();
+    if (data.size() < m_frame_size) {
+      LOG_ERROR("Frame of {} bytes, {} expected", data.size(), m_frame_size);
+      return;
+    }
+
+    trace_frame(meta.frame_id, TraceStage::encode_started);
 
     x264_picture_t pic_out{};
     x264_nal_t* nal{};
     int i_nal{};
 
-    m_pic->img.i_plane = 2;
-    assert(m_pic->img.i_plane == 2);
-
-    const size_t width = 1280;
-    const size_t height = 720;
+    set_planes(data.data());
 
-    // Packed YUYV 422 has only one plain.
-    m_pic->img.plane[0] = data.data();
-    m_pic->img.i_stride[0] = 1280 * 2;
+    apply_pending_changes();
 
-    // TODO: what is PTS?
-    m_pic->i_pts = m_frame;
-    LOG_DEBUG("frame: {}", m_pic->i_pts);
+    m_pic->i_pts = std::chrono::duration_cast<std::chrono::microseconds>(
+                       meta.timestamp.time_since_epoch())
+                       .count();
+    LOG_DEBUG("frame: {} pts: {}", m_frame, m_pic->i_pts);
 
-    // Allcate user data on stack of this thread,  the pointer will be valid
-    // for as long as x264_encoder_encode is working so we can avoid heap
-    // memory allocation.
-    FrameUserData user_data{.this_ = this, .captured_meta = std::move(meta)};
-    m_pic->opaque = &user_data;
+    // Frame threads are still at it when x264_encoder_encode() returns, user
+    // data stays till the frame comes out. Spare ones are reused, so that
+    // there is no heap allocation per frame.
+    std::unique_ptr<FrameUserData> user_data;
+    if (m_spare_user_data.empty()) {
+      user_data = std::make_unique<FrameUserData>();
+    } else {
+      user_data = std::move(m_spare_user_data.back());
+      m_spare_user_data.pop_back();
+    }
+    *user_data = FrameUserData{
+        .this_ = this, .captured_meta = std::move(meta), .index = m_frame};
+    m_pic->opaque = user_data.get();
+    m_frames_in_flight.push_back(std::move(user_data));
 
     LOG_DEBUG("Start encode");
+    const auto encode_start = std::chrono::steady_clock::now();
     int frame_size =
         x264_encoder_encode(m_h, &nal, &i_nal, m_pic.get(), &pic_out);
+    m_metrics.encode_time.record(static_cast<uint64_t>(
+        std::chrono::duration_cast<std::chrono::microseconds>(
+            std::chrono::steady_clock::now() - encode_start)
+            .count()));
     if (frame_size < 0) {
       LOG_ERROR("Failed encoding frame {}", m_frame);
       // TODO: consider not to fail immidiately.
       return;
     } else if (frame_size) {
-      m_client.on_frame_ended();
+      frame_out(static_cast<FrameUserData*>(pic_out.opaque));
+      m_metrics.frames_encoded.add();
 
       LOG_DEBUG(
           "Encoded frame {} (nals count: {}, nal payload size: {}, frame "
@@ -242,17 +376,153 @@ class EncoderImpl : public Encoder {
     m_frame++;
   }
 
+  virtual void set_target_bitrate(uint64_t bitrate) override {
+    m_pending_bitrate = std::max<uint64_t>(bitrate, 1000);
+  }
+
+  virtual std::error_code reconfigure(const EncoderConfig& config) override {
+    if (fixed_settings_differ(config, m_initial_config)) {
+      return make_error_code(std::errc::operation_not_supported);
+    }
+    std::lock_guard lock(m_pending_config_lock);
+    m_pending_config = config;
+    return {};
+  }
+
  private:
+  // Rows are not padded, planes follow each other.
+  void set_planes(uint8_t* data) {
+    const int width = static_cast<int>(m_config.width);
+    const int height = static_cast<int>(m_config.height);
+    const int chroma_width = (width + 1) / 2;
+    auto& img = m_pic->img;
+    img.plane[0] = data;
+    switch (m_config.pixel_format) {
+      case PixelFormat::YUV422_packed:
+        img.i_plane = 1;
+        img.i_stride[0] = width * 2;
+        break;
+      case PixelFormat::YUV422_planar:
+      case PixelFormat::YUV420_planar: {
+        const int chroma_height =
+            m_config.pixel_format == PixelFormat::YUV422_planar
+                ? height
+                : (height + 1) / 2;
+        img.i_plane = 3;
+        img.i_stride[0] = width;
+        img.i_stride[1] = img.i_stride[2] = chroma_width;
+        img.plane[1] = img.plane[0] + width * height;
+        img.plane[2] = img.plane[1] + chroma_width * chroma_height;
+        break;
+      }
+      case PixelFormat::NV12:
+        img.i_plane = 2;
+        img.i_stride[0] = width;
+        img.i_stride[1] = chroma_width * 2;
+        img.plane[1] = img.plane[0] + width * height;
+        break;
+    }
+  }
+
+  // All NALs of the frame of `user_data` are out of x264.
+  void frame_out(FrameUserData* user_data) {
+    auto it = std::find_if(
+        m_frames_in_flight.begin(), m_frames_in_flight.end(),
+        [user_data](const auto& in_flight) {
+          return in_flight.get() == user_data;
+        });
+    if (it == m_frames_in_flight.end()) {
+      LOG_ERROR("Unknown frame out of x264");
+      return;
+    }
+    m_sequencer.end_frame(user_data->index);
+    m_spare_user_data.push_back(std::move(*it));
+    m_frames_in_flight.erase(it);
+  }
+
+  // x264_encoder_reconfig() must not run concurrently with encoding, so new
+  // config and bitrate wait for the encoding thread.
+  void apply_pending_changes() {
+    std::optional<EncoderConfig> config;
+    {
+      std::lock_guard lock(m_pending_config_lock);
+      config = std::exchange(m_pending_config, std::nullopt);
+    }
+    const uint64_t bitrate = m_pending_bitrate.exchange(0);
+    if (!config && bitrate == 0) {
+      return;
+    }
+
+    if (config) {
+      // Bitrate estimation goes on where it was.
+      const auto bitrate_kbps = m_config.bitrate_kbps;
+      const auto vbv_max_bitrate_kbps = m_config.vbv_max_bitrate_kbps;
+      m_config = std::move(*config);
+      if (m_target_bitrate_set) {
+        m_config.bitrate_kbps = bitrate_kbps;
+        m_config.vbv_max_bitrate_kbps = vbv_max_bitrate_kbps;
+      }
+    }
+    if (bitrate) {
+      const auto kbps = static_cast<unsigned>(bitrate / 1000);
+      if (m_config.rate_control == RateControl::abr) {
+        m_config.bitrate_kbps = kbps;
+      } else if (m_config.vbv_max_bitrate_kbps) {
+        m_config.vbv_max_bitrate_kbps = kbps;
+      }
+      m_target_bitrate_set = true;
+    }
+
+    x264_param_t param{};
+    x264_encoder_parameters(m_h, &param);
+    const x264_param_t before = param;
+    apply_tunables(m_config, param);
+    if (param.rc.i_bitrate == before.rc.i_bitrate &&
+        param.rc.i_vbv_max_bitrate == before.rc.i_vbv_max_bitrate &&
+        param.rc.i_vbv_buffer_size == before.rc.i_vbv_buffer_size &&
+        param.rc.f_rf_constant == before.rc.f_rf_constant &&
+        param.rc.i_qp_constant == before.rc.i_qp_constant &&
+        param.i_slice_max_size == before.i_slice_max_size &&
+        param.i_slice_max_mbs == before.i_slice_max_mbs &&
+        param.i_slice_count == before.i_slice_count) {
+      return;
+    }
+    if (x264_encoder_reconfig(m_h, &param) < 0) {
+      LOG_WARNING("Failed reconfiguring encoder");
+      return;
+    }
+    LOG_DEBUG("Reconfigured, bitrate {} kbps, VBV {} kbps of {} kbit",
+              param.rc.i_bitrate, param.rc.i_vbv_max_bitrate,
+              param.rc.i_vbv_buffer_size);
+  }
+
   EncoderClient& m_client;
+  // Fixed settings are compared with it.
+  const EncoderConfig m_initial_config;
+  // Of the encoding thread.
+  EncoderConfig m_config;
+  // Bitrate of m_config comes from set_target_bitrate() rather than config.
+  bool m_target_bitrate_set{};
   x264_t* m_h{};
   std::unique_ptr<x264_picture_t> m_pic{};
-  int m_frame{};
-  std::mutex m_client_notification_lock;
-  std::vector<uint8_t> m_nal_encoding_buff;
+  // Of input frames.
+  size_t m_frame_size{};
+  uint64_t m_frame{};
+  NalSequencer m_sequencer{m_client};
+  std::atomic<bool> m_closing{};
+  // Given to x264 and not out yet, oldest first.
+  std::deque<std::unique_ptr<FrameUserData>> m_frames_in_flight;
+  std::vector<std::unique_ptr<FrameUserData>> m_spare_user_data;
+  // Zero when there is nothing new.
+  std::atomic<uint64_t> m_pending_bitrate{};
+  std::mutex m_pending_config_lock;
+  std::optional<EncoderConfig> m_pending_config;
+  EncoderMetrics m_metrics;
 };
 
-std::unique_ptr<Encoder> make_encoder(EncoderClient& client) {
-  auto instance = std::make_unique<EncoderImpl>(client);
+std::unique_ptr<Encoder> make_encoder(EncoderClient& client,
+                                      EncoderConfig config) {
+  auto instance = std::make_unique<EncoderImpl>(client, config);
   if (!instance->initialize()) {
     LOG_ERROR("Failed initializing encoder");
     return nullptr;
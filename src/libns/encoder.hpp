@@ -1,17 +1,93 @@
 #pragma once
 
+#include <cstdint>
 #include <memory>
+#include <optional>
 #include <span>
+#include <string>
+#include <system_error>
+#include "packet_pool.hpp"
 #include "types.hpp"
 
+// Notified of each encoded frame: on_frame_started(), its NALs in bitstream
+// order, on_frame_ended(). Calls may come from x264 threads as well as the one
+// calling process_frame(), but never from two at once.
 class EncoderClient {
  public:
   virtual ~EncoderClient() = default;
 
   virtual void on_frame_started() = 0;
   virtual void on_frame_ended() = 0;
+  // NAL with start code in `data`. That is the bytes of `buffer` if the
+  // client gave one for it, which is passed on without copying; a buffer of
+  // the encoder valid only for the time of the call otherwise.
   virtual void on_nal_encoded(std::span<const uint8_t> data,
+                              PacketRef buffer,
                               NAL_Metadata meta) = 0;
+
+  // Buffer for the encoder to write a NAL into, of at least `size` bytes of
+  // capacity. Empty, as by default, has the encoder use one of its own. Called
+  // from x264 threads, several at once with multithreading.
+  virtual PacketRef nal_buffer(size_t size) { return {}; }
+};
+
+enum class RateControl {
+  // Average bitrate capped with VBV at the same bitrate, retuned by
+  // set_target_bitrate().
+  abr,
+  // Constant quality, capped with VBV if there is a maximum bitrate. The cap
+  // is retuned by set_target_bitrate().
+  crf,
+  // Constant quantizer, bitrate is whatever it takes.
+  cqp
+};
+
+// Settings marked "fixed" are those of the encoder till it is gone, the
+// others may be changed with Encoder::reconfigure().
+struct EncoderConfig {
+  // Frames the encoder is given, as the capture delivers them. Fixed.
+  uint32_t width = 1280;
+  uint32_t height = 720;
+  PixelFormat pixel_format = PixelFormat::YUV422_packed;
+  FrameInterval interval;
+
+  // x264 preset and tune, B-frames are off whatever they say. Fixed.
+  std::string preset = "faster";
+  std::string tune = "zerolatency";
+
+  // Fixed.
+  RateControl rate_control = RateControl::abr;
+  // Of abr, till set_target_bitrate().
+  unsigned bitrate_kbps = 2000;
+  // Of crf, lower is better.
+  float crf = 23;
+  // Of cqp, lower is better.
+  int qp = 23;
+  // VBV cap of crf, none if zero. VBV can not be turned on or off later.
+  unsigned vbv_max_bitrate_kbps = 0;
+  // Zero is enough for a single frame: every frame is about the size of the
+  // average one, so there are no bursts for the network to absorb.
+  unsigned vbv_buffer_kbits = 0;
+
+  // Frames between keyframes at most, or the period of intra refresh. x264
+  // default if not set. Fixed.
+  std::optional<int> keyint_max;
+  // Refreshes the picture with a column of intra macroblocks sweeping across
+  // frames instead of keyframes, which would be bursts. Fixed.
+  bool intra_refresh = true;
+
+  // Slices no larger than that many bytes or macroblocks, or that many slices
+  // per frame. Zero is no limit. Slices of a packet each can be decoded even
+  // if packets around them are lost.
+  unsigned slice_max_size = 1400;
+  unsigned slice_max_mbs = 0;
+  unsigned slice_count = 0;
+
+  // Zero picks the number by CPU count. Frame threads encode several frames
+  // at once, each one a frame of latency more; sliced threads split every
+  // frame between them instead, without latency but with slices each. Fixed.
+  unsigned threads = 1;
+  bool sliced_threads = false;
 };
 
 class Encoder {
@@ -22,6 +98,17 @@ class Encoder {
   // this interface like this.
   virtual void process_frame(std::span<uint8_t> data,
                              CapturedFrameMeta meta) = 0;
+
+  // Retunes rate control (bitrate and VBV) to `bitrate` bits per second.
+  // Takes effect from the next frame. May be called from any thread.
+  virtual void set_target_bitrate(uint64_t bitrate) = 0;
+
+  // Takes the changes of `config` from the next frame, without reopening the
+  // encoder. Fails if a fixed setting is changed. May be called from any
+  // thread.
+  virtual std::error_code reconfigure(const EncoderConfig& config) = 0;
 };
 
-std::unique_ptr<Encoder> make_encoder(EncoderClient& client);
+// Fails on config x264 does not take.
+std::unique_ptr<Encoder> make_encoder(EncoderClient& client,
+                                      EncoderConfig config = {});
@@ -0,0 +1,423 @@
+#include "fec.hpp"
+#include "log.hpp"
+#include "rtp.hpp"
+
+#include <algorithm>
+#include <bit>
+#include <cstring>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define NS_FEC_X86 1
+#endif
+
+LOG_MODULE_NAME("FEC");
+
+namespace {
+// Parity packets waiting for the rest of their group. Older ones are dropped
+// when there are more.
+constexpr size_t MAX_PENDING_FEC = 64;
+
+void xor_bytes_scalar(uint8_t* dst, const uint8_t* src, size_t size) {
+  size_t i = 0;
+  for (; i + sizeof(uint64_t) <= size; i += sizeof(uint64_t)) {
+    uint64_t a;
+    uint64_t b;
+    std::memcpy(&a, dst + i, sizeof(a));
+    std::memcpy(&b, src + i, sizeof(b));
+    a ^= b;
+    std::memcpy(dst + i, &a, sizeof(a));
+  }
+  for (; i < size; ++i) {
+    dst[i] ^= src[i];
+  }
+}
+
+#ifdef NS_FEC_X86
+__attribute__((target("sse2"))) void xor_bytes_sse2(uint8_t* dst,
+                                                    const uint8_t* src,
+                                                    size_t size) {
+  size_t i = 0;
+  for (; i + 64 <= size; i += 64) {
+    auto* d = reinterpret_cast<__m128i*>(dst + i);
+    auto* s = reinterpret_cast<const __m128i*>(src + i);
+    const __m128i r0 =
+        _mm_xor_si128(_mm_loadu_si128(d + 0), _mm_loadu_si128(s + 0));
+    const __m128i r1 =
+        _mm_xor_si128(_mm_loadu_si128(d + 1), _mm_loadu_si128(s + 1));
+    const __m128i r2 =
+        _mm_xor_si128(_mm_loadu_si128(d + 2), _mm_loadu_si128(s + 2));
+    const __m128i r3 =
+        _mm_xor_si128(_mm_loadu_si128(d + 3), _mm_loadu_si128(s + 3));
+    _mm_storeu_si128(d + 0, r0);
+    _mm_storeu_si128(d + 1, r1);
+    _mm_storeu_si128(d + 2, r2);
+    _mm_storeu_si128(d + 3, r3);
+  }
+  for (; i + 16 <= size; i += 16) {
+    auto* d = reinterpret_cast<__m128i*>(dst + i);
+    auto* s = reinterpret_cast<const __m128i*>(src + i);
+    _mm_storeu_si128(d, _mm_xor_si128(_mm_loadu_si128(d), _mm_loadu_si128(s)));
+  }
+  xor_bytes_scalar(dst + i, src + i, size - i);
+}
+
+__attribute__((target("avx2"))) void xor_bytes_avx2(uint8_t* dst,
+                                                    const uint8_t* src,
+                                                    size_t size) {
+  size_t i = 0;
+  for (; i + 128 <= size; i += 128) {
+    auto* d = reinterpret_cast<__m256i*>(dst + i);
+    auto* s = reinterpret_cast<const __m256i*>(src + i);
+    const __m256i r0 =
+        _mm256_xor_si256(_mm256_loadu_si256(d + 0), _mm256_loadu_si256(s + 0));
+    const __m256i r1 =
+        _mm256_xor_si256(_mm256_loadu_si256(d + 1), _mm256_loadu_si256(s + 1));
+    const __m256i r2 =
+        _mm256_xor_si256(_mm256_loadu_si256(d + 2), _mm256_loadu_si256(s + 2));
+    const __m256i r3 =
+        _mm256_xor_si256(_mm256_loadu_si256(d + 3), _mm256_loadu_si256(s + 3));
+    _mm256_storeu_si256(d + 0, r0);
+    _mm256_storeu_si256(d + 1, r1);
+    _mm256_storeu_si256(d + 2, r2);
+    _mm256_storeu_si256(d + 3, r3);
+  }
+  for (; i + 32 <= size; i += 32) {
+    auto* d = reinterpret_cast<__m256i*>(dst + i);
+    auto* s = reinterpret_cast<const __m256i*>(src + i);
+    _mm256_storeu_si256(
+        d, _mm256_xor_si256(_mm256_loadu_si256(d), _mm256_loadu_si256(s)));
+  }
+  xor_bytes_sse2(dst + i, src + i, size - i);
+}
+#endif
+
+using XorBytesFn = void (*)(uint8_t*, const uint8_t*, size_t);
+
+XorBytesFn select_xor_bytes() {
+#ifdef NS_FEC_X86
+  __builtin_cpu_init();
+  if (__builtin_cpu_supports("avx2")) {
+    return xor_bytes_avx2;
+  }
+  if (__builtin_cpu_supports("sse2")) {
+    return xor_bytes_sse2;
+  }
+#endif
+  return xor_bytes_scalar;
+}
+
+const XorBytesFn xor_bytes_impl = select_xor_bytes();
+
+FecConfig sanitize(FecConfig config) {
+  config.row_size = std::min(config.row_size, FEC_MaxGroupSize);
+  config.rows = std::clamp(config.rows, 1u, FEC_MaxGroupSize);
+  return config;
+}
+}  // namespace
+
+void xor_bytes(uint8_t* dst, const uint8_t* src, size_t size) {
+  xor_bytes_impl(dst, src, size);
+}
+
+std::error_code serialize_fec_header(const FecHeader& header,
+                                     std::span<uint8_t> buffer) {
+  if (buffer.size() < FEC_Header_Size) {
+    LOG_ERROR("Minimum buffer size for FEC header is {}, there is: {}",
+              FEC_Header_Size, buffer.size());
+    return make_error_code(std::errc::invalid_argument);
+  }
+  buffer[0] = header.base_sequence_num >> 8;
+  buffer[1] = header.base_sequence_num & 0xFF;
+  buffer[2] = header.stride;
+  buffer[3] = header.count;
+  buffer[4] = header.length_recovery >> 8;
+  buffer[5] = header.length_recovery & 0xFF;
+  buffer[6] = 0;
+  buffer[7] = 0;
+  return {};
+}
+
+expected<FecHeader> deserialize_fec_header(std::span<const uint8_t> data) {
+  if (data.size() < FEC_Header_Size) {
+    return unexpected{make_error_code(std::errc::message_size)};
+  }
+  FecHeader header;
+  header.base_sequence_num = static_cast<uint16_t>(data[0] << 8 | data[1]);
+  header.stride = data[2];
+  header.count = data[3];
+  header.length_recovery = static_cast<uint16_t>(data[4] << 8 | data[5]);
+  if (header.stride == 0 || header.count == 0) {
+    return unexpected{make_error_code(std::errc::invalid_argument)};
+  }
+  return header;
+}
+
+FecEncoder::FecEncoder(size_t max_packet_size, FecConfig config)
+    : m_max_packet_size(max_packet_size),
+      m_config(sanitize(config)),
+      m_next_config(m_config) {
+  m_row.data.resize(max_payload_size());
+  start_block();
+}
+
+void FecEncoder::set_config(FecConfig config) {
+  std::lock_guard lock{m_lock};
+  m_next_config = sanitize(config);
+}
+
+void FecEncoder::start_block() {
+  {
+    std::lock_guard lock{m_lock};
+    m_config = m_next_config;
+  }
+  const size_t columns = m_config.rows > 1 ? m_config.row_size : 0;
+  if (m_columns.size() != columns) {
+    m_columns.resize(columns);
+    for (auto& column : m_columns) {
+      column.data.resize(max_payload_size());
+    }
+  }
+}
+
+void FecEncoder::add_to(Accumulator& acc,
+                        uint16_t sequence_num,
+                        std::span<const std::span<const uint8_t>> parts,
+                        size_t packet_size) {
+  if (acc.count == 0) {
+    acc.base_sequence_num = sequence_num;
+  }
+  // Accumulator is zeroed past its size, so the first packet could be copied
+  // instead, but XOR is just as fast.
+  uint8_t* dst = acc.data.data() + FEC_Header_Size;
+  for (auto part : parts) {
+    xor_bytes(dst, part.data(), part.size());
+    dst += part.size();
+  }
+  acc.size = std::max(acc.size, packet_size);
+  acc.length_recovery ^= static_cast<uint16_t>(packet_size);
+  acc.count++;
+}
+
+void FecEncoder::emit(Accumulator& acc, unsigned stride, const FecSink& sink) {
+  FecHeader header;
+  header.base_sequence_num = acc.base_sequence_num;
+  header.stride = static_cast<uint8_t>(stride);
+  header.count = static_cast<uint8_t>(acc.count);
+  header.length_recovery = acc.length_recovery;
+  serialize_fec_header(header, acc.data);
+
+  sink(std::span{acc.data}.first(FEC_Header_Size + acc.size));
+  reset(acc);
+}
+
+void FecEncoder::reset(Accumulator& acc) {
+  std::memset(acc.data.data() + FEC_Header_Size, 0, acc.size);
+  acc.size = 0;
+  acc.length_recovery = 0;
+  acc.count = 0;
+}
+
+void FecEncoder::add_packet(uint16_t sequence_num,
+                            std::span<const std::span<const uint8_t>> parts,
+                            const FecSink& sink) {
+  if (m_index == 0) {
+    start_block();
+  }
+  if (m_config.row_size == 0) {
+    return;
+  }
+
+  size_t packet_size = 0;
+  for (auto part : parts) {
+    packet_size += part.size();
+  }
+  if (packet_size > m_max_packet_size) {
+    // Can't be protected, and groups must consist of packets going at fixed
+    // sequence number distance, so end them here.
+    LOG_DEBUG("Packet {} of {} bytes is too big for FEC", sequence_num,
+              packet_size);
+    flush(sink);
+    return;
+  }
+
+  const unsigned row_size = m_config.row_size;
+  const unsigned column = m_index % row_size;
+
+  add_to(m_row, sequence_num, parts, packet_size);
+  if (!m_columns.empty()) {
+    add_to(m_columns[column], sequence_num, parts, packet_size);
+  }
+  m_index++;
+
+  if (column == row_size - 1) {
+    emit(m_row, 1, sink);
+  }
+  if (m_index == row_size * m_config.rows) {
+    for (auto& acc : m_columns) {
+      emit(acc, row_size, sink);
+    }
+    m_index = 0;
+  }
+}
+
+void FecEncoder::flush(const FecSink& sink) {
+  if (m_index == 0) {
+    return;
+  }
+  if (m_row.count > 0) {
+    emit(m_row, 1, sink);
+  }
+  for (auto& acc : m_columns) {
+    if (acc.count > 1) {
+      emit(acc, m_config.row_size, sink);
+    } else {
+      // Parity of a single packet is its copy, the row parity covers it
+      // already.
+      reset(acc);
+    }
+  }
+  m_index = 0;
+}
+
+FecDecoder::FecDecoder(PacketBufferPool& pool, size_t window)
+    : m_pool(pool),
+      m_media(std::bit_ceil(std::max<size_t>(window, 2))),
+      m_mask(m_media.size() - 1) {
+  m_pending.reserve(MAX_PENDING_FEC);
+}
+
+bool FecDecoder::has(uint16_t sequence_num) {
+  auto& s = slot(sequence_num);
+  return s.packet && s.sequence_num == sequence_num;
+}
+
+bool FecDecoder::covers(const FecHeader& header, uint16_t sequence_num) const {
+  const uint16_t distance = sequence_num - header.base_sequence_num;
+  return distance % header.stride == 0 &&
+         distance / header.stride < header.count;
+}
+
+void FecDecoder::on_media_packet(uint16_t sequence_num,
+                                 PacketRef packet,
+                                 const RecoveredSink& sink) {
+  auto& s = slot(sequence_num);
+  s.sequence_num = sequence_num;
+  s.packet = std::move(packet);
+
+  const bool covered = std::any_of(
+      m_pending.begin(), m_pending.end(),
+      [&](const auto& fec) { return covers(fec.header, sequence_num); });
+  if (covered) {
+    recover_pending(sink);
+  }
+}
+
+void FecDecoder::on_fec_packet(PacketRef packet,
+                               std::span<const uint8_t> fec_payload,
+                               const RecoveredSink& sink) {
+  auto maybe_header = deserialize_fec_header(fec_payload);
+  if (!maybe_header) {
+    LOG_WARNING("Malformed FEC header: {}", maybe_header.error().message());
+    return;
+  }
+
+  if (m_pending.size() == MAX_PENDING_FEC) {
+    m_pending.erase(m_pending.begin());
+  }
+  m_pending.push_back({.lease = std::move(packet),
+                       .header = *maybe_header,
+                       .data = fec_payload.subspan(FEC_Header_Size)});
+  recover_pending(sink);
+}
+
+void FecDecoder::recover_pending(const RecoveredSink& sink) {
+  // Recovering a packet may complete other groups (e.g. column parity fills
+  // in a row), so go on until nothing changes.
+  bool progress = true;
+  while (progress) {
+    progress = false;
+    for (auto it = m_pending.begin(); it != m_pending.end();) {
+      if (try_recover(*it) == Outcome::done) {
+        it = m_pending.erase(it);
+        progress = true;
+      } else {
+        ++it;
+      }
+    }
+  }
+
+  for (auto& packet : m_recovered) {
+    sink(std::move(packet));
+  }
+  m_recovered.clear();
+}
+
+FecDecoder::Outcome FecDecoder::try_recover(const PendingFec& fec) {
+  const auto& header = fec.header;
+
+  unsigned missing = 0;
+  uint16_t missing_sequence_num = 0;
+  for (unsigned i = 0; i < header.count; ++i) {
+    const uint16_t seq = header.base_sequence_num + i * header.stride;
+    if (!has(seq)) {
+      missing++;
+      missing_sequence_num = seq;
+    }
+  }
+
+  if (missing == 0) {
+    return Outcome::done;
+  }
+  if (missing > 1) {
+    return Outcome::pending;
+  }
+
+  uint16_t length = header.length_recovery;
+  for (unsigned i = 0; i < header.count; ++i) {
+    const uint16_t seq = header.base_sequence_num + i * header.stride;
+    if (seq != missing_sequence_num) {
+      length ^= static_cast<uint16_t>(slot(seq).packet.size());
+    }
+  }
+
+  if (length < RTP_PacketHeader_Size || length > fec.data.size() ||
+      length > m_pool.buffer_size()) {
+    LOG_WARNING("Bad length {} of recovered packet {}", length,
+                missing_sequence_num);
+    return Outcome::done;
+  }
+
+  PacketRef recovered = m_pool.acquire();
+  if (!recovered) {
+    LOG_WARNING("No buffer to recover packet {} into", missing_sequence_num);
+    return Outcome::pending;
+  }
+
+  uint8_t* dst = recovered.data();
+  std::memcpy(dst, fec.data.data(), length);
+  for (unsigned i = 0; i < header.count; ++i) {
+    const uint16_t seq = header.base_sequence_num + i * header.stride;
+    if (seq != missing_sequence_num) {
+      const auto& packet = slot(seq).packet;
+      xor_bytes(dst, packet.data(), std::min<size_t>(packet.size(), length));
+    }
+  }
+  recovered.set_size(length);
+
+  if (dst[0] >> 6 != 2 || dst[2] != (missing_sequence_num >> 8) ||
+      dst[3] != (missing_sequence_num & 0xFF)) {
+    LOG_WARNING("Recovered packet {} does not look right, dropping",
+                missing_sequence_num);
+    return Outcome::done;
+  }
+
+  LOG_DEBUG("Recovered packet {}", missing_sequence_num);
+  m_recovered_count++;
+
+  auto& s = slot(missing_sequence_num);
+  s.sequence_num = missing_sequence_num;
+  s.packet = recovered;
+  m_recovered.push_back(std::move(recovered));
+  return Outcome::done;
+}
@@ -0,0 +1,178 @@
+////////////////////////////////////////////////////////////
+// XOR forward error correction over RTP packets.
+////////////////////////////////////////////////////////////
+#pragma once
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <span>
+#include <system_error>
+#include <vector>
+
+#include "defs.hpp"
+#include "packet_pool.hpp"
+
+// Parity scheme follows the 2-D row/column layout of FlexFEC (RFC 8627) and
+// SMPTE 2022-1, but with a much simpler header of our own. Media packets are
+// laid out row by row into blocks of `row_size` x `rows` packets. Every row
+// gets a parity packet, which recovers any single loss in the row, and when
+// there is more than one row every column gets one too, which recovers bursts
+// up to a row long. Parity is computed over whole RTP packets, header
+// included, so the recovered packet is exactly the lost one.
+//
+// FEC packets go in their own RTP stream: same socket, own payload type and
+// own sequence numbers. Payload is FEC header followed by XOR of protected
+// packets (shorter ones padded with zeroes):
+//
+//   0                   1                   2                   3
+//   0 1 2 3 4 5 6 7 8 9 0 1 2 3 4 5 6 7 8 9 0 1 2 3 4 5 6 7 8 9 0 1
+//  +-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+
+//  |      base sequence number     |    stride     |     count     |
+//  +-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+
+//  |        length recovery        |           reserved            |
+//  +-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+
+//
+// Protected packets are base, base + stride, ..., base + (count - 1) * stride.
+// Length recovery is XOR of their lengths.
+
+constexpr unsigned RTP_FecPayloadType = 97;
+
+constexpr size_t FEC_Header_Size = 8;
+
+// Bounds of both row_size and rows.
+constexpr unsigned FEC_MaxGroupSize = 64;
+
+struct FecHeader {
+  uint16_t base_sequence_num{};
+  uint8_t stride{};
+  uint8_t count{};
+  uint16_t length_recovery{};
+};
+
+std::error_code serialize_fec_header(const FecHeader& header,
+                                     std::span<uint8_t> buffer);
+expected<FecHeader> deserialize_fec_header(std::span<const uint8_t> data);
+
+struct FecConfig {
+  // Number of media packets protected by one row parity packet. Zero disables
+  // FEC.
+  unsigned row_size = 0;
+  // Number of rows in a block. Columns get parity packets when there is more
+  // than one.
+  unsigned rows = 1;
+};
+
+// dst[i] ^= src[i]. Uses the widest SIMD the CPU supports.
+void xor_bytes(uint8_t* dst, const uint8_t* src, size_t size);
+
+// Produces parity packets for media packets passed to it in sequence number
+// order. Not thread safe, except for set_config().
+class FecEncoder {
+ public:
+  // FEC payload is valid only for the time of the call.
+  using FecSink = std::function<void(std::span<const uint8_t> fec_payload)>;
+
+  // Packets bigger than `max_packet_size` are sent unprotected.
+  explicit FecEncoder(size_t max_packet_size, FecConfig config = {});
+
+  // New configuration takes effect from the next block. May be called from
+  // any thread.
+  void set_config(FecConfig config);
+
+  // `parts` concatenated make the RTP packet as it goes to the network.
+  void add_packet(uint16_t sequence_num,
+                  std::span<const std::span<const uint8_t>> parts,
+                  const FecSink& sink);
+
+  // Ends the current block, emitting parity of what there is in incomplete
+  // row and columns. Called at the end of each frame, so that protection of
+  // its last packets does not wait for the next one.
+  void flush(const FecSink& sink);
+
+  // Largest FEC payload produced.
+  size_t max_payload_size() const {
+    return FEC_Header_Size + m_max_packet_size;
+  }
+
+ private:
+  struct Accumulator {
+    std::vector<uint8_t> data;
+    // Length of the longest packet added.
+    size_t size{};
+    uint16_t length_recovery{};
+    uint16_t base_sequence_num{};
+    unsigned count{};
+  };
+
+  void add_to(Accumulator& acc,
+              uint16_t sequence_num,
+              std::span<const std::span<const uint8_t>> parts,
+              size_t packet_size);
+  void emit(Accumulator& acc, unsigned stride, const FecSink& sink);
+  void reset(Accumulator& acc);
+  void start_block();
+
+  size_t m_max_packet_size{};
+  FecConfig m_config;
+  Accumulator m_row;
+  std::vector<Accumulator> m_columns;
+  // Position of the next packet in the block.
+  unsigned m_index{};
+
+  std::mutex m_lock;
+  FecConfig m_next_config;
+};
+
+// Rebuilds lost media packets from the ones received and parity packets.
+// Keeps references to recently received media packets rather than copies of
+// them, recovered packets are written into buffers of the given pool.
+//
+// Not thread safe.
+class FecDecoder {
+ public:
+  using RecoveredSink = std::function<void(PacketRef packet)>;
+
+  // `window` is the number of most recent media packets kept for recovery.
+  explicit FecDecoder(PacketBufferPool& pool, size_t window = 256);
+
+  // `packet.bytes()` is the whole RTP packet.
+  void on_media_packet(uint16_t sequence_num,
+                       PacketRef packet,
+                       const RecoveredSink& sink);
+
+  // `fec_payload` is a view into `packet`.
+  void on_fec_packet(PacketRef packet,
+                     std::span<const uint8_t> fec_payload,
+                     const RecoveredSink& sink);
+
+  uint64_t recovered_count() const { return m_recovered_count; }
+
+ private:
+  struct MediaSlot {
+    uint16_t sequence_num{};
+    PacketRef packet;
+  };
+
+  struct PendingFec {
+    PacketRef lease;
+    FecHeader header;
+    std::span<const uint8_t> data;
+  };
+
+  enum class Outcome { pending, done };
+
+  MediaSlot& slot(uint16_t sequence_num) {
+    return m_media[sequence_num & m_mask];
+  }
+  bool has(uint16_t sequence_num);
+  bool covers(const FecHeader& header, uint16_t sequence_num) const;
+  Outcome try_recover(const PendingFec& fec);
+  void recover_pending(const RecoveredSink& sink);
+
+  PacketBufferPool& m_pool;
+  std::vector<MediaSlot> m_media;
+  size_t m_mask{};
+  std::vector<PendingFec> m_pending;
+  std::vector<PacketRef> m_recovered;
+  uint64_t m_recovered_count{};
+};
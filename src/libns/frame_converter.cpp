@@ -0,0 +1,802 @@
+#include "frame_converter.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <optional>
+
+#include "log.hpp"
+#include "metrics.hpp"
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define NS_CONVERT_X86 1
+#endif
+
+LOG_MODULE_NAME("CONVERT");
+
+namespace {
+// Kernels convert a pair of YUYV rows of `width` pixels. For the odd last row
+// both rows are the same one.
+using I420RowsFn = void (*)(const uint8_t* row0,
+                            const uint8_t* row1,
+                            uint8_t* y0,
+                            uint8_t* y1,
+                            uint8_t* u,
+                            uint8_t* v,
+                            size_t width);
+using NV12RowsFn = void (*)(const uint8_t* row0,
+                            const uint8_t* row1,
+                            uint8_t* y0,
+                            uint8_t* y1,
+                            uint8_t* uv,
+                            size_t width);
+
+uint8_t average(uint8_t a, uint8_t b) {
+  return static_cast<uint8_t>((a + b + 1) >> 1);
+}
+
+void yuyv_rows_to_i420_scalar(const uint8_t* row0,
+                              const uint8_t* row1,
+                              uint8_t* y0,
+                              uint8_t* y1,
+                              uint8_t* u,
+                              uint8_t* v,
+                              size_t width) {
+  for (size_t x = 0; x + 1 < width; x += 2) {
+    const uint8_t* p0 = row0 + x * 2;
+    const uint8_t* p1 = row1 + x * 2;
+    y0[x] = p0[0];
+    y0[x + 1] = p0[2];
+    y1[x] = p1[0];
+    y1[x + 1] = p1[2];
+    u[x / 2] = average(p0[1], p1[1]);
+    v[x / 2] = average(p0[3], p1[3]);
+  }
+}
+
+void yuyv_rows_to_nv12_scalar(const uint8_t* row0,
+                              const uint8_t* row1,
+                              uint8_t* y0,
+                              uint8_t* y1,
+                              uint8_t* uv,
+                              size_t width) {
+  for (size_t x = 0; x + 1 < width; x += 2) {
+    const uint8_t* p0 = row0 + x * 2;
+    const uint8_t* p1 = row1 + x * 2;
+    y0[x] = p0[0];
+    y0[x + 1] = p0[2];
+    y1[x] = p1[0];
+    y1[x + 1] = p1[2];
+    uv[x] = average(p0[1], p1[1]);
+    uv[x + 1] = average(p0[3], p1[3]);
+  }
+}
+
+// Vector kernels below split YUYV into luma (low bytes of 16-bit words) and
+// interleaved UV (high bytes) with packus, average UV of the two rows with
+// avg_epu8, which rounds up like average(), and split UV once more for I420.
+// Pixels left over are done by the scalar kernel.
+
+#ifdef NS_CONVERT_X86
+// Low bytes of 16-bit words of `a` then of `b`: Y out of YUYV, U out of UV.
+__attribute__((target("sse2"))) inline __m128i luma_sse2(__m128i a,
+                                                        __m128i b) {
+  const __m128i mask = _mm_set1_epi16(0x00FF);
+  return _mm_packus_epi16(_mm_and_si128(a, mask), _mm_and_si128(b, mask));
+}
+
+// High bytes likewise: UV out of YUYV, V out of UV.
+__attribute__((target("sse2"))) inline __m128i chroma_sse2(__m128i a,
+                                                          __m128i b) {
+  return _mm_packus_epi16(_mm_srli_epi16(a, 8), _mm_srli_epi16(b, 8));
+}
+
+__attribute__((target("sse2"))) void yuyv_rows_to_i420_sse2(
+    const uint8_t* row0,
+    const uint8_t* row1,
+    uint8_t* y0,
+    uint8_t* y1,
+    uint8_t* u,
+    uint8_t* v,
+    size_t width) {
+  size_t x = 0;
+  for (; x + 32 <= width; x += 32) {
+    const auto* s0 = reinterpret_cast<const __m128i*>(row0 + x * 2);
+    const auto* s1 = reinterpret_cast<const __m128i*>(row1 + x * 2);
+    const __m128i a0 = _mm_loadu_si128(s0 + 0);
+    const __m128i a1 = _mm_loadu_si128(s0 + 1);
+    const __m128i a2 = _mm_loadu_si128(s0 + 2);
+    const __m128i a3 = _mm_loadu_si128(s0 + 3);
+    const __m128i b0 = _mm_loadu_si128(s1 + 0);
+    const __m128i b1 = _mm_loadu_si128(s1 + 1);
+    const __m128i b2 = _mm_loadu_si128(s1 + 2);
+    const __m128i b3 = _mm_loadu_si128(s1 + 3);
+
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(y0 + x), luma_sse2(a0, a1));
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(y0 + x + 16),
+                     luma_sse2(a2, a3));
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(y1 + x), luma_sse2(b0, b1));
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(y1 + x + 16),
+                     luma_sse2(b2, b3));
+
+    const __m128i uv01 = _mm_avg_epu8(chroma_sse2(a0, a1), chroma_sse2(b0, b1));
+    const __m128i uv23 = _mm_avg_epu8(chroma_sse2(a2, a3), chroma_sse2(b2, b3));
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(u + x / 2),
+                     luma_sse2(uv01, uv23));
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(v + x / 2),
+                     chroma_sse2(uv01, uv23));
+  }
+  yuyv_rows_to_i420_scalar(row0 + x * 2, row1 + x * 2, y0 + x, y1 + x,
+                           u + x / 2, v + x / 2, width - x);
+}
+
+__attribute__((target("sse2"))) void yuyv_rows_to_nv12_sse2(
+    const uint8_t* row0,
+    const uint8_t* row1,
+    uint8_t* y0,
+    uint8_t* y1,
+    uint8_t* uv,
+    size_t width) {
+  size_t x = 0;
+  for (; x + 16 <= width; x += 16) {
+    const auto* s0 = reinterpret_cast<const __m128i*>(row0 + x * 2);
+    const auto* s1 = reinterpret_cast<const __m128i*>(row1 + x * 2);
+    const __m128i a0 = _mm_loadu_si128(s0 + 0);
+    const __m128i a1 = _mm_loadu_si128(s0 + 1);
+    const __m128i b0 = _mm_loadu_si128(s1 + 0);
+    const __m128i b1 = _mm_loadu_si128(s1 + 1);
+
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(y0 + x), luma_sse2(a0, a1));
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(y1 + x), luma_sse2(b0, b1));
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(uv + x),
+                     _mm_avg_epu8(chroma_sse2(a0, a1), chroma_sse2(b0, b1)));
+  }
+  yuyv_rows_to_nv12_scalar(row0 + x * 2, row1 + x * 2, y0 + x, y1 + x, uv + x,
+                           width - x);
+}
+
+// 256-bit packus works on 128-bit lanes, interleaving its operands. Permuting
+// 64-bit parts puts them back in order.
+__attribute__((target("avx2"))) inline __m256i luma_avx2(__m256i a,
+                                                        __m256i b) {
+  const __m256i mask = _mm256_set1_epi16(0x00FF);
+  return _mm256_permute4x64_epi64(
+      _mm256_packus_epi16(_mm256_and_si256(a, mask),
+                          _mm256_and_si256(b, mask)),
+      0xD8);
+}
+
+__attribute__((target("avx2"))) inline __m256i chroma_avx2(__m256i a,
+                                                          __m256i b) {
+  return _mm256_permute4x64_epi64(
+      _mm256_packus_epi16(_mm256_srli_epi16(a, 8), _mm256_srli_epi16(b, 8)),
+      0xD8);
+}
+
+__attribute__((target("avx2"))) void yuyv_rows_to_i420_avx2(
+    const uint8_t* row0,
+    const uint8_t* row1,
+    uint8_t* y0,
+    uint8_t* y1,
+    uint8_t* u,
+    uint8_t* v,
+    size_t width) {
+  size_t x = 0;
+  for (; x + 64 <= width; x += 64) {
+    const auto* s0 = reinterpret_cast<const __m256i*>(row0 + x * 2);
+    const auto* s1 = reinterpret_cast<const __m256i*>(row1 + x * 2);
+    const __m256i a0 = _mm256_loadu_si256(s0 + 0);
+    const __m256i a1 = _mm256_loadu_si256(s0 + 1);
+    const __m256i a2 = _mm256_loadu_si256(s0 + 2);
+    const __m256i a3 = _mm256_loadu_si256(s0 + 3);
+    const __m256i b0 = _mm256_loadu_si256(s1 + 0);
+    const __m256i b1 = _mm256_loadu_si256(s1 + 1);
+    const __m256i b2 = _mm256_loadu_si256(s1 + 2);
+    const __m256i b3 = _mm256_loadu_si256(s1 + 3);
+
+    _mm256_storeu_si256(reinterpret_cast<__m256i*>(y0 + x), luma_avx2(a0, a1));
+    _mm256_storeu_si256(reinterpret_cast<__m256i*>(y0 + x + 32),
+                        luma_avx2(a2, a3));
+    _mm256_storeu_si256(reinterpret_cast<__m256i*>(y1 + x), luma_avx2(b0, b1));
+    _mm256_storeu_si256(reinterpret_cast<__m256i*>(y1 + x + 32),
+                        luma_avx2(b2, b3));
+
+    const __m256i uv01 =
+        _mm256_avg_epu8(chroma_avx2(a0, a1), chroma_avx2(b0, b1));
+    const __m256i uv23 =
+        _mm256_avg_epu8(chroma_avx2(a2, a3), chroma_avx2(b2, b3));
+    _mm256_storeu_si256(reinterpret_cast<__m256i*>(u + x / 2),
+                        luma_avx2(uv01, uv23));
+    _mm256_storeu_si256(reinterpret_cast<__m256i*>(v + x / 2),
+                        chroma_avx2(uv01, uv23));
+  }
+  yuyv_rows_to_i420_sse2(row0 + x * 2, row1 + x * 2, y0 + x, y1 + x, u + x / 2,
+                         v + x / 2, width - x);
+}
+
+__attribute__((target("avx2"))) void yuyv_rows_to_nv12_avx2(
+    const uint8_t* row0,
+    const uint8_t* row1,
+    uint8_t* y0,
+    uint8_t* y1,
+    uint8_t* uv,
+    size_t width) {
+  size_t x = 0;
+  for (; x + 32 <= width; x += 32) {
+    const auto* s0 = reinterpret_cast<const __m256i*>(row0 + x * 2);
+    const auto* s1 = reinterpret_cast<const __m256i*>(row1 + x * 2);
+    const __m256i a0 = _mm256_loadu_si256(s0 + 0);
+    const __m256i a1 = _mm256_loadu_si256(s0 + 1);
+    const __m256i b0 = _mm256_loadu_si256(s1 + 0);
+    const __m256i b1 = _mm256_loadu_si256(s1 + 1);
+
+    _mm256_storeu_si256(reinterpret_cast<__m256i*>(y0 + x), luma_avx2(a0, a1));
+    _mm256_storeu_si256(reinterpret_cast<__m256i*>(y1 + x), luma_avx2(b0, b1));
+    _mm256_storeu_si256(reinterpret_cast<__m256i*>(uv + x),
+                        _mm256_avg_epu8(chroma_avx2(a0, a1),
+                                        chroma_avx2(b0, b1)));
+  }
+  yuyv_rows_to_nv12_sse2(row0 + x * 2, row1 + x * 2, y0 + x, y1 + x, uv + x,
+                         width - x);
+}
+
+// Same with 512-bit packus, which interleaves four lanes.
+__attribute__((target("avx512f,avx512bw"))) inline __m512i luma_avx512(
+    __m512i a,
+    __m512i b) {
+  const __m512i mask = _mm512_set1_epi16(0x00FF);
+  return _mm512_permutexvar_epi64(
+      _mm512_set_epi64(7, 5, 3, 1, 6, 4, 2, 0),
+      _mm512_packus_epi16(_mm512_and_si512(a, mask),
+                          _mm512_and_si512(b, mask)));
+}
+
+__attribute__((target("avx512f,avx512bw"))) inline __m512i chroma_avx512(
+    __m512i a,
+    __m512i b) {
+  return _mm512_permutexvar_epi64(
+      _mm512_set_epi64(7, 5, 3, 1, 6, 4, 2, 0),
+      _mm512_packus_epi16(_mm512_srli_epi16(a, 8), _mm512_srli_epi16(b, 8)));
+}
+
+__attribute__((target("avx512f,avx512bw"))) void yuyv_rows_to_i420_avx512(
+    const uint8_t* row0,
+    const uint8_t* row1,
+    uint8_t* y0,
+    uint8_t* y1,
+    uint8_t* u,
+    uint8_t* v,
+    size_t width) {
+  size_t x = 0;
+  for (; x + 128 <= width; x += 128) {
+    const uint8_t* s0 = row0 + x * 2;
+    const uint8_t* s1 = row1 + x * 2;
+    const __m512i a0 = _mm512_loadu_si512(s0 + 0);
+    const __m512i a1 = _mm512_loadu_si512(s0 + 64);
+    const __m512i a2 = _mm512_loadu_si512(s0 + 128);
+    const __m512i a3 = _mm512_loadu_si512(s0 + 192);
+    const __m512i b0 = _mm512_loadu_si512(s1 + 0);
+    const __m512i b1 = _mm512_loadu_si512(s1 + 64);
+    const __m512i b2 = _mm512_loadu_si512(s1 + 128);
+    const __m512i b3 = _mm512_loadu_si512(s1 + 192);
+
+    _mm512_storeu_si512(y0 + x, luma_avx512(a0, a1));
+    _mm512_storeu_si512(y0 + x + 64, luma_avx512(a2, a3));
+    _mm512_storeu_si512(y1 + x, luma_avx512(b0, b1));
+    _mm512_storeu_si512(y1 + x + 64, luma_avx512(b2, b3));
+
+    const __m512i uv01 =
+        _mm512_avg_epu8(chroma_avx512(a0, a1), chroma_avx512(b0, b1));
+    const __m512i uv23 =
+        _mm512_avg_epu8(chroma_avx512(a2, a3), chroma_avx512(b2, b3));
+    _mm512_storeu_si512(u + x / 2, luma_avx512(uv01, uv23));
+    _mm512_storeu_si512(v + x / 2, chroma_avx512(uv01, uv23));
+  }
+  yuyv_rows_to_i420_avx2(row0 + x * 2, row1 + x * 2, y0 + x, y1 + x, u + x / 2,
+                         v + x / 2, width - x);
+}
+
+__attribute__((target("avx512f,avx512bw"))) void yuyv_rows_to_nv12_avx512(
+    const uint8_t* row0,
+    const uint8_t* row1,
+    uint8_t* y0,
+    uint8_t* y1,
+    uint8_t* uv,
+    size_t width) {
+  size_t x = 0;
+  for (; x + 64 <= width; x += 64) {
+    const uint8_t* s0 = row0 + x * 2;
+    const uint8_t* s1 = row1 + x * 2;
+    const __m512i a0 = _mm512_loadu_si512(s0 + 0);
+    const __m512i a1 = _mm512_loadu_si512(s0 + 64);
+    const __m512i b0 = _mm512_loadu_si512(s1 + 0);
+    const __m512i b1 = _mm512_loadu_si512(s1 + 64);
+
+    _mm512_storeu_si512(y0 + x, luma_avx512(a0, a1));
+    _mm512_storeu_si512(y1 + x, luma_avx512(b0, b1));
+    _mm512_storeu_si512(uv + x,
+                        _mm512_avg_epu8(chroma_avx512(a0, a1),
+                                        chroma_avx512(b0, b1)));
+  }
+  yuyv_rows_to_nv12_avx2(row0 + x * 2, row1 + x * 2, y0 + x, y1 + x, uv + x,
+                         width - x);
+}
+#endif
+
+// Halving kernels average a pair of rows into one of `width` pixels: each is
+// the average of the two rows, rounded up, of a pair of pixels, averaged
+// again. Bytes of a pixel of NV12 chroma are a UV pair. Vector kernels average
+// the rows first, then split even and odd pixels like YUYV above.
+using HalveRowsFn = void (*)(const uint8_t* row0,
+                             const uint8_t* row1,
+                             uint8_t* dst,
+                             size_t width);
+
+void halve_rows_scalar(const uint8_t* row0,
+                       const uint8_t* row1,
+                       uint8_t* dst,
+                       size_t width) {
+  for (size_t x = 0; x < width; ++x) {
+    dst[x] = average(average(row0[x * 2], row1[x * 2]),
+                     average(row0[x * 2 + 1], row1[x * 2 + 1]));
+  }
+}
+
+// `width` in bytes, two per UV pair.
+void halve_uv_rows_scalar(const uint8_t* row0,
+                          const uint8_t* row1,
+                          uint8_t* dst,
+                          size_t width) {
+  for (size_t x = 0; x < width; ++x) {
+    const size_t i = (x & ~size_t{1}) * 2 + (x & 1);
+    dst[x] = average(average(row0[i], row1[i]),
+                     average(row0[i + 2], row1[i + 2]));
+  }
+}
+
+#ifdef NS_CONVERT_X86
+// Even 16-bit words of `a` then of `b`, UV pairs out of NV12 chroma. Words
+// are sign extended first so that signed packs does not saturate them.
+__attribute__((target("sse2"))) inline __m128i even_words_sse2(__m128i a,
+                                                              __m128i b) {
+  return _mm_packs_epi32(_mm_srai_epi32(_mm_slli_epi32(a, 16), 16),
+                         _mm_srai_epi32(_mm_slli_epi32(b, 16), 16));
+}
+
+__attribute__((target("sse2"))) inline __m128i odd_words_sse2(__m128i a,
+                                                             __m128i b) {
+  return _mm_packs_epi32(_mm_srai_epi32(a, 16), _mm_srai_epi32(b, 16));
+}
+
+__attribute__((target("sse2"))) void halve_rows_sse2(const uint8_t* row0,
+                                                     const uint8_t* row1,
+                                                     uint8_t* dst,
+                                                     size_t width) {
+  size_t x = 0;
+  for (; x + 16 <= width; x += 16) {
+    const auto* s0 = reinterpret_cast<const __m128i*>(row0 + x * 2);
+    const auto* s1 = reinterpret_cast<const __m128i*>(row1 + x * 2);
+    const __m128i a =
+        _mm_avg_epu8(_mm_loadu_si128(s0 + 0), _mm_loadu_si128(s1 + 0));
+    const __m128i b =
+        _mm_avg_epu8(_mm_loadu_si128(s0 + 1), _mm_loadu_si128(s1 + 1));
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + x),
+                     _mm_avg_epu8(luma_sse2(a, b), chroma_sse2(a, b)));
+  }
+  halve_rows_scalar(row0 + x * 2, row1 + x * 2, dst + x, width - x);
+}
+
+__attribute__((target("sse2"))) void halve_uv_rows_sse2(const uint8_t* row0,
+                                                        const uint8_t* row1,
+                                                        uint8_t* dst,
+                                                        size_t width) {
+  size_t x = 0;
+  for (; x + 16 <= width; x += 16) {
+    const auto* s0 = reinterpret_cast<const __m128i*>(row0 + x * 2);
+    const auto* s1 = reinterpret_cast<const __m128i*>(row1 + x * 2);
+    const __m128i a =
+        _mm_avg_epu8(_mm_loadu_si128(s0 + 0), _mm_loadu_si128(s1 + 0));
+    const __m128i b =
+        _mm_avg_epu8(_mm_loadu_si128(s0 + 1), _mm_loadu_si128(s1 + 1));
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + x),
+                     _mm_avg_epu8(even_words_sse2(a, b), odd_words_sse2(a, b)));
+  }
+  halve_uv_rows_scalar(row0 + x * 2, row1 + x * 2, dst + x, width - x);
+}
+
+__attribute__((target("avx2"))) inline __m256i even_words_avx2(__m256i a,
+                                                              __m256i b) {
+  return _mm256_permute4x64_epi64(
+      _mm256_packs_epi32(_mm256_srai_epi32(_mm256_slli_epi32(a, 16), 16),
+                         _mm256_srai_epi32(_mm256_slli_epi32(b, 16), 16)),
+      0xD8);
+}
+
+__attribute__((target("avx2"))) inline __m256i odd_words_avx2(__m256i a,
+                                                             __m256i b) {
+  return _mm256_permute4x64_epi64(
+      _mm256_packs_epi32(_mm256_srai_epi32(a, 16), _mm256_srai_epi32(b, 16)),
+      0xD8);
+}
+
+__attribute__((target("avx2"))) void halve_rows_avx2(const uint8_t* row0,
+                                                     const uint8_t* row1,
+                                                     uint8_t* dst,
+                                                     size_t width) {
+  size_t x = 0;
+  for (; x + 32 <= width; x += 32) {
+    const auto* s0 = reinterpret_cast<const __m256i*>(row0 + x * 2);
+    const auto* s1 = reinterpret_cast<const __m256i*>(row1 + x * 2);
+    const __m256i a = _mm256_avg_epu8(_mm256_loadu_si256(s0 + 0),
+                                      _mm256_loadu_si256(s1 + 0));
+    const __m256i b = _mm256_avg_epu8(_mm256_loadu_si256(s0 + 1),
+                                      _mm256_loadu_si256(s1 + 1));
+    _mm256_storeu_si256(reinterpret_cast<__m256i*>(dst + x),
+                        _mm256_avg_epu8(luma_avx2(a, b), chroma_avx2(a, b)));
+  }
+  halve_rows_sse2(row0 + x * 2, row1 + x * 2, dst + x, width - x);
+}
+
+__attribute__((target("avx2"))) void halve_uv_rows_avx2(const uint8_t* row0,
+                                                        const uint8_t* row1,
+                                                        uint8_t* dst,
+                                                        size_t width) {
+  size_t x = 0;
+  for (; x + 32 <= width; x += 32) {
+    const auto* s0 = reinterpret_cast<const __m256i*>(row0 + x * 2);
+    const auto* s1 = reinterpret_cast<const __m256i*>(row1 + x * 2);
+    const __m256i a = _mm256_avg_epu8(_mm256_loadu_si256(s0 + 0),
+                                      _mm256_loadu_si256(s1 + 0));
+    const __m256i b = _mm256_avg_epu8(_mm256_loadu_si256(s0 + 1),
+                                      _mm256_loadu_si256(s1 + 1));
+    _mm256_storeu_si256(
+        reinterpret_cast<__m256i*>(dst + x),
+        _mm256_avg_epu8(even_words_avx2(a, b), odd_words_avx2(a, b)));
+  }
+  halve_uv_rows_sse2(row0 + x * 2, row1 + x * 2, dst + x, width - x);
+}
+
+__attribute__((target("avx512f,avx512bw"))) inline __m512i even_words_avx512(
+    __m512i a,
+    __m512i b) {
+  return _mm512_permutexvar_epi64(
+      _mm512_set_epi64(7, 5, 3, 1, 6, 4, 2, 0),
+      _mm512_packs_epi32(_mm512_srai_epi32(_mm512_slli_epi32(a, 16), 16),
+                         _mm512_srai_epi32(_mm512_slli_epi32(b, 16), 16)));
+}
+
+__attribute__((target("avx512f,avx512bw"))) inline __m512i odd_words_avx512(
+    __m512i a,
+    __m512i b) {
+  return _mm512_permutexvar_epi64(
+      _mm512_set_epi64(7, 5, 3, 1, 6, 4, 2, 0),
+      _mm512_packs_epi32(_mm512_srai_epi32(a, 16), _mm512_srai_epi32(b, 16)));
+}
+
+__attribute__((target("avx512f,avx512bw"))) void halve_rows_avx512(
+    const uint8_t* row0,
+    const uint8_t* row1,
+    uint8_t* dst,
+    size_t width) {
+  size_t x = 0;
+  for (; x + 64 <= width; x += 64) {
+    const uint8_t* s0 = row0 + x * 2;
+    const uint8_t* s1 = row1 + x * 2;
+    const __m512i a = _mm512_avg_epu8(_mm512_loadu_si512(s0 + 0),
+                                      _mm512_loadu_si512(s1 + 0));
+    const __m512i b = _mm512_avg_epu8(_mm512_loadu_si512(s0 + 64),
+                                      _mm512_loadu_si512(s1 + 64));
+    _mm512_storeu_si512(
+        dst + x, _mm512_avg_epu8(luma_avx512(a, b), chroma_avx512(a, b)));
+  }
+  halve_rows_avx2(row0 + x * 2, row1 + x * 2, dst + x, width - x);
+}
+
+__attribute__((target("avx512f,avx512bw"))) void halve_uv_rows_avx512(
+    const uint8_t* row0,
+    const uint8_t* row1,
+    uint8_t* dst,
+    size_t width) {
+  size_t x = 0;
+  for (; x + 64 <= width; x += 64) {
+    const uint8_t* s0 = row0 + x * 2;
+    const uint8_t* s1 = row1 + x * 2;
+    const __m512i a = _mm512_avg_epu8(_mm512_loadu_si512(s0 + 0),
+                                      _mm512_loadu_si512(s1 + 0));
+    const __m512i b = _mm512_avg_epu8(_mm512_loadu_si512(s0 + 64),
+                                      _mm512_loadu_si512(s1 + 64));
+    _mm512_storeu_si512(dst + x, _mm512_avg_epu8(even_words_avx512(a, b),
+                                                 odd_words_avx512(a, b)));
+  }
+  halve_uv_rows_avx2(row0 + x * 2, row1 + x * 2, dst + x, width - x);
+}
+#endif
+
+SimdLevel detect_simd_level() {
+#ifdef NS_CONVERT_X86
+  __builtin_cpu_init();
+  if (__builtin_cpu_supports("avx512f") && __builtin_cpu_supports("avx512bw")) {
+    return SimdLevel::avx512;
+  }
+  if (__builtin_cpu_supports("avx2")) {
+    return SimdLevel::avx2;
+  }
+  if (__builtin_cpu_supports("sse2")) {
+    return SimdLevel::sse2;
+  }
+#endif
+  return SimdLevel::scalar;
+}
+
+const SimdLevel supported_simd_level = detect_simd_level();
+
+I420RowsFn i420_kernel(SimdLevel level) {
+  switch (level) {
+#ifdef NS_CONVERT_X86
+    case SimdLevel::avx512:
+      return yuyv_rows_to_i420_avx512;
+    case SimdLevel::avx2:
+      return yuyv_rows_to_i420_avx2;
+    case SimdLevel::sse2:
+      return yuyv_rows_to_i420_sse2;
+#endif
+    default:
+      return yuyv_rows_to_i420_scalar;
+  }
+}
+
+NV12RowsFn nv12_kernel(SimdLevel level) {
+  switch (level) {
+#ifdef NS_CONVERT_X86
+    case SimdLevel::avx512:
+      return yuyv_rows_to_nv12_avx512;
+    case SimdLevel::avx2:
+      return yuyv_rows_to_nv12_avx2;
+    case SimdLevel::sse2:
+      return yuyv_rows_to_nv12_sse2;
+#endif
+    default:
+      return yuyv_rows_to_nv12_scalar;
+  }
+}
+
+HalveRowsFn halve_kernel(SimdLevel level) {
+  switch (level) {
+#ifdef NS_CONVERT_X86
+    case SimdLevel::avx512:
+      return halve_rows_avx512;
+    case SimdLevel::avx2:
+      return halve_rows_avx2;
+    case SimdLevel::sse2:
+      return halve_rows_sse2;
+#endif
+    default:
+      return halve_rows_scalar;
+  }
+}
+
+HalveRowsFn halve_uv_kernel(SimdLevel level) {
+  switch (level) {
+#ifdef NS_CONVERT_X86
+    case SimdLevel::avx512:
+      return halve_uv_rows_avx512;
+    case SimdLevel::avx2:
+      return halve_uv_rows_avx2;
+    case SimdLevel::sse2:
+      return halve_uv_rows_sse2;
+#endif
+    default:
+      return halve_uv_rows_scalar;
+  }
+}
+
+// `width` x `height` plane of `src` into the half as wide and high one of
+// `dst`, width in bytes.
+void halve_plane(const uint8_t* src,
+                 size_t width,
+                 size_t height,
+                 uint8_t* dst,
+                 HalveRowsFn kernel) {
+  for (size_t row = 0; row + 1 < height; row += 2) {
+    const uint8_t* row0 = src + row * width;
+    kernel(row0, row0 + width, dst + row / 2 * (width / 2), width / 2);
+  }
+}
+
+HdrHistogram& convert_time() {
+  static HdrHistogram& instance = metrics().histogram(
+      "ns_convert_time_microseconds",
+      "Time to convert a captured frame for the encoder.");
+  return instance;
+}
+
+HdrHistogram& downscale_time() {
+  static HdrHistogram& instance = metrics().histogram(
+      "ns_downscale_time_microseconds",
+      "Time to halve a frame for an encoder of lower resolution.");
+  return instance;
+}
+}  // namespace
+
+std::string to_string(SimdLevel v) {
+  switch (v) {
+    case SimdLevel::scalar:
+      return "scalar";
+    case SimdLevel::sse2:
+      return "sse2";
+    case SimdLevel::avx2:
+      return "avx2";
+    case SimdLevel::avx512:
+      return "avx512";
+  }
+  return "unknown";
+}
+
+SimdLevel simd_level() {
+  return supported_simd_level;
+}
+
+std::error_code convert_yuyv(std::span<const uint8_t> src,
+                             uint32_t width,
+                             uint32_t height,
+                             PixelFormat to,
+                             std::span<uint8_t> dst,
+                             SimdLevel level) {
+  if (width % 2 ||
+      (to != PixelFormat::YUV420_planar && to != PixelFormat::NV12)) {
+    return make_error_code(std::errc::invalid_argument);
+  }
+  if (src.size() < frame_size(PixelFormat::YUV422_packed, width, height) ||
+      dst.size() < frame_size(to, width, height)) {
+    return make_error_code(std::errc::message_size);
+  }
+  level = std::min(level, supported_simd_level);
+
+  const size_t src_stride = size_t{width} * 2;
+  uint8_t* y = dst.data();
+  uint8_t* chroma = y + size_t{width} * height;
+  for (uint32_t row = 0; row < height; row += 2) {
+    const uint8_t* row0 = src.data() + row * src_stride;
+    const bool last = row + 1 == height;
+    const uint8_t* row1 = last ? row0 : row0 + src_stride;
+    uint8_t* y0 = y + size_t{row} * width;
+    uint8_t* y1 = last ? y0 : y0 + width;
+    if (to == PixelFormat::NV12) {
+      nv12_kernel(level)(row0, row1, y0, y1, chroma + size_t{row / 2} * width,
+                         width);
+    } else {
+      const size_t chroma_plane = size_t{width / 2} * ((height + 1) / 2);
+      uint8_t* u = chroma + size_t{row / 2} * (width / 2);
+      i420_kernel(level)(row0, row1, y0, y1, u, u + chroma_plane, width);
+    }
+  }
+  return {};
+}
+
+std::error_code halve_420(std::span<const uint8_t> src,
+                          uint32_t width,
+                          uint32_t height,
+                          PixelFormat format,
+                          std::span<uint8_t> dst,
+                          SimdLevel level) {
+  if (width % 4 || height % 4 ||
+      (format != PixelFormat::YUV420_planar && format != PixelFormat::NV12)) {
+    return make_error_code(std::errc::invalid_argument);
+  }
+  if (src.size() < frame_size(format, width, height) ||
+      dst.size() < frame_size(format, width / 2, height / 2)) {
+    return make_error_code(std::errc::message_size);
+  }
+  level = std::min(level, supported_simd_level);
+
+  const size_t luma = size_t{width} * height;
+  const HalveRowsFn kernel = halve_kernel(level);
+  halve_plane(src.data(), width, height, dst.data(), kernel);
+  if (format == PixelFormat::NV12) {
+    halve_plane(src.data() + luma, width, height / 2, dst.data() + luma / 4,
+                halve_uv_kernel(level));
+  } else {
+    const size_t chroma_plane = luma / 4;
+    for (size_t plane = 0; plane < 2; ++plane) {
+      halve_plane(src.data() + luma + plane * chroma_plane, width / 2,
+                  height / 2, dst.data() + (luma + plane * chroma_plane) / 4,
+                  kernel);
+    }
+  }
+  return {};
+}
+
+FrameConverter::FrameConverter(PixelFormat to,
+                               uint32_t width,
+                               uint32_t height,
+                               size_t buffers_count)
+    : m_to(to), m_width(width), m_height(height), m_buffers(buffers_count) {
+  for (auto& buffer : m_buffers) {
+    buffer.data.resize(frame_size(to, width, height));
+  }
+}
+
+FrameLease FrameConverter::convert(const FrameLease& frame) {
+  std::optional<size_t> slot;
+  {
+    std::lock_guard lock(m_lock);
+    const auto it = std::find_if(m_buffers.begin(), m_buffers.end(),
+                                 [](const Buffer& b) { return !b.leased; });
+    if (it == m_buffers.end()) {
+      LOG_WARNING("All {} conversion buffers are leased out", m_buffers.size());
+      return {};
+    }
+    it->leased = true;
+    slot = it - m_buffers.begin();
+  }
+
+  // Not touched by anybody else while leased.
+  auto& data = m_buffers[*slot].data;
+  const auto start = std::chrono::steady_clock::now();
+  if (const auto ec =
+          convert_yuyv(frame.data(), m_width, m_height, m_to, data)) {
+    LOG_ERROR("Failed converting {} bytes frame: {}", frame.data().size(),
+              ec.message());
+    return_frame(*slot);
+    return {};
+  }
+  convert_time().record(static_cast<uint64_t>(
+      std::chrono::duration_cast<std::chrono::microseconds>(
+          std::chrono::steady_clock::now() - start)
+          .count()));
+  return FrameLease{data, frame.meta(), this, *slot};
+}
+
+void FrameConverter::return_frame(size_t slot) {
+  std::lock_guard lock(m_lock);
+  m_buffers[slot].leased = false;
+}
+
+FrameDownscaler::FrameDownscaler(PixelFormat format,
+                                 uint32_t width,
+                                 uint32_t height,
+                                 size_t buffers_count)
+    : m_format(format),
+      m_width(width),
+      m_height(height),
+      m_buffers(buffers_count) {
+  for (auto& buffer : m_buffers) {
+    buffer.data.resize(frame_size(format, width / 2, height / 2));
+  }
+}
+
+FrameLease FrameDownscaler::downscale(const FrameLease& frame) {
+  std::optional<size_t> slot;
+  {
+    std::lock_guard lock(m_lock);
+    const auto it = std::find_if(m_buffers.begin(), m_buffers.end(),
+                                 [](const Buffer& b) { return !b.leased; });
+    if (it == m_buffers.end()) {
+      LOG_WARNING("All {} downscaling buffers are leased out",
+                  m_buffers.size());
+      return {};
+    }
+    it->leased = true;
+    slot = it - m_buffers.begin();
+  }
+
+  auto& data = m_buffers[*slot].data;
+  const auto start = std::chrono::steady_clock::now();
+  if (const auto ec =
+          halve_420(frame.data(), m_width, m_height, m_format, data)) {
+    LOG_ERROR("Failed halving {} bytes frame: {}", frame.data().size(),
+              ec.message());
+    return_frame(*slot);
+    return {};
+  }
+  downscale_time().record(static_cast<uint64_t>(
+      std::chrono::duration_cast<std::chrono::microseconds>(
+          std::chrono::steady_clock::now() - start)
+          .count()));
+  return FrameLease{data, frame.meta(), this, *slot};
+}
+
+void FrameDownscaler::return_frame(size_t slot) {
+  std::lock_guard lock(m_lock);
+  m_buffers[slot].leased = false;
+}
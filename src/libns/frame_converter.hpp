@@ -0,0 +1,106 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <span>
+#include <string>
+#include <system_error>
+#include <vector>
+
+#include "frame_mailbox.hpp"
+#include "types.hpp"
+
+// Instruction sets conversions below may use, narrowest first.
+enum class SimdLevel { scalar, sse2, avx2, avx512 };
+
+std::string to_string(SimdLevel v);
+
+// Widest one the CPU supports.
+SimdLevel simd_level();
+
+// Converts `width` x `height` packed YUYV 4:2:2 frame into I420 or NV12 one in
+// `dst`, both without row padding. Chroma of each pair of rows is their
+// average rounded up, of the odd last row it is the row's own. Results are the
+// same with any SIMD level, `level` above simd_level() is lowered to it.
+std::error_code convert_yuyv(std::span<const uint8_t> src,
+                             uint32_t width,
+                             uint32_t height,
+                             PixelFormat to,
+                             std::span<uint8_t> dst,
+                             SimdLevel level = simd_level());
+
+// Scales `width` x `height` 4:2:0 frame of `format`, I420 or NV12, down to
+// half the width and height into `dst`, both without row padding. Each pixel
+// is the average of the 2x2 ones it replaces: of the pairs of rows rounded up,
+// then of the pair of columns rounded up. Width and height must be multiples
+// of 4, for chroma to halve too. Results are the same with any SIMD level.
+std::error_code halve_420(std::span<const uint8_t> src,
+                          uint32_t width,
+                          uint32_t height,
+                          PixelFormat format,
+                          std::span<uint8_t> dst,
+                          SimdLevel level = simd_level());
+
+// Converts captured YUYV frames into 4:2:0 ones, which are cheaper to encode
+// and to decode than 4:2:2. Converted frames are lent out of a few buffers of
+// its own, the converter must outlive them.
+class FrameConverter : public FrameLender {
+ public:
+  // `to` is YUV420_planar or NV12.
+  FrameConverter(PixelFormat to,
+                 uint32_t width,
+                 uint32_t height,
+                 size_t buffers_count = 2);
+
+  // Converted `frame` with the same metadata. Empty if the frame is not of
+  // the expected size or all buffers are leased out. `frame` is not needed
+  // once it returns and may be released right away.
+  FrameLease convert(const FrameLease& frame);
+
+  virtual void return_frame(size_t slot) override;
+
+ private:
+  struct Buffer {
+    std::vector<uint8_t> data;
+    bool leased{};
+  };
+
+  PixelFormat m_to;
+  uint32_t m_width;
+  uint32_t m_height;
+  std::mutex m_lock;
+  std::vector<Buffer> m_buffers;
+};
+
+// Halves 4:2:0 frames for encoders of lower resolution. Halved frames are lent
+// out of a few buffers of its own like those of FrameConverter.
+class FrameDownscaler : public FrameLender {
+ public:
+  // Of the frames to halve, see halve_420().
+  FrameDownscaler(PixelFormat format,
+                  uint32_t width,
+                  uint32_t height,
+                  size_t buffers_count = 2);
+
+  uint32_t width() const { return m_width / 2; }
+  uint32_t height() const { return m_height / 2; }
+
+  // Halved `frame` with the same metadata. Empty if the frame is not of the
+  // expected size or all buffers are leased out.
+  FrameLease downscale(const FrameLease& frame);
+
+  virtual void return_frame(size_t slot) override;
+
+ private:
+  struct Buffer {
+    std::vector<uint8_t> data;
+    bool leased{};
+  };
+
+  PixelFormat m_format;
+  uint32_t m_width;
+  uint32_t m_height;
+  std::mutex m_lock;
+  std::vector<Buffer> m_buffers;
+};
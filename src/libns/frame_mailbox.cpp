@@ -0,0 +1,110 @@
+#include "frame_mailbox.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <utility>
+
+#include "log.hpp"
+#include "metrics.hpp"
+
+LOG_MODULE_NAME("MAILBOX");
+
+namespace {
+struct MailboxMetrics {
+  Counter& frames_dropped = metrics().counter(
+      "ns_capture_frames_dropped_total",
+      "Captured frames replaced by newer ones before the encoder took them.");
+  HdrHistogram& frame_age = metrics().histogram(
+      "ns_capture_frame_age_us",
+      "Time from capture till the encoder took the frame, in microseconds.");
+};
+
+MailboxMetrics& mailbox_metrics() {
+  static MailboxMetrics instance;
+  return instance;
+}
+}  // namespace
+
+FrameLease::FrameLease(FrameLease&& other) noexcept
+    : m_data(std::exchange(other.m_data, {})),
+      m_meta(other.m_meta),
+      m_lender(std::exchange(other.m_lender, nullptr)),
+      m_slot(other.m_slot),
+      m_dmabuf_fd(std::exchange(other.m_dmabuf_fd, -1)) {}
+
+FrameLease& FrameLease::operator=(FrameLease&& other) noexcept {
+  if (this != &other) {
+    release();
+    m_data = std::exchange(other.m_data, {});
+    m_meta = other.m_meta;
+    m_lender = std::exchange(other.m_lender, nullptr);
+    m_slot = other.m_slot;
+    m_dmabuf_fd = std::exchange(other.m_dmabuf_fd, -1);
+  }
+  return *this;
+}
+
+FrameLease::~FrameLease() {
+  release();
+}
+
+void FrameLease::release() {
+  m_data = {};
+  m_dmabuf_fd = -1;
+  if (auto lender = std::exchange(m_lender, nullptr)) {
+    lender->return_frame(m_slot);
+  }
+}
+
+FrameMailbox::FrameMailbox() = default;
+FrameMailbox::~FrameMailbox() = default;
+
+void FrameMailbox::put(FrameLease frame) {
+  {
+    std::lock_guard lock(m_lock);
+    if (!m_closed) {
+      if (m_frame) {
+        m_dropped++;
+        mailbox_metrics().frames_dropped.add();
+        LOG_DEBUG("Dropped frame {}, encoder is late",
+                  m_frame.meta().frame_id);
+      }
+      std::swap(m_frame, frame);
+    }
+  }
+  // Whatever is left: giving the buffer back to the capture may take a
+  // syscall, not under the lock.
+  frame.release();
+  m_put.notify_one();
+}
+
+FrameLease FrameMailbox::take(std::stop_token stoken) {
+  FrameLease frame;
+  {
+    std::unique_lock lock(m_lock);
+    if (!m_put.wait(lock, stoken, [this] { return m_closed || m_frame; }) ||
+        m_closed) {
+      return {};
+    }
+    frame = std::move(m_frame);
+  }
+  const auto age = std::chrono::duration_cast<std::chrono::microseconds>(
+      std::chrono::steady_clock::now() - frame.meta().timestamp);
+  mailbox_metrics().frame_age.record(std::max<int64_t>(age.count(), 0));
+  return frame;
+}
+
+void FrameMailbox::close() {
+  FrameLease left;
+  {
+    std::lock_guard lock(m_lock);
+    m_closed = true;
+    left = std::move(m_frame);
+  }
+  m_put.notify_all();
+}
+
+uint64_t FrameMailbox::dropped() const {
+  std::lock_guard lock(m_lock);
+  return m_dropped;
+}
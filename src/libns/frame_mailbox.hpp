@@ -0,0 +1,88 @@
+#pragma once
+
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <span>
+#include <stop_token>
+
+#include "types.hpp"
+
+// Whoever owns the buffers of FrameLease: a video capture.
+class FrameLender {
+ public:
+  virtual ~FrameLender() = default;
+
+  // Takes buffer `slot` back. Called on the thread releasing the lease.
+  virtual void return_frame(size_t slot) = 0;
+};
+
+// Captured frame on loan from the capture that produced it. The capture does
+// not reuse the buffer till the lease is released or destroyed, on whatever
+// thread. Leases must not outlive their capture.
+class FrameLease {
+ public:
+  FrameLease() = default;
+  // Without a lender there is nothing to give back when released.
+  FrameLease(std::span<uint8_t> data,
+             CapturedFrameMeta meta,
+             FrameLender* lender = nullptr,
+             size_t slot = 0,
+             int dmabuf_fd = -1)
+      : m_data(data),
+        m_meta(meta),
+        m_lender(lender),
+        m_slot(slot),
+        m_dmabuf_fd(dmabuf_fd) {}
+  FrameLease(FrameLease&& other) noexcept;
+  FrameLease& operator=(FrameLease&& other) noexcept;
+  ~FrameLease();
+
+  explicit operator bool() const { return m_data.data() != nullptr; }
+
+  // NOTE: non-const for the same reason as Encoder::process_frame().
+  std::span<uint8_t> data() const { return m_data; }
+  const CapturedFrameMeta& meta() const { return m_meta; }
+  // DMABUF of the buffer, for importing it into a device without copying, or
+  // -1. Owned by the capture, valid as long as it.
+  int dmabuf_fd() const { return m_dmabuf_fd; }
+
+  void release();
+
+ private:
+  std::span<uint8_t> m_data;
+  CapturedFrameMeta m_meta;
+  FrameLender* m_lender{};
+  size_t m_slot{};
+  int m_dmabuf_fd{-1};
+};
+
+// Hands frames over from the capture thread to the encoder thread. Holds a
+// single frame: a newer one replaces it, releasing the older one, so the
+// encoder always gets the latest frame and the capture never waits for it. An
+// encode that takes too long costs dropped frames rather than latency.
+class FrameMailbox {
+ public:
+  FrameMailbox();
+  ~FrameMailbox();
+
+  // Replaces the frame not taken yet, if any. Drops the frame once closed.
+  void put(FrameLease frame);
+
+  // Waits for a frame. Returns empty lease once closed or stop is requested.
+  FrameLease take(std::stop_token stoken = {});
+
+  // Wakes up take(), the frame left is released.
+  void close();
+
+  // Frames replaced before they were taken.
+  uint64_t dropped() const;
+
+ private:
+  mutable std::mutex m_lock;
+  std::condition_variable_any m_put;
+  FrameLease m_frame;
+  bool m_closed{};
+  uint64_t m_dropped{};
+};
@@ -0,0 +1,154 @@
+#include "frame_trace.hpp"
+
+#include <algorithm>
+#include <cassert>
+#include <format>
+
+std::string to_string(TraceStage v) {
+  switch (v) {
+    case TraceStage::captured:
+      return "captured";
+    case TraceStage::encode_started:
+      return "encode_started";
+    case TraceStage::encoded:
+      return "encoded";
+    case TraceStage::sent:
+      return "sent";
+    case TraceStage::received:
+      return "received";
+    case TraceStage::decoded:
+      return "decoded";
+    case TraceStage::converted:
+      return "converted";
+    case TraceStage::rendered:
+      return "rendered";
+    default:
+      return "TraceStage::<unknown>";
+  }
+}
+
+std::string to_string(const TraceStageReport& v) {
+  auto ms = [](std::chrono::microseconds value) {
+    return static_cast<double>(value.count()) / 1000.0;
+  };
+  auto summary = [&](const LatencyHistogram& h) {
+    return std::format("{:.1f}/{:.1f}/{:.1f} ms", ms(h.percentile(50)),
+                       ms(h.percentile(99)), ms(h.max()));
+  };
+  auto result = std::format("{}: {} frames", to_string(v.stage),
+                            v.since_previous.count());
+  if (v.since_previous.count() > 0) {
+    result += ", +" + summary(v.since_previous);
+  }
+  if (v.since_capture.count() > 0) {
+    result += ", " + summary(v.since_capture) + " since capture";
+  }
+  return result;
+}
+
+void LatencyHistogram::add(std::chrono::microseconds value) {
+  m_buckets[HdrHistogram::bucket_index(
+      static_cast<uint64_t>(std::max<int64_t>(value.count(), 0)))]++;
+  m_count++;
+  m_sum += value;
+  m_max = std::max(m_max, value);
+}
+
+std::chrono::microseconds LatencyHistogram::mean() const {
+  if (m_count == 0) {
+    return {};
+  }
+  return m_sum / static_cast<int64_t>(m_count);
+}
+
+std::chrono::microseconds LatencyHistogram::percentile(double p) const {
+  if (m_count == 0) {
+    return {};
+  }
+  // Rank of the value, 1-based, at least the first one.
+  const auto rank = std::max<uint64_t>(
+      1, static_cast<uint64_t>(p / 100.0 * static_cast<double>(m_count) + 0.5));
+  uint64_t seen = 0;
+  for (size_t i = 0; i < m_buckets.size(); ++i) {
+    seen += m_buckets[i];
+    if (seen >= rank) {
+      // The last bucket has no upper bound.
+      if (i + 1 == m_buckets.size()) {
+        return m_max;
+      }
+      return std::min(std::chrono::microseconds{static_cast<int64_t>(
+                          HdrHistogram::bucket_upper_bound(i))},
+                      m_max);
+    }
+  }
+  return m_max;
+}
+
+FrameTracer::FrameTracer(size_t frames_in_flight) : m_frames(frames_in_flight) {
+  assert(frames_in_flight > 0);
+  for (size_t i = 0; i < m_stages.size(); ++i) {
+    m_stages[i].stage = static_cast<TraceStage>(i);
+  }
+}
+
+FrameTracer::Frame& FrameTracer::find_or_add(uint32_t frame_id) {
+  // A handful of frames, scanning them is cheaper than anything smarter.
+  Frame* oldest = &m_frames.front();
+  for (auto& frame : m_frames) {
+    if (frame.age != 0 && frame.id == frame_id) {
+      return frame;
+    }
+    if (frame.age < oldest->age) {
+      oldest = &frame;
+    }
+  }
+  *oldest = Frame{.id = frame_id, .age = m_next_age++};
+  return *oldest;
+}
+
+void FrameTracer::record(uint32_t frame_id,
+                         TraceStage stage,
+                         clock::time_point time) {
+  const auto index = static_cast<size_t>(stage);
+  assert(index < TraceStageCount);
+
+  std::lock_guard lock(m_lock);
+  auto& frame = find_or_add(frame_id);
+  if (frame.times[index]) {
+    return;
+  }
+  frame.times[index] = time;
+
+  auto& report = m_stages[index];
+  for (size_t previous = index; previous-- > 0;) {
+    if (frame.times[previous]) {
+      report.since_previous.add(
+          std::chrono::duration_cast<std::chrono::microseconds>(
+              time - *frame.times[previous]));
+      break;
+    }
+  }
+  const auto& captured = frame.times[static_cast<size_t>(TraceStage::captured)];
+  if (stage != TraceStage::captured && captured) {
+    report.since_capture.add(
+        std::chrono::duration_cast<std::chrono::microseconds>(time -
+                                                              *captured));
+  }
+}
+
+std::vector<TraceStageReport> FrameTracer::take_report() {
+  std::vector<TraceStageReport> result;
+  std::lock_guard lock(m_lock);
+  for (auto& stage : m_stages) {
+    if (stage.since_previous.count() > 0 || stage.since_capture.count() > 0) {
+      result.push_back(stage);
+    }
+    stage = TraceStageReport{.stage = stage.stage};
+  }
+  return result;
+}
+
+FrameTracer& frame_tracer() {
+  static FrameTracer instance;
+  return instance;
+}
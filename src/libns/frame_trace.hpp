@@ -0,0 +1,112 @@
+#pragma once
+
+#include <array>
+#include <chrono>
+#include <cstdint>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <vector>
+
+#include "metrics.hpp"
+
+// Where a frame is on its way from the camera to the screen. Stages of the
+// sender come first, then those of the receiver.
+enum class TraceStage : uint8_t {
+  // Dequeued from the capture device.
+  captured,
+  // Handed to the encoder.
+  encode_started,
+  // First NAL out of the encoder.
+  encoded,
+  // First packet handed to the socket, or to the pacer if there is one.
+  sent,
+  // First packet off the socket.
+  received,
+  // Out of the decoder.
+  decoded,
+  // Converted into something the screen can show.
+  converted,
+  // Painted.
+  rendered,
+  __count
+};
+
+constexpr size_t TraceStageCount = static_cast<size_t>(TraceStage::__count);
+
+std::string to_string(TraceStage v);
+
+// Distribution of latencies in microseconds, in buckets of HdrHistogram, so
+// percentiles are off by no more than 12.5% whatever the scale. Unlike
+// HdrHistogram it belongs to one thread and knows the largest value.
+class LatencyHistogram {
+ public:
+  void add(std::chrono::microseconds value);
+
+  uint64_t count() const { return m_count; }
+  std::chrono::microseconds mean() const;
+  std::chrono::microseconds max() const { return m_max; }
+  // Upper bound of the bucket the percentile `p` (0 to 100) falls into.
+  std::chrono::microseconds percentile(double p) const;
+
+ private:
+  std::array<uint32_t, HdrHistogram::BucketCount> m_buckets{};
+  uint64_t m_count{};
+  std::chrono::microseconds m_sum{};
+  std::chrono::microseconds m_max{};
+};
+
+struct TraceStageReport {
+  TraceStage stage{};
+  // From the closest earlier stage the frame was seen at.
+  LatencyHistogram since_previous;
+  // From capture, if the frame was seen captured. That is the glass-to-glass
+  // latency by the time the frame is rendered.
+  LatencyHistogram since_capture;
+};
+
+// One line for logs: frame count, p50/p99/max in milliseconds of both.
+std::string to_string(const TraceStageReport& v);
+
+// Follows frames by their ID (see frame_id() in types.hpp) through the stages
+// of the pipeline, on whatever threads they run. The first time a frame is seen
+// at a stage counts, later ones are ignored, so that stages working on packets
+// may record every one of them. Records of a frame get lost once more than
+// `frames_in_flight` newer ones are traced.
+class FrameTracer {
+ public:
+  using clock = std::chrono::steady_clock;
+
+  explicit FrameTracer(size_t frames_in_flight = 16);
+
+  void record(uint32_t frame_id,
+              TraceStage stage,
+              clock::time_point time = clock::now());
+
+  // Stages with anything recorded since the previous call, in order.
+  std::vector<TraceStageReport> take_report();
+
+ private:
+  struct Frame {
+    uint32_t id{};
+    uint64_t age{};
+    std::array<std::optional<clock::time_point>, TraceStageCount> times;
+  };
+
+  Frame& find_or_add(uint32_t frame_id);
+
+  std::mutex m_lock;
+  std::vector<Frame> m_frames;
+  uint64_t m_next_age{1};
+  std::array<TraceStageReport, TraceStageCount> m_stages;
+};
+
+// Of the whole process, reported by the applications.
+FrameTracer& frame_tracer();
+
+inline void trace_frame(
+    uint32_t frame_id,
+    TraceStage stage,
+    FrameTracer::clock::time_point time = FrameTracer::clock::now()) {
+  frame_tracer().record(frame_id, stage, time);
+}
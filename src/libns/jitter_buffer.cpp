@@ -0,0 +1,173 @@
+#include "jitter_buffer.hpp"
+#include "log.hpp"
+
+#include <algorithm>
+#include <bit>
+#include <cassert>
+#include <cmath>
+
+LOG_MODULE_NAME("JITTER");
+
+JitterBuffer::JitterBuffer(JitterBufferListener& listener,
+                           JitterBufferConfig config)
+    : m_listener(listener), m_config(config), m_jitter(config.clock_rate) {
+  // Power of two so that slot index is just a mask of extended sequence.
+  const size_t capacity = std::bit_ceil(std::max<size_t>(config.capacity, 2));
+  m_slots.resize(capacity);
+  m_mask = static_cast<int64_t>(capacity) - 1;
+  m_released.reserve(capacity);
+}
+
+int64_t JitterBuffer::unwrap(uint16_t sequence_num) const {
+  if (m_highest < 0) {
+    return sequence_num;
+  }
+  // Closest extended number to the highest seen one with the same lower 16
+  // bits, so both forward jumps and reordering across wraparound work out.
+  const auto delta = static_cast<int16_t>(
+      static_cast<uint16_t>(sequence_num - static_cast<uint16_t>(m_highest)));
+  return m_highest + delta;
+}
+
+void JitterBuffer::insert(ReceivedPacket packet, clock::time_point now) {
+  const int64_t ext_seq = unwrap(packet.sequence_num);
+
+  if (m_highest < 0) {
+    m_head = ext_seq;
+  }
+
+  if (ext_seq < m_head) {
+    // Its frame has already been released.
+    m_stats.packets_late++;
+    LOG_DEBUG("Late packet {}, dropping", packet.sequence_num);
+    return;
+  }
+
+  const int64_t capacity = m_mask + 1;
+  while (ext_seq - m_head >= capacity && m_count > 0) {
+    // Not enough room, make it by giving up on the oldest frames.
+    release_head_frame(find_head_frame());
+  }
+  if (ext_seq - m_head >= capacity) {
+    // Nothing buffered and still too far ahead, most likely sender restart.
+    LOG_WARNING("Sequence number jumped from {} to {}, resynchronizing",
+                m_head, ext_seq);
+    m_head = ext_seq;
+  }
+
+  auto& s = slot(ext_seq);
+  if (s.occupied) {
+    m_stats.packets_duplicate++;
+    return;
+  }
+
+  m_jitter.on_packet(packet.nal_meta.timestamp, now);
+  m_stats.jitter = m_jitter.jitter();
+
+  s.occupied = true;
+  s.arrival = now;
+  s.packet = std::move(packet);
+  m_count++;
+  m_highest = std::max(m_highest, ext_seq);
+
+  poll(now);
+}
+
+void JitterBuffer::poll(clock::time_point now) {
+  while (m_count > 0) {
+    const auto frame = find_head_frame();
+    if (!frame.complete && now < frame.first_arrival + target_delay()) {
+      break;
+    }
+    release_head_frame(frame);
+  }
+}
+
+std::optional<JitterBuffer::clock::time_point> JitterBuffer::next_deadline()
+    const {
+  if (m_count == 0) {
+    return std::nullopt;
+  }
+  return find_head_frame().first_arrival + target_delay();
+}
+
+JitterBuffer::clock::duration JitterBuffer::target_delay() const {
+  const auto jitter = std::chrono::duration<double>(
+      m_config.jitter_multiplier * m_stats.jitter / m_config.clock_rate);
+  return std::clamp(std::chrono::duration_cast<clock::duration>(jitter),
+                    clock::duration{m_config.min_delay},
+                    clock::duration{m_config.max_delay});
+}
+
+JitterBufferStats JitterBuffer::stats() const {
+  auto s = m_stats;
+  s.target_delay = target_delay();
+  return s;
+}
+
+// Head frame spans from m_head up to (not including) the first packet with a
+// different timestamp, or up to and including a packet with the marker bit.
+JitterBuffer::HeadFrame JitterBuffer::find_head_frame() const {
+  assert(m_count > 0);
+
+  HeadFrame frame;
+  frame.first_arrival = clock::time_point::max();
+
+  std::optional<uint32_t> timestamp;
+  bool gaps = false;
+  bool end_known = false;
+
+  int64_t i = m_head;
+  for (; i <= m_highest; ++i) {
+    const auto& s = slot(i);
+    if (!s.occupied) {
+      gaps = true;
+      continue;
+    }
+    if (!timestamp) {
+      timestamp = s.packet.nal_meta.timestamp;
+    } else if (*timestamp != s.packet.nal_meta.timestamp) {
+      end_known = true;
+      break;
+    }
+    frame.first_arrival = std::min(frame.first_arrival, s.arrival);
+    if (s.packet.marker) {
+      end_known = true;
+      ++i;
+      break;
+    }
+  }
+
+  frame.end = i;
+  frame.complete = end_known && !gaps;
+  return frame;
+}
+
+void JitterBuffer::release_head_frame(const HeadFrame& frame) {
+  uint64_t missing = 0;
+  for (int64_t i = m_head; i < frame.end; ++i) {
+    auto& s = slot(i);
+    if (!s.occupied) {
+      missing++;
+      continue;
+    }
+    m_released.push_back(std::move(s.packet));
+    s.occupied = false;
+    m_count--;
+  }
+  m_head = frame.end;
+
+  m_stats.frames_released++;
+  if (!frame.complete) {
+    m_stats.frames_incomplete++;
+    m_stats.packets_lost += missing;
+    if (missing > 0) {
+      LOG_ERROR("Error, missed {} packet(s) before {}", missing, frame.end);
+    }
+  }
+
+  if (!m_released.empty()) {
+    m_listener.on_frame_released(m_released, frame.complete);
+  }
+  m_released.clear();
+}
@@ -0,0 +1,107 @@
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+#include <optional>
+#include <span>
+#include <vector>
+
+#include "rtp.hpp"
+#include "rtp_receive_statistics.hpp"
+#include "udp_receive.hpp"
+
+class JitterBufferListener {
+ public:
+  virtual ~JitterBufferListener() = default;
+
+  // Packets of one access unit (all packets sharing the RTP timestamp) in
+  // sequence number order. `complete` is false when the frame has been
+  // released on its deadline with some packets still missing.
+  virtual void on_frame_released(std::span<ReceivedPacket> packets,
+                                 bool complete) = 0;
+};
+
+struct JitterBufferConfig {
+  uint32_t clock_rate = RTP_VideoClockRate;
+  // Bounds of the target delay, i.e. how long incomplete frame is waited for.
+  std::chrono::milliseconds min_delay{5};
+  std::chrono::milliseconds max_delay{200};
+  // Target delay is this many times the measured interarrival jitter.
+  double jitter_multiplier = 3.0;
+  // Maximum distance in sequence numbers between the oldest and the newest
+  // buffered packet.
+  size_t capacity = 1024;
+};
+
+struct JitterBufferStats {
+  uint64_t frames_released{};
+  uint64_t frames_incomplete{};
+  uint64_t packets_lost{};
+  uint64_t packets_late{};
+  uint64_t packets_duplicate{};
+  // RFC 3550 interarrival jitter in RTP timestamp units.
+  double jitter{};
+  std::chrono::steady_clock::duration target_delay{};
+};
+
+// Orders packets by their 16-bit RTP sequence number and releases them frame
+// by frame. A frame is released as soon as it is known to be complete: there
+// are no gaps from the previous frame and either its last packet carries the
+// marker bit or the first packet of the next frame has arrived. Otherwise it
+// is held until the arrival of its first packet plus the target delay, which
+// follows the measured jitter.
+//
+// Not thread safe. Time is passed in explicitly, the owner is expected to call
+// poll() no later than next_deadline().
+class JitterBuffer {
+ public:
+  using clock = std::chrono::steady_clock;
+
+  explicit JitterBuffer(JitterBufferListener& listener,
+                        JitterBufferConfig config = {});
+
+  void insert(ReceivedPacket packet, clock::time_point now);
+
+  // Releases frames that are complete or whose deadline has passed.
+  void poll(clock::time_point now);
+
+  // Time of the next poll(), if there is anything buffered.
+  std::optional<clock::time_point> next_deadline() const;
+
+  clock::duration target_delay() const;
+  JitterBufferStats stats() const;
+
+ private:
+  struct Slot {
+    bool occupied{};
+    clock::time_point arrival;
+    ReceivedPacket packet;
+  };
+
+  struct HeadFrame {
+    int64_t end{};
+    bool complete{};
+    clock::time_point first_arrival;
+  };
+
+  Slot& slot(int64_t ext_seq) { return m_slots[ext_seq & m_mask]; }
+  const Slot& slot(int64_t ext_seq) const { return m_slots[ext_seq & m_mask]; }
+
+  int64_t unwrap(uint16_t sequence_num) const;
+  HeadFrame find_head_frame() const;
+  void release_head_frame(const HeadFrame& frame);
+
+  JitterBufferListener& m_listener;
+  JitterBufferConfig m_config;
+  std::vector<Slot> m_slots;
+  int64_t m_mask{};
+  // Extended sequence number of the next packet to be released.
+  int64_t m_head{};
+  // Extended sequence number of the newest packet seen so far.
+  int64_t m_highest{-1};
+  size_t m_count{};
+  std::vector<ReceivedPacket> m_released;
+
+  RTP_JitterEstimator m_jitter;
+  JitterBufferStats m_stats;
+};
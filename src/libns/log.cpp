@@ -1,11 +1,236 @@
 #include "log.hpp"
 
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
 namespace lsem_log_details {
-/*extern*/ std::mutex g_lock;
+namespace {
+// Per thread. Fits a couple thousand typical records.
+constexpr size_t RING_CAPACITY = 256 * 1024;
+// Background thread looks at the rings that often unless woken up earlier by
+// a warning or an error.
+constexpr auto DRAIN_INTERVAL = std::chrono::milliseconds{20};
+
+const char* label(LogLevel level) {
+  switch (level) {
+    case LogLevel::debug:
+      return "  DEBUG";
+    case LogLevel::info:
+      return "   INFO";
+    case LogLevel::warning:
+      return "WARNING";
+    case LogLevel::error:
+      return "ERROR ";
+    default:
+      return "LogLevel::<unknown>";
+  }
+}
+
+void append_line(std::string& out,
+                 LogLevel level,
+                 std::string_view module_,
+                 std::string_view message) {
+  out += label(level);
+  out += ": ";
+  if (module_.size() < MODULE_WIDTH) {
+    out.append(MODULE_WIDTH - module_.size(), ' ');
+  }
+  out += module_;
+  out += message;
+  out += '\n';
+}
+
+// Single producer (the thread that owns it), single consumer (whoever holds
+// the drain lock). Positions grow monotonically, records never straddle the
+// end of the buffer.
+class LogRing {
+ public:
+  LogRing() : m_buffer(new std::max_align_t[RING_CAPACITY / RECORD_ALIGN]) {}
+
+  void* reserve(size_t size) {
+    const size_t pos = m_write % RING_CAPACITY;
+    const size_t contiguous = RING_CAPACITY - pos;
+    const size_t skip = size > contiguous ? contiguous : 0;
+    if (m_write + skip + size - m_read.load(std::memory_order_acquire) >
+        RING_CAPACITY) {
+      m_dropped.fetch_add(1, std::memory_order_relaxed);
+      return nullptr;
+    }
+    if (skip > 0) {
+      if (skip >= RECORD_HEADER_SIZE) {
+        new (data() + pos) RecordHeader{};
+      }
+      m_write += skip;
+    }
+    void* record = data() + m_write % RING_CAPACITY;
+    m_write += size;
+    return record;
+  }
+
+  void commit() { m_committed.store(m_write, std::memory_order_release); }
+
+  // Formats everything committed so far into `out`.
+  void drain(std::string& out, std::string& message) {
+    size_t read = m_read.load(std::memory_order_relaxed);
+    const size_t committed = m_committed.load(std::memory_order_acquire);
+    while (read != committed) {
+      const size_t pos = read % RING_CAPACITY;
+      const size_t contiguous = RING_CAPACITY - pos;
+      auto* header = reinterpret_cast<RecordHeader*>(data() + pos);
+      if (contiguous < RECORD_HEADER_SIZE || !header->format) {
+        read += contiguous;
+        continue;
+      }
+      message.clear();
+      try {
+        header->format(header->fmt, data() + pos + RECORD_HEADER_SIZE,
+                       message);
+      } catch (const std::exception& e) {
+        message = std::string{"Bad log record '"} + std::string{header->fmt} +
+                  "': " + e.what();
+      }
+      append_line(out, header->level, *header->module, message);
+      read += header->size;
+    }
+    m_read.store(read, std::memory_order_release);
+
+    if (const auto dropped = m_dropped.exchange(0, std::memory_order_relaxed)) {
+      append_line(out, LogLevel::warning, "LOG: ",
+                  std::format("{} records dropped, ring is full", dropped));
+    }
+  }
+
+  void retire() { m_retired.store(true, std::memory_order_release); }
+  bool retired() const { return m_retired.load(std::memory_order_acquire); }
+
+ private:
+  std::byte* data() { return reinterpret_cast<std::byte*>(m_buffer.get()); }
+
+  std::unique_ptr<std::max_align_t[]> m_buffer;
+  // Producer only.
+  size_t m_write{};
+  alignas(64) std::atomic<size_t> m_committed{};
+  alignas(64) std::atomic<size_t> m_read{};
+  std::atomic<uint64_t> m_dropped{};
+  std::atomic<bool> m_retired{};
+};
+
+class LogBackend {
+ public:
+  LogBackend() : m_thread([this] { run(); }) {}
+
+  ~LogBackend() {
+    {
+      std::lock_guard lock(m_wake_lock);
+      m_stopped = true;
+    }
+    m_wake.notify_one();
+    m_thread.join();
+    drain();
+  }
+
+  std::shared_ptr<LogRing> add_ring() {
+    auto ring = std::make_shared<LogRing>();
+    std::lock_guard lock(m_rings_lock);
+    m_rings.push_back(ring);
+    return ring;
+  }
+
+  void wake() { m_wake.notify_one(); }
+
+  void drain() {
+    std::lock_guard drain_lock(m_drain_lock);
+    {
+      std::lock_guard lock(m_rings_lock);
+      m_draining = m_rings;
+    }
+    m_out.clear();
+    for (auto& ring : m_draining) {
+      // Nothing can be added to a retired ring, once drained it can go.
+      const bool retired = ring->retired();
+      ring->drain(m_out, m_message);
+      if (retired) {
+        std::lock_guard lock(m_rings_lock);
+        std::erase(m_rings, ring);
+      }
+    }
+    m_draining.clear();
+    if (!m_out.empty()) {
+      std::cout << m_out << std::flush;
+    }
+  }
+
+ private:
+  void run() {
+    std::unique_lock lock(m_wake_lock);
+    while (!m_stopped) {
+      lock.unlock();
+      drain();
+      lock.lock();
+      m_wake.wait_for(lock, DRAIN_INTERVAL);
+    }
+  }
+
+  std::mutex m_rings_lock;
+  std::vector<std::shared_ptr<LogRing>> m_rings;
+
+  // Held by whoever drains, the background thread or log_flush().
+  std::mutex m_drain_lock;
+  std::vector<std::shared_ptr<LogRing>> m_draining;
+  std::string m_out;
+  std::string m_message;
+
+  std::mutex m_wake_lock;
+  std::condition_variable m_wake;
+  bool m_stopped{};
+  std::thread m_thread;
+};
+
+// Outlives thread-local rings of the main thread, other threads are expected
+// to be done by the time static objects are destroyed.
+LogBackend& backend() {
+  static LogBackend instance;
+  return instance;
+}
+
+struct ThreadRing {
+  ThreadRing() : ring(backend().add_ring()) {}
+  ~ThreadRing() { ring->retire(); }
+
+  std::shared_ptr<LogRing> ring;
+};
+
+LogRing& this_thread_ring() {
+  thread_local ThreadRing instance;
+  return *instance.ring;
+}
+}  // namespace
 
 const std::string& get_module(const lsem_log_details::ModuleNameDefaultTag&) {
   static const std::string no_name;
   return no_name;
 }
 
+void* reserve_record(size_t size) {
+  return this_thread_ring().reserve(size);
+}
+
+void commit_record(LogLevel level) {
+  this_thread_ring().commit();
+  if (level >= LogLevel::warning) {
+    // Do not let problems sit in the ring.
+    backend().wake();
+  }
+}
+
 }  // namespace lsem_log_details
+
+void log_flush() {
+  lsem_log_details::backend().drain();
+}
@@ -1,77 +1,137 @@
 #pragma once
 
+#include <cstddef>
+#include <cstdint>
 #include <format>
-#include <iomanip>
-#include <iostream>
-#include <mutex>
+#include <new>
+#include <string>
 #include <string_view>
+#include <tuple>
+#include <type_traits>
+#include <utility>
+
+// Lowest level compiled in, index into LogLevel. Anything below it is gone at
+// compile time, arguments are not even evaluated. Normally set by NS_LOG_LEVEL
+// CMake option.
+#ifndef NS_LOG_LEVEL
+#define NS_LOG_LEVEL 0
+#endif
 
 namespace lsem_log_details {
-extern std::mutex g_lock;
 
 enum class LogLevel { debug, info, warning, error };
 
+constexpr LogLevel COMPILED_LEVEL = static_cast<LogLevel>(NS_LOG_LEVEL);
+
 constexpr auto MODULE_WIDTH = 10;
 
 class ModuleNameDefaultTag {};
 class ModuleNameSpecificTag : public ModuleNameDefaultTag {};
 const std::string& get_module(const ModuleNameDefaultTag&);
 // Defines module name. Should be a valid C++ identifier as the name used in
-// class name generation.
-#define LOG_MODULE_NAME(Name)                                     \
-  namespace {                                                     \
-  const std::string& get_module(                                  \
-      const lsem_log_details::ModuleNameSpecificTag& m) {         \
-    static const std::string this_module_name{std::string{Name} + \
-                                              std::string(": ")}; \
-    return this_module_name;                                      \
-  }                                                               \
+// class name generation. The name is never destroyed, records that refer to
+// it may be written out as the program exits.
+#define LOG_MODULE_NAME(Name)                                       \
+  namespace {                                                       \
+  const std::string& get_module(                                    \
+      const lsem_log_details::ModuleNameSpecificTag& m) {           \
+    static const std::string* this_module_name = new std::string{   \
+        std::string{Name} + std::string(": ")};                     \
+    return *this_module_name;                                       \
+  }                                                                 \
   }
 
+// Records are not formatted by the thread that logs. It copies the format
+// string view, module and arguments into a lock-free ring buffer of its own,
+// a background thread formats and writes them out. Records of different
+// threads may come out of order. When the ring is full records are dropped
+// rather than the thread blocked, the number of dropped ones is logged later.
+//
+// A record is RecordHeader followed by arguments, both aligned to
+// RECORD_ALIGN.
+struct RecordHeader {
+  // Formats arguments at `args` and destroys them. Empty for padding at the
+  // end of the ring.
+  void (*format)(std::string_view fmt, void* args, std::string& out);
+  const std::string* module;
+  std::string_view fmt;
+  uint32_t size;
+  LogLevel level;
+};
+
+constexpr size_t RECORD_ALIGN = alignof(std::max_align_t);
+
+constexpr size_t align_record(size_t size) {
+  return (size + RECORD_ALIGN - 1) & ~(RECORD_ALIGN - 1);
+}
+
+constexpr size_t RECORD_HEADER_SIZE = align_record(sizeof(RecordHeader));
+
+// Space for a record in the ring of the calling thread, nullptr if it does
+// not fit.
+void* reserve_record(size_t size);
+// Makes the record reserved last visible to the background thread.
+void commit_record(LogLevel level);
+
+// Views may not outlive the call, strings are copied instead.
+template <class T>
+using stored_t =
+    std::conditional_t<std::is_convertible_v<std::decay_t<T>,
+                                             std::string_view> &&
+                           !std::is_same_v<std::decay_t<T>, std::string>,
+                       std::string,
+                       std::decay_t<T>>;
+
+template <class Args>
+void format_record(std::string_view fmt, void* args, std::string& out) {
+  auto& stored = *static_cast<Args*>(args);
+  std::apply(
+      [&](auto&... a) {
+        out += std::vformat(fmt, std::make_format_args(a...));
+      },
+      stored);
+  stored.~Args();
+}
+
 template <class... Args>
 inline void print_log(LogLevel level,
                       const std::string& module_,
                       std::string_view fmt,
                       Args&&... args) {
-  auto label_fn = [](LogLevel level) {
-    switch (level) {
-      case LogLevel::debug:
-        return "  DEBUG";
-      case LogLevel::info:
-        return "   INFO";
-      case LogLevel::warning:
-        return "WARNING";
-      case LogLevel::error:
-        return "ERROR ";
-      default:
-        return "LogLevel::<unknown>";
-    }
-  };
-
-  auto s = std::vformat(fmt, std::make_format_args(args...));
-  std::lock_guard lck{g_lock};
-  std::cout << label_fn(level) << ": " << std::setw(MODULE_WIDTH) << module_
-            << s << "\n";
+  using Stored = std::tuple<stored_t<Args>...>;
+  static_assert(alignof(Stored) <= RECORD_ALIGN);
+  constexpr size_t size = RECORD_HEADER_SIZE + align_record(sizeof(Stored));
+
+  auto* record = static_cast<std::byte*>(reserve_record(size));
+  if (!record) {
+    return;
+  }
+  new (record) RecordHeader{.format = &format_record<Stored>,
+                            .module = &module_,
+                            .fmt = fmt,
+                            .size = static_cast<uint32_t>(size),
+                            .level = level};
+  new (record + RECORD_HEADER_SIZE) Stored{std::forward<Args>(args)...};
+  commit_record(level);
 }
 
 }  // namespace lsem_log_details
-#define LOG_DEBUG(FmtMsg, ...)                                       \
-  lsem_log_details::print_log(                                       \
-      lsem_log_details::LogLevel::debug,                             \
-      get_module(lsem_log_details::ModuleNameSpecificTag{}), FmtMsg, \
-      ##__VA_ARGS__)
-#define LOG_INFO(FmtMsg, ...)                                        \
-  lsem_log_details::print_log(                                       \
-      lsem_log_details::LogLevel::info,                              \
-      get_module(lsem_log_details::ModuleNameSpecificTag{}), FmtMsg, \
-      ##__VA_ARGS__)
-#define LOG_WARNING(FmtMsg, ...)                                     \
-  lsem_log_details::print_log(                                       \
-      lsem_log_details::LogLevel::warning,                           \
-      get_module(lsem_log_details::ModuleNameSpecificTag{}), FmtMsg, \
-      ##__VA_ARGS__)
-#define LOG_ERROR(FmtMsg, ...)                                       \
-  lsem_log_details::print_log(                                       \
-      lsem_log_details::LogLevel::error,                             \
-      get_module(lsem_log_details::ModuleNameSpecificTag{}), FmtMsg, \
-      ##__VA_ARGS__)
+
+// Blocks until everything logged so far, by any thread, is written out.
+void log_flush();
+
+#define LSEM_LOG(Level, FmtMsg, ...)                                     \
+  do {                                                                   \
+    if constexpr (lsem_log_details::LogLevel::Level >=                   \
+                  lsem_log_details::COMPILED_LEVEL) {                    \
+      lsem_log_details::print_log(                                       \
+          lsem_log_details::LogLevel::Level,                             \
+          get_module(lsem_log_details::ModuleNameSpecificTag{}), FmtMsg, \
+          ##__VA_ARGS__);                                                \
+    }                                                                    \
+  } while (0)
+
+#define LOG_DEBUG(FmtMsg, ...) LSEM_LOG(debug, FmtMsg, ##__VA_ARGS__)
+#define LOG_INFO(FmtMsg, ...) LSEM_LOG(info, FmtMsg, ##__VA_ARGS__)
+#define LOG_WARNING(FmtMsg, ...) LSEM_LOG(warning, FmtMsg, ##__VA_ARGS__)
+#define LOG_ERROR(FmtMsg, ...) LSEM_LOG(error, FmtMsg, ##__VA_ARGS__)
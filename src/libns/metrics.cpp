@@ -0,0 +1,138 @@
+#include "metrics.hpp"
+
+#include <algorithm>
+#include <bit>
+#include <cassert>
+#include <format>
+
+struct MetricsRegistry::Metric {
+  std::string name;
+  std::string help;
+  // One of them.
+  std::unique_ptr<Counter> counter;
+  std::unique_ptr<Gauge> gauge;
+  std::unique_ptr<HdrHistogram> histogram;
+};
+
+size_t HdrHistogram::bucket_index(uint64_t value) {
+  if (value < SubBuckets) {
+    return value;
+  }
+  // Power of two range, from 3 (8 to 15) on, and which of its parts.
+  const int range = std::bit_width(value) - 1;
+  const size_t sub = (value >> (range - 3)) & (SubBuckets - 1);
+  return std::min(SubBuckets * (range - 2) + sub, BucketCount - 1);
+}
+
+uint64_t HdrHistogram::bucket_upper_bound(size_t index) {
+  if (index < SubBuckets) {
+    return index;
+  }
+  const size_t range = index / SubBuckets + 2;
+  const size_t sub = index % SubBuckets;
+  return ((SubBuckets + sub + 1) << (range - 3)) - 1;
+}
+
+void HdrHistogram::record(uint64_t value) {
+  m_buckets[bucket_index(value)].fetch_add(1, std::memory_order_relaxed);
+  m_count.fetch_add(1, std::memory_order_relaxed);
+  m_sum.fetch_add(value, std::memory_order_relaxed);
+}
+
+HdrHistogram::Snapshot HdrHistogram::snapshot() const {
+  Snapshot result;
+  for (size_t i = 0; i < BucketCount; ++i) {
+    result.buckets[i] = m_buckets[i].load(std::memory_order_relaxed);
+  }
+  result.count = m_count.load(std::memory_order_relaxed);
+  result.sum = m_sum.load(std::memory_order_relaxed);
+  return result;
+}
+
+MetricsRegistry::MetricsRegistry() = default;
+MetricsRegistry::~MetricsRegistry() = default;
+
+MetricsRegistry::Metric& MetricsRegistry::find_or_add(
+    const std::string& name,
+    const std::string& help) {
+  for (auto& metric : m_metrics) {
+    if (metric->name == name) {
+      return *metric;
+    }
+  }
+  m_metrics.push_back(std::make_unique<Metric>(Metric{name, help}));
+  return *m_metrics.back();
+}
+
+Counter& MetricsRegistry::counter(const std::string& name,
+                                  const std::string& help) {
+  std::lock_guard lock(m_lock);
+  auto& metric = find_or_add(name, help);
+  assert(!metric.gauge && !metric.histogram);
+  if (!metric.counter) {
+    metric.counter = std::make_unique<Counter>();
+  }
+  return *metric.counter;
+}
+
+Gauge& MetricsRegistry::gauge(const std::string& name,
+                              const std::string& help) {
+  std::lock_guard lock(m_lock);
+  auto& metric = find_or_add(name, help);
+  assert(!metric.counter && !metric.histogram);
+  if (!metric.gauge) {
+    metric.gauge = std::make_unique<Gauge>();
+  }
+  return *metric.gauge;
+}
+
+HdrHistogram& MetricsRegistry::histogram(const std::string& name,
+                                         const std::string& help) {
+  std::lock_guard lock(m_lock);
+  auto& metric = find_or_add(name, help);
+  assert(!metric.counter && !metric.gauge);
+  if (!metric.histogram) {
+    metric.histogram = std::make_unique<HdrHistogram>();
+  }
+  return *metric.histogram;
+}
+
+std::string MetricsRegistry::to_prometheus() const {
+  std::string out;
+  std::lock_guard lock(m_lock);
+  for (const auto& metric : m_metrics) {
+    const auto& name = metric->name;
+    out += std::format("# HELP {} {}\n", name, metric->help);
+    if (metric->counter) {
+      out += std::format("# TYPE {} counter\n{} {}\n", name, name,
+                         metric->counter->value());
+    } else if (metric->gauge) {
+      out += std::format("# TYPE {} gauge\n{} {}\n", name, name,
+                         metric->gauge->value());
+    } else if (metric->histogram) {
+      out += std::format("# TYPE {} histogram\n", name);
+      // Cumulative, at the end of every power of two range rather than every
+      // bucket, that is plenty.
+      const auto snapshot = metric->histogram->snapshot();
+      uint64_t cumulative = 0;
+      for (size_t i = 0; i + 1 < HdrHistogram::BucketCount; ++i) {
+        cumulative += snapshot.buckets[i];
+        if ((i + 1) % HdrHistogram::SubBuckets == 0) {
+          out += std::format("{}_bucket{{le=\"{}\"}} {}\n", name,
+                             HdrHistogram::bucket_upper_bound(i), cumulative);
+        }
+      }
+      // From the buckets rather than the count, so that it adds up.
+      cumulative += snapshot.buckets.back();
+      out += std::format("{}_bucket{{le=\"+Inf\"}} {}\n", name, cumulative);
+      out += std::format("{}_sum {}\n{}_count {}\n", name, snapshot.sum, name,
+                         cumulative);
+    }
+  }
+  return out;
+}
+
+MetricsRegistry& metrics() {
+  static MetricsRegistry instance;
+  return instance;
+}
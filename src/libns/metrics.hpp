@@ -0,0 +1,92 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+// Counters, gauges and histograms updated from any thread without locking,
+// exported in Prometheus text format (see metrics_endpoint.hpp). They are
+// process-wide: modules look them up in metrics() by name once, when they are
+// created, and keep the reference. Instances of the same module share them.
+
+// Cache line of its own, metrics of different threads do not bounce.
+class alignas(64) Counter {
+ public:
+  void add(uint64_t n = 1) { m_value.fetch_add(n, std::memory_order_relaxed); }
+  uint64_t value() const { return m_value.load(std::memory_order_relaxed); }
+
+ private:
+  std::atomic<uint64_t> m_value{};
+};
+
+class alignas(64) Gauge {
+ public:
+  void set(int64_t v) { m_value.store(v, std::memory_order_relaxed); }
+  void add(int64_t n) { m_value.fetch_add(n, std::memory_order_relaxed); }
+  int64_t value() const { return m_value.load(std::memory_order_relaxed); }
+
+ private:
+  std::atomic<int64_t> m_value{};
+};
+
+// Log-linear buckets in the manner of HDR histogram: each power of two range
+// is split into SubBuckets, so a value is known to 1/8 of itself whatever the
+// scale. Values below 8 have buckets of their own, those of 2^24 and above
+// share the last one.
+class HdrHistogram {
+ public:
+  static constexpr size_t SubBuckets = 8;
+  static constexpr size_t BucketCount = 8 + 21 * SubBuckets;
+
+  static size_t bucket_index(uint64_t value);
+  // Largest value that goes into the bucket. The last one has no bound, the
+  // result for it is meaningless.
+  static uint64_t bucket_upper_bound(size_t index);
+
+  void record(uint64_t value);
+
+  struct Snapshot {
+    std::array<uint64_t, BucketCount> buckets{};
+    uint64_t count{};
+    uint64_t sum{};
+  };
+  // Not atomic as a whole: values recorded meanwhile may be partly in.
+  Snapshot snapshot() const;
+
+ private:
+  std::array<std::atomic<uint64_t>, BucketCount> m_buckets{};
+  std::atomic<uint64_t> m_count{};
+  std::atomic<uint64_t> m_sum{};
+};
+
+class MetricsRegistry {
+ public:
+  MetricsRegistry();
+  ~MetricsRegistry();
+
+  // Registers the metric the first time its name is seen, later calls get the
+  // same one. Names follow Prometheus conventions: `ns_` prefix, unit suffix,
+  // `_total` for counters. Same name must not be used for metrics of
+  // different kinds.
+  Counter& counter(const std::string& name, const std::string& help);
+  Gauge& gauge(const std::string& name, const std::string& help);
+  HdrHistogram& histogram(const std::string& name, const std::string& help);
+
+  // Everything registered, in Prometheus text exposition format 0.0.4.
+  std::string to_prometheus() const;
+
+ private:
+  struct Metric;
+
+  Metric& find_or_add(const std::string& name, const std::string& help);
+
+  mutable std::mutex m_lock;
+  std::vector<std::unique_ptr<Metric>> m_metrics;
+};
+
+// Of the whole process.
+MetricsRegistry& metrics();
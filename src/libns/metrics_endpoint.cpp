@@ -0,0 +1,162 @@
+#include "metrics_endpoint.hpp"
+
+#include <asio.hpp>
+#include <format>
+#include <string>
+#include <string_view>
+
+#include "log.hpp"
+
+LOG_MODULE_NAME("METRICS");
+
+using asio::ip::tcp;
+
+namespace {
+// Request line and headers, anything bigger is not a scrape.
+constexpr size_t MAX_REQUEST_SIZE = 8 * 1024;
+// Slow or stuck clients do not hold a connection longer than that.
+constexpr auto REQUEST_TIMEOUT = std::chrono::seconds{5};
+
+std::string make_response(std::string_view status, std::string_view body) {
+  return std::format(
+      "HTTP/1.1 {}\r\n"
+      "Content-Type: text/plain; version=0.0.4; charset=utf-8\r\n"
+      "Content-Length: {}\r\n"
+      "Connection: close\r\n"
+      "\r\n"
+      "{}",
+      status, body.size(), body);
+}
+
+// Reads the request, writes the response and closes. Keeps itself alive with
+// the handlers it has pending.
+class Session : public std::enable_shared_from_this<Session> {
+ public:
+  Session(tcp::socket socket, MetricsRegistry& registry)
+      : m_socket(std::move(socket)),
+        m_registry(registry),
+        m_timer(m_socket.get_executor()) {}
+
+  void start() {
+    m_timer.expires_after(REQUEST_TIMEOUT);
+    m_timer.async_wait([self = shared_from_this()](std::error_code ec) {
+      if (!ec) {
+        self->m_socket.close(ec);
+      }
+    });
+    asio::async_read_until(
+        m_socket, asio::dynamic_buffer(m_request, MAX_REQUEST_SIZE),
+        "\r\n\r\n",
+        [self = shared_from_this()](std::error_code ec, size_t) {
+          self->on_request(ec);
+        });
+  }
+
+ private:
+  void on_request(std::error_code ec) {
+    if (ec) {
+      LOG_DEBUG("Failed reading request: {}", ec.message());
+      m_timer.cancel();
+      return;
+    }
+
+    const std::string_view request{m_request};
+    const auto request_line = request.substr(0, request.find("\r\n"));
+    if (request_line.starts_with("GET /metrics ") ||
+        request_line.starts_with("GET /metrics?")) {
+      m_response = make_response("200 OK", m_registry.to_prometheus());
+    } else if (request_line.starts_with("GET ")) {
+      m_response = make_response("404 Not Found", "Not found\n");
+    } else {
+      m_response = make_response("405 Method Not Allowed", "GET only\n");
+    }
+
+    asio::async_write(
+        m_socket, asio::buffer(m_response),
+        [self = shared_from_this()](std::error_code ec, size_t) {
+          if (ec) {
+            LOG_DEBUG("Failed writing response: {}", ec.message());
+          }
+          self->m_socket.shutdown(tcp::socket::shutdown_both, ec);
+          self->m_timer.cancel();
+        });
+  }
+
+  tcp::socket m_socket;
+  MetricsRegistry& m_registry;
+  asio::steady_timer m_timer;
+  std::string m_request;
+  std::string m_response;
+};
+}  // namespace
+
+class MetricsEndpointImpl : public MetricsEndpoint {
+ public:
+  MetricsEndpointImpl(asio::io_context& ctx,
+                      uint16_t port,
+                      MetricsRegistry& registry)
+      : m_port(port), m_registry(registry), m_acceptor(ctx) {}
+
+  bool initialize() {
+    std::error_code ec;
+    const tcp::endpoint endpoint{asio::ip::address_v4::loopback(), m_port};
+
+    m_acceptor.open(endpoint.protocol(), ec);
+    if (ec) {
+      LOG_ERROR("Failed opening TCP socket: {}", ec.message());
+      return false;
+    }
+
+    m_acceptor.set_option(tcp::acceptor::reuse_address(true), ec);
+    m_acceptor.bind(endpoint, ec);
+    if (ec) {
+      LOG_ERROR("Failed binding to port {}: {}", m_port, ec.message());
+      return false;
+    }
+
+    m_acceptor.listen(asio::socket_base::max_listen_connections, ec);
+    if (ec) {
+      LOG_ERROR("Failed listening: {}", ec.message());
+      return false;
+    }
+
+    m_port = m_acceptor.local_endpoint().port();
+    LOG_INFO("Serving metrics on http://127.0.0.1:{}/metrics", m_port);
+
+    accept_next();
+    return true;
+  }
+
+  virtual uint16_t port() const override { return m_port; }
+
+ private:
+  void accept_next() {
+    m_acceptor.async_accept([this](std::error_code ec, tcp::socket socket) {
+      if (ec) {
+        if (ec == asio::error::operation_aborted) {
+          return;
+        }
+        LOG_WARNING("Failed accepting connection: {}", ec.message());
+      } else {
+        std::make_shared<Session>(std::move(socket), m_registry)->start();
+      }
+      accept_next();
+    });
+  }
+
+  uint16_t m_port{};
+  MetricsRegistry& m_registry;
+  tcp::acceptor m_acceptor;
+};
+
+std::unique_ptr<MetricsEndpoint> make_metrics_endpoint(
+    asio::io_context& ctx,
+    uint16_t port,
+    MetricsRegistry& registry) {
+  auto instance = std::make_unique<MetricsEndpointImpl>(ctx, port, registry);
+  if (!instance->initialize()) {
+    LOG_ERROR("Failed to initialize MetricsEndpoint");
+    return nullptr;
+  }
+  return instance;
+}
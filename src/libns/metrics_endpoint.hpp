@@ -0,0 +1,21 @@
+#pragma once
+
+#include <asio/io_context.hpp>
+#include <cstdint>
+#include <memory>
+
+#include "metrics.hpp"
+
+// Serves the registry to Prometheus: GET /metrics over HTTP/1.1 on the
+// loopback interface, one request per connection. Runs on io_context thread.
+class MetricsEndpoint {
+ public:
+  virtual ~MetricsEndpoint() = default;
+  // The one it listens on, chosen by the system if 0 was asked for.
+  virtual uint16_t port() const = 0;
+};
+
+std::unique_ptr<MetricsEndpoint> make_metrics_endpoint(
+    asio::io_context& ctx,
+    uint16_t port,
+    MetricsRegistry& registry = metrics());
@@ -0,0 +1,94 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <bit>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <optional>
+#include <utility>
+
+// Bounded FIFO of many producers and a single consumer, after Dmitry Vyukov's
+// bounded MPMC queue. Items live in a ring allocated upfront, so neither side
+// touches the allocator, and neither waits for the other: a producer claims a
+// cell with a compare-and-swap and fills it in, the consumer takes filled
+// cells in order. Items are in the order their cells were claimed; a push
+// that happens before another one is ahead of it.
+//
+// The consumer may change threads, as long as it does not run on two at once
+// and each one synchronizes with the previous one.
+template <class T>
+class MpscQueue {
+ public:
+  // Capacity is rounded up to a power of two.
+  explicit MpscQueue(size_t capacity)
+      : m_mask(std::bit_ceil(std::max<size_t>(capacity, 2)) - 1),
+        m_cells(new Cell[m_mask + 1]) {
+    for (size_t i = 0; i <= m_mask; ++i) {
+      m_cells[i].sequence.store(i, std::memory_order_relaxed);
+    }
+  }
+  MpscQueue(const MpscQueue&) = delete;
+  MpscQueue& operator=(const MpscQueue&) = delete;
+
+  size_t capacity() const { return m_mask + 1; }
+
+  // Any thread. Fails if the queue is full, `value` is moved from only on
+  // success.
+  bool try_push(T&& value) {
+    size_t pos = m_push_pos.load(std::memory_order_relaxed);
+    Cell* cell{};
+    for (;;) {
+      cell = &m_cells[pos & m_mask];
+      const size_t sequence = cell->sequence.load(std::memory_order_acquire);
+      const auto diff =
+          static_cast<intptr_t>(sequence) - static_cast<intptr_t>(pos);
+      if (diff == 0) {
+        if (m_push_pos.compare_exchange_weak(pos, pos + 1,
+                                             std::memory_order_relaxed)) {
+          break;
+        }
+      } else if (diff < 0) {
+        // The cell still holds the item of the previous lap.
+        return false;
+      } else {
+        pos = m_push_pos.load(std::memory_order_relaxed);
+      }
+    }
+    cell->value = std::move(value);
+    cell->sequence.store(pos + 1, std::memory_order_release);
+    return true;
+  }
+
+  // Consumer only. Empty if nothing is queued, or if the next item is not
+  // completely in yet: its producer was preempted amid try_push(), and pop()
+  // succeeds once it resumes.
+  std::optional<T> pop() {
+    Cell& cell = m_cells[m_pop_pos & m_mask];
+    if (cell.sequence.load(std::memory_order_acquire) != m_pop_pos + 1) {
+      return {};
+    }
+    std::optional<T> result{std::move(cell.value)};
+    // Whatever the moved from value still holds goes now, not a lap later.
+    cell.value = T{};
+    cell.sequence.store(m_pop_pos + m_mask + 1, std::memory_order_release);
+    m_pop_pos++;
+    return result;
+  }
+
+ private:
+  struct Cell {
+    // Position the cell is to be pushed at next, plus one once it is filled
+    // in.
+    std::atomic<size_t> sequence;
+    T value{};
+  };
+
+  const size_t m_mask;
+  std::unique_ptr<Cell[]> m_cells;
+  // Producers' side.
+  alignas(64) std::atomic<size_t> m_push_pos{};
+  // Consumer's side.
+  alignas(64) size_t m_pop_pos{};
+};
@@ -0,0 +1,73 @@
+#include "nack_tracker.hpp"
+#include "log.hpp"
+
+LOG_MODULE_NAME("NACK");
+
+NackTracker::NackTracker(NackTrackerConfig config) : m_config(config) {}
+
+int64_t NackTracker::unwrap(uint16_t sequence_num) const {
+  // Same as in JitterBuffer: closest extended number to the highest seen one.
+  const auto delta = static_cast<int16_t>(
+      static_cast<uint16_t>(sequence_num - static_cast<uint16_t>(m_highest)));
+  return m_highest + delta;
+}
+
+void NackTracker::on_packet(uint16_t sequence_num, clock::time_point now) {
+  if (m_highest < 0) {
+    m_highest = sequence_num;
+    return;
+  }
+
+  const int64_t ext_seq = unwrap(sequence_num);
+  if (ext_seq <= m_highest) {
+    // Reordered or retransmitted packet.
+    m_missing.erase(ext_seq);
+    return;
+  }
+
+  const int64_t gap = ext_seq - m_highest - 1;
+  if (gap > static_cast<int64_t>(m_config.max_gap)) {
+    LOG_WARNING("Sequence number jumped from {} to {}, not requesting {} "
+                "packets",
+                m_highest, ext_seq, gap);
+    m_missing.clear();
+  } else {
+    for (int64_t i = m_highest + 1; i < ext_seq; ++i) {
+      m_missing.emplace_hint(m_missing.end(), i, Missing{.next_request = now});
+    }
+  }
+  m_highest = ext_seq;
+
+  // Forget packets that are too old to be of any use.
+  const int64_t oldest = m_highest - static_cast<int64_t>(m_config.max_gap);
+  m_missing.erase(m_missing.begin(), m_missing.lower_bound(oldest));
+}
+
+void NackTracker::collect(clock::time_point now, std::vector<uint16_t>& out) {
+  for (auto it = m_missing.begin(); it != m_missing.end();) {
+    auto& missing = it->second;
+    if (missing.next_request > now) {
+      ++it;
+      continue;
+    }
+    out.push_back(static_cast<uint16_t>(it->first));
+    missing.requests++;
+    if (missing.requests >= m_config.max_requests) {
+      it = m_missing.erase(it);
+      continue;
+    }
+    missing.next_request = now + m_config.retry_interval;
+    ++it;
+  }
+}
+
+std::optional<NackTracker::clock::time_point> NackTracker::next_deadline()
+    const {
+  std::optional<clock::time_point> deadline;
+  for (const auto& [_, missing] : m_missing) {
+    if (!deadline || missing.next_request < *deadline) {
+      deadline = missing.next_request;
+    }
+  }
+  return deadline;
+}
@@ -0,0 +1,55 @@
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+#include <map>
+#include <optional>
+#include <vector>
+
+struct NackTrackerConfig {
+  // Jumps in sequence numbers bigger than that are taken for a stream restart
+  // rather than a loss. Also bounds how far back missing packets are tracked.
+  size_t max_gap = 256;
+  // How many times a missing packet is requested before giving up on it.
+  int max_requests = 3;
+  // Interval between requests for the same packet. Should be about the round
+  // trip time: the retransmission can't arrive any sooner.
+  std::chrono::milliseconds retry_interval{20};
+};
+
+// Detects gaps in RTP sequence numbers and tells which packets should be
+// requested from the sender (with RTCP generic NACK) and when. Packets that
+// arrive later, reordered or retransmitted, are no longer requested.
+//
+// Not thread safe. Time is passed in explicitly, the owner is expected to
+// collect() requests no later than next_deadline().
+class NackTracker {
+ public:
+  using clock = std::chrono::steady_clock;
+
+  explicit NackTracker(NackTrackerConfig config = {});
+
+  void on_packet(uint16_t sequence_num, clock::time_point now);
+
+  // Appends sequence numbers to be requested now to `out`, oldest first.
+  void collect(clock::time_point now, std::vector<uint16_t>& out);
+
+  // Time of the next collect(), if there is anything missing.
+  std::optional<clock::time_point> next_deadline() const;
+
+  size_t missing_count() const { return m_missing.size(); }
+
+ private:
+  struct Missing {
+    clock::time_point next_request;
+    int requests{};
+  };
+
+  int64_t unwrap(uint16_t sequence_num) const;
+
+  NackTrackerConfig m_config;
+  // Extended sequence number of the newest packet seen so far.
+  int64_t m_highest{-1};
+  // Keyed by extended sequence number.
+  std::map<int64_t, Missing> m_missing;
+};
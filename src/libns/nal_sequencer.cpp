@@ -0,0 +1,168 @@
+#include "nal_sequencer.hpp"
+#include "log.hpp"
+#include "metrics.hpp"
+
+#include <algorithm>
+#include <thread>
+#include <utility>
+
+LOG_MODULE_NAME("NAL_SEQ");
+
+namespace {
+bool is_slice(NAL_Type type) {
+  return type >= NAL_Type::slice && type <= NAL_Type::slice_idr;
+}
+
+Counter& reordered_nals() {
+  static Counter& counter = metrics().counter(
+      "ns_encoder_nals_reordered_total",
+      "NALs held back by the encoder till those ahead of them are out.");
+  return counter;
+}
+}  // namespace
+
+NalSequencer::NalSequencer(EncoderClient& client, uint64_t first_frame)
+    : m_client(client), m_frame(first_frame) {}
+
+void NalSequencer::push_nal(uint64_t frame,
+                            NAL_Metadata meta,
+                            PacketRef buffer) {
+  push(Item{.frame = frame, .meta = meta, .buffer = std::move(buffer)});
+}
+
+void NalSequencer::push_nal(uint64_t frame,
+                            NAL_Metadata meta,
+                            std::vector<uint8_t> data) {
+  push(Item{.frame = frame, .meta = meta, .data = std::move(data)});
+}
+
+void NalSequencer::end_frame(uint64_t frame) {
+  push(Item{.frame = frame, .end = true});
+}
+
+void NalSequencer::push(Item item) {
+  // Full only if whoever is delivering lags that much behind, then it is
+  // up to us.
+  while (!m_queue.try_push(std::move(item))) {
+    deliver();
+    std::this_thread::yield();
+  }
+  m_queued.fetch_add(1);
+  deliver();
+}
+
+void NalSequencer::deliver() {
+  // Sequentially consistent with pushing: either the pusher sees nobody
+  // delivering, or the one delivering sees the item queued after it is done.
+  do {
+    if (m_delivering.exchange(true)) {
+      return;
+    }
+    while (m_queued.load() > 0) {
+      auto item = m_queue.pop();
+      if (!item) {
+        // Its pusher is amid push().
+        std::this_thread::yield();
+        continue;
+      }
+      m_queued.fetch_sub(1);
+      const uint64_t frame = m_frame;
+      handle(std::move(*item));
+      if (m_frame != frame) {
+        handle_later();
+      }
+    }
+    m_delivering.store(false);
+  } while (m_queued.load() > 0);
+}
+
+void NalSequencer::handle(Item item) {
+  if (item.frame != m_frame) {
+    reordered_nals().add(item.end ? 0 : 1);
+    m_later.push_back(std::move(item));
+    return;
+  }
+  if (item.end) {
+    // The queue is in order of pushes, all NALs of the frame are in.
+    if (!m_held_slices.empty()) {
+      LOG_WARNING("Frame {} has no slice from macroblock {}", m_frame,
+                  m_next_macroblock);
+      for (auto& slice : m_held_slices) {
+        deliver_nal(slice);
+      }
+      m_held_slices.clear();
+    }
+    finish_frame();
+    return;
+  }
+  if (!is_slice(item.meta.nal_type)) {
+    deliver_nal(item);
+    return;
+  }
+  if (item.meta.first_macroblock != m_next_macroblock) {
+    reordered_nals().add();
+    auto it = std::upper_bound(m_held_slices.begin(), m_held_slices.end(),
+                               item.meta.first_macroblock,
+                               [](uint16_t first, const Item& slice) {
+                                 return first < slice.meta.first_macroblock;
+                               });
+    m_held_slices.insert(it, std::move(item));
+    return;
+  }
+  deliver_nal(item);
+  deliver_held_slices();
+}
+
+void NalSequencer::deliver_nal(Item& item) {
+  if (!m_frame_started) {
+    m_frame_started = true;
+    m_client.on_frame_started();
+  }
+  if (is_slice(item.meta.nal_type)) {
+    m_next_macroblock = item.meta.last_macroblock + 1u;
+  }
+  if (item.buffer) {
+    const auto data = item.buffer.bytes();
+    m_client.on_nal_encoded(data, std::move(item.buffer), item.meta);
+  } else {
+    m_client.on_nal_encoded(item.data, {}, item.meta);
+  }
+}
+
+void NalSequencer::deliver_held_slices() {
+  auto it = m_held_slices.begin();
+  for (; it != m_held_slices.end() &&
+         it->meta.first_macroblock == m_next_macroblock;
+       ++it) {
+    deliver_nal(*it);
+  }
+  m_held_slices.erase(m_held_slices.begin(), it);
+}
+
+void NalSequencer::finish_frame() {
+  if (m_frame_started) {
+    m_client.on_frame_ended();
+  }
+  m_frame++;
+  m_frame_started = false;
+  m_next_macroblock = 0;
+}
+
+void NalSequencer::handle_later() {
+  // What came early for the frame goes in as if it came now. The end of it
+  // finishes it in turn, and the same goes for the next one.
+  size_t i = 0;
+  while (i < m_later.size()) {
+    if (m_later[i].frame != m_frame) {
+      ++i;
+      continue;
+    }
+    auto item = std::move(m_later[i]);
+    m_later.erase(m_later.begin() + static_cast<ptrdiff_t>(i));
+    const uint64_t frame = m_frame;
+    handle(std::move(item));
+    if (m_frame != frame) {
+      i = 0;
+    }
+  }
+}
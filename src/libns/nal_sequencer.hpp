@@ -0,0 +1,73 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <vector>
+
+#include "encoder.hpp"
+#include "mpsc_queue.hpp"
+#include "packet_pool.hpp"
+#include "types.hpp"
+
+// Puts NALs encoded on several threads back in order for EncoderClient: frame
+// by frame, slices of a frame by their first macroblock, other NALs of the
+// frame (parameter sets, SEI) as they come. The client is notified on
+// whichever thread happens to push, but never on two at once, and each frame
+// is wrapped in on_frame_started() and on_frame_ended().
+//
+// Nothing locks: pushes go through a lock-free queue, and the pusher that
+// finds nobody else delivering delivers whatever is ready, pushes of others
+// meanwhile included. Buffers are reused, pushing does not allocate.
+class NalSequencer {
+ public:
+  // NALs queued for delivery at most. Beyond that pushers wait, delivering
+  // themselves if nobody else is.
+  static constexpr size_t QUEUE_CAPACITY = 1024;
+
+  // Frames are numbered from `first_frame` on without gaps, in the order they
+  // are encoded.
+  explicit NalSequencer(EncoderClient& client, uint64_t first_frame = 0);
+
+  // NAL of `frame` in `buffer` or `data`. Any thread.
+  void push_nal(uint64_t frame, NAL_Metadata meta, PacketRef buffer);
+  void push_nal(uint64_t frame, NAL_Metadata meta, std::vector<uint8_t> data);
+  // All NALs of `frame` are pushed: they happen before the call. Any thread.
+  void end_frame(uint64_t frame);
+
+ private:
+  struct Item {
+    uint64_t frame{};
+    // End of the frame rather than a NAL.
+    bool end{};
+    NAL_Metadata meta{};
+    // Client's, or else of its own.
+    PacketRef buffer;
+    std::vector<uint8_t> data;
+  };
+
+  void push(Item item);
+  // Delivers what is ready, unless another thread is already at it.
+  void deliver();
+  void handle(Item item);
+  void deliver_nal(Item& item);
+  void deliver_held_slices();
+  void finish_frame();
+  // Handles what came early for the current frame.
+  void handle_later();
+
+  EncoderClient& m_client;
+  MpscQueue<Item> m_queue{QUEUE_CAPACITY};
+  // Pushed and not popped yet.
+  std::atomic<uint64_t> m_queued{};
+  std::atomic<bool> m_delivering{};
+
+  // Of the delivering thread.
+  uint64_t m_frame;
+  bool m_frame_started{};
+  // Of the next slice of the frame.
+  uint32_t m_next_macroblock{};
+  // Slices of the frame ahead of the next one, by first macroblock.
+  std::vector<Item> m_held_slices;
+  // NALs and ends of frames after the current one, as they came.
+  std::vector<Item> m_later;
+};
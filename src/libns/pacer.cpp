@@ -0,0 +1,127 @@
+#include "pacer.hpp"
+
+#include <algorithm>
+#include <cassert>
+
+using std::chrono::duration_cast;
+using std::chrono::microseconds;
+
+Pacer::Pacer(PacerConfig config)
+    : m_config(config), m_queue(std::max<size_t>(config.queue_capacity, 1)) {
+  m_budget = max_budget();
+}
+
+double Pacer::max_budget() const {
+  return bytes_per_second() *
+         std::chrono::duration<double>(m_config.max_burst).count();
+}
+
+void Pacer::refill(clock::time_point now) {
+  if (m_last_refill && now > *m_last_refill) {
+    const std::chrono::duration<double> elapsed = now - *m_last_refill;
+    m_budget =
+        std::min(m_budget + elapsed.count() * bytes_per_second(), max_budget());
+  }
+  if (!m_last_refill || now > *m_last_refill) {
+    m_last_refill = now;
+  }
+}
+
+void Pacer::set_rate(uint64_t rate, clock::time_point now) {
+  // Whatever has been earned so far is earned at the old rate.
+  refill(now);
+  m_config.rate = rate;
+  m_budget = std::min(m_budget, max_budget());
+}
+
+bool Pacer::push(PacketRef packet, clock::time_point now) {
+  assert(packet);
+  if (m_size == m_queue.size()) {
+    m_stats.dropped_packets++;
+    return false;
+  }
+  m_queued_bytes += packet.size();
+  m_queue[(m_head + m_size) % m_queue.size()] = {std::move(packet), now};
+  m_size++;
+  return true;
+}
+
+void Pacer::pop_ready(clock::time_point now, std::vector<PacketRef>& out) {
+  if (empty()) {
+    return;
+  }
+  refill(now);
+
+  while (!empty()) {
+    auto& queued = front();
+    const auto delay = now - queued.pushed;
+    const size_t size = queued.packet.size();
+    if (m_config.rate == 0) {
+      // Pacing disabled, everything goes right away.
+    } else if (m_budget >= 0) {
+      // Budget may go negative here, the debt delays the next packet.
+      m_budget -= size;
+    } else if (delay >= m_config.max_queue_delay) {
+      // Not charged: it is over the budget already and the debt would only
+      // make packets behind it late too.
+      m_stats.late_packets++;
+    } else {
+      break;
+    }
+
+    m_stats.sent_packets++;
+    m_stats.max_queue_delay =
+        std::max(m_stats.max_queue_delay, duration_cast<microseconds>(delay));
+    m_delay_sum += delay;
+    m_delay_count++;
+
+    out.push_back(std::move(queued.packet));
+    m_head = (m_head + 1) % m_queue.size();
+    m_size--;
+    m_queued_bytes -= size;
+  }
+}
+
+void Pacer::on_sent_directly(size_t size, clock::time_point now) {
+  if (m_config.rate == 0) {
+    return;
+  }
+  refill(now);
+  m_budget -= size;
+}
+
+std::optional<Pacer::clock::time_point> Pacer::next_send_time() const {
+  if (empty()) {
+    return std::nullopt;
+  }
+  const auto& queued = front();
+  if (m_config.rate == 0 || m_budget >= 0 || !m_last_refill) {
+    return queued.pushed;
+  }
+
+  // Rounded up so that the debt is surely paid off by then.
+  const auto budget_time =
+      *m_last_refill + std::chrono::ceil<microseconds>(
+                           std::chrono::duration<double>(-m_budget /
+                                                         bytes_per_second()));
+  return std::min(budget_time, queued.pushed + m_config.max_queue_delay);
+}
+
+PacerStats Pacer::take_stats(clock::time_point now) {
+  PacerStats stats = m_stats;
+  stats.queued_packets = m_size;
+  stats.queued_bytes = m_queued_bytes;
+  if (!empty()) {
+    stats.oldest_queue_delay =
+        duration_cast<microseconds>(now - front().pushed);
+  }
+  if (m_delay_count > 0) {
+    stats.average_queue_delay =
+        duration_cast<microseconds>(m_delay_sum / m_delay_count);
+  }
+
+  m_stats.max_queue_delay = {};
+  m_delay_sum = {};
+  m_delay_count = 0;
+  return stats;
+}
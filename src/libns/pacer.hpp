@@ -0,0 +1,101 @@
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+#include <optional>
+#include <vector>
+
+#include "packet_pool.hpp"
+
+struct PacerConfig {
+  // Rate packets are let out at, in bits per second. Should be somewhat above
+  // the encoder bitrate, so that the queue drains between frames. Zero
+  // disables pacing.
+  uint64_t rate = 0;
+  // Budget accumulated while idle is capped at that much time worth of `rate`.
+  // Bounds bursts that go out back to back.
+  std::chrono::milliseconds max_burst{5};
+  // Packets that waited that long are sent regardless of the budget. Bounds
+  // latency added by pacing when the encoder overshoots.
+  std::chrono::milliseconds max_queue_delay{100};
+  // Packets pushed into a full queue are dropped.
+  size_t queue_capacity = 1024;
+};
+
+struct PacerStats {
+  size_t queued_packets{};
+  size_t queued_bytes{};
+  // Age of the oldest packet still in the queue.
+  std::chrono::microseconds oldest_queue_delay{};
+  // Time spent in the queue by packets sent since the previous take_stats().
+  std::chrono::microseconds average_queue_delay{};
+  std::chrono::microseconds max_queue_delay{};
+  // Totals since the pacer was created.
+  uint64_t sent_packets{};
+  // Sent over the budget because they hit max_queue_delay.
+  uint64_t late_packets{};
+  uint64_t dropped_packets{};
+};
+
+// Token bucket in front of the socket. Packets are pushed as the encoder
+// produces them and popped no faster than the configured rate, so that a big
+// frame does not hit the link as a single burst.
+//
+// Not thread safe. Time is passed in explicitly, the owner is expected to
+// pop_ready() no later than next_send_time().
+class Pacer {
+ public:
+  using clock = std::chrono::steady_clock;
+
+  explicit Pacer(PacerConfig config = {});
+
+  void set_rate(uint64_t rate, clock::time_point now);
+  uint64_t rate() const { return m_config.rate; }
+
+  // Returns false if the queue is full and the packet has been dropped.
+  bool push(PacketRef packet, clock::time_point now);
+
+  // Appends packets due by `now` to `out`, in the order they were pushed.
+  void pop_ready(clock::time_point now, std::vector<PacketRef>& out);
+
+  // Charges a packet sent past the queue (e.g. a retransmission) against the
+  // budget.
+  void on_sent_directly(size_t size, clock::time_point now);
+
+  // Time of the next pop_ready(), if there is anything queued.
+  std::optional<clock::time_point> next_send_time() const;
+
+  bool empty() const { return m_size == 0; }
+  // Packets in the queue.
+  size_t size() const { return m_size; }
+
+  // Resets the queue delay window.
+  PacerStats take_stats(clock::time_point now);
+
+ private:
+  struct Queued {
+    PacketRef packet;
+    clock::time_point pushed;
+  };
+
+  Queued& front() { return m_queue[m_head]; }
+  const Queued& front() const { return m_queue[m_head]; }
+  void refill(clock::time_point now);
+  double bytes_per_second() const { return m_config.rate / 8.0; }
+  double max_budget() const;
+
+  PacerConfig m_config;
+  // Ring of queue_capacity entries, no allocations after construction.
+  std::vector<Queued> m_queue;
+  size_t m_head{};
+  size_t m_size{};
+  size_t m_queued_bytes{};
+
+  // In bytes, negative after a packet bigger than what was left.
+  double m_budget{};
+  std::optional<clock::time_point> m_last_refill;
+
+  PacerStats m_stats;
+  clock::duration m_delay_sum{};
+  uint64_t m_delay_count{};
+};
@@ -0,0 +1,119 @@
+#include "packet_pool.hpp"
+#include "log.hpp"
+
+#include <cassert>
+#include <utility>
+
+LOG_MODULE_NAME("POOL");
+
+PacketRef::PacketRef(const PacketRef& other) : m_buffer(other.m_buffer) {
+  if (m_buffer) {
+    m_buffer->refs.fetch_add(1, std::memory_order_relaxed);
+  }
+}
+
+PacketRef::PacketRef(PacketRef&& other) noexcept
+    : m_buffer(std::exchange(other.m_buffer, nullptr)) {}
+
+PacketRef& PacketRef::operator=(const PacketRef& other) {
+  if (this != &other) {
+    PacketRef copy{other};
+    *this = std::move(copy);
+  }
+  return *this;
+}
+
+PacketRef& PacketRef::operator=(PacketRef&& other) noexcept {
+  if (this != &other) {
+    reset();
+    m_buffer = std::exchange(other.m_buffer, nullptr);
+  }
+  return *this;
+}
+
+PacketRef::~PacketRef() {
+  reset();
+}
+
+void PacketRef::set_size(size_t size) {
+  assert(size <= capacity());
+  m_buffer->size = size;
+}
+
+void PacketRef::reserve_headroom(size_t size) {
+  assert(m_buffer->size == 0);
+  assert(size <= capacity());
+  m_buffer->offset += size;
+}
+
+std::span<uint8_t> PacketRef::prepend(size_t size) {
+  assert(size <= m_buffer->offset);
+  m_buffer->offset -= size;
+  m_buffer->size += size;
+  return {data(), size};
+}
+
+void PacketRef::consume_front(size_t size) {
+  assert(size <= m_buffer->size);
+  m_buffer->offset += size;
+  m_buffer->size -= size;
+}
+
+void PacketRef::reset() {
+  if (!m_buffer) {
+    return;
+  }
+  auto buffer = std::exchange(m_buffer, nullptr);
+  if (buffer->refs.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+    buffer->pool->release(buffer);
+  }
+}
+
+PacketBufferPool::PacketBufferPool(size_t buffers_count, size_t buffer_size)
+    : m_buffers_count(buffers_count),
+      m_buffer_size(buffer_size),
+      m_storage(new uint8_t[buffers_count * buffer_size]),
+      m_buffers(new PacketBuffer[buffers_count]) {
+  m_free.reserve(buffers_count);
+  for (size_t i = 0; i < buffers_count; ++i) {
+    auto& b = m_buffers[i];
+    b.data = m_storage.get() + i * buffer_size;
+    b.capacity = buffer_size;
+    b.pool = this;
+    m_free.push_back(&b);
+  }
+}
+
+PacketBufferPool::~PacketBufferPool() {
+  if (m_free.size() != m_buffers_count) {
+    LOG_ERROR("Pool destroyed while {} buffers are still referenced",
+              m_buffers_count - m_free.size());
+    assert(false && "PacketBufferPool must outlive its references");
+  }
+}
+
+PacketRef PacketBufferPool::acquire() {
+  PacketBuffer* buffer{};
+  {
+    std::lock_guard lck{m_lock};
+    if (m_free.empty()) {
+      return {};
+    }
+    buffer = m_free.back();
+    m_free.pop_back();
+  }
+  buffer->offset = 0;
+  buffer->size = 0;
+  buffer->refs.store(1, std::memory_order_relaxed);
+  return PacketRef{buffer};
+}
+
+size_t PacketBufferPool::available() const {
+  std::lock_guard lck{m_lock};
+  return m_free.size();
+}
+
+void PacketBufferPool::release(PacketBuffer* buffer) {
+  std::lock_guard lck{m_lock};
+  m_free.push_back(buffer);
+}
@@ -0,0 +1,100 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <span>
+#include <vector>
+
+class PacketBufferPool;
+
+// Fixed size buffer living in PacketBufferPool. Not supposed to be used
+// directly, only through PacketRef.
+struct PacketBuffer {
+  uint8_t* data{};
+  size_t capacity{};
+  // Of the meaningful bytes from `data`, headroom in front of them.
+  size_t offset{};
+  size_t size{};
+  std::atomic<unsigned> refs{};
+  PacketBufferPool* pool{};
+};
+
+// Reference counted lease of a pool buffer. Copies share the same buffer, the
+// buffer goes back to the pool once the last reference is dropped. References
+// can be passed between threads, but the bytes themselves are not
+// synchronized: whoever fills the buffer must do so before sharing it.
+//
+// Bytes may start past the beginning of the buffer, leaving headroom for
+// headers to be prepended later without moving what is already there.
+class PacketRef {
+ public:
+  PacketRef() = default;
+  PacketRef(const PacketRef& other);
+  PacketRef(PacketRef&& other) noexcept;
+  PacketRef& operator=(const PacketRef& other);
+  PacketRef& operator=(PacketRef&& other) noexcept;
+  ~PacketRef();
+
+  explicit operator bool() const { return m_buffer != nullptr; }
+
+  // Of the meaningful bytes, after the headroom.
+  uint8_t* data() const { return m_buffer->data + m_buffer->offset; }
+  size_t capacity() const { return m_buffer->capacity - m_buffer->offset; }
+  // Number of meaningful bytes in the buffer, set by whoever filled it.
+  size_t size() const { return m_buffer->size; }
+  void set_size(size_t size);
+
+  size_t headroom() const { return m_buffer->offset; }
+  // Sets headroom of an empty buffer aside, data() starts after it.
+  void reserve_headroom(size_t size);
+  // Makes `size` bytes of headroom the first ones of the data, returns them
+  // to be filled.
+  std::span<uint8_t> prepend(size_t size);
+  // Drops the first `size` bytes of the data, they become headroom.
+  void consume_front(size_t size);
+
+  std::span<uint8_t> bytes() const { return {data(), size()}; }
+  std::span<uint8_t> storage() const { return {data(), capacity()}; }
+
+  void reset();
+
+ private:
+  friend class PacketBufferPool;
+  // Adopts buffer whose reference count has already been set to one.
+  explicit PacketRef(PacketBuffer* buffer) : m_buffer(buffer) {}
+
+  PacketBuffer* m_buffer{};
+};
+
+// Preallocated set of equally sized buffers. Acquiring and releasing buffers
+// does not touch the allocator. The pool must outlive all references it has
+// handed out.
+class PacketBufferPool {
+ public:
+  PacketBufferPool(size_t buffers_count, size_t buffer_size);
+  ~PacketBufferPool();
+
+  PacketBufferPool(const PacketBufferPool&) = delete;
+  PacketBufferPool& operator=(const PacketBufferPool&) = delete;
+
+  // Returns empty reference when all buffers are in use.
+  PacketRef acquire();
+
+  size_t buffer_size() const { return m_buffer_size; }
+  size_t buffers_count() const { return m_buffers_count; }
+  size_t available() const;
+
+ private:
+  friend class PacketRef;
+  void release(PacketBuffer* buffer);
+
+  size_t m_buffers_count{};
+  size_t m_buffer_size{};
+  std::unique_ptr<uint8_t[]> m_storage;
+  std::unique_ptr<PacketBuffer[]> m_buffers;
+  mutable std::mutex m_lock;
+  std::vector<PacketBuffer*> m_free;
+};
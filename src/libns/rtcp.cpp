@@ -0,0 +1,533 @@
+#include "rtcp.hpp"
+#include "log.hpp"
+
+#include <algorithm>
+
+LOG_MODULE_NAME("RTCP");
+
+namespace {
+// Generic NACK FCI entry: PID followed by bitmask of following lost packets.
+constexpr size_t GENERIC_NACK_FCI_SIZE = 4;
+// Header plus SSRC of packet sender and SSRC of media source.
+constexpr size_t FEEDBACK_FIXED_SIZE = RTCP_Header_Size + 8;
+// Base sequence number, packet status count, reference time and feedback
+// packet count.
+constexpr size_t TRANSPORT_FEEDBACK_FIXED_SIZE = FEEDBACK_FIXED_SIZE + 8;
+// Header plus SSRC of packet sender.
+constexpr size_t RECEIVER_REPORT_FIXED_SIZE = RTCP_Header_Size + 4;
+// Plus sender info: NTP and RTP timestamps, packet and octet counts.
+constexpr size_t SENDER_REPORT_FIXED_SIZE = RECEIVER_REPORT_FIXED_SIZE + 20;
+constexpr size_t REPORT_BLOCK_SIZE = 24;
+constexpr size_t MAX_REPORT_BLOCKS = 31;
+
+// NTP era starts in 1900, Unix one in 1970.
+constexpr uint64_t NTP_UNIX_EPOCH_OFFSET = 2'208'988'800;
+
+// Packet status symbols of transport feedback.
+constexpr unsigned STATUS_NOT_RECEIVED = 0;
+constexpr unsigned STATUS_SMALL_DELTA = 1;
+constexpr unsigned STATUS_LARGE_DELTA = 2;
+// Chunk type bits: run length chunks have the top bit clear, status vector
+// chunks have it set and the next bit tells the symbol size.
+constexpr uint16_t STATUS_VECTOR_CHUNK = 0x8000;
+constexpr uint16_t TWO_BIT_SYMBOLS = 0x4000;
+constexpr size_t TWO_BIT_SYMBOLS_PER_CHUNK = 7;
+constexpr size_t ONE_BIT_SYMBOLS_PER_CHUNK = 14;
+
+uint16_t read_u16(std::span<const uint8_t> data) {
+  return static_cast<uint16_t>(data[0] << 8 | data[1]);
+}
+
+uint32_t read_u32(std::span<const uint8_t> data) {
+  return static_cast<uint32_t>(data[0]) << 24 |
+         static_cast<uint32_t>(data[1]) << 16 |
+         static_cast<uint32_t>(data[2]) << 8 | data[3];
+}
+
+// Symbol for arrival `delta` DeltaUnits after the previous packet. Large
+// deltas are signed, so that reordered packets can be reported.
+std::optional<unsigned> delta_status(int64_t delta) {
+  if (delta >= 0 && delta <= UINT8_MAX) {
+    return STATUS_SMALL_DELTA;
+  }
+  if (delta >= INT16_MIN && delta <= INT16_MAX) {
+    return STATUS_LARGE_DELTA;
+  }
+  return std::nullopt;
+}
+
+void write_u16(std::vector<uint8_t>& out, uint16_t v) {
+  out.push_back(v >> 8);
+  out.push_back(v & 0xFF);
+}
+
+void write_u32(std::vector<uint8_t>& out, uint32_t v) {
+  out.push_back(v >> 24);
+  out.push_back((v >> 16) & 0xFF);
+  out.push_back((v >> 8) & 0xFF);
+  out.push_back(v & 0xFF);
+}
+
+void write_report_block(std::vector<uint8_t>& out,
+                        const RTCP_ReportBlock& block) {
+  write_u32(out, block.ssrc);
+  // Cumulative loss saturates at 24 bits rather than wrapping.
+  const int32_t lost = std::clamp(block.cumulative_lost, -0x800000, 0x7FFFFF);
+  write_u32(out, static_cast<uint32_t>(block.fraction_lost) << 24 |
+                     (static_cast<uint32_t>(lost) & 0xFFFFFF));
+  write_u32(out, block.extended_highest_sequence_num);
+  write_u32(out, block.jitter);
+  write_u32(out, block.last_sr);
+  write_u32(out, block.delay_since_last_sr);
+}
+
+RTCP_ReportBlock read_report_block(std::span<const uint8_t> data) {
+  RTCP_ReportBlock block;
+  block.ssrc = read_u32(data);
+  const uint32_t loss = read_u32(data.subspan(4));
+  block.fraction_lost = loss >> 24;
+  // Sign extend 24-bit cumulative loss.
+  block.cumulative_lost = static_cast<int32_t>(loss << 8) >> 8;
+  block.extended_highest_sequence_num = read_u32(data.subspan(8));
+  block.jitter = read_u32(data.subspan(12));
+  block.last_sr = read_u32(data.subspan(16));
+  block.delay_since_last_sr = read_u32(data.subspan(20));
+  return block;
+}
+
+// Header and report blocks are common to both kinds of reports, sender info
+// goes in between.
+std::error_code serialize_report(unsigned payload_type,
+                                 uint32_t sender_ssrc,
+                                 const RTCP_SenderReport* sender_info,
+                                 std::span<const RTCP_ReportBlock> blocks,
+                                 std::vector<uint8_t>& out) {
+  if (blocks.size() > MAX_REPORT_BLOCKS) {
+    LOG_ERROR("Too many report blocks: {}", blocks.size());
+    return make_error_code(std::errc::value_too_large);
+  }
+
+  const size_t fixed_size = sender_info ? SENDER_REPORT_FIXED_SIZE
+                                        : RECEIVER_REPORT_FIXED_SIZE;
+  const size_t words =
+      (fixed_size + blocks.size() * REPORT_BLOCK_SIZE) / 4 - 1;
+  out.push_back(2 << 6 | blocks.size());
+  out.push_back(payload_type);
+  write_u16(out, static_cast<uint16_t>(words));
+  write_u32(out, sender_ssrc);
+  if (sender_info) {
+    write_u32(out, static_cast<uint32_t>(sender_info->ntp_time >> 32));
+    write_u32(out, static_cast<uint32_t>(sender_info->ntp_time));
+    write_u32(out, sender_info->rtp_timestamp);
+    write_u32(out, sender_info->packet_count);
+    write_u32(out, sender_info->octet_count);
+  }
+  for (const auto& block : blocks) {
+    write_report_block(out, block);
+  }
+  return {};
+}
+
+// Validates the header and returns report blocks part of the packet.
+expected<std::span<const uint8_t>> report_blocks_of(
+    std::span<const uint8_t> data,
+    unsigned payload_type,
+    size_t fixed_size) {
+  auto maybe_header = deserialize_rtcp_header(data);
+  if (!maybe_header) {
+    return unexpected{maybe_header.error()};
+  }
+  const auto& header = *maybe_header;
+  if (header.payload_type != payload_type) {
+    return unexpected{make_error_code(std::errc::invalid_argument)};
+  }
+  // Anything after report blocks is profile-specific extension, which we
+  // skip.
+  if (header.size < fixed_size + header.count * REPORT_BLOCK_SIZE) {
+    return unexpected{make_error_code(std::errc::message_size)};
+  }
+  return data.subspan(fixed_size, header.count * REPORT_BLOCK_SIZE);
+}
+
+std::vector<RTCP_ReportBlock> read_report_blocks(
+    std::span<const uint8_t> data) {
+  std::vector<RTCP_ReportBlock> blocks;
+  blocks.reserve(data.size() / REPORT_BLOCK_SIZE);
+  for (; data.size() >= REPORT_BLOCK_SIZE;
+       data = data.subspan(REPORT_BLOCK_SIZE)) {
+    blocks.push_back(read_report_block(data));
+  }
+  return blocks;
+}
+}  // namespace
+
+expected<RTCP_Header> deserialize_rtcp_header(std::span<const uint8_t> data) {
+  if (data.size() < RTCP_Header_Size) {
+    return unexpected{make_error_code(std::errc::message_size)};
+  }
+
+  RTCP_Header header;
+  header.version = data[0] >> 6;
+  header.padding_bit = data[0] & (1 << 5);
+  header.count = data[0] & 0x1F;
+  header.payload_type = data[1];
+  // Length is in 32-bit words minus one.
+  header.size = (static_cast<size_t>(read_u16(data.subspan(2))) + 1) * 4;
+
+  if (header.version != 2) {
+    return unexpected{make_error_code(std::errc::protocol_error)};
+  }
+  if (header.size > data.size()) {
+    return unexpected{make_error_code(std::errc::message_size)};
+  }
+  return header;
+}
+
+bool is_rtcp_packet(std::span<const uint8_t> data) {
+  return data.size() >= RTCP_Header_Size && data[1] >= RTCP_PayloadType_SR &&
+         data[1] <= RTCP_PayloadType_RTPFB;
+}
+
+std::error_code for_each_rtcp_packet(
+    std::span<const uint8_t> data,
+    const std::function<void(const RTCP_Header&, std::span<const uint8_t>)>&
+        fn) {
+  while (!data.empty()) {
+    auto maybe_header = deserialize_rtcp_header(data);
+    if (!maybe_header) {
+      return maybe_header.error();
+    }
+    fn(*maybe_header, data.first(maybe_header->size));
+    data = data.subspan(maybe_header->size);
+  }
+  return {};
+}
+
+uint64_t to_ntp_time(std::chrono::system_clock::time_point time) {
+  const auto since_epoch = time.time_since_epoch();
+  const auto seconds =
+      std::chrono::duration_cast<std::chrono::seconds>(since_epoch);
+  const auto fraction =
+      std::chrono::duration_cast<std::chrono::nanoseconds>(since_epoch -
+                                                           seconds);
+  return (static_cast<uint64_t>(seconds.count()) + NTP_UNIX_EPOCH_OFFSET)
+             << 32 |
+         (static_cast<uint64_t>(fraction.count()) << 32) / 1'000'000'000;
+}
+
+uint32_t to_compact_ntp_duration(std::chrono::microseconds duration) {
+  if (duration.count() <= 0) {
+    return 0;
+  }
+  const uint64_t units = (static_cast<uint64_t>(duration.count()) << 16) /
+                         1'000'000;
+  return static_cast<uint32_t>(std::min<uint64_t>(units, UINT32_MAX));
+}
+
+std::chrono::microseconds from_compact_ntp_duration(uint32_t duration) {
+  return std::chrono::microseconds{
+      (static_cast<uint64_t>(duration) * 1'000'000) >> 16};
+}
+
+std::chrono::microseconds rtcp_report_delay(std::chrono::milliseconds interval,
+                                            std::minstd_rand& random) {
+  std::uniform_real_distribution<double> factor{0.5, 1.5};
+  return std::chrono::duration_cast<std::chrono::microseconds>(
+      interval * factor(random));
+}
+
+std::error_code serialize_sender_report(const RTCP_SenderReport& report,
+                                        std::vector<uint8_t>& out) {
+  return serialize_report(RTCP_PayloadType_SR, report.sender_ssrc, &report,
+                          report.report_blocks, out);
+}
+
+std::error_code serialize_receiver_report(const RTCP_ReceiverReport& report,
+                                          std::vector<uint8_t>& out) {
+  return serialize_report(RTCP_PayloadType_RR, report.sender_ssrc, nullptr,
+                          report.report_blocks, out);
+}
+
+expected<RTCP_SenderReport> deserialize_sender_report(
+    std::span<const uint8_t> data) {
+  auto blocks =
+      report_blocks_of(data, RTCP_PayloadType_SR, SENDER_REPORT_FIXED_SIZE);
+  if (!blocks) {
+    return unexpected{blocks.error()};
+  }
+
+  RTCP_SenderReport report;
+  report.sender_ssrc = read_u32(data.subspan(4));
+  report.ntp_time = static_cast<uint64_t>(read_u32(data.subspan(8))) << 32 |
+                    read_u32(data.subspan(12));
+  report.rtp_timestamp = read_u32(data.subspan(16));
+  report.packet_count = read_u32(data.subspan(20));
+  report.octet_count = read_u32(data.subspan(24));
+  report.report_blocks = read_report_blocks(*blocks);
+  return report;
+}
+
+expected<RTCP_ReceiverReport> deserialize_receiver_report(
+    std::span<const uint8_t> data) {
+  auto blocks =
+      report_blocks_of(data, RTCP_PayloadType_RR, RECEIVER_REPORT_FIXED_SIZE);
+  if (!blocks) {
+    return unexpected{blocks.error()};
+  }
+
+  RTCP_ReceiverReport report;
+  report.sender_ssrc = read_u32(data.subspan(4));
+  report.report_blocks = read_report_blocks(*blocks);
+  return report;
+}
+
+std::error_code serialize_generic_nack(const RTCP_GenericNack& nack,
+                                       std::vector<uint8_t>& out) {
+  if (nack.lost.empty()) {
+    LOG_ERROR("Generic NACK without lost packets");
+    return make_error_code(std::errc::invalid_argument);
+  }
+
+  const size_t begin = out.size();
+  out.push_back(2 << 6 | RTCP_FeedbackFormat_GenericNack);
+  out.push_back(RTCP_PayloadType_RTPFB);
+  // Length is patched once we know how many FCI entries there are.
+  write_u16(out, 0);
+  write_u32(out, nack.sender_ssrc);
+  write_u32(out, nack.media_ssrc);
+
+  size_t i = 0;
+  while (i < nack.lost.size()) {
+    const uint16_t pid = nack.lost[i++];
+    uint16_t blp = 0;
+    while (i < nack.lost.size()) {
+      const uint16_t distance = nack.lost[i] - pid;
+      if (distance == 0) {
+        // Duplicate.
+        i++;
+        continue;
+      }
+      if (distance > 16) {
+        break;
+      }
+      blp |= 1 << (distance - 1);
+      i++;
+    }
+    write_u16(out, pid);
+    write_u16(out, blp);
+  }
+
+  const size_t words = (out.size() - begin) / 4 - 1;
+  if (words > 0xFFFF) {
+    LOG_ERROR("Generic NACK too long: {} words", words);
+    out.resize(begin);
+    return make_error_code(std::errc::value_too_large);
+  }
+  out[begin + 2] = words >> 8;
+  out[begin + 3] = words & 0xFF;
+  return {};
+}
+
+expected<RTCP_GenericNack> deserialize_generic_nack(
+    std::span<const uint8_t> data) {
+  auto maybe_header = deserialize_rtcp_header(data);
+  if (!maybe_header) {
+    return unexpected{maybe_header.error()};
+  }
+  const auto& header = *maybe_header;
+  if (header.payload_type != RTCP_PayloadType_RTPFB ||
+      header.count != RTCP_FeedbackFormat_GenericNack) {
+    return unexpected{make_error_code(std::errc::invalid_argument)};
+  }
+  if (header.size < FEEDBACK_FIXED_SIZE) {
+    return unexpected{make_error_code(std::errc::message_size)};
+  }
+
+  RTCP_GenericNack nack;
+  nack.sender_ssrc = read_u32(data.subspan(4));
+  nack.media_ssrc = read_u32(data.subspan(8));
+
+  auto fci = data.subspan(FEEDBACK_FIXED_SIZE,
+                          header.size - FEEDBACK_FIXED_SIZE);
+  while (fci.size() >= GENERIC_NACK_FCI_SIZE) {
+    const uint16_t pid = read_u16(fci);
+    const uint16_t blp = read_u16(fci.subspan(2));
+    nack.lost.push_back(pid);
+    for (unsigned bit = 0; bit < 16; ++bit) {
+      if (blp & (1 << bit)) {
+        nack.lost.push_back(pid + bit + 1);
+      }
+    }
+    fci = fci.subspan(GENERIC_NACK_FCI_SIZE);
+  }
+  return nack;
+}
+
+std::error_code serialize_transport_feedback(
+    const RTCP_TransportFeedback& feedback,
+    std::vector<uint8_t>& out) {
+  const auto& arrivals = feedback.arrivals;
+  if (arrivals.empty() || arrivals.size() > UINT16_MAX) {
+    LOG_ERROR("Transport feedback cannot report {} packets", arrivals.size());
+    return make_error_code(std::errc::invalid_argument);
+  }
+
+  const size_t begin = out.size();
+  out.push_back(2 << 6 | RTCP_FeedbackFormat_TransportCC);
+  out.push_back(RTCP_PayloadType_RTPFB);
+  // Length is patched at the end.
+  write_u16(out, 0);
+  write_u32(out, feedback.sender_ssrc);
+  write_u32(out, feedback.media_ssrc);
+  write_u16(out, feedback.base_sequence_num);
+  write_u16(out, static_cast<uint16_t>(arrivals.size()));
+  write_u32(out, static_cast<uint32_t>(feedback.reference_time) << 8 |
+                     feedback.feedback_count);
+
+  // Statuses go in two-bit vector chunks only. Run length chunks would be
+  // shorter for long runs, but receivers must understand all kinds anyway and
+  // these are simplest to produce.
+  int64_t previous = 0;
+  for (size_t i = 0; i < arrivals.size(); i += TWO_BIT_SYMBOLS_PER_CHUNK) {
+    uint16_t chunk = STATUS_VECTOR_CHUNK | TWO_BIT_SYMBOLS;
+    for (size_t j = 0; j < TWO_BIT_SYMBOLS_PER_CHUNK; ++j) {
+      unsigned symbol = STATUS_NOT_RECEIVED;
+      if (i + j < arrivals.size() && arrivals[i + j]) {
+        const auto status = delta_status(*arrivals[i + j] - previous);
+        if (!status) {
+          LOG_ERROR("Arrival delta of packet {} does not fit 16 bits",
+                    static_cast<uint16_t>(feedback.base_sequence_num + i + j));
+          out.resize(begin);
+          return make_error_code(std::errc::value_too_large);
+        }
+        symbol = *status;
+        previous = *arrivals[i + j];
+      }
+      chunk |= symbol << (2 * (TWO_BIT_SYMBOLS_PER_CHUNK - 1 - j));
+    }
+    write_u16(out, chunk);
+  }
+
+  previous = 0;
+  for (const auto& arrival : arrivals) {
+    if (!arrival) {
+      continue;
+    }
+    const int64_t delta = *arrival - previous;
+    previous = *arrival;
+    if (delta_status(delta) == STATUS_SMALL_DELTA) {
+      out.push_back(static_cast<uint8_t>(delta));
+    } else {
+      write_u16(out, static_cast<uint16_t>(static_cast<int16_t>(delta)));
+    }
+  }
+
+  // Pad to 32-bit boundary, the last byte of padding is its size.
+  const size_t padding = (4 - (out.size() - begin) % 4) % 4;
+  if (padding > 0) {
+    out.resize(out.size() + padding, 0);
+    out.back() = static_cast<uint8_t>(padding);
+    out[begin] |= 1 << 5;
+  }
+
+  const size_t words = (out.size() - begin) / 4 - 1;
+  if (words > UINT16_MAX) {
+    LOG_ERROR("Transport feedback too long: {} words", words);
+    out.resize(begin);
+    return make_error_code(std::errc::value_too_large);
+  }
+  out[begin + 2] = words >> 8;
+  out[begin + 3] = words & 0xFF;
+  return {};
+}
+
+expected<RTCP_TransportFeedback> deserialize_transport_feedback(
+    std::span<const uint8_t> data) {
+  auto maybe_header = deserialize_rtcp_header(data);
+  if (!maybe_header) {
+    return unexpected{maybe_header.error()};
+  }
+  const auto& header = *maybe_header;
+  if (header.payload_type != RTCP_PayloadType_RTPFB ||
+      header.count != RTCP_FeedbackFormat_TransportCC) {
+    return unexpected{make_error_code(std::errc::invalid_argument)};
+  }
+  if (header.size < TRANSPORT_FEEDBACK_FIXED_SIZE) {
+    return unexpected{make_error_code(std::errc::message_size)};
+  }
+  size_t size = header.size;
+  if (header.padding_bit) {
+    const size_t padding = data[size - 1];
+    if (padding == 0 || padding > size - TRANSPORT_FEEDBACK_FIXED_SIZE) {
+      return unexpected{make_error_code(std::errc::protocol_error)};
+    }
+    size -= padding;
+  }
+
+  RTCP_TransportFeedback feedback;
+  feedback.sender_ssrc = read_u32(data.subspan(4));
+  feedback.media_ssrc = read_u32(data.subspan(8));
+  feedback.base_sequence_num = read_u16(data.subspan(12));
+  const size_t count = read_u16(data.subspan(14));
+  const uint32_t reference = read_u32(data.subspan(16));
+  // Arithmetic shift sign extends 24-bit reference time.
+  feedback.reference_time = static_cast<int32_t>(reference) >> 8;
+  feedback.feedback_count = reference & 0xFF;
+
+  auto rest = data.subspan(TRANSPORT_FEEDBACK_FIXED_SIZE,
+                           size - TRANSPORT_FEEDBACK_FIXED_SIZE);
+
+  std::vector<uint8_t> symbols;
+  symbols.reserve(count);
+  while (symbols.size() < count) {
+    if (rest.size() < 2) {
+      return unexpected{make_error_code(std::errc::message_size)};
+    }
+    const uint16_t chunk = read_u16(rest);
+    rest = rest.subspan(2);
+
+    if (!(chunk & STATUS_VECTOR_CHUNK)) {
+      const uint8_t symbol = (chunk >> 13) & 0x03;
+      const size_t run =
+          std::min<size_t>(chunk & 0x1FFF, count - symbols.size());
+      symbols.insert(symbols.end(), run, symbol);
+    } else if (chunk & TWO_BIT_SYMBOLS) {
+      for (size_t j = 0;
+           j < TWO_BIT_SYMBOLS_PER_CHUNK && symbols.size() < count; ++j) {
+        symbols.push_back(
+            (chunk >> (2 * (TWO_BIT_SYMBOLS_PER_CHUNK - 1 - j))) & 0x03);
+      }
+    } else {
+      for (size_t j = 0;
+           j < ONE_BIT_SYMBOLS_PER_CHUNK && symbols.size() < count; ++j) {
+        symbols.push_back((chunk >> (ONE_BIT_SYMBOLS_PER_CHUNK - 1 - j)) & 1);
+      }
+    }
+  }
+
+  feedback.arrivals.reserve(count);
+  int64_t arrival = 0;
+  for (uint8_t symbol : symbols) {
+    if (symbol == STATUS_NOT_RECEIVED) {
+      feedback.arrivals.emplace_back();
+      continue;
+    }
+    if (symbol == STATUS_SMALL_DELTA) {
+      if (rest.empty()) {
+        return unexpected{make_error_code(std::errc::message_size)};
+      }
+      arrival += rest[0];
+      rest = rest.subspan(1);
+    } else if (symbol == STATUS_LARGE_DELTA) {
+      if (rest.size() < 2) {
+        return unexpected{make_error_code(std::errc::message_size)};
+      }
+      arrival += static_cast<int16_t>(read_u16(rest));
+      rest = rest.subspan(2);
+    } else {
+      return unexpected{make_error_code(std::errc::protocol_error)};
+    }
+    feedback.arrivals.push_back(arrival);
+  }
+  return feedback;
+}
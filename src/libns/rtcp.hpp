@@ -0,0 +1,162 @@
+////////////////////////////////////////////////////////////
+// RTCP packets we exchange between sender and receiver.
+////////////////////////////////////////////////////////////
+#pragma once
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <optional>
+#include <random>
+#include <span>
+#include <system_error>
+#include <vector>
+#include "defs.hpp"
+
+// https://datatracker.ietf.org/doc/html/rfc3550#section-6.4
+// https://datatracker.ietf.org/doc/html/rfc4585#section-6.1
+
+constexpr size_t RTCP_Header_Size = 4;
+
+// Sender and receiver reports (RFC 3550).
+constexpr unsigned RTCP_PayloadType_SR = 200;
+constexpr unsigned RTCP_PayloadType_RR = 201;
+// Transport layer feedback message (RFC 4585).
+constexpr unsigned RTCP_PayloadType_RTPFB = 205;
+
+// FMT values of RTPFB messages.
+constexpr unsigned RTCP_FeedbackFormat_GenericNack = 1;
+constexpr unsigned RTCP_FeedbackFormat_TransportCC = 15;
+
+// Common part of all RTCP packets. Depending on packet type `count` is either
+// reception report count, source count or feedback message type (FMT).
+struct RTCP_Header {
+  unsigned version{};
+  bool padding_bit{};
+  unsigned count{};
+  unsigned payload_type{};
+  // Size of the whole packet in bytes, header included.
+  size_t size{};
+};
+
+expected<RTCP_Header> deserialize_rtcp_header(std::span<const uint8_t> data);
+
+// RTCP shares the port with RTP (RFC 5761), this tells them apart by the
+// second byte. Only packet types we send are recognized: our naive RTP payload
+// type 78 with the marker bit set looks like RTCP PSFB (206).
+bool is_rtcp_packet(std::span<const uint8_t> data);
+
+// Walks through compound RTCP packet and calls `fn` for every packet in it
+// with its header and bytes (header included). Stops at the first malformed
+// packet.
+std::error_code for_each_rtcp_packet(
+    std::span<const uint8_t> data,
+    const std::function<void(const RTCP_Header&, std::span<const uint8_t>)>&
+        fn);
+
+// 64-bit NTP timestamp: seconds since 1900 in the upper half, fraction in the
+// lower one.
+uint64_t to_ntp_time(std::chrono::system_clock::time_point time);
+// Middle 32 bits of NTP timestamp, as found in report blocks.
+inline uint32_t compact_ntp(uint64_t ntp_time) {
+  return static_cast<uint32_t>(ntp_time >> 16);
+}
+// Durations in report blocks are in 1/65536 of a second.
+uint32_t to_compact_ntp_duration(std::chrono::microseconds duration);
+std::chrono::microseconds from_compact_ntp_duration(uint32_t duration);
+
+// Delay until the next report: `interval` randomized to [0.5, 1.5] of it, so
+// that reports of different participants do not synchronize (6.3.1 of RFC
+// 3550). The rest of the RFC algorithm scales the interval with the number of
+// participants and RTCP bandwidth, neither of which matters for our one to one
+// sessions.
+std::chrono::microseconds rtcp_report_delay(std::chrono::milliseconds interval,
+                                            std::minstd_rand& random);
+
+// Reception statistics of one source, see 6.4.1 of RFC 3550.
+struct RTCP_ReportBlock {
+  uint32_t ssrc{};
+  // Share of packets lost since the previous report, in 1/256.
+  uint8_t fraction_lost{};
+  // Packets expected minus received since the beginning, 24 bits signed.
+  int32_t cumulative_lost{};
+  uint32_t extended_highest_sequence_num{};
+  // Interarrival jitter in RTP timestamp units.
+  uint32_t jitter{};
+  // compact_ntp() of the last sender report from the source and the time
+  // since it has been received, in 1/65536 s. Zeros if there has been none.
+  uint32_t last_sr{};
+  uint32_t delay_since_last_sr{};
+};
+
+struct RTCP_SenderReport {
+  uint32_t sender_ssrc{};
+  uint64_t ntp_time{};
+  // Same instant as ntp_time on the RTP timestamp clock.
+  uint32_t rtp_timestamp{};
+  uint32_t packet_count{};
+  // Payload bytes, headers excluded.
+  uint32_t octet_count{};
+  std::vector<RTCP_ReportBlock> report_blocks;
+};
+
+struct RTCP_ReceiverReport {
+  uint32_t sender_ssrc{};
+  std::vector<RTCP_ReportBlock> report_blocks;
+};
+
+// Append serialized packet to `out`. At most 31 report blocks fit.
+std::error_code serialize_sender_report(const RTCP_SenderReport& report,
+                                        std::vector<uint8_t>& out);
+std::error_code serialize_receiver_report(const RTCP_ReceiverReport& report,
+                                          std::vector<uint8_t>& out);
+// Expect a single packet, e.g. as given by for_each_rtcp_packet().
+expected<RTCP_SenderReport> deserialize_sender_report(
+    std::span<const uint8_t> data);
+expected<RTCP_ReceiverReport> deserialize_receiver_report(
+    std::span<const uint8_t> data);
+
+// Generic NACK, see 6.2.1 of RFC 4585.
+struct RTCP_GenericNack {
+  uint32_t sender_ssrc{};
+  uint32_t media_ssrc{};
+  // Sequence numbers of lost packets. Consecutive numbers (within 17 of each
+  // other) share one FCI entry on the wire, so keep them in order.
+  std::vector<uint16_t> lost;
+};
+
+// Appends serialized packet to `out`.
+std::error_code serialize_generic_nack(const RTCP_GenericNack& nack,
+                                       std::vector<uint8_t>& out);
+// Expects a single packet, e.g. as given by for_each_rtcp_packet().
+expected<RTCP_GenericNack> deserialize_generic_nack(
+    std::span<const uint8_t> data);
+
+// Transport-wide congestion control feedback, see 3.1 of
+// draft-holmer-rmcat-transport-wide-cc-extensions-01. Tells the sender when
+// each packet, identified by its transport-wide sequence number, arrived.
+struct RTCP_TransportFeedback {
+  // Units of reference_time and of arrival times.
+  static constexpr std::chrono::milliseconds ReferenceTimeUnit{64};
+  static constexpr std::chrono::microseconds DeltaUnit{250};
+
+  uint32_t sender_ssrc{};
+  uint32_t media_ssrc{};
+  uint16_t base_sequence_num{};
+  // Receiver clock in ReferenceTimeUnit, 24 bits on the wire. Only
+  // differences between feedback packets are meaningful.
+  int32_t reference_time{};
+  // Incremented with every feedback packet, gaps mean lost feedback.
+  uint8_t feedback_count{};
+  // Arrival times of packets base_sequence_num, base_sequence_num + 1 and so
+  // on, in DeltaUnit since reference_time. Empty for packets not received.
+  std::vector<std::optional<int64_t>> arrivals;
+};
+
+// Appends serialized packet to `out`. Fails if arrivals of consecutive
+// received packets are more than 16 bit worth of DeltaUnit apart.
+std::error_code serialize_transport_feedback(
+    const RTCP_TransportFeedback& feedback,
+    std::vector<uint8_t>& out);
+// Expects a single packet, e.g. as given by for_each_rtcp_packet().
+expected<RTCP_TransportFeedback> deserialize_transport_feedback(
+    std::span<const uint8_t> data);
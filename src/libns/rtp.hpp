@@ -2,56 +2,236 @@
 // Generic RTP types and routines.
 ////////////////////////////////////////////////////////////
 #pragma once
+#include <array>
 #include <cstdint>
 #include <iosfwd>
+#include <optional>
 #include <span>
 #include <system_error>
-#include <vector>
 #include "defs.hpp"
 #include "types.hpp"
 
 // https://datatracker.ietf.org/doc/html/rfc3550#section-5.1
 
+// This is the size that client needs to allocate to accomodate header without
+// CSRC list and extension. RTP_PacketHeader::size() tells the full size.
+constexpr size_t RTP_PacketHeader_Size = 12;
+
+// Marker bit lives in the second byte of serialized header.
+constexpr uint8_t RTP_MarkerBitMask = 0x80;
+
+// The total size of header with extension would be RTP_PacketHeader_Size +
+// RTP_HeaderExtensionFixed_Size + profile-specific extension length (can be
+// even variable length). See 5.3.1 for details.
+constexpr size_t RTP_HeaderExtensionFixed_Size = 4;
+
+// CSRC count is a 4-bit field.
+constexpr size_t RTP_MaxCsrcCount = 15;
+
+// Generic header extension of 5.3.1: 16 bits defined by the profile and the
+// data, which must be a multiple of 4 bytes long. Data is not owned, after
+// parsing it points into the packet.
+struct RTP_HeaderExtension {
+  uint16_t profile{};
+  std::span<const uint8_t> data;
+};
+
+// Fixed capacity, so that headers can be built and parsed per packet without
+// touching the heap.
 struct RTP_PacketHeader {
   unsigned version{};
   bool padding_bit{};
+  // Set by the serializer when there is `extension`. Can be set without it too,
+  // then the caller writes extension block right after the header itself.
   bool extension_bit{};
   bool marker_bit{};
   unsigned payload_type{};
   uint16_t sequence_num{};
   uint32_t timestamp{};
   uint32_t ssrc{};
-  std::vector<uint32_t> csrc;
+  // Only the first `csrc_count` are set, the rest is left uninitialized on
+  // purpose: zeroing it costs as much as filling in the rest of the header.
+  std::array<uint32_t, RTP_MaxCsrcCount> csrc;
+  uint8_t csrc_count{};
+  std::optional<RTP_HeaderExtension> extension;
+
+  constexpr std::span<const uint32_t> csrcs() const {
+    return std::span{csrc}.first(csrc_count);
+  }
+
+  // Returns false when the list is full.
+  constexpr bool add_csrc(uint32_t source) {
+    if (csrc_count == RTP_MaxCsrcCount) {
+      return false;
+    }
+    csrc[csrc_count++] = source;
+    return true;
+  }
+
+  // Serialized size, payload starts at this offset.
+  constexpr size_t size() const {
+    return RTP_PacketHeader_Size + 4 * csrc_count +
+           (extension ? RTP_HeaderExtensionFixed_Size + extension->data.size()
+                      : 0);
+  }
 };
 
+namespace rtp_detail {
+constexpr void write_u16(uint8_t* out, uint16_t v) {
+  out[0] = static_cast<uint8_t>(v >> 8);
+  out[1] = static_cast<uint8_t>(v);
+}
+
+constexpr void write_u32(uint8_t* out, uint32_t v) {
+  out[0] = static_cast<uint8_t>(v >> 24);
+  out[1] = static_cast<uint8_t>(v >> 16);
+  out[2] = static_cast<uint8_t>(v >> 8);
+  out[3] = static_cast<uint8_t>(v);
+}
+
+constexpr uint16_t read_u16(const uint8_t* in) {
+  return static_cast<uint16_t>(in[0] << 8 | in[1]);
+}
+
+constexpr uint32_t read_u32(const uint8_t* in) {
+  return static_cast<uint32_t>(in[0]) << 24 |
+         static_cast<uint32_t>(in[1]) << 16 |
+         static_cast<uint32_t>(in[2]) << 8 | static_cast<uint32_t>(in[3]);
+}
+}  // namespace rtp_detail
+
+// Writes the header with CSRC list and extension, if there is one. Returns
+// number of bytes written, zero if the header is invalid or does not fit.
+// Usable in constant expressions, does not log or allocate.
+constexpr size_t write_rtp_header(const RTP_PacketHeader& ph,
+                                  std::span<uint8_t> buffer) {
+  using namespace rtp_detail;
+
+  if (ph.version > 3 || ph.payload_type > 127 ||
+      ph.csrc_count > RTP_MaxCsrcCount) {
+    return 0;
+  }
+  if (ph.extension && (ph.extension->data.size() % 4 != 0 ||
+                       ph.extension->data.size() / 4 > 0xFFFF)) {
+    return 0;
+  }
+  const size_t size = ph.size();
+  if (buffer.size() < size) {
+    return 0;
+  }
+
+  // Byte stores alias everything, fields are read once rather than after
+  // every store.
+  const size_t csrc_count = ph.csrc_count;
+  const bool extension_bit = ph.extension_bit || ph.extension;
+  const uint8_t b0 = static_cast<uint8_t>(
+      ph.version << 6 | ph.padding_bit << 5 | extension_bit << 4 | csrc_count);
+  const uint8_t b1 = static_cast<uint8_t>(ph.marker_bit << 7 | ph.payload_type);
+  const uint16_t sequence_num = ph.sequence_num;
+  const uint32_t timestamp = ph.timestamp;
+  const uint32_t ssrc = ph.ssrc;
+
+  uint8_t* out = buffer.data();
+  out[0] = b0;
+  out[1] = b1;
+  write_u16(out + 2, sequence_num);
+  write_u32(out + 4, timestamp);
+  write_u32(out + 8, ssrc);
+  out += RTP_PacketHeader_Size;
+
+  for (size_t i = 0; i < csrc_count; ++i) {
+    write_u32(out, ph.csrc[i]);
+    out += 4;
+  }
+
+  if (ph.extension) {
+    const auto& [profile, data] = *ph.extension;
+    write_u16(out, profile);
+    write_u16(out + 2, static_cast<uint16_t>(data.size() / 4));
+    out += RTP_HeaderExtensionFixed_Size;
+    for (size_t i = 0; i < data.size(); ++i) {
+      out[i] = data[i];
+    }
+  }
+  return size;
+}
+
+// Parses the header with CSRC list and extension into `ph`. Returns false if
+// the data is shorter than the header claims to be, `ph` is left half-filled
+// then. Usable in constant expressions, does not log or allocate; extension
+// data points into `data`. Header is filled in place rather than returned,
+// copying it out costs more than parsing.
+constexpr bool read_rtp_header(std::span<const uint8_t> data,
+                               RTP_PacketHeader& ph) {
+  using namespace rtp_detail;
+
+  if (data.size() < RTP_PacketHeader_Size) {
+    return false;
+  }
+
+  // Everything aliases bytes, reading them into locals once saves reloads.
+  const uint8_t* in = data.data();
+  const uint8_t b0 = in[0];
+  const uint8_t b1 = in[1];
+  const size_t csrc_count = b0 & 0x0F;
+  // TODO: decide if we want to validate version on this level or let client do
+  // this.
+  ph.version = b0 >> 6;
+  ph.padding_bit = b0 & 0x20;
+  ph.extension_bit = b0 & 0x10;
+  ph.csrc_count = static_cast<uint8_t>(csrc_count);
+  ph.marker_bit = b1 >> 7;
+  ph.payload_type = b1 & 0x7F;
+  ph.sequence_num = read_u16(in + 2);
+  ph.timestamp = read_u32(in + 4);
+  ph.ssrc = read_u32(in + 8);
+
+  size_t pos = RTP_PacketHeader_Size;
+  if (data.size() < pos + 4 * csrc_count) {
+    return false;
+  }
+  for (size_t i = 0; i < csrc_count; ++i, pos += 4) {
+    ph.csrc[i] = read_u32(in + pos);
+  }
+
+  ph.extension.reset();
+  if (b0 & 0x10) {
+    if (data.size() < pos + RTP_HeaderExtensionFixed_Size) {
+      return false;
+    }
+    // Length of extension is in 32-bit words, fixed part not included.
+    const size_t length = 4 * read_u16(in + pos + 2);
+    if (data.size() < pos + RTP_HeaderExtensionFixed_Size + length) {
+      return false;
+    }
+    ph.extension = RTP_HeaderExtension{
+        .profile = read_u16(in + pos),
+        .data = data.subspan(pos + RTP_HeaderExtensionFixed_Size, length)};
+  }
+  return true;
+}
+
+// Same as above with errors as error codes.
 std::error_code serialize_rtp_header_to(const RTP_PacketHeader& ph,
                                         std::span<uint8_t> buffer);
 expected<RTP_PacketHeader> deserialize_rtp_header_from(
     std::span<const uint8_t> data);
 
+// Extensions are equal if their data is, wherever it is stored.
 bool operator==(const RTP_PacketHeader& lhs, const RTP_PacketHeader& rhs);
 
 std::ostream& operator<<(std::ostream& os, const RTP_PacketHeader&);
 
-// RFC does not define any extensions and leaves it open for implementations.
-// For now, I don't need extensions but if I event need I would need to model it
-// properly with C++. For now I just leave generic fields and raw data bytes
-// just to be able to skip extension data. See 5.3.1 of RFC for details.
-class RTP_HeaderExtension {
-  std::byte header_bytes[2];
-  uint16_t length{};
-  std::vector<std::byte> data;
-};
+// Offset of the payload: fixed header, CSRC list and header extension if
+// there is one.
+expected<size_t> rtp_header_size(std::span<const uint8_t> packet);
 
-// This is the size that client needs to allocate to accomodate header. If we
-// want to use extensions, they must be calculated separately for extensions
-// that are used.
-constexpr size_t RTP_PacketHeader_Size = 12;
+// Payload type of our own format: RTP_PayloadHeader followed by a NAL.
+constexpr unsigned RTP_NaivePayloadType = 78;
 
-// The total size of header with extension would be RTP_PacketHeader_Size +
-// RTP_HeaderExtensionFixed_Size + profile-specific extension length (can be
-// even variable length). See 3.5.1 for details.
-constexpr size_t RTP_HeaderExtensionFixed_Size = 4;
+// RTP timestamp clock of our video. The encoder stamps frames with capture time
+// in milliseconds rather than the usual 90 kHz.
+constexpr uint32_t RTP_VideoClockRate = 1000;
 
 // This is non-RTP header that from RTP point of view is hidden in payload.
 struct RTP_PayloadHeader {
@@ -0,0 +1,292 @@
+#include "rtp_extensions.hpp"
+
+#include <algorithm>
+#include <array>
+
+namespace {
+// Upper 12 bits of two-byte profile, the rest are application bits.
+constexpr uint16_t TWO_BYTE_PROFILE_MASK = 0xFFF0;
+// In one-byte form, id 15 terminates the list of elements.
+constexpr uint8_t ONE_BYTE_STOP_ID = 15;
+constexpr size_t MAX_TWO_BYTE_SIZE = 255;
+
+constexpr size_t TRANSPORT_SEQUENCE_NUM_SIZE = 2;
+constexpr size_t ABS_SEND_TIME_SIZE = 3;
+// Short form, the long one for scalable streams is 3 bytes and starts the same.
+constexpr size_t FRAME_MARKING_SIZE = 1;
+constexpr size_t FRAME_MARKING_LONG_SIZE = 3;
+constexpr uint8_t FRAME_MARKING_START = 0x80;
+constexpr uint8_t FRAME_MARKING_END = 0x40;
+constexpr uint8_t FRAME_MARKING_INDEPENDENT = 0x20;
+constexpr uint8_t FRAME_MARKING_DISCARDABLE = 0x10;
+
+// 6.18 fixed point, 24 bits.
+constexpr int ABS_SEND_TIME_FRACTION_BITS = 18;
+constexpr uint32_t ABS_SEND_TIME_MASK = 0xFFFFFF;
+
+bool is_one_byte_profile(uint16_t profile) {
+  return profile == RTP_OneByteExtensionProfile;
+}
+
+bool is_two_byte_profile(uint16_t profile) {
+  return (profile & TWO_BYTE_PROFILE_MASK) == RTP_TwoByteExtensionProfile;
+}
+
+bool fits_one_byte_form(const RTP_ExtensionElement& element) {
+  return element.id <= RTP_OneByteExtensionMaxId && !element.data.empty() &&
+         element.data.size() <= RTP_OneByteExtensionMaxSize;
+}
+
+// Extension block of the packet, if it has an RFC 8285 one.
+std::optional<RTP_HeaderExtension> packet_extension(
+    std::span<const uint8_t> packet) {
+  RTP_PacketHeader header;
+  if (!read_rtp_header(packet, header) || !header.extension) {
+    return std::nullopt;
+  }
+  return header.extension;
+}
+
+uint8_t frame_marking_bits(const RTP_FrameMarking& marking) {
+  return (marking.start_of_frame ? FRAME_MARKING_START : 0) |
+         (marking.end_of_frame ? FRAME_MARKING_END : 0) |
+         (marking.independent ? FRAME_MARKING_INDEPENDENT : 0) |
+         (marking.discardable ? FRAME_MARKING_DISCARDABLE : 0);
+}
+}  // namespace
+
+size_t write_rtp_extension_block(
+    std::span<const RTP_ExtensionElement> elements,
+    std::span<uint8_t> buffer) {
+  const bool one_byte = std::ranges::all_of(elements, fits_one_byte_form);
+  const size_t element_header_size = one_byte ? 1 : 2;
+
+  size_t size = 0;
+  for (const auto& element : elements) {
+    if (element.id == 0 || element.data.size() > MAX_TWO_BYTE_SIZE) {
+      return 0;
+    }
+    size += element_header_size + element.data.size();
+  }
+  // Padded to whole words.
+  const size_t words = (size + 3) / 4;
+  const size_t block_size = RTP_HeaderExtensionFixed_Size + 4 * words;
+  if (buffer.size() < block_size || words > 0xFFFF) {
+    return 0;
+  }
+
+  const uint16_t profile =
+      one_byte ? RTP_OneByteExtensionProfile : RTP_TwoByteExtensionProfile;
+  buffer[0] = profile >> 8;
+  buffer[1] = profile & 0xFF;
+  buffer[2] = static_cast<uint8_t>(words >> 8);
+  buffer[3] = static_cast<uint8_t>(words);
+
+  uint8_t* out = buffer.data() + RTP_HeaderExtensionFixed_Size;
+  for (const auto& element : elements) {
+    if (one_byte) {
+      // Size is stored minus one.
+      *out++ =
+          static_cast<uint8_t>(element.id << 4 | (element.data.size() - 1));
+    } else {
+      *out++ = element.id;
+      *out++ = static_cast<uint8_t>(element.data.size());
+    }
+    out = std::copy(element.data.begin(), element.data.end(), out);
+  }
+  std::fill(out, buffer.data() + block_size, 0);
+  return block_size;
+}
+
+std::error_code for_each_rtp_extension(
+    const RTP_HeaderExtension& extension,
+    const std::function<void(const RTP_ExtensionElement&)>& fn) {
+  const bool one_byte = is_one_byte_profile(extension.profile);
+  if (!one_byte && !is_two_byte_profile(extension.profile)) {
+    return {};
+  }
+
+  const auto data = extension.data;
+  size_t pos = 0;
+  while (pos < data.size()) {
+    if (data[pos] == 0) {
+      // Padding, in either form.
+      ++pos;
+      continue;
+    }
+
+    uint8_t id{};
+    size_t size{};
+    if (one_byte) {
+      id = data[pos] >> 4;
+      if (id == ONE_BYTE_STOP_ID) {
+        break;
+      }
+      size = (data[pos] & 0x0F) + 1;
+      pos += 1;
+    } else {
+      if (pos + 2 > data.size()) {
+        return make_error_code(std::errc::message_size);
+      }
+      id = data[pos];
+      size = data[pos + 1];
+      pos += 2;
+    }
+    if (pos + size > data.size()) {
+      return make_error_code(std::errc::message_size);
+    }
+    fn(RTP_ExtensionElement{.id = id, .data = data.subspan(pos, size)});
+    pos += size;
+  }
+  return {};
+}
+
+std::optional<std::span<const uint8_t>> find_rtp_extension(
+    std::span<const uint8_t> packet,
+    uint8_t id) {
+  const auto extension = packet_extension(packet);
+  if (!extension || id == 0) {
+    return std::nullopt;
+  }
+  std::optional<std::span<const uint8_t>> found;
+  // Malformed elements after ours do not matter.
+  for_each_rtp_extension(*extension, [&](const RTP_ExtensionElement& element) {
+    if (!found && element.id == id) {
+      found = element.data;
+    }
+  });
+  return found;
+}
+
+std::optional<std::span<uint8_t>> find_rtp_extension(std::span<uint8_t> packet,
+                                                     uint8_t id) {
+  const auto found = find_rtp_extension(std::span<const uint8_t>{packet}, id);
+  if (!found) {
+    return std::nullopt;
+  }
+  return packet.subspan(found->data() - packet.data(), found->size());
+}
+
+size_t write_rtp_extensions(const RTP_Extensions& extensions,
+                            const RTP_ExtensionMap& map,
+                            std::span<uint8_t> buffer) {
+  std::array<RTP_ExtensionElement, 3> elements;
+  size_t count = 0;
+
+  std::array<uint8_t, TRANSPORT_SEQUENCE_NUM_SIZE> sequence_num;
+  if (extensions.transport_sequence_num && map.transport_sequence_num != 0) {
+    const uint16_t value = *extensions.transport_sequence_num;
+    sequence_num = {static_cast<uint8_t>(value >> 8),
+                    static_cast<uint8_t>(value)};
+    elements[count++] = {map.transport_sequence_num, sequence_num};
+  }
+  std::array<uint8_t, ABS_SEND_TIME_SIZE> send_time;
+  if (extensions.abs_send_time && map.abs_send_time != 0) {
+    send_time = {static_cast<uint8_t>(*extensions.abs_send_time >> 16),
+                 static_cast<uint8_t>(*extensions.abs_send_time >> 8),
+                 static_cast<uint8_t>(*extensions.abs_send_time)};
+    elements[count++] = {map.abs_send_time, send_time};
+  }
+  std::array<uint8_t, FRAME_MARKING_SIZE> marking;
+  if (extensions.frame_marking && map.frame_marking != 0) {
+    marking = {frame_marking_bits(*extensions.frame_marking)};
+    elements[count++] = {map.frame_marking, marking};
+  }
+
+  if (count == 0) {
+    return 0;
+  }
+  return write_rtp_extension_block(std::span{elements}.first(count), buffer);
+}
+
+expected<RTP_Extensions> parse_rtp_extensions(
+    const RTP_HeaderExtension& extension,
+    const RTP_ExtensionMap& map) {
+  RTP_Extensions extensions;
+  auto ec = for_each_rtp_extension(
+      extension, [&](const RTP_ExtensionElement& element) {
+        const auto data = element.data;
+        if (element.id == map.transport_sequence_num &&
+            data.size() == TRANSPORT_SEQUENCE_NUM_SIZE) {
+          extensions.transport_sequence_num =
+              static_cast<uint16_t>(data[0] << 8 | data[1]);
+        } else if (element.id == map.abs_send_time &&
+                   data.size() == ABS_SEND_TIME_SIZE) {
+          extensions.abs_send_time =
+              static_cast<uint32_t>(data[0] << 16 | data[1] << 8 | data[2]);
+        } else if (element.id == map.frame_marking &&
+                   (data.size() == FRAME_MARKING_SIZE ||
+                    data.size() == FRAME_MARKING_LONG_SIZE)) {
+          extensions.frame_marking = RTP_FrameMarking{
+              .start_of_frame = (data[0] & FRAME_MARKING_START) != 0,
+              .end_of_frame = (data[0] & FRAME_MARKING_END) != 0,
+              .independent = (data[0] & FRAME_MARKING_INDEPENDENT) != 0,
+              .discardable = (data[0] & FRAME_MARKING_DISCARDABLE) != 0};
+        }
+      });
+  if (ec) {
+    return unexpected(ec);
+  }
+  return extensions;
+}
+
+uint32_t to_abs_send_time(std::chrono::microseconds time) {
+  const uint64_t us = static_cast<uint64_t>(time.count());
+  return static_cast<uint32_t>((us << ABS_SEND_TIME_FRACTION_BITS) /
+                               1'000'000) &
+         ABS_SEND_TIME_MASK;
+}
+
+RTP_AbsSendTimeDuration abs_send_time_delta(uint32_t from, uint32_t to) {
+  // Sign extend the 24-bit difference.
+  int32_t delta = static_cast<int32_t>((to - from) & ABS_SEND_TIME_MASK);
+  if (delta > static_cast<int32_t>(ABS_SEND_TIME_MASK >> 1)) {
+    delta -= static_cast<int32_t>(ABS_SEND_TIME_MASK) + 1;
+  }
+  return RTP_AbsSendTimeDuration{delta};
+}
+
+std::optional<uint16_t> find_transport_sequence_num(
+    std::span<const uint8_t> packet,
+    uint8_t id) {
+  const auto data = find_rtp_extension(packet, id);
+  if (!data || data->size() != TRANSPORT_SEQUENCE_NUM_SIZE) {
+    return std::nullopt;
+  }
+  return static_cast<uint16_t>((*data)[0] << 8 | (*data)[1]);
+}
+
+bool overwrite_transport_sequence_num(std::span<uint8_t> packet,
+                                      uint8_t id,
+                                      uint16_t sequence_num) {
+  const auto data = find_rtp_extension(packet, id);
+  if (!data || data->size() != TRANSPORT_SEQUENCE_NUM_SIZE) {
+    return false;
+  }
+  (*data)[0] = sequence_num >> 8;
+  (*data)[1] = sequence_num & 0xFF;
+  return true;
+}
+
+bool overwrite_abs_send_time(std::span<uint8_t> packet,
+                             uint8_t id,
+                             uint32_t abs_send_time) {
+  const auto data = find_rtp_extension(packet, id);
+  if (!data || data->size() != ABS_SEND_TIME_SIZE) {
+    return false;
+  }
+  (*data)[0] = static_cast<uint8_t>(abs_send_time >> 16);
+  (*data)[1] = static_cast<uint8_t>(abs_send_time >> 8);
+  (*data)[2] = static_cast<uint8_t>(abs_send_time);
+  return true;
+}
+
+bool set_end_of_frame(std::span<uint8_t> packet, uint8_t id) {
+  const auto data = find_rtp_extension(packet, id);
+  if (!data || (data->size() != FRAME_MARKING_SIZE &&
+                data->size() != FRAME_MARKING_LONG_SIZE)) {
+    return false;
+  }
+  (*data)[0] |= FRAME_MARKING_END;
+  return true;
+}
@@ -0,0 +1,121 @@
+////////////////////////////////////////////////////////////
+// RTP header extensions (RFC 8285) and the ones we use.
+////////////////////////////////////////////////////////////
+#pragma once
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <optional>
+#include <span>
+#include <system_error>
+#include "defs.hpp"
+#include "rtp.hpp"
+
+// Extension block profiles of RFC 8285, 4.2 and 4.3. Lower 4 bits of two-byte
+// one are application bits, we write zeros and ignore them.
+constexpr uint16_t RTP_OneByteExtensionProfile = 0xBEDE;
+constexpr uint16_t RTP_TwoByteExtensionProfile = 0x1000;
+
+// One-byte form takes ids 1-14 and 1-16 bytes of data, two-byte form ids
+// 1-255 and up to 255 bytes. Elements that do not fit the one-byte form switch
+// the whole block to the two-byte one.
+constexpr uint8_t RTP_OneByteExtensionMaxId = 14;
+constexpr size_t RTP_OneByteExtensionMaxSize = 16;
+
+struct RTP_ExtensionElement {
+  uint8_t id{};
+  std::span<const uint8_t> data;
+};
+
+// Extension block with `elements`: what goes into RTP_HeaderExtension or right
+// after the fixed header (and CSRC list) of a packet with extension bit set.
+// Returns bytes written, fixed part and padding included, zero if an element
+// has invalid id or size or the buffer is too small.
+size_t write_rtp_extension_block(
+    std::span<const RTP_ExtensionElement> elements,
+    std::span<uint8_t> buffer);
+
+// Calls `fn` for every element of a one-byte or two-byte extension block,
+// padding skipped. Blocks of other profiles have no elements. Stops at the
+// first malformed element.
+std::error_code for_each_rtp_extension(
+    const RTP_HeaderExtension& extension,
+    const std::function<void(const RTP_ExtensionElement&)>& fn);
+
+// Data of element `id` in a serialized packet, e.g. to be updated in place
+// right before the packet is sent.
+std::optional<std::span<uint8_t>> find_rtp_extension(std::span<uint8_t> packet,
+                                                     uint8_t id);
+std::optional<std::span<const uint8_t>> find_rtp_extension(
+    std::span<const uint8_t> packet,
+    uint8_t id);
+
+// Local ids of the extensions we know, zero for the ones not in use. There is
+// no signaling to negotiate them, both ends must use the same map.
+struct RTP_ExtensionMap {
+  // Transport-wide sequence number
+  // (draft-holmer-rmcat-transport-wide-cc-extensions-01): one counter for all
+  // packets that go through a socket, media, FEC and retransmissions alike.
+  // 16 bits.
+  uint8_t transport_sequence_num = 1;
+  // Absolute send time (http://www.webrtc.org/experiments/rtp-hdrext/
+  // abs-send-time): when the packet left the sender, see to_abs_send_time().
+  // 24 bits.
+  uint8_t abs_send_time = 2;
+  // Frame marking (draft-ietf-avtext-framemarking-13), the short form for
+  // non-scalable streams. 8 bits.
+  uint8_t frame_marking = 3;
+};
+
+struct RTP_FrameMarking {
+  bool start_of_frame{};
+  bool end_of_frame{};
+  // Frame can be decoded without any of the previous ones, e.g. IDR.
+  bool independent{};
+  // Nothing refers to the frame, it can be dropped.
+  bool discardable{};
+};
+
+// Built-in extensions of a packet.
+struct RTP_Extensions {
+  std::optional<uint16_t> transport_sequence_num;
+  std::optional<uint32_t> abs_send_time;
+  std::optional<RTP_FrameMarking> frame_marking;
+};
+
+// Extension block with all the built-in extensions, two-byte form.
+constexpr size_t RTP_MaxExtensionBlockSize = 16;
+
+// Same as write_rtp_extension_block(), for extensions that have a value and an
+// id in `map`. Nothing to write is not an error, returns zero then too.
+size_t write_rtp_extensions(const RTP_Extensions& extensions,
+                            const RTP_ExtensionMap& map,
+                            std::span<uint8_t> buffer);
+
+// Values of the built-in extensions in the block. Elements with unknown ids or
+// unexpected sizes are skipped.
+expected<RTP_Extensions> parse_rtp_extensions(
+    const RTP_HeaderExtension& extension,
+    const RTP_ExtensionMap& map);
+
+// Send time in 6.18 fixed point seconds, 24 bits, so wraps every 64 seconds.
+// Any clock will do, the receiver only looks at differences.
+uint32_t to_abs_send_time(std::chrono::microseconds time);
+// Exact, so that differences can be summed up without rounding errors.
+using RTP_AbsSendTimeDuration =
+    std::chrono::duration<int64_t, std::ratio<1, 1 << 18>>;
+// `to` minus `from`, assuming they are less than 32 seconds apart.
+RTP_AbsSendTimeDuration abs_send_time_delta(uint32_t from, uint32_t to);
+
+// Update or read values of serialized packets. Return false (empty) if the
+// packet does not carry the extension.
+std::optional<uint16_t> find_transport_sequence_num(
+    std::span<const uint8_t> packet,
+    uint8_t id);
+bool overwrite_transport_sequence_num(std::span<uint8_t> packet,
+                                      uint8_t id,
+                                      uint16_t sequence_num);
+bool overwrite_abs_send_time(std::span<uint8_t> packet,
+                             uint8_t id,
+                             uint32_t abs_send_time);
+bool set_end_of_frame(std::span<uint8_t> packet, uint8_t id);
@@ -0,0 +1,251 @@
+#include "rtp_h264.hpp"
+#include "log.hpp"
+
+#include <algorithm>
+#include <cassert>
+
+LOG_MODULE_NAME("RTP_H264");
+
+namespace {
+constexpr uint8_t NAL_FORBIDDEN_BIT_MASK = 0x80;
+constexpr uint8_t NAL_NRI_MASK = 0x60;
+constexpr uint8_t NAL_TYPE_MASK = 0x1F;
+
+constexpr uint8_t FU_START_BIT = 0x80;
+constexpr uint8_t FU_END_BIT = 0x40;
+
+constexpr uint8_t ANNEXB_START_CODE[] = {0x00, 0x00, 0x00, 0x01};
+
+// H.264 NAL unit types (Table 7-1) we aggregate into STAP-A.
+constexpr uint8_t NAL_TYPE_SEI = 6;
+constexpr uint8_t NAL_TYPE_SPS = 7;
+constexpr uint8_t NAL_TYPE_PPS = 8;
+constexpr uint8_t NAL_TYPE_AUD = 9;
+}  // namespace
+
+std::span<const uint8_t> strip_annexb_start_code(
+    std::span<const uint8_t> data) {
+  if (data.size() >= 4 && data[0] == 0 && data[1] == 0 && data[2] == 0 &&
+      data[3] == 1) {
+    return data.subspan(4);
+  }
+  if (data.size() >= 3 && data[0] == 0 && data[1] == 0 && data[2] == 1) {
+    return data.subspan(3);
+  }
+  return data;
+}
+
+H264_Packetizer::H264_Packetizer(size_t max_payload_size)
+    : m_max_payload_size(max_payload_size) {
+  assert(max_payload_size > H264_FU_A_Header_Size);
+  m_aggregate.reserve(max_payload_size);
+  m_fragment.reserve(max_payload_size);
+}
+
+bool H264_Packetizer::is_aggregatable(std::span<const uint8_t> nal) const {
+  switch (nal[0] & NAL_TYPE_MASK) {
+    case NAL_TYPE_SEI:
+    case NAL_TYPE_SPS:
+    case NAL_TYPE_PPS:
+    case NAL_TYPE_AUD:
+      return H264_STAP_A_Header_Size + H264_STAP_A_NalSize_Size + nal.size() <=
+             m_max_payload_size;
+    default:
+      return false;
+  }
+}
+
+bool H264_Packetizer::is_single_nal_unit(std::span<const uint8_t> nal) const {
+  return !nal.empty() && !is_aggregatable(nal) &&
+         nal.size() <= m_max_payload_size;
+}
+
+std::error_code H264_Packetizer::push_nal(std::span<const uint8_t> nal,
+                                          const PayloadSink& sink) {
+  if (nal.empty()) {
+    LOG_ERROR("Empty NAL unit");
+    return make_error_code(std::errc::invalid_argument);
+  }
+
+  if (is_aggregatable(nal)) {
+    if (m_aggregate.size() + H264_STAP_A_NalSize_Size + nal.size() >
+        m_max_payload_size) {
+      flush(sink);
+    }
+    if (m_aggregate.empty()) {
+      m_aggregate.push_back(H264_NalType_STAP_A);
+    }
+    // STAP-A header takes the strongest F and NRI of aggregated units. See
+    // 5.7.1.
+    const uint8_t f = (m_aggregate[0] | nal[0]) & NAL_FORBIDDEN_BIT_MASK;
+    const uint8_t nri =
+        std::max<uint8_t>(m_aggregate[0] & NAL_NRI_MASK, nal[0] & NAL_NRI_MASK);
+    m_aggregate[0] = f | nri | H264_NalType_STAP_A;
+
+    m_aggregate.push_back(static_cast<uint8_t>(nal.size() >> 8));
+    m_aggregate.push_back(static_cast<uint8_t>(nal.size() & 0xFF));
+    m_aggregate.insert(m_aggregate.end(), nal.begin(), nal.end());
+    m_aggregated_count++;
+    return {};
+  }
+
+  // Parameter sets have to go before the slices that refer to them.
+  flush(sink);
+
+  if (nal.size() <= m_max_payload_size) {
+    sink(nal);
+    return {};
+  }
+
+  // FU-A, see 5.8. NAL header is not sent as is, its F and NRI go to FU
+  // indicator and type goes to FU header.
+  const uint8_t fu_indicator =
+      (nal[0] & (NAL_FORBIDDEN_BIT_MASK | NAL_NRI_MASK)) | H264_NalType_FU_A;
+  const uint8_t nal_type = nal[0] & NAL_TYPE_MASK;
+  const size_t max_fragment_size = m_max_payload_size - H264_FU_A_Header_Size;
+
+  auto rest = nal.subspan(1);
+  bool first = true;
+  while (!rest.empty()) {
+    const size_t fragment_size = std::min(rest.size(), max_fragment_size);
+    const bool last = fragment_size == rest.size();
+
+    uint8_t fu_header = nal_type;
+    if (first) {
+      fu_header |= FU_START_BIT;
+    }
+    if (last) {
+      fu_header |= FU_END_BIT;
+    }
+
+    m_fragment.clear();
+    m_fragment.push_back(fu_indicator);
+    m_fragment.push_back(fu_header);
+    m_fragment.insert(m_fragment.end(), rest.begin(),
+                      rest.begin() + fragment_size);
+    sink(m_fragment);
+
+    rest = rest.subspan(fragment_size);
+    first = false;
+  }
+
+  return {};
+}
+
+void H264_Packetizer::flush(const PayloadSink& sink) {
+  if (m_aggregated_count == 1) {
+    // Aggregating a single unit makes no sense, send it as is.
+    sink(std::span{m_aggregate}.subspan(H264_STAP_A_Header_Size +
+                                        H264_STAP_A_NalSize_Size));
+  } else if (m_aggregated_count > 1) {
+    sink(m_aggregate);
+  }
+  m_aggregate.clear();
+  m_aggregated_count = 0;
+}
+
+H264_Depacketizer::H264_Depacketizer(size_t tail_padding)
+    : m_tail_padding(tail_padding) {}
+
+void H264_Depacketizer::reset() {
+  m_fragmented.clear();
+  m_in_fragment = false;
+}
+
+void H264_Depacketizer::emit(std::span<const uint8_t> nal,
+                             const NalSink& sink) {
+  m_nal.clear();
+  m_nal.insert(m_nal.end(), std::begin(ANNEXB_START_CODE),
+               std::end(ANNEXB_START_CODE));
+  m_nal.insert(m_nal.end(), nal.begin(), nal.end());
+  const size_t size = m_nal.size();
+  m_nal.resize(size + m_tail_padding, 0);
+  sink(std::span{m_nal}.first(size));
+}
+
+std::error_code H264_Depacketizer::push_payload(
+    std::span<const uint8_t> payload,
+    uint16_t sequence_num,
+    const NalSink& sink) {
+  const bool in_sequence =
+      m_last_sequence_num &&
+      static_cast<uint16_t>(*m_last_sequence_num + 1) == sequence_num;
+  m_last_sequence_num = sequence_num;
+
+  if (payload.empty()) {
+    LOG_ERROR("Empty payload");
+    return make_error_code(std::errc::invalid_argument);
+  }
+
+  const uint8_t type = payload[0] & NAL_TYPE_MASK;
+
+  if (type != H264_NalType_FU_A && m_in_fragment) {
+    LOG_WARNING("FU-A interrupted by NAL unit of type {}, dropping it", type);
+    reset();
+  }
+
+  if (type >= 1 && type <= 23) {
+    // Single NAL unit packet.
+    emit(payload, sink);
+    return {};
+  }
+
+  if (type == H264_NalType_STAP_A) {
+    auto rest = payload.subspan(H264_STAP_A_Header_Size);
+    while (!rest.empty()) {
+      if (rest.size() < H264_STAP_A_NalSize_Size) {
+        LOG_ERROR("Truncated STAP-A");
+        return make_error_code(std::errc::invalid_argument);
+      }
+      const size_t nal_size = static_cast<size_t>(rest[0]) << 8 | rest[1];
+      rest = rest.subspan(H264_STAP_A_NalSize_Size);
+      if (nal_size == 0 || nal_size > rest.size()) {
+        LOG_ERROR("Bad NAL unit size in STAP-A: {}", nal_size);
+        return make_error_code(std::errc::invalid_argument);
+      }
+      emit(rest.first(nal_size), sink);
+      rest = rest.subspan(nal_size);
+    }
+    return {};
+  }
+
+  if (type == H264_NalType_FU_A) {
+    if (payload.size() <= H264_FU_A_Header_Size) {
+      LOG_ERROR("Truncated FU-A");
+      return make_error_code(std::errc::invalid_argument);
+    }
+    const uint8_t fu_indicator = payload[0];
+    const uint8_t fu_header = payload[1];
+    const auto fragment = payload.subspan(H264_FU_A_Header_Size);
+
+    if (fu_header & FU_START_BIT) {
+      if (m_in_fragment) {
+        LOG_WARNING("FU-A started before previous one has ended, dropping it");
+      }
+      m_fragmented.clear();
+      // Reconstruct original NAL header.
+      m_fragmented.push_back(
+          (fu_indicator & (NAL_FORBIDDEN_BIT_MASK | NAL_NRI_MASK)) |
+          (fu_header & NAL_TYPE_MASK));
+      m_in_fragment = true;
+    } else if (!m_in_fragment || !in_sequence) {
+      if (m_in_fragment) {
+        LOG_WARNING("Lost FU-A fragment before {}, dropping NAL unit",
+                    sequence_num);
+      }
+      reset();
+      return {};
+    }
+
+    m_fragmented.insert(m_fragmented.end(), fragment.begin(), fragment.end());
+
+    if (fu_header & FU_END_BIT) {
+      emit(m_fragmented, sink);
+      reset();
+    }
+    return {};
+  }
+
+  LOG_ERROR("Unsupported NAL unit type {} in RTP payload", type);
+  return make_error_code(std::errc::protocol_not_supported);
+}
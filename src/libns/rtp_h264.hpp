@@ -0,0 +1,90 @@
+////////////////////////////////////////////////////////////
+// RTP payload format for H.264 (RFC 6184), non-interleaved mode.
+////////////////////////////////////////////////////////////
+#pragma once
+#include <cstdint>
+#include <functional>
+#include <optional>
+#include <span>
+#include <system_error>
+#include <vector>
+
+// https://datatracker.ietf.org/doc/html/rfc6184
+
+// Dynamic payload type we announce H.264 with.
+constexpr unsigned RTP_H264_PayloadType = 96;
+
+// NAL unit types defined by RFC 6184 on top of H.264 ones. See 5.2.
+constexpr uint8_t H264_NalType_STAP_A = 24;
+constexpr uint8_t H264_NalType_FU_A = 28;
+
+constexpr size_t H264_STAP_A_Header_Size = 1;
+constexpr size_t H264_STAP_A_NalSize_Size = 2;
+constexpr size_t H264_FU_A_Header_Size = 2;
+
+// Returns NAL unit with Annex B start code (00 00 01 or 00 00 00 01) stripped.
+// Data without start code is returned as is.
+std::span<const uint8_t> strip_annexb_start_code(std::span<const uint8_t> data);
+
+// Turns NAL units into RTP payloads. NAL units that fit into a packet go as
+// they are (single NAL unit packet), bigger ones are fragmented into FU-A
+// packets. Small parameter-like NAL units (SPS, PPS, SEI, AUD) are held back
+// and aggregated with the following ones into one STAP-A packet.
+class H264_Packetizer {
+ public:
+  // Payload is valid only for the time of the call.
+  using PayloadSink = std::function<void(std::span<const uint8_t> payload)>;
+
+  explicit H264_Packetizer(size_t max_payload_size);
+
+  // NAL unit is expected without start code.
+  std::error_code push_nal(std::span<const uint8_t> nal,
+                           const PayloadSink& sink);
+
+  // Emits NAL units held for aggregation. Should be called at the end of
+  // every access unit.
+  void flush(const PayloadSink& sink);
+
+  // Whether push_nal() would send `nal` as it is, in a packet of its own.
+  // Such NAL units may as well be sent without the packetizer, after flush().
+  bool is_single_nal_unit(std::span<const uint8_t> nal) const;
+
+ private:
+  bool is_aggregatable(std::span<const uint8_t> nal) const;
+
+  size_t m_max_payload_size{};
+  // STAP-A under construction.
+  std::vector<uint8_t> m_aggregate;
+  size_t m_aggregated_count{};
+  std::vector<uint8_t> m_fragment;
+};
+
+// Reassembles NAL units from RTP payloads. Payloads are expected in sequence
+// number order (i.e. after jitter buffer); a gap in sequence numbers in the
+// middle of FU-A drops the whole fragmented NAL unit.
+class H264_Depacketizer {
+ public:
+  // NAL unit is prefixed with 4-byte Annex B start code and followed by
+  // `tail_padding` zero bytes which are not part of the span. Valid only for
+  // the time of the call.
+  using NalSink = std::function<void(std::span<const uint8_t> nal)>;
+
+  explicit H264_Depacketizer(size_t tail_padding = 0);
+
+  std::error_code push_payload(std::span<const uint8_t> payload,
+                               uint16_t sequence_num,
+                               const NalSink& sink);
+
+  // Forgets partially received FU-A.
+  void reset();
+
+ private:
+  void emit(std::span<const uint8_t> nal, const NalSink& sink);
+
+  size_t m_tail_padding{};
+  std::vector<uint8_t> m_nal;
+  // FU-A being reassembled, without start code.
+  std::vector<uint8_t> m_fragmented;
+  bool m_in_fragment{};
+  std::optional<uint16_t> m_last_sequence_num;
+};
@@ -0,0 +1,95 @@
+#include "rtp_history.hpp"
+#include "log.hpp"
+
+#include <algorithm>
+#include <bit>
+#include <cstring>
+
+LOG_MODULE_NAME("RTP_HIST");
+
+namespace {
+// Buffers on top of history capacity for retransmissions in flight.
+constexpr size_t SPARE_BUFFERS = 16;
+
+size_t history_capacity(size_t capacity) {
+  // Power of two so that slot index is just a mask of sequence number, and no
+  // more than sequence number space.
+  return std::min<size_t>(std::bit_ceil(std::max<size_t>(capacity, 1)),
+                          size_t{1} << 16);
+}
+}  // namespace
+
+RTP_PacketHistory::RTP_PacketHistory(size_t capacity, size_t max_packet_size)
+    : m_pool(history_capacity(capacity) + SPARE_BUFFERS, max_packet_size),
+      m_entries(history_capacity(capacity)),
+      m_mask(history_capacity(capacity) - 1) {}
+
+void RTP_PacketHistory::store(uint16_t sequence_num,
+                              std::span<const std::span<const uint8_t>> parts,
+                              clock::time_point now) {
+  size_t size = 0;
+  for (auto part : parts) {
+    size += part.size();
+  }
+  if (size > m_pool.buffer_size()) {
+    LOG_DEBUG("Packet {} of {} bytes is too big to be kept", sequence_num,
+              size);
+    std::lock_guard lock{m_lock};
+    entry(sequence_num).packet.reset();
+    return;
+  }
+
+  std::lock_guard lock{m_lock};
+  auto& e = entry(sequence_num);
+  // Give the buffer back before taking a new one, so the pool does not run out
+  // while the history is full.
+  e.packet.reset();
+  e.packet = m_pool.acquire();
+  if (!e.packet) {
+    LOG_WARNING("No buffer for packet {}, it won't be retransmitted",
+                sequence_num);
+    return;
+  }
+
+  uint8_t* dst = e.packet.data();
+  for (auto part : parts) {
+    std::memcpy(dst, part.data(), part.size());
+    dst += part.size();
+  }
+  e.packet.set_size(size);
+  e.sequence_num = sequence_num;
+  e.sent = now;
+  e.was_retransmitted = false;
+}
+
+void RTP_PacketHistory::store(uint16_t sequence_num,
+                              PacketRef packet,
+                              clock::time_point now) {
+  std::lock_guard lock{m_lock};
+  auto& e = entry(sequence_num);
+  e.packet = std::move(packet);
+  e.sequence_num = sequence_num;
+  e.sent = now;
+  e.was_retransmitted = false;
+}
+
+PacketRef RTP_PacketHistory::take_for_retransmission(
+    uint16_t sequence_num,
+    clock::time_point now,
+    clock::duration max_age,
+    clock::duration min_interval) {
+  std::lock_guard lock{m_lock};
+  auto& e = entry(sequence_num);
+  if (!e.packet || e.sequence_num != sequence_num) {
+    return {};
+  }
+  if (now - e.sent > max_age) {
+    return {};
+  }
+  if (e.was_retransmitted && now - e.retransmitted < min_interval) {
+    return {};
+  }
+  e.retransmitted = now;
+  e.was_retransmitted = true;
+  return e.packet;
+}
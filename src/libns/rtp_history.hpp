@@ -0,0 +1,61 @@
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+#include <mutex>
+#include <span>
+#include <vector>
+
+#include "packet_pool.hpp"
+
+// Bounded history of sent RTP packets indexed by sequence number, answers
+// retransmission requests. Packets are either copied into pool buffers of its
+// own or, if the sender has them in pool buffers already, kept by reference.
+// Newer packets push out the ones sent `capacity` sequence numbers earlier.
+//
+// Thread safe: packets are usually stored from the sending thread and looked
+// up from the one handling RTCP feedback.
+class RTP_PacketHistory {
+ public:
+  using clock = std::chrono::steady_clock;
+
+  RTP_PacketHistory(size_t capacity, size_t max_packet_size);
+
+  // Stores a copy of the packet made of `parts` concatenated. Packets bigger
+  // than max_packet_size are not kept.
+  void store(uint16_t sequence_num,
+             std::span<const std::span<const uint8_t>> parts,
+             clock::time_point now);
+  // Keeps a reference to `packet`, whose bytes are the packet. The sender
+  // must not change them anymore, retransmission may.
+  void store(uint16_t sequence_num, PacketRef packet, clock::time_point now);
+
+  // Returns the packet to be sent again, or empty reference when it is not
+  // worth it: the packet is gone from the history, was first sent more than
+  // `max_age` ago, or has already been resent less than `min_interval` ago (a
+  // repeated request that crossed our previous retransmission).
+  PacketRef take_for_retransmission(uint16_t sequence_num,
+                                    clock::time_point now,
+                                    clock::duration max_age,
+                                    clock::duration min_interval);
+
+ private:
+  struct Entry {
+    PacketRef packet;
+    uint16_t sequence_num{};
+    clock::time_point sent;
+    clock::time_point retransmitted;
+    bool was_retransmitted{};
+  };
+
+  Entry& entry(uint16_t sequence_num) {
+    return m_entries[sequence_num & m_mask];
+  }
+
+  // Retransmitted packets may still be referenced by the caller when their
+  // slots are reused, the pool has some spare buffers for that.
+  PacketBufferPool m_pool;
+  std::mutex m_lock;
+  std::vector<Entry> m_entries;
+  size_t m_mask{};
+};
@@ -0,0 +1,172 @@
+#include "rtp_receive_statistics.hpp"
+#include "log.hpp"
+
+#include <algorithm>
+#include <cmath>
+
+LOG_MODULE_NAME("RTP_STATS");
+
+void RTP_JitterEstimator::on_packet(uint32_t timestamp,
+                                    clock::time_point arrival) {
+  if (m_last_timestamp == timestamp) {
+    return;
+  }
+
+  if (m_last_timestamp) {
+    const double arrival_delta =
+        std::chrono::duration<double>(arrival - m_last_arrival).count() *
+        m_clock_rate;
+    // Signed difference takes care of timestamp wraparound.
+    const auto timestamp_delta =
+        static_cast<int32_t>(timestamp - *m_last_timestamp);
+    const double d = std::abs(arrival_delta - timestamp_delta);
+    m_jitter += (d - m_jitter) / 16.0;
+  }
+  m_last_arrival = arrival;
+  m_last_timestamp = timestamp;
+}
+
+void RTP_DelayVariationEstimator::on_packet(uint32_t abs_send_time,
+                                            clock::time_point arrival) {
+  if (m_last_send_time) {
+    // Signed, reordered packets go back in time.
+    m_send_time += abs_send_time_delta(*m_last_send_time, abs_send_time);
+  }
+  m_last_send_time = abs_send_time;
+
+  const int64_t transit =
+      std::chrono::duration_cast<std::chrono::microseconds>(
+          arrival.time_since_epoch() - m_send_time)
+          .count();
+  if (!m_last_transit) {
+    m_min_transit = transit;
+    m_prior_min_transit = transit;
+    m_window_start = arrival;
+  } else {
+    const double d = std::abs(static_cast<double>(transit - *m_last_transit));
+    m_variation += (d - m_variation) / 16.0;
+    if (arrival - m_window_start >= MinTransitWindow) {
+      m_prior_min_transit = m_min_transit;
+      m_min_transit = transit;
+      m_window_start = arrival;
+    } else {
+      m_min_transit = std::min(m_min_transit, transit);
+    }
+  }
+  m_last_transit = transit;
+}
+
+std::chrono::microseconds RTP_DelayVariationEstimator::delay_variation()
+    const {
+  return std::chrono::microseconds{static_cast<int64_t>(m_variation)};
+}
+
+std::chrono::microseconds RTP_DelayVariationEstimator::queuing_delay() const {
+  if (!m_last_transit) {
+    return {};
+  }
+  return std::chrono::microseconds{
+      *m_last_transit - std::min(m_min_transit, m_prior_min_transit)};
+}
+
+RTP_ReceiveStatistics::RTP_ReceiveStatistics(uint32_t clock_rate)
+    : m_clock_rate(clock_rate), m_jitter(clock_rate) {}
+
+int64_t RTP_ReceiveStatistics::unwrap(uint16_t sequence_num) const {
+  // Same as in NackTracker: closest extended number to the highest seen one.
+  const auto delta = static_cast<int16_t>(
+      static_cast<uint16_t>(sequence_num - static_cast<uint16_t>(m_highest)));
+  return m_highest + delta;
+}
+
+void RTP_ReceiveStatistics::on_packet(uint32_t ssrc,
+                                      uint16_t sequence_num,
+                                      uint32_t timestamp,
+                                      size_t payload_size,
+                                      clock::time_point arrival) {
+  if (m_ssrc != ssrc) {
+    if (m_ssrc) {
+      LOG_INFO("Source changed from {:08x} to {:08x}, starting over", *m_ssrc,
+               ssrc);
+    }
+    *this = RTP_ReceiveStatistics{m_clock_rate};
+    m_ssrc = ssrc;
+    m_base = sequence_num;
+    m_highest = sequence_num;
+  }
+
+  const int64_t ext_seq = unwrap(sequence_num);
+  if (ext_seq < m_base) {
+    // Reordered across the very first packet.
+    m_base = ext_seq;
+  }
+  m_highest = std::max(m_highest, ext_seq);
+  m_received++;
+  m_bytes += payload_size;
+  m_jitter.on_packet(timestamp, arrival);
+}
+
+void RTP_ReceiveStatistics::on_send_time(uint32_t abs_send_time,
+                                         clock::time_point arrival) {
+  if (m_ssrc) {
+    m_delay.on_packet(abs_send_time, arrival);
+  }
+}
+
+void RTP_ReceiveStatistics::on_sender_report(const RTCP_SenderReport& report,
+                                             clock::time_point arrival) {
+  m_last_sr = compact_ntp(report.ntp_time);
+  m_last_sr_arrival = arrival;
+}
+
+std::optional<RTCP_ReportBlock> RTP_ReceiveStatistics::make_report_block(
+    clock::time_point now) {
+  if (!m_ssrc) {
+    return std::nullopt;
+  }
+
+  // RFC 3550, A.3.
+  const int64_t expected_interval = expected() - m_expected_prior;
+  const int64_t received_interval =
+      static_cast<int64_t>(m_received - m_received_prior);
+  const int64_t lost_interval = expected_interval - received_interval;
+  m_expected_prior = expected();
+  m_received_prior = m_received;
+
+  RTCP_ReportBlock block;
+  block.ssrc = *m_ssrc;
+  if (expected_interval > 0 && lost_interval > 0) {
+    block.fraction_lost =
+        static_cast<uint8_t>((lost_interval << 8) / expected_interval);
+  }
+  m_loss_fraction = block.fraction_lost / 256.0;
+  block.cumulative_lost = static_cast<int32_t>(
+      std::clamp<int64_t>(expected() - static_cast<int64_t>(m_received),
+                          INT32_MIN, INT32_MAX));
+  block.extended_highest_sequence_num = static_cast<uint32_t>(m_highest);
+  block.jitter = static_cast<uint32_t>(m_jitter.jitter());
+  if (m_last_sr) {
+    block.last_sr = *m_last_sr;
+    block.delay_since_last_sr = to_compact_ntp_duration(
+        std::chrono::duration_cast<std::chrono::microseconds>(
+            now - m_last_sr_arrival));
+  }
+  return block;
+}
+
+RTP_ReceiveStats RTP_ReceiveStatistics::stats() const {
+  RTP_ReceiveStats stats;
+  if (!m_ssrc) {
+    return stats;
+  }
+  stats.packets_received = m_received;
+  stats.bytes_received = m_bytes;
+  stats.cumulative_lost = expected() - static_cast<int64_t>(m_received);
+  stats.loss_fraction = m_loss_fraction;
+  stats.extended_highest_sequence_num = static_cast<uint32_t>(m_highest);
+  stats.jitter = std::chrono::microseconds{static_cast<int64_t>(
+      m_jitter.jitter() * 1'000'000 / m_clock_rate)};
+  stats.delay_variation = m_delay.delay_variation();
+  stats.queuing_delay = m_delay.queuing_delay();
+  return stats;
+}
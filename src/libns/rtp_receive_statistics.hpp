@@ -0,0 +1,134 @@
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+#include <optional>
+
+#include "rtcp.hpp"
+#include "rtp_extensions.hpp"
+
+// Interarrival jitter of RFC 3550, A.8: smoothed deviation of packet spacing
+// on arrival from the spacing of their RTP timestamps. Packets sharing a
+// timestamp leave back to back as the frame gets encoded and sent, their
+// transit grows with that, so only the first packet of each frame is sampled.
+class RTP_JitterEstimator {
+ public:
+  using clock = std::chrono::steady_clock;
+
+  explicit RTP_JitterEstimator(uint32_t clock_rate)
+      : m_clock_rate(clock_rate) {}
+
+  void on_packet(uint32_t timestamp, clock::time_point arrival);
+
+  // In RTP timestamp units.
+  double jitter() const { return m_jitter; }
+
+ private:
+  uint32_t m_clock_rate{};
+  std::optional<uint32_t> m_last_timestamp;
+  clock::time_point m_last_arrival;
+  double m_jitter{};
+};
+
+// One-way delay variation from absolute send time of every packet (see
+// rtp_extensions.hpp). Transit, arrival minus send time on unrelated clocks,
+// is meaningless by itself, but its changes are not: smoothed difference
+// between consecutive packets, same as in interarrival jitter, and how much it
+// is above the lowest one seen lately, which is queuing on the path. Unlike
+// interarrival jitter every packet is sampled, packets of a frame sent back to
+// back carry their own send times.
+class RTP_DelayVariationEstimator {
+ public:
+  using clock = std::chrono::steady_clock;
+
+  // Lowest transit is the one of the current or the previous window.
+  static constexpr std::chrono::seconds MinTransitWindow{10};
+
+  void on_packet(uint32_t abs_send_time, clock::time_point arrival);
+
+  std::chrono::microseconds delay_variation() const;
+  // Transit of the last packet above the lowest one.
+  std::chrono::microseconds queuing_delay() const;
+
+ private:
+  std::optional<uint32_t> m_last_send_time;
+  // Unwrapped, since the first packet.
+  RTP_AbsSendTimeDuration m_send_time{};
+  std::optional<int64_t> m_last_transit;
+  double m_variation{};
+  int64_t m_min_transit{};
+  int64_t m_prior_min_transit{};
+  clock::time_point m_window_start;
+};
+
+struct RTP_ReceiveStats {
+  uint64_t packets_received{};
+  // Payload bytes, headers excluded.
+  uint64_t bytes_received{};
+  // Packets expected minus packets received since the first one. Duplicates,
+  // e.g. needless retransmissions, make it go down.
+  int64_t cumulative_lost{};
+  // Share of packets lost in the last report interval.
+  double loss_fraction{};
+  uint32_t extended_highest_sequence_num{};
+  std::chrono::microseconds jitter{};
+  // From absolute send time, zero if the sender does not stamp packets with
+  // it. See RTP_DelayVariationEstimator.
+  std::chrono::microseconds delay_variation{};
+  std::chrono::microseconds queuing_delay{};
+};
+
+// Receiver side statistics of one RTP source after RFC 3550 (A.1, A.3 and
+// A.8), which become report blocks of RTCP receiver reports. A new SSRC starts
+// everything over.
+//
+// Not thread safe. Time is passed in explicitly.
+class RTP_ReceiveStatistics {
+ public:
+  using clock = std::chrono::steady_clock;
+
+  explicit RTP_ReceiveStatistics(uint32_t clock_rate);
+
+  // For every media packet that comes from the network, retransmissions
+  // included. Packets rebuilt from FEC do not count, they have been lost.
+  void on_packet(uint32_t ssrc,
+                 uint16_t sequence_num,
+                 uint32_t timestamp,
+                 size_t payload_size,
+                 clock::time_point arrival);
+
+  // Absolute send time of the packet passed to on_packet() right before.
+  void on_send_time(uint32_t abs_send_time, clock::time_point arrival);
+
+  // Remembered to be echoed back in report blocks, so that the sender can
+  // measure round trip time.
+  void on_sender_report(const RTCP_SenderReport& report,
+                        clock::time_point arrival);
+
+  // Report block for the interval since the previous one. Empty until the
+  // first packet.
+  std::optional<RTCP_ReportBlock> make_report_block(clock::time_point now);
+
+  RTP_ReceiveStats stats() const;
+
+ private:
+  int64_t unwrap(uint16_t sequence_num) const;
+  int64_t expected() const { return m_highest - m_base + 1; }
+
+  uint32_t m_clock_rate{};
+  std::optional<uint32_t> m_ssrc;
+  RTP_JitterEstimator m_jitter;
+  RTP_DelayVariationEstimator m_delay;
+  // Extended sequence numbers of the first and the newest packet.
+  int64_t m_base{};
+  int64_t m_highest{};
+  uint64_t m_received{};
+  uint64_t m_bytes{};
+  // At the previous report block.
+  int64_t m_expected_prior{};
+  uint64_t m_received_prior{};
+  double m_loss_fraction{};
+
+  std::optional<uint32_t> m_last_sr;
+  clock::time_point m_last_sr_arrival;
+};
@@ -0,0 +1,157 @@
+#include "simulcast.hpp"
+
+#include <algorithm>
+#include <bit>
+#include <stop_token>
+#include <thread>
+
+#include "frame_converter.hpp"
+#include "log.hpp"
+
+LOG_MODULE_NAME("SIMULCAST");
+
+namespace {
+// Halved frames of a scale at once: one in the mailbox, one being encoded and
+// one being made.
+constexpr size_t BUFFERS_PER_SCALE = 3;
+
+class SimulcastEncoderImpl : public SimulcastEncoder {
+ public:
+  SimulcastEncoderImpl(uint32_t width,
+                       uint32_t height,
+                       PixelFormat format,
+                       std::vector<SimulcastLayer> layers)
+      : m_width(width),
+        m_height(height),
+        m_format(format),
+        m_layers(std::move(layers)) {}
+
+  bool initialize() {
+    if (m_layers.empty()) {
+      LOG_ERROR("No layers");
+      return false;
+    }
+
+    uint32_t max_scale = 1;
+    for (const auto& layer : m_layers) {
+      if (!layer.encoder) {
+        LOG_ERROR("Layer without encoder");
+        return false;
+      }
+      if (!std::has_single_bit(layer.scale_down_by)) {
+        LOG_ERROR("Layer scaled down by {}, not a power of two",
+                  layer.scale_down_by);
+        return false;
+      }
+      const auto same_scale = [&](const SimulcastLayer& other) {
+        return other.scale_down_by == layer.scale_down_by;
+      };
+      if (std::count_if(m_layers.begin(), m_layers.end(), same_scale) > 1) {
+        LOG_ERROR("Several layers scaled down by {}", layer.scale_down_by);
+        return false;
+      }
+      max_scale = std::max(max_scale, layer.scale_down_by);
+    }
+    if (max_scale > 1 && m_format != PixelFormat::YUV420_planar &&
+        m_format != PixelFormat::NV12) {
+      LOG_ERROR("Can not downscale {} frames", to_string(m_format));
+      return false;
+    }
+
+    // Scale 2^n is halved from 2^(n-1), frames of all scales are made before
+    // any of them is handed out.
+    uint32_t width = m_width;
+    uint32_t height = m_height;
+    for (uint32_t scale = 2; scale <= max_scale; scale *= 2) {
+      if (width % 4 || height % 4) {
+        LOG_ERROR("{}x{} frames can not be scaled down by {}", m_width,
+                  m_height, scale);
+        return false;
+      }
+      m_downscalers.push_back(std::make_unique<FrameDownscaler>(
+          m_format, width, height, BUFFERS_PER_SCALE));
+      width /= 2;
+      height /= 2;
+    }
+    m_frames.resize(m_downscalers.size() + 1);
+
+    for (auto& layer : m_layers) {
+      auto rendition = std::make_unique<Rendition>();
+      rendition->scale_index =
+          static_cast<size_t>(std::countr_zero(layer.scale_down_by));
+      rendition->encoder = layer.encoder.get();
+      rendition->thread = std::jthread{
+          [&rendition = *rendition](std::stop_token stoken) {
+            while (auto frame = rendition.mailbox.take(stoken)) {
+              rendition.encoder->process_frame(frame.data(), frame.meta());
+            }
+          }};
+      LOG_INFO("Layer of {}x{}", m_width / layer.scale_down_by,
+               m_height / layer.scale_down_by);
+      m_renditions.push_back(std::move(rendition));
+    }
+    return true;
+  }
+
+  virtual void process_frame(FrameLease frame) override {
+    m_frames[0] = std::move(frame);
+    for (size_t i = 0; i < m_downscalers.size() && m_frames[i]; ++i) {
+      m_frames[i + 1] = m_downscalers[i]->downscale(m_frames[i]);
+    }
+    for (auto& rendition : m_renditions) {
+      if (auto& frame = m_frames[rendition->scale_index]) {
+        rendition->mailbox.put(std::move(frame));
+      }
+    }
+    // Those of intermediate scales no rendition takes.
+    for (auto& frame : m_frames) {
+      frame.release();
+    }
+  }
+
+  virtual size_t layers_count() const override { return m_layers.size(); }
+
+  virtual Encoder& encoder(size_t index) override {
+    return *m_layers[index].encoder;
+  }
+
+  virtual uint64_t dropped(size_t index) const override {
+    return m_renditions[index]->mailbox.dropped();
+  }
+
+ private:
+  struct Rendition {
+    // Of frames in m_frames.
+    size_t scale_index{};
+    Encoder* encoder{};
+    FrameMailbox mailbox;
+    // Last, so that it is stopped and joined before the mailbox goes.
+    std::jthread thread;
+  };
+
+  uint32_t m_width;
+  uint32_t m_height;
+  PixelFormat m_format;
+  std::vector<SimulcastLayer> m_layers;
+  // Lend frames to renditions, so go before them. The one of index i halves
+  // frames scaled down by 2^i.
+  std::vector<std::unique_ptr<FrameDownscaler>> m_downscalers;
+  // Of the frame being processed, by scale: the captured one, then halved
+  // once, twice and so on.
+  std::vector<FrameLease> m_frames;
+  std::vector<std::unique_ptr<Rendition>> m_renditions;
+};
+}  // namespace
+
+std::unique_ptr<SimulcastEncoder> make_simulcast_encoder(
+    uint32_t width,
+    uint32_t height,
+    PixelFormat format,
+    std::vector<SimulcastLayer> layers) {
+  auto encoder = std::make_unique<SimulcastEncoderImpl>(width, height, format,
+                                                        std::move(layers));
+  if (!encoder->initialize()) {
+    return nullptr;
+  }
+  return encoder;
+}
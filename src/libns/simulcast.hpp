@@ -0,0 +1,56 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+#include "encoder.hpp"
+#include "frame_mailbox.hpp"
+#include "types.hpp"
+
+// Rendition of SimulcastEncoder.
+struct SimulcastLayer {
+  // Power of two the captured width and height are divided by, the encoder
+  // is configured for that resolution.
+  uint32_t scale_down_by = 1;
+  // Notifies a client of its own, which sends the rendition as a stream of its
+  // own: its own SSRC, see UDP_TransmitOptions::ssrc.
+  std::unique_ptr<Encoder> encoder;
+};
+
+// Encodes each captured frame into several renditions at once, say 720p, 360p
+// and 180p, so that a receiver, or a relay on its behalf, can switch to the
+// one its link takes.
+//
+// One downscaler serves all renditions: frames are halved as many times as
+// the smallest one needs, each halving from the one before rather than from
+// the captured frame. Each rendition encodes on a thread of its own, taking
+// frames from a mailbox of its own, so a slow one drops frames of its own
+// without holding up the others or the capture.
+class SimulcastEncoder {
+ public:
+  virtual ~SimulcastEncoder() = default;
+
+  // Captured frame, of the resolution and format the encoder was made for.
+  // Downscaled copies are made right away, on the calling thread, and the
+  // frame goes to the full resolution rendition if there is one, is released
+  // otherwise. One thread at a time.
+  virtual void process_frame(FrameLease frame) = 0;
+
+  virtual size_t layers_count() const = 0;
+  // Of layer `index`, in the order given, e.g. to retune its bitrate.
+  virtual Encoder& encoder(size_t index) = 0;
+  // Frames layer `index` dropped, as it was still encoding an earlier one.
+  virtual uint64_t dropped(size_t index) const = 0;
+};
+
+// Frames are `width` x `height` ones of `format`, which must be I420 or NV12
+// if any layer is scaled down. Fails if a scale is not a power of two or
+// repeats, or if the frame does not halve that many times, see halve_420().
+// Destroying the encoder waits for frames being encoded and drops the others.
+std::unique_ptr<SimulcastEncoder> make_simulcast_encoder(
+    uint32_t width,
+    uint32_t height,
+    PixelFormat format,
+    std::vector<SimulcastLayer> layers);
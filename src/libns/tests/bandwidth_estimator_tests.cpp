@@ -0,0 +1,174 @@
+#include <gtest/gtest.h>
+#include <algorithm>
+#include <vector>
+
+#include "bandwidth_estimator.hpp"
+#include "transport_feedback_generator.hpp"
+
+namespace {
+using namespace std::chrono_literals;
+using clock_type = BandwidthEstimator::clock;
+
+const auto t0 = clock_type::time_point{} + 1h;
+
+constexpr size_t PACKET_SIZE = 1200;
+
+// Sender that follows the estimate, a bottleneck link with a FIFO queue and a
+// receiver that reports arrivals every 50 ms. Feedback goes through the wire
+// format.
+class Simulation {
+ public:
+  Simulation(BandwidthEstimator& estimator, uint64_t link_bitrate)
+      : m_estimator(estimator), m_link_bitrate(link_bitrate) {}
+
+  // Every n-th packet is lost after the bottleneck.
+  void set_loss_period(unsigned period) { m_loss_period = period; }
+  void set_link_bitrate(uint64_t bitrate) { m_link_bitrate = bitrate; }
+
+  void run(std::chrono::milliseconds duration) {
+    const auto end = m_now + duration;
+    while (m_now < end) {
+      send_packet();
+      if (m_now >= m_next_feedback) {
+        deliver_feedback();
+        m_next_feedback = m_now + 50ms;
+      }
+      const auto interval = std::chrono::duration<double>(
+          PACKET_SIZE * 8.0 / m_estimator.estimate().target_bitrate);
+      m_now += std::chrono::duration_cast<clock_type::duration>(interval);
+    }
+  }
+
+  // Queuing delay of the last packet that went through the link.
+  clock_type::duration queue_delay() const { return m_queue_delay; }
+
+ private:
+  void send_packet() {
+    m_estimator.on_packet_sent(m_sequence_num, PACKET_SIZE, m_now);
+
+    const auto serialization = std::chrono::duration_cast<clock_type::duration>(
+        std::chrono::duration<double>(PACKET_SIZE * 8.0 / m_link_bitrate));
+    const auto start = std::max(m_now, m_link_free);
+    m_link_free = start + serialization;
+    m_queue_delay = start - m_now;
+    const auto arrival = m_link_free + 20ms;
+
+    if (m_loss_period == 0 || ++m_sent % m_loss_period != 0) {
+      m_in_flight.emplace_back(m_sequence_num, arrival);
+    }
+    m_sequence_num++;
+  }
+
+  void deliver_feedback() {
+    // Whatever has arrived by now.
+    auto it = m_in_flight.begin();
+    for (; it != m_in_flight.end() && it->second <= m_now; ++it) {
+      m_generator.on_packet(it->first, it->second);
+    }
+    m_in_flight.erase(m_in_flight.begin(), it);
+
+    RTCP_TransportFeedback feedback;
+    while (m_generator.build(feedback)) {
+      std::vector<uint8_t> buffer;
+      ASSERT_FALSE(serialize_transport_feedback(feedback, buffer));
+      auto parsed = deserialize_transport_feedback(buffer);
+      ASSERT_TRUE(parsed.has_value());
+      // Feedback takes the same 20 ms to get back.
+      m_estimator.on_feedback(*parsed, m_now + 20ms);
+    }
+  }
+
+  BandwidthEstimator& m_estimator;
+  TransportFeedbackGenerator m_generator;
+  uint64_t m_link_bitrate{};
+  unsigned m_loss_period{};
+  uint64_t m_sent{};
+  clock_type::time_point m_now = t0;
+  clock_type::time_point m_link_free = t0;
+  clock_type::time_point m_next_feedback = t0 + 50ms;
+  clock_type::duration m_queue_delay{};
+  uint16_t m_sequence_num{};
+  std::vector<std::pair<uint16_t, clock_type::time_point>> m_in_flight;
+};
+}  // namespace
+
+TEST(bandwidth_estimator_tests, starts_at_start_bitrate_test) {
+  BandwidthEstimator estimator{{.start_bitrate = 500'000}};
+  EXPECT_EQ(estimator.estimate().target_bitrate, 500'000);
+  EXPECT_EQ(estimator.estimate().acknowledged_bitrate, 0);
+}
+
+TEST(bandwidth_estimator_tests, ramps_up_on_free_link_test) {
+  BandwidthEstimator estimator{{.start_bitrate = 300'000}};
+  Simulation simulation{estimator, 50'000'000};
+  simulation.run(10s);
+
+  const auto& estimate = estimator.estimate();
+  EXPECT_NE(estimate.usage, BandwidthUsage::overusing);
+  // 8% a second, compounded.
+  EXPECT_GT(estimate.target_bitrate, 600'000);
+  EXPECT_GT(estimate.acknowledged_bitrate, 400'000);
+  EXPECT_EQ(estimate.loss_fraction, 0);
+}
+
+TEST(bandwidth_estimator_tests, backs_off_to_bottleneck_test) {
+  BandwidthEstimator estimator{{.start_bitrate = 3'000'000}};
+  Simulation simulation{estimator, 1'000'000};
+  simulation.run(10s);
+
+  // Settles around the link rate and keeps the queue short, instead of
+  // filling it up.
+  const auto& estimate = estimator.estimate();
+  EXPECT_LT(estimate.target_bitrate, 1'200'000);
+  EXPECT_GT(estimate.target_bitrate, 500'000);
+  EXPECT_LT(simulation.queue_delay(), 200ms);
+}
+
+TEST(bandwidth_estimator_tests, follows_link_drop_test) {
+  BandwidthEstimator estimator{{.start_bitrate = 1'000'000}};
+  Simulation simulation{estimator, 2'000'000};
+  simulation.run(5s);
+  const auto before = estimator.estimate().target_bitrate;
+
+  simulation.set_link_bitrate(500'000);
+  simulation.run(5s);
+  EXPECT_LT(estimator.estimate().target_bitrate, before);
+  EXPECT_LT(estimator.estimate().target_bitrate, 600'000);
+  EXPECT_LT(simulation.queue_delay(), 300ms);
+}
+
+TEST(bandwidth_estimator_tests, backs_off_on_heavy_loss_test) {
+  BandwidthEstimator estimator{{.start_bitrate = 2'000'000}};
+  Simulation simulation{estimator, 50'000'000};
+  simulation.set_loss_period(4);
+  simulation.run(5s);
+
+  const auto& estimate = estimator.estimate();
+  EXPECT_NEAR(estimate.loss_fraction, 0.25, 0.05);
+  EXPECT_LT(estimate.target_bitrate, 1'000'000);
+}
+
+TEST(bandwidth_estimator_tests, stays_within_bounds_test) {
+  BandwidthEstimator estimator{{.start_bitrate = 1'000'000,
+                                .min_bitrate = 800'000,
+                                .max_bitrate = 1'100'000}};
+  Simulation simulation{estimator, 50'000'000};
+  simulation.run(10s);
+  EXPECT_EQ(estimator.estimate().target_bitrate, 1'100'000);
+
+  simulation.set_link_bitrate(200'000);
+  simulation.run(5s);
+  EXPECT_EQ(estimator.estimate().target_bitrate, 800'000);
+}
+
+TEST(bandwidth_estimator_tests, ignores_unknown_packets_test) {
+  BandwidthEstimator estimator{{.start_bitrate = 1'000'000}};
+  RTCP_TransportFeedback feedback;
+  feedback.base_sequence_num = 1000;
+  feedback.arrivals = {0, std::nullopt, 8};
+  estimator.on_feedback(feedback, t0);
+
+  const auto& estimate = estimator.estimate();
+  EXPECT_EQ(estimate.target_bitrate, 1'000'000);
+  EXPECT_EQ(estimate.loss_fraction, 0);
+}
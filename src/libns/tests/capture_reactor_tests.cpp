@@ -0,0 +1,145 @@
+#include <gtest/gtest.h>
+#include <sched.h>
+#include <sys/eventfd.h>
+#include <unistd.h>
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "capture_reactor.hpp"
+
+namespace {
+using namespace std::chrono_literals;
+
+// Readable while signalled, like a device with a frame ready.
+class TestDevice {
+ public:
+  TestDevice() : m_fd(eventfd(0, EFD_NONBLOCK)) {}
+  ~TestDevice() { close(m_fd); }
+
+  int fd() const { return m_fd; }
+
+  void signal() {
+    const uint64_t one = 1;
+    ASSERT_EQ(write(m_fd, &one, sizeof(one)), sizeof(one));
+  }
+
+  // For the handler: takes the frame and counts it.
+  CaptureReactor::Handler handler() {
+    return [this] {
+      uint64_t value{};
+      if (read(m_fd, &value, sizeof(value)) > 0) {
+        std::lock_guard lock(m_lock);
+        m_reads++;
+        m_thread = std::this_thread::get_id();
+        m_cpu = sched_getcpu();
+        m_read.notify_all();
+      }
+    };
+  }
+
+  // False if there are fewer than `count` reads by the deadline.
+  bool wait_for(int count, std::chrono::milliseconds timeout = 1s) {
+    std::unique_lock lock(m_lock);
+    return m_read.wait_for(lock, timeout, [&] { return m_reads >= count; });
+  }
+
+  std::thread::id thread() {
+    std::lock_guard lock(m_lock);
+    return m_thread;
+  }
+
+  int cpu() {
+    std::lock_guard lock(m_lock);
+    return m_cpu;
+  }
+
+ private:
+  int m_fd;
+  std::mutex m_lock;
+  std::condition_variable m_read;
+  int m_reads{};
+  std::thread::id m_thread;
+  int m_cpu{-1};
+};
+}  // namespace
+
+TEST(capture_reactor_tests, devices_share_thread_test) {
+  auto reactor = make_capture_reactor();
+  ASSERT_TRUE(reactor);
+  TestDevice first;
+  TestDevice second;
+  ASSERT_FALSE(reactor->add(first.fd(), first.handler()));
+  ASSERT_FALSE(reactor->add(second.fd(), second.handler()));
+  // Same one twice.
+  EXPECT_TRUE(reactor->add(first.fd(), first.handler()));
+
+  first.signal();
+  second.signal();
+  ASSERT_TRUE(first.wait_for(1));
+  ASSERT_TRUE(second.wait_for(1));
+  EXPECT_EQ(first.thread(), second.thread());
+  EXPECT_NE(first.thread(), std::this_thread::get_id());
+
+  first.signal();
+  EXPECT_TRUE(first.wait_for(2));
+}
+
+TEST(capture_reactor_tests, remove_test) {
+  auto reactor = make_capture_reactor();
+  ASSERT_TRUE(reactor);
+  TestDevice device;
+  ASSERT_FALSE(reactor->add(device.fd(), device.handler()));
+  device.signal();
+  ASSERT_TRUE(device.wait_for(1));
+
+  reactor->remove(device.fd());
+  device.signal();
+  EXPECT_FALSE(device.wait_for(2, 50ms));
+
+  // Handlers may remove themselves.
+  TestDevice once;
+  ASSERT_FALSE(reactor->add(once.fd(), [&, handler = once.handler()] {
+    handler();
+    reactor->remove(once.fd());
+  }));
+  once.signal();
+  ASSERT_TRUE(once.wait_for(1));
+  once.signal();
+  EXPECT_FALSE(once.wait_for(2, 50ms));
+}
+
+TEST(capture_reactor_tests, set_enabled_test) {
+  auto reactor = make_capture_reactor();
+  ASSERT_TRUE(reactor);
+  TestDevice device;
+  ASSERT_FALSE(reactor->add(device.fd(), device.handler()));
+  reactor->set_enabled(device.fd(), false);
+  device.signal();
+  EXPECT_FALSE(device.wait_for(1, 50ms));
+  reactor->set_enabled(device.fd(), true);
+  EXPECT_TRUE(device.wait_for(1));
+}
+
+TEST(capture_reactor_tests, shutdown_test) {
+  TestDevice device;
+  auto reactor = make_capture_reactor();
+  ASSERT_TRUE(reactor);
+  ASSERT_FALSE(reactor->add(device.fd(), device.handler()));
+  // Wakes up from epoll_wait with nothing ready.
+  const auto start = std::chrono::steady_clock::now();
+  reactor.reset();
+  EXPECT_LT(std::chrono::steady_clock::now() - start, 50ms);
+}
+
+TEST(capture_reactor_tests, pinned_thread_test) {
+  auto reactor = make_capture_reactor({.cpu = 0});
+  ASSERT_TRUE(reactor);
+  TestDevice device;
+  ASSERT_FALSE(reactor->add(device.fd(), device.handler()));
+  device.signal();
+  ASSERT_TRUE(device.wait_for(1));
+  EXPECT_EQ(device.cpu(), 0);
+}
@@ -0,0 +1,170 @@
+#include <gtest/gtest.h>
+#include <chrono>
+#include <vector>
+
+#include "encoder.hpp"
+
+namespace {
+using namespace std::chrono_literals;
+
+constexpr uint32_t WIDTH = 320;
+constexpr uint32_t HEIGHT = 240;
+
+class NalCollector : public EncoderClient {
+ public:
+  virtual void on_frame_started() override {
+    EXPECT_FALSE(m_in_frame);
+    m_in_frame = true;
+    m_frames_started++;
+  }
+  virtual void on_frame_ended() override {
+    EXPECT_TRUE(m_in_frame);
+    m_in_frame = false;
+    m_frames_ended++;
+  }
+  virtual void on_nal_encoded(std::span<const uint8_t> data,
+                              PacketRef buffer,
+                              NAL_Metadata meta) override {
+    EXPECT_TRUE(m_in_frame);
+    if (buffer) {
+      EXPECT_EQ(data.data(), buffer.data());
+      m_nals_in_buffers++;
+    }
+    m_bytes += data.size();
+    m_largest_nal = std::max(m_largest_nal, data.size());
+    m_metas.push_back(meta);
+  }
+
+  virtual PacketRef nal_buffer(size_t size) override {
+    return m_pool ? m_pool->acquire() : PacketRef{};
+  }
+
+  PacketBufferPool* m_pool{};
+  int m_nals_in_buffers{};
+  bool m_in_frame{};
+  int m_frames_started{};
+  int m_frames_ended{};
+  size_t m_bytes{};
+  size_t m_largest_nal{};
+  std::vector<NAL_Metadata> m_metas;
+};
+
+// Encodes `count` NV12 frames with a moving gradient, 10 ms apart.
+void encode_frames(Encoder& encoder, int count) {
+  std::vector<uint8_t> frame(frame_size(PixelFormat::NV12, WIDTH, HEIGHT));
+  const auto start = std::chrono::steady_clock::now();
+  for (int i = 0; i < count; ++i) {
+    for (size_t j = 0; j < frame.size(); ++j) {
+      frame[j] = static_cast<uint8_t>(j * 7 + i * 3);
+    }
+    const auto timestamp = start + i * 10ms;
+    encoder.process_frame(
+        frame, CapturedFrameMeta{.timestamp = timestamp,
+                                 .frame_id = frame_id(timestamp),
+                                 .sequence = static_cast<uint32_t>(i)});
+  }
+}
+
+EncoderConfig small_config() {
+  return EncoderConfig{.width = WIDTH,
+                       .height = HEIGHT,
+                       .pixel_format = PixelFormat::NV12,
+                       .interval = {1, 100}};
+}
+}  // namespace
+
+TEST(encoder_tests, rate_control_test) {
+  for (auto rate_control :
+       {RateControl::abr, RateControl::crf, RateControl::cqp}) {
+    NalCollector collector;
+    auto config = small_config();
+    config.rate_control = rate_control;
+    auto encoder = make_encoder(collector, config);
+    ASSERT_TRUE(encoder);
+    encode_frames(*encoder, 5);
+    // Zero latency tune: every frame comes out right away.
+    EXPECT_EQ(collector.m_frames_ended, 5);
+    EXPECT_GT(collector.m_bytes, 0);
+  }
+}
+
+TEST(encoder_tests, bad_config_test) {
+  NalCollector collector;
+  auto config = small_config();
+  config.preset = "no such preset";
+  EXPECT_FALSE(make_encoder(collector, config));
+}
+
+TEST(encoder_tests, threaded_test) {
+  for (bool sliced : {false, true}) {
+    NalCollector collector;
+    auto config = small_config();
+    config.threads = 4;
+    config.sliced_threads = sliced;
+    config.slice_max_size = 300;
+    {
+      auto encoder = make_encoder(collector, config);
+      ASSERT_TRUE(encoder);
+      encode_frames(*encoder, 20);
+    }
+    // Frame threads hold the last few frames back, closing drops them.
+    EXPECT_GE(collector.m_frames_ended, sliced ? 20 : 10);
+    EXPECT_EQ(collector.m_frames_started - collector.m_frames_ended,
+              collector.m_in_frame ? 1 : 0);
+    // Frame by frame, slices in macroblock order.
+    uint32_t frame = collector.m_metas.front().timestamp;
+    uint16_t next_macroblock = 0;
+    for (const auto& meta : collector.m_metas) {
+      if (meta.nal_type != NAL_Type::slice &&
+          meta.nal_type != NAL_Type::slice_idr) {
+        continue;
+      }
+      if (meta.timestamp != frame) {
+        frame = meta.timestamp;
+        next_macroblock = 0;
+      }
+      EXPECT_EQ(meta.first_macroblock, next_macroblock) << sliced;
+      next_macroblock = meta.last_macroblock + 1;
+    }
+  }
+}
+
+// NALs are written straight into buffers of the client, those too big for
+// them into the encoder's own.
+TEST(encoder_tests, client_buffers_test) {
+  PacketBufferPool pool{16, 2048};
+  NalCollector collector;
+  collector.m_pool = &pool;
+  auto encoder = make_encoder(collector, small_config());
+  ASSERT_TRUE(encoder);
+  encode_frames(*encoder, 5);
+  EXPECT_GT(collector.m_nals_in_buffers, 0);
+  EXPECT_EQ(pool.available(), 16);
+}
+
+TEST(encoder_tests, reconfigure_test) {
+  NalCollector collector;
+  auto config = small_config();
+  auto encoder = make_encoder(collector, config);
+  ASSERT_TRUE(encoder);
+  encode_frames(*encoder, 2);
+
+  // Slices of at most 200 bytes from the next frame.
+  config.slice_max_size = 200;
+  config.bitrate_kbps = 5000;
+  EXPECT_FALSE(encoder->reconfigure(config));
+  collector.m_largest_nal = 0;
+  encode_frames(*encoder, 3);
+  EXPECT_EQ(collector.m_frames_ended, 5);
+  EXPECT_LE(collector.m_largest_nal, 200 + 4);
+
+  auto fixed = config;
+  fixed.width = 640;
+  EXPECT_EQ(encoder->reconfigure(fixed), std::errc::operation_not_supported);
+  fixed = config;
+  fixed.preset = "slow";
+  EXPECT_EQ(encoder->reconfigure(fixed), std::errc::operation_not_supported);
+  fixed = config;
+  fixed.rate_control = RateControl::crf;
+  EXPECT_EQ(encoder->reconfigure(fixed), std::errc::operation_not_supported);
+}
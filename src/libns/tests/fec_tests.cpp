@@ -0,0 +1,248 @@
+#include <gtest/gtest.h>
+#include <array>
+#include <map>
+#include <random>
+#include <set>
+#include <vector>
+
+#include "fec.hpp"
+#include "rtp.hpp"
+
+namespace {
+// Media packets with random payloads of various sizes and parity produced for
+// them by FecEncoder.
+struct Stream {
+  std::vector<std::vector<uint8_t>> media;
+  std::vector<std::vector<uint8_t>> fec;
+};
+
+std::vector<uint8_t> make_media_packet(uint16_t seq, std::mt19937& rng) {
+  RTP_PacketHeader header;
+  header.version = 2;
+  header.payload_type = 96;
+  header.sequence_num = seq;
+  header.timestamp = seq / 10;
+  std::vector<uint8_t> packet(RTP_PacketHeader_Size + 1 + rng() % 1400);
+  EXPECT_FALSE(serialize_rtp_header_to(header, packet));
+  for (size_t i = RTP_PacketHeader_Size; i < packet.size(); ++i) {
+    packet[i] = rng();
+  }
+  return packet;
+}
+
+Stream make_stream(FecConfig config,
+                   uint16_t first_seq,
+                   size_t count,
+                   size_t flush_every = 0) {
+  std::mt19937 rng{42};
+  Stream stream;
+  FecEncoder encoder{1500, config};
+  auto sink = [&](std::span<const uint8_t> payload) {
+    stream.fec.emplace_back(payload.begin(), payload.end());
+  };
+  for (size_t i = 0; i < count; ++i) {
+    const uint16_t seq = first_seq + i;
+    auto packet = make_media_packet(seq, rng);
+    // Split in two parts, as transmit does with header and payload.
+    const std::array<std::span<const uint8_t>, 2> parts{
+        std::span{packet}.first(RTP_PacketHeader_Size),
+        std::span{packet}.subspan(RTP_PacketHeader_Size)};
+    encoder.add_packet(seq, parts, sink);
+    stream.media.push_back(std::move(packet));
+    if (flush_every > 0 && (i + 1) % flush_every == 0) {
+      encoder.flush(sink);
+    }
+  }
+  encoder.flush(sink);
+  return stream;
+}
+
+PacketRef to_ref(PacketBufferPool& pool, const std::vector<uint8_t>& data) {
+  auto ref = pool.acquire();
+  EXPECT_TRUE(ref);
+  std::copy(data.begin(), data.end(), ref.data());
+  ref.set_size(data.size());
+  return ref;
+}
+
+// Passes the stream through FecDecoder with given media packets lost, returns
+// recovered packets by sequence number.
+std::map<uint16_t, std::vector<uint8_t>> receive(
+    const Stream& stream,
+    uint16_t first_seq,
+    const std::set<size_t>& lost,
+    bool fec_first = false) {
+  PacketBufferPool pool{4096, 1600};
+  FecDecoder decoder{pool};
+  std::map<uint16_t, std::vector<uint8_t>> recovered;
+  auto sink = [&](PacketRef packet) {
+    const uint16_t seq = packet.data()[2] << 8 | packet.data()[3];
+    EXPECT_FALSE(recovered.contains(seq));
+    recovered[seq] = {packet.bytes().begin(), packet.bytes().end()};
+  };
+
+  auto feed_fec = [&] {
+    for (auto& fec : stream.fec) {
+      auto ref = to_ref(pool, fec);
+      const auto payload = ref.bytes();
+      decoder.on_fec_packet(std::move(ref), payload, sink);
+    }
+  };
+
+  if (fec_first) {
+    feed_fec();
+  }
+  for (size_t i = 0; i < stream.media.size(); ++i) {
+    if (!lost.contains(i)) {
+      decoder.on_media_packet(first_seq + i, to_ref(pool, stream.media[i]),
+                              sink);
+    }
+  }
+  if (!fec_first) {
+    feed_fec();
+  }
+  return recovered;
+}
+}  // namespace
+
+TEST(fec_tests, header_roundtrip_test) {
+  FecHeader header{.base_sequence_num = 65000,
+                   .stride = 5,
+                   .count = 4,
+                   .length_recovery = 0x1234};
+  std::array<uint8_t, FEC_Header_Size> buffer;
+  ASSERT_FALSE(serialize_fec_header(header, buffer));
+  auto parsed = deserialize_fec_header(buffer);
+  ASSERT_TRUE(parsed.has_value());
+  EXPECT_EQ(parsed->base_sequence_num, 65000);
+  EXPECT_EQ(parsed->stride, 5);
+  EXPECT_EQ(parsed->count, 4);
+  EXPECT_EQ(parsed->length_recovery, 0x1234);
+
+  EXPECT_FALSE(
+      deserialize_fec_header(std::span{buffer}.first(FEC_Header_Size - 1)));
+  buffer[2] = 0;
+  EXPECT_FALSE(deserialize_fec_header(buffer));
+}
+
+TEST(fec_tests, xor_bytes_test) {
+  std::mt19937 rng{1};
+  for (size_t size : {0, 1, 7, 8, 15, 16, 31, 33, 64, 127, 128, 129, 1500}) {
+    std::vector<uint8_t> a(size);
+    std::vector<uint8_t> b(size);
+    for (size_t i = 0; i < size; ++i) {
+      a[i] = rng();
+      b[i] = rng();
+    }
+    auto expected = a;
+    for (size_t i = 0; i < size; ++i) {
+      expected[i] ^= b[i];
+    }
+    xor_bytes(a.data(), b.data(), size);
+    EXPECT_EQ(a, expected) << size;
+  }
+}
+
+TEST(fec_tests, disabled_produces_nothing_test) {
+  auto stream = make_stream({}, 0, 50);
+  EXPECT_TRUE(stream.fec.empty());
+}
+
+TEST(fec_tests, row_parity_count_test) {
+  auto stream = make_stream({.row_size = 5}, 0, 23);
+  // 4 full rows and one of 3 packets flushed at the end.
+  EXPECT_EQ(stream.fec.size(), 5);
+
+  stream = make_stream({.row_size = 4, .rows = 3}, 0, 24);
+  // Two full blocks, each with 3 row and 4 column packets.
+  EXPECT_EQ(stream.fec.size(), 14);
+}
+
+TEST(fec_tests, single_loss_per_row_is_recovered_test) {
+  const uint16_t first_seq = 65530;  // Groups span sequence number wraparound.
+  auto stream = make_stream({.row_size = 5}, first_seq, 40);
+  const std::set<size_t> lost{0, 7, 14, 39};
+
+  auto recovered = receive(stream, first_seq, lost);
+  ASSERT_EQ(recovered.size(), lost.size());
+  for (size_t i : lost) {
+    EXPECT_EQ(recovered[static_cast<uint16_t>(first_seq + i)],
+              stream.media[i]);
+  }
+}
+
+TEST(fec_tests, two_losses_in_row_are_not_recovered_without_columns_test) {
+  auto stream = make_stream({.row_size = 5}, 0, 10);
+  auto recovered = receive(stream, 0, {1, 2});
+  EXPECT_TRUE(recovered.empty());
+}
+
+TEST(fec_tests, burst_is_recovered_with_columns_test) {
+  auto stream = make_stream({.row_size = 5, .rows = 4}, 100, 40);
+  // Whole row lost, plus more losses fixed by columns and then rows.
+  const std::set<size_t> lost{5, 6, 7, 8, 9, 10, 16, 21, 22};
+
+  auto recovered = receive(stream, 100, lost);
+  ASSERT_EQ(recovered.size(), lost.size());
+  for (size_t i : lost) {
+    EXPECT_EQ(recovered[100 + i], stream.media[i]);
+  }
+}
+
+TEST(fec_tests, parity_arriving_before_media_test) {
+  auto stream = make_stream({.row_size = 4, .rows = 2}, 0, 16);
+  const std::set<size_t> lost{3, 9};
+
+  auto recovered = receive(stream, 0, lost, true);
+  // Last packet of each group is rebuilt before it arrives, which is fine.
+  for (size_t i : lost) {
+    EXPECT_TRUE(recovered.contains(i));
+  }
+  for (auto& [seq, packet] : recovered) {
+    EXPECT_EQ(packet, stream.media[seq]);
+  }
+}
+
+TEST(fec_tests, flushed_partial_blocks_test) {
+  // Frames of 7 packets, blocks of 3x3 ending early on every frame.
+  auto stream = make_stream({.row_size = 3, .rows = 3}, 0, 28, 7);
+  const std::set<size_t> lost{1, 4, 6, 8, 13, 20, 27};
+
+  auto recovered = receive(stream, 0, lost);
+  ASSERT_EQ(recovered.size(), lost.size());
+  for (size_t i : lost) {
+    EXPECT_EQ(recovered[i], stream.media[i]);
+  }
+}
+
+TEST(fec_tests, config_change_applies_on_next_block_test) {
+  std::mt19937 rng{3};
+  FecEncoder encoder{1500, {.row_size = 4}};
+  std::vector<FecHeader> headers;
+  auto sink = [&](std::span<const uint8_t> payload) {
+    headers.push_back(*deserialize_fec_header(payload));
+  };
+  auto add = [&](uint16_t seq) {
+    auto packet = make_media_packet(seq, rng);
+    encoder.add_packet(
+        seq, std::array<std::span<const uint8_t>, 1>{packet}, sink);
+  };
+
+  add(0);
+  add(1);
+  encoder.set_config({.row_size = 2});
+  add(2);
+  add(3);
+  add(4);
+  add(5);
+  encoder.set_config({});
+  add(6);
+  add(7);
+  encoder.flush(sink);
+
+  ASSERT_EQ(headers.size(), 2);
+  EXPECT_EQ(headers[0].base_sequence_num, 0);
+  EXPECT_EQ(headers[0].count, 4);
+  EXPECT_EQ(headers[1].base_sequence_num, 4);
+  EXPECT_EQ(headers[1].count, 2);
+}
@@ -0,0 +1,211 @@
+#include <gtest/gtest.h>
+#include <random>
+#include <vector>
+
+#include "frame_converter.hpp"
+
+namespace {
+std::vector<uint8_t> random_yuyv(uint32_t width, uint32_t height) {
+  std::mt19937 generator{width * 31 + height};
+  std::uniform_int_distribution<int> byte{0, 255};
+  std::vector<uint8_t> frame(
+      frame_size(PixelFormat::YUV422_packed, width, height));
+  for (auto& b : frame) {
+    b = static_cast<uint8_t>(byte(generator));
+  }
+  return frame;
+}
+
+std::vector<uint8_t> convert(const std::vector<uint8_t>& yuyv,
+                             uint32_t width,
+                             uint32_t height,
+                             PixelFormat to,
+                             SimdLevel level) {
+  std::vector<uint8_t> result(frame_size(to, width, height), 0xEE);
+  EXPECT_FALSE(convert_yuyv(yuyv, width, height, to, result, level));
+  return result;
+}
+
+std::vector<SimdLevel> supported_levels() {
+  std::vector<SimdLevel> result;
+  for (auto level : {SimdLevel::scalar, SimdLevel::sse2, SimdLevel::avx2,
+                     SimdLevel::avx512}) {
+    if (level <= simd_level()) {
+      result.push_back(level);
+    }
+  }
+  return result;
+}
+}  // namespace
+
+TEST(frame_converter_tests, scalar_test) {
+  // Two rows of two pixels: Y0 U Y1 V each.
+  const std::vector<uint8_t> yuyv{10, 100, 20, 200, 30, 101, 40, 202};
+  EXPECT_EQ(convert(yuyv, 2, 2, PixelFormat::YUV420_planar, SimdLevel::scalar),
+            (std::vector<uint8_t>{10, 20, 30, 40, 101, 201}));
+  EXPECT_EQ(convert(yuyv, 2, 2, PixelFormat::NV12, SimdLevel::scalar),
+            (std::vector<uint8_t>{10, 20, 30, 40, 101, 201}));
+
+  // Odd last row has chroma of its own.
+  const std::vector<uint8_t> row{1, 2, 3, 4, 5, 6, 7, 8};
+  EXPECT_EQ(convert(row, 4, 1, PixelFormat::YUV420_planar, SimdLevel::scalar),
+            (std::vector<uint8_t>{1, 3, 5, 7, 2, 6, 4, 8}));
+  EXPECT_EQ(convert(row, 4, 1, PixelFormat::NV12, SimdLevel::scalar),
+            (std::vector<uint8_t>{1, 3, 5, 7, 2, 4, 6, 8}));
+}
+
+// Widths around vector sizes, so that every kernel leaves pixels over to the
+// narrower ones.
+TEST(frame_converter_tests, simd_matches_scalar_test) {
+  const std::pair<uint32_t, uint32_t> sizes[] = {
+      {2, 1},   {16, 2},  {30, 3},    {64, 4},     {98, 5},
+      {128, 6}, {250, 7}, {640, 360}, {1280, 720}, {1918, 1081}};
+  for (const auto& [width, height] : sizes) {
+    const auto yuyv = random_yuyv(width, height);
+    for (auto to : {PixelFormat::YUV420_planar, PixelFormat::NV12}) {
+      const auto expected = convert(yuyv, width, height, to, SimdLevel::scalar);
+      for (auto level : supported_levels()) {
+        EXPECT_EQ(convert(yuyv, width, height, to, level), expected)
+            << width << "x" << height << " " << to_string(to) << " "
+            << to_string(level);
+      }
+    }
+  }
+}
+
+TEST(frame_converter_tests, bad_arguments_test) {
+  std::vector<uint8_t> dst(1024);
+  const auto yuyv = random_yuyv(16, 16);
+  EXPECT_EQ(convert_yuyv(yuyv, 15, 16, PixelFormat::NV12, dst),
+            std::errc::invalid_argument);
+  EXPECT_EQ(convert_yuyv(yuyv, 16, 16, PixelFormat::YUV422_packed, dst),
+            std::errc::invalid_argument);
+  EXPECT_EQ(convert_yuyv(yuyv, 16, 17, PixelFormat::NV12, dst),
+            std::errc::message_size);
+  EXPECT_EQ(convert_yuyv(yuyv, 16, 16, PixelFormat::NV12,
+                         std::span{dst}.first(100)),
+            std::errc::message_size);
+}
+
+TEST(frame_converter_tests, converter_test) {
+  constexpr uint32_t width = 64;
+  constexpr uint32_t height = 32;
+  auto yuyv = random_yuyv(width, height);
+  const FrameLease captured{yuyv, CapturedFrameMeta{.frame_id = 42}};
+
+  FrameConverter converter{PixelFormat::NV12, width, height, 2};
+  auto first = converter.convert(captured);
+  ASSERT_TRUE(first);
+  EXPECT_EQ(first.meta().frame_id, 42);
+  EXPECT_EQ(std::vector<uint8_t>(first.data().begin(), first.data().end()),
+            convert(yuyv, width, height, PixelFormat::NV12, simd_level()));
+
+  // Out of buffers till one is released.
+  auto second = converter.convert(captured);
+  ASSERT_TRUE(second);
+  EXPECT_NE(first.data().data(), second.data().data());
+  EXPECT_FALSE(converter.convert(captured));
+  auto* reused = first.data().data();
+  first.release();
+  EXPECT_EQ(converter.convert(captured).data().data(), reused);
+
+  // Wrong size.
+  auto small = random_yuyv(width, height / 2);
+  EXPECT_FALSE(converter.convert(FrameLease{small, {}}));
+}
+
+namespace {
+std::vector<uint8_t> random_frame(PixelFormat format,
+                                  uint32_t width,
+                                  uint32_t height) {
+  std::mt19937 generator{width * 37 + height};
+  std::uniform_int_distribution<int> byte{0, 255};
+  std::vector<uint8_t> frame(frame_size(format, width, height));
+  for (auto& b : frame) {
+    b = static_cast<uint8_t>(byte(generator));
+  }
+  return frame;
+}
+
+std::vector<uint8_t> halve(const std::vector<uint8_t>& src,
+                           uint32_t width,
+                           uint32_t height,
+                           PixelFormat format,
+                           SimdLevel level) {
+  std::vector<uint8_t> result(frame_size(format, width / 2, height / 2), 0xEE);
+  EXPECT_FALSE(halve_420(src, width, height, format, result, level));
+  return result;
+}
+}  // namespace
+
+TEST(frame_converter_tests, halve_scalar_test) {
+  // 4x4 luma, then chroma: 2x2 U and V planes, or two rows of two UV pairs.
+  const std::vector<uint8_t> frame{
+      0,  1,  10, 20,  //
+      2,  4,  30, 40,  //
+      50, 50, 9,  9,   //
+      50, 51, 9,  9,   //
+      1,  2,  3,  4,   //
+      5,  6,  7,  8};
+  // Rows first: (0+2+1)/2 = 1 and (1+4+1)/2 = 3, then (1+3+1)/2 = 2.
+  EXPECT_EQ(
+      halve(frame, 4, 4, PixelFormat::YUV420_planar, SimdLevel::scalar),
+      (std::vector<uint8_t>{2, 25, 51, 9, 3, 7}));
+  EXPECT_EQ(halve(frame, 4, 4, PixelFormat::NV12, SimdLevel::scalar),
+            (std::vector<uint8_t>{2, 25, 51, 9, 4, 5}));
+}
+
+TEST(frame_converter_tests, halve_simd_matches_scalar_test) {
+  const std::pair<uint32_t, uint32_t> sizes[] = {
+      {4, 4},     {32, 4},    {60, 8},     {128, 12},
+      {252, 16},  {640, 360}, {1280, 720}, {1916, 1080}};
+  for (const auto& [width, height] : sizes) {
+    for (auto format : {PixelFormat::YUV420_planar, PixelFormat::NV12}) {
+      const auto src = random_frame(format, width, height);
+      const auto expected =
+          halve(src, width, height, format, SimdLevel::scalar);
+      for (auto level : supported_levels()) {
+        EXPECT_EQ(halve(src, width, height, format, level), expected)
+            << width << "x" << height << " " << to_string(format) << " "
+            << to_string(level);
+      }
+    }
+  }
+}
+
+TEST(frame_converter_tests, halve_bad_arguments_test) {
+  std::vector<uint8_t> dst(1024);
+  const auto src = random_frame(PixelFormat::NV12, 16, 16);
+  EXPECT_EQ(halve_420(src, 14, 16, PixelFormat::NV12, dst),
+            std::errc::invalid_argument);
+  EXPECT_EQ(halve_420(src, 16, 18, PixelFormat::NV12, dst),
+            std::errc::invalid_argument);
+  EXPECT_EQ(halve_420(src, 16, 16, PixelFormat::YUV422_packed, dst),
+            std::errc::invalid_argument);
+  EXPECT_EQ(halve_420(src, 16, 20, PixelFormat::NV12, dst),
+            std::errc::message_size);
+  EXPECT_EQ(
+      halve_420(src, 16, 16, PixelFormat::NV12, std::span{dst}.first(50)),
+      std::errc::message_size);
+}
+
+TEST(frame_converter_tests, downscaler_test) {
+  constexpr uint32_t width = 64;
+  constexpr uint32_t height = 32;
+  auto src = random_frame(PixelFormat::NV12, width, height);
+  const FrameLease frame{src, CapturedFrameMeta{.frame_id = 7}};
+
+  FrameDownscaler downscaler{PixelFormat::NV12, width, height, 1};
+  EXPECT_EQ(downscaler.width(), width / 2);
+  EXPECT_EQ(downscaler.height(), height / 2);
+  auto halved = downscaler.downscale(frame);
+  ASSERT_TRUE(halved);
+  EXPECT_EQ(halved.meta().frame_id, 7);
+  EXPECT_EQ(std::vector<uint8_t>(halved.data().begin(), halved.data().end()),
+            halve(src, width, height, PixelFormat::NV12, simd_level()));
+
+  // Out of buffers till the one is released.
+  EXPECT_FALSE(downscaler.downscale(frame));
+  halved.release();
+  EXPECT_TRUE(downscaler.downscale(frame));
+}
@@ -0,0 +1,116 @@
+#include <gtest/gtest.h>
+#include <array>
+#include <chrono>
+#include <future>
+#include <thread>
+#include <vector>
+
+#include "frame_mailbox.hpp"
+
+namespace {
+using namespace std::chrono_literals;
+
+// Remembers which buffers came back.
+class TestLender : public FrameLender {
+ public:
+  virtual void return_frame(size_t slot) override { returned.push_back(slot); }
+
+  FrameLease lend(size_t slot) {
+    const CapturedFrameMeta meta{.timestamp = std::chrono::steady_clock::now(),
+                                 .frame_id = static_cast<uint32_t>(slot)};
+    return FrameLease{buffers[slot], meta, this, slot};
+  }
+
+  std::array<std::array<uint8_t, 16>, 4> buffers{};
+  std::vector<size_t> returned;
+};
+}  // namespace
+
+TEST(frame_mailbox_tests, lease_test) {
+  TestLender lender;
+  {
+    auto lease = lender.lend(0);
+    ASSERT_TRUE(lease);
+    EXPECT_EQ(lease.data().data(), lender.buffers[0].data());
+
+    // Moving does not return it.
+    FrameLease moved = std::move(lease);
+    EXPECT_FALSE(lease);
+    EXPECT_TRUE(lender.returned.empty());
+
+    moved = lender.lend(1);
+    EXPECT_EQ(lender.returned, std::vector<size_t>{0});
+    moved.release();
+    EXPECT_FALSE(moved);
+    EXPECT_EQ(lender.returned, (std::vector<size_t>{0, 1}));
+    moved.release();
+    EXPECT_EQ(lender.returned.size(), 2);
+
+    auto destroyed = lender.lend(2);
+  }
+  EXPECT_EQ(lender.returned, (std::vector<size_t>{0, 1, 2}));
+
+  // Nobody to give it back to.
+  uint8_t byte{};
+  FrameLease{{&byte, 1}, {}}.release();
+}
+
+TEST(frame_mailbox_tests, latest_frame_wins_test) {
+  TestLender lender;
+  FrameMailbox mailbox;
+  mailbox.put(lender.lend(0));
+  mailbox.put(lender.lend(1));
+  // The first one was never taken, and is back already.
+  EXPECT_EQ(lender.returned, std::vector<size_t>{0});
+  mailbox.put(lender.lend(2));
+  EXPECT_EQ(lender.returned, (std::vector<size_t>{0, 1}));
+  EXPECT_EQ(mailbox.dropped(), 2);
+
+  {
+    auto frame = mailbox.take();
+    ASSERT_TRUE(frame);
+    EXPECT_EQ(frame.meta().frame_id, 2);
+    // Taken frames are not dropped by later ones.
+    mailbox.put(lender.lend(3));
+    EXPECT_EQ(mailbox.dropped(), 2);
+  }
+  EXPECT_EQ(lender.returned, (std::vector<size_t>{0, 1, 2}));
+  EXPECT_EQ(mailbox.take().meta().frame_id, 3);
+}
+
+TEST(frame_mailbox_tests, take_waits_test) {
+  TestLender lender;
+  FrameMailbox mailbox;
+  auto taken = std::async(std::launch::async, [&] {
+    return mailbox.take().meta().frame_id;
+  });
+  EXPECT_EQ(taken.wait_for(20ms), std::future_status::timeout);
+  mailbox.put(lender.lend(3));
+  EXPECT_EQ(taken.get(), 3);
+}
+
+TEST(frame_mailbox_tests, close_test) {
+  TestLender lender;
+  FrameMailbox mailbox;
+  auto taken = std::async(std::launch::async,
+                          [&] { return static_cast<bool>(mailbox.take()); });
+  std::this_thread::sleep_for(10ms);
+  mailbox.close();
+  EXPECT_FALSE(taken.get());
+
+  // Returned straight away.
+  mailbox.put(lender.lend(0));
+  EXPECT_EQ(lender.returned, std::vector<size_t>{0});
+  EXPECT_FALSE(mailbox.take());
+  EXPECT_EQ(mailbox.dropped(), 0);
+}
+
+TEST(frame_mailbox_tests, stop_token_test) {
+  FrameMailbox mailbox;
+  std::jthread consumer{[&](std::stop_token stoken) {
+    EXPECT_FALSE(mailbox.take(stoken));
+  }};
+  std::this_thread::sleep_for(10ms);
+  consumer.request_stop();
+  consumer.join();
+}
@@ -0,0 +1,124 @@
+#include <gtest/gtest.h>
+
+#include "frame_trace.hpp"
+#include "types.hpp"
+
+namespace {
+using namespace std::chrono_literals;
+using clock_type = FrameTracer::clock;
+
+const TraceStageReport* find_stage(const std::vector<TraceStageReport>& report,
+                                   TraceStage stage) {
+  for (const auto& s : report) {
+    if (s.stage == stage) {
+      return &s;
+    }
+  }
+  return nullptr;
+}
+}  // namespace
+
+TEST(frame_trace_tests, histogram_percentiles_test) {
+  LatencyHistogram histogram;
+  EXPECT_EQ(histogram.percentile(50), 0us);
+
+  // 1 to 100 ms.
+  for (int i = 1; i <= 100; ++i) {
+    histogram.add(std::chrono::milliseconds{i});
+  }
+  EXPECT_EQ(histogram.count(), 100);
+  EXPECT_EQ(histogram.max(), 100ms);
+  EXPECT_NEAR(histogram.mean().count(), 50'500, 1);
+  // Within the resolution of 1/8 of the value.
+  EXPECT_GE(histogram.percentile(50), 50ms);
+  EXPECT_LE(histogram.percentile(50), 50ms * 9 / 8);
+  EXPECT_GE(histogram.percentile(99), 99ms);
+  EXPECT_LE(histogram.percentile(99), 100ms);
+  EXPECT_EQ(histogram.percentile(100), 100ms);
+}
+
+TEST(frame_trace_tests, histogram_small_and_huge_values_test) {
+  LatencyHistogram histogram;
+  histogram.add(3us);
+  EXPECT_EQ(histogram.percentile(50), 3us);
+  // Way past the last bucket, still accounted for.
+  histogram.add(1h);
+  EXPECT_EQ(histogram.count(), 2);
+  EXPECT_EQ(histogram.percentile(100), 1h);
+  EXPECT_EQ(histogram.max(), 1h);
+}
+
+TEST(frame_trace_tests, stages_test) {
+  FrameTracer tracer;
+  const auto start = clock_type::now();
+  for (uint32_t frame = 0; frame < 10; ++frame) {
+    const auto captured = start + frame * 40ms;
+    tracer.record(frame, TraceStage::captured, captured);
+    tracer.record(frame, TraceStage::encode_started, captured + 1ms);
+    tracer.record(frame, TraceStage::encoded, captured + 6ms);
+    // Every packet of the frame, only the first one counts.
+    for (int packet = 0; packet < 5; ++packet) {
+      tracer.record(frame, TraceStage::sent, captured + 7ms + packet * 1ms);
+    }
+    // Nothing decoded, rendered right after it is sent.
+    tracer.record(frame, TraceStage::rendered, captured + 10ms);
+  }
+
+  const auto report = tracer.take_report();
+  ASSERT_EQ(report.size(), 4);
+  EXPECT_EQ(report[0].stage, TraceStage::encode_started);
+  EXPECT_EQ(report[3].stage, TraceStage::rendered);
+
+  const auto* encoded = find_stage(report, TraceStage::encoded);
+  ASSERT_TRUE(encoded);
+  EXPECT_EQ(encoded->since_previous.count(), 10);
+  EXPECT_EQ(encoded->since_previous.max(), 5ms);
+  EXPECT_EQ(encoded->since_capture.max(), 6ms);
+
+  const auto* sent = find_stage(report, TraceStage::sent);
+  ASSERT_TRUE(sent);
+  EXPECT_EQ(sent->since_previous.count(), 10);
+  EXPECT_EQ(sent->since_previous.max(), 1ms);
+
+  const auto* rendered = find_stage(report, TraceStage::rendered);
+  ASSERT_TRUE(rendered);
+  EXPECT_EQ(rendered->since_previous.max(), 3ms);
+  EXPECT_EQ(rendered->since_capture.max(), 10ms);
+
+  // Taken, nothing new since then.
+  EXPECT_TRUE(tracer.take_report().empty());
+}
+
+// Frames that did not get to the next stage before too many newer ones came
+// are forgotten, they do not mix with new frames.
+TEST(frame_trace_tests, frames_in_flight_test) {
+  FrameTracer tracer{2};
+  const auto start = clock_type::now();
+  tracer.record(1, TraceStage::captured, start);
+  tracer.record(2, TraceStage::captured, start + 10ms);
+  tracer.record(3, TraceStage::captured, start + 20ms);
+  tracer.record(3, TraceStage::encoded, start + 25ms);
+  tracer.record(2, TraceStage::encoded, start + 30ms);
+  // Gone with the third one.
+  tracer.record(1, TraceStage::encoded, start + 35ms);
+
+  const auto report = tracer.take_report();
+  ASSERT_EQ(report.size(), 1);
+  EXPECT_EQ(report[0].since_capture.count(), 2);
+  EXPECT_EQ(report[0].since_capture.max(), 20ms);
+  // Frame 1 is there again, but without its capture.
+  EXPECT_EQ(report[0].since_previous.count(), 2);
+}
+
+TEST(frame_trace_tests, frame_capture_time_test) {
+  const auto now = clock_type::now();
+  const auto captured = now - 123ms;
+  const auto id = frame_id(captured);
+  EXPECT_EQ(frame_capture_time(id, now),
+            std::chrono::floor<std::chrono::milliseconds>(captured));
+
+  // Capture before the lower 32 bits of milliseconds wrapped.
+  const auto after_wrap = clock_type::time_point{(int64_t{5} << 32) * 1ms};
+  EXPECT_EQ(frame_capture_time(frame_id(after_wrap - 10ms), after_wrap + 5ms),
+            after_wrap - 10ms);
+}
@@ -0,0 +1,93 @@
+#include "impairment_proxy.hpp"
+
+#include <algorithm>
+
+using asio::ip::udp;
+
+ImpairmentProxy::ImpairmentProxy(asio::io_context& ctx,
+                                 uint16_t receiver_port,
+                                 ImpairmentConfig config)
+    : m_socket(ctx, udp::endpoint{asio::ip::address_v4::loopback(), 0}),
+      m_receiver(asio::ip::address_v4::loopback(), receiver_port),
+      m_timer(ctx),
+      m_config(config) {
+  receive();
+}
+
+std::chrono::microseconds ImpairmentProxy::take_max_queue_delay() {
+  return std::chrono::microseconds{m_max_queue_delay_us.exchange(0)};
+}
+
+void ImpairmentProxy::receive() {
+  m_socket.async_receive_from(
+      asio::buffer(m_buffer), m_from,
+      [this](std::error_code ec, size_t bytes_received) {
+        if (ec == asio::error::operation_aborted) {
+          return;
+        }
+        if (!ec) {
+          on_datagram(std::span{m_buffer}.first(bytes_received));
+        }
+        receive();
+      });
+}
+
+void ImpairmentProxy::on_datagram(std::span<const uint8_t> data) {
+  std::error_code ec;
+  if (m_from == m_receiver) {
+    if (m_sender) {
+      m_socket.send_to(asio::buffer(data.data(), data.size()), *m_sender, {},
+                       ec);
+    }
+    return;
+  }
+  m_sender = m_from;
+
+  if (m_config.loss_period > 0 &&
+      ++m_forwarded % m_config.loss_period == 0) {
+    m_dropped++;
+    return;
+  }
+
+  const auto now = clock::now();
+  const auto start = std::max(now, m_link_free);
+  const auto queue_delay =
+      std::chrono::duration_cast<std::chrono::microseconds>(start - now);
+  if (queue_delay > m_config.max_queue_delay) {
+    m_dropped++;
+    return;
+  }
+  if (queue_delay.count() > m_max_queue_delay_us) {
+    m_max_queue_delay_us = queue_delay.count();
+  }
+
+  auto serialization = clock::duration::zero();
+  if (m_config.bitrate > 0) {
+    serialization = std::chrono::duration_cast<clock::duration>(
+        std::chrono::duration<double>(data.size() * 8.0 / m_config.bitrate));
+  }
+  m_link_free = start + serialization;
+
+  m_queue.push_back({m_link_free + m_config.delay, {data.begin(), data.end()}});
+  if (m_queue.size() == 1) {
+    schedule_delivery();
+  }
+}
+
+void ImpairmentProxy::schedule_delivery() {
+  // Delivery times only grow, the queue front is always due first.
+  m_timer.expires_at(m_queue.front().deliver_at);
+  m_timer.async_wait([this](std::error_code ec) {
+    if (ec) {
+      return;
+    }
+    const auto now = clock::now();
+    while (!m_queue.empty() && m_queue.front().deliver_at <= now) {
+      m_socket.send_to(asio::buffer(m_queue.front().data), m_receiver, {}, ec);
+      m_queue.pop_front();
+    }
+    if (!m_queue.empty()) {
+      schedule_delivery();
+    }
+  });
+}
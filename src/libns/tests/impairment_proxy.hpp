@@ -0,0 +1,68 @@
+#pragma once
+
+#include <asio.hpp>
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <deque>
+#include <optional>
+#include <span>
+#include <vector>
+
+struct ImpairmentConfig {
+  // Bottleneck rate in bits per second, zero for no limit.
+  uint64_t bitrate = 0;
+  // One-way delay on top of the bottleneck queue.
+  std::chrono::milliseconds delay{};
+  // Every n-th packet is lost, zero for no loss.
+  unsigned loss_period = 0;
+  // Packets that would wait longer than that in the bottleneck queue are
+  // dropped, like with a router of a finite buffer.
+  std::chrono::milliseconds max_queue_delay{500};
+};
+
+// UDP proxy on loopback standing in for the network between a sender and a
+// receiver. Datagrams from the sender go through a bottleneck link with a
+// FIFO queue, delay and loss. Whatever the receiver sends back (feedback) goes
+// to the sender as it is. Runs on io_context thread.
+class ImpairmentProxy {
+ public:
+  using clock = std::chrono::steady_clock;
+
+  ImpairmentProxy(asio::io_context& ctx,
+                  uint16_t receiver_port,
+                  ImpairmentConfig config);
+
+  // Where the sender should send to.
+  uint16_t port() const { return m_socket.local_endpoint().port(); }
+
+  // Longest bottleneck queuing delay since the previous call. May be called
+  // from any thread.
+  std::chrono::microseconds take_max_queue_delay();
+  size_t dropped_packets() const { return m_dropped; }
+
+ private:
+  struct Delayed {
+    clock::time_point deliver_at;
+    std::vector<uint8_t> data;
+  };
+
+  void receive();
+  void on_datagram(std::span<const uint8_t> data);
+  void schedule_delivery();
+
+  asio::ip::udp::socket m_socket;
+  asio::ip::udp::endpoint m_receiver;
+  std::optional<asio::ip::udp::endpoint> m_sender;
+  asio::ip::udp::endpoint m_from;
+  asio::steady_timer m_timer;
+  ImpairmentConfig m_config;
+  std::array<uint8_t, 2048> m_buffer;
+
+  std::deque<Delayed> m_queue;
+  clock::time_point m_link_free;
+  uint64_t m_forwarded{};
+  std::atomic<size_t> m_dropped{};
+  std::atomic<int64_t> m_max_queue_delay_us{};
+};
@@ -0,0 +1,166 @@
+#include <gtest/gtest.h>
+#include <vector>
+
+#include "jitter_buffer.hpp"
+
+namespace {
+using namespace std::chrono_literals;
+using clock_type = JitterBuffer::clock;
+
+struct ReleasedFrame {
+  std::vector<uint16_t> sequence_nums;
+  bool complete{};
+};
+
+class RecordingListener : public JitterBufferListener {
+ public:
+  void on_frame_released(std::span<ReceivedPacket> packets,
+                         bool complete) override {
+    ReleasedFrame frame{.complete = complete};
+    for (auto& p : packets) {
+      frame.sequence_nums.push_back(p.sequence_num);
+    }
+    frames.push_back(std::move(frame));
+  }
+
+  std::vector<ReleasedFrame> frames;
+};
+
+ReceivedPacket make_packet(uint16_t seq, uint32_t timestamp,
+                           bool marker = false) {
+  ReceivedPacket p;
+  p.sequence_num = seq;
+  p.nal_meta.timestamp = timestamp;
+  p.marker = marker;
+  return p;
+}
+
+const auto t0 = clock_type::time_point{} + 1h;
+}  // namespace
+
+TEST(jitter_buffer_tests, frame_with_marker_released_immediately_test) {
+  RecordingListener listener;
+  JitterBuffer jb{listener};
+
+  jb.insert(make_packet(10, 100), t0);
+  jb.insert(make_packet(11, 100), t0);
+  EXPECT_TRUE(listener.frames.empty());
+  jb.insert(make_packet(12, 100, true), t0);
+
+  ASSERT_EQ(listener.frames.size(), 1);
+  EXPECT_TRUE(listener.frames[0].complete);
+  EXPECT_EQ(listener.frames[0].sequence_nums,
+            (std::vector<uint16_t>{10, 11, 12}));
+  EXPECT_FALSE(jb.next_deadline().has_value());
+}
+
+TEST(jitter_buffer_tests, frame_released_when_next_one_starts_test) {
+  RecordingListener listener;
+  JitterBuffer jb{listener};
+
+  jb.insert(make_packet(1, 100), t0);
+  jb.insert(make_packet(2, 100), t0);
+  EXPECT_TRUE(listener.frames.empty());
+  jb.insert(make_packet(3, 200), t0);
+
+  ASSERT_EQ(listener.frames.size(), 1);
+  EXPECT_TRUE(listener.frames[0].complete);
+  EXPECT_EQ(listener.frames[0].sequence_nums, (std::vector<uint16_t>{1, 2}));
+}
+
+TEST(jitter_buffer_tests, reordered_packets_are_sorted_test) {
+  RecordingListener listener;
+  JitterBuffer jb{listener};
+
+  jb.insert(make_packet(5, 100), t0);
+  jb.insert(make_packet(7, 100, true), t0);
+  EXPECT_TRUE(listener.frames.empty());
+  jb.insert(make_packet(6, 100), t0 + 1ms);
+
+  ASSERT_EQ(listener.frames.size(), 1);
+  EXPECT_TRUE(listener.frames[0].complete);
+  EXPECT_EQ(listener.frames[0].sequence_nums,
+            (std::vector<uint16_t>{5, 6, 7}));
+}
+
+TEST(jitter_buffer_tests, incomplete_frame_released_on_deadline_test) {
+  RecordingListener listener;
+  JitterBuffer jb{listener, JitterBufferConfig{.min_delay = 10ms}};
+
+  jb.insert(make_packet(1, 100), t0);
+  jb.insert(make_packet(3, 100, true), t0 + 1ms);
+
+  ASSERT_TRUE(jb.next_deadline().has_value());
+  EXPECT_EQ(*jb.next_deadline(), t0 + 10ms);
+
+  jb.poll(t0 + 9ms);
+  EXPECT_TRUE(listener.frames.empty());
+
+  jb.poll(t0 + 10ms);
+  ASSERT_EQ(listener.frames.size(), 1);
+  EXPECT_FALSE(listener.frames[0].complete);
+  EXPECT_EQ(listener.frames[0].sequence_nums, (std::vector<uint16_t>{1, 3}));
+  EXPECT_EQ(jb.stats().packets_lost, 1);
+  EXPECT_EQ(jb.stats().frames_incomplete, 1);
+
+  // Missing packet shows up too late.
+  jb.insert(make_packet(2, 100), t0 + 11ms);
+  EXPECT_EQ(listener.frames.size(), 1);
+  EXPECT_EQ(jb.stats().packets_late, 1);
+
+  jb.insert(make_packet(4, 200, true), t0 + 100ms);
+  ASSERT_EQ(listener.frames.size(), 2);
+  EXPECT_TRUE(listener.frames[1].complete);
+  EXPECT_EQ(listener.frames[1].sequence_nums, (std::vector<uint16_t>{4}));
+}
+
+TEST(jitter_buffer_tests, sequence_wraparound_test) {
+  RecordingListener listener;
+  JitterBuffer jb{listener};
+
+  jb.insert(make_packet(65534, 100), t0);
+  jb.insert(make_packet(0, 100), t0);
+  jb.insert(make_packet(65535, 100), t0);
+  jb.insert(make_packet(1, 100, true), t0);
+
+  ASSERT_EQ(listener.frames.size(), 1);
+  EXPECT_TRUE(listener.frames[0].complete);
+  EXPECT_EQ(listener.frames[0].sequence_nums,
+            (std::vector<uint16_t>{65534, 65535, 0, 1}));
+}
+
+TEST(jitter_buffer_tests, duplicates_are_dropped_test) {
+  RecordingListener listener;
+  JitterBuffer jb{listener};
+
+  jb.insert(make_packet(1, 100), t0);
+  jb.insert(make_packet(1, 100), t0);
+  jb.insert(make_packet(2, 100, true), t0);
+
+  ASSERT_EQ(listener.frames.size(), 1);
+  EXPECT_EQ(listener.frames[0].sequence_nums, (std::vector<uint16_t>{1, 2}));
+  EXPECT_EQ(jb.stats().packets_duplicate, 1);
+}
+
+TEST(jitter_buffer_tests, target_delay_follows_jitter_test) {
+  RecordingListener listener;
+  JitterBuffer jb{listener, JitterBufferConfig{.min_delay = 1ms,
+                                               .max_delay = 500ms}};
+
+  // Frames every 100ms, steady arrival.
+  auto now = t0;
+  uint16_t seq = 0;
+  for (uint32_t ts = 0; ts < 2000; ts += 100, now += 100ms) {
+    jb.insert(make_packet(seq++, ts, true), now);
+  }
+  const auto steady_delay = jb.target_delay();
+  EXPECT_EQ(steady_delay, 1ms);
+
+  // Same frame rate but arrival alternates by +-20ms.
+  for (uint32_t ts = 2000; ts < 6000; ts += 100, now += 100ms) {
+    const auto shift = (ts / 100) % 2 ? 20ms : -20ms;
+    jb.insert(make_packet(seq++, ts, true), now + shift);
+  }
+  EXPECT_GT(jb.target_delay(), 50ms);
+  EXPECT_LT(jb.target_delay(), 200ms);
+}
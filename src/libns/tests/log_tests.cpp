@@ -0,0 +1,129 @@
+#include <gtest/gtest.h>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "log.hpp"
+
+LOG_MODULE_NAME("LOG_TEST");
+
+namespace {
+// Whatever the background thread writes out while it is alive. Errors are
+// used throughout, the only level that is always compiled in.
+class CapturedOutput {
+ public:
+  CapturedOutput() {
+    log_flush();
+    m_previous = std::cout.rdbuf(m_stream.rdbuf());
+  }
+  ~CapturedOutput() {
+    log_flush();
+    std::cout.rdbuf(m_previous);
+  }
+
+  std::vector<std::string> lines() {
+    log_flush();
+    std::vector<std::string> lines;
+    std::istringstream stream{m_stream.str()};
+    for (std::string line; std::getline(stream, line);) {
+      lines.push_back(line);
+    }
+    return lines;
+  }
+
+ private:
+  std::stringstream m_stream;
+  std::streambuf* m_previous{};
+};
+}  // namespace
+
+TEST(log_tests, format_test) {
+  CapturedOutput output;
+  LOG_ERROR("value {} and {}", 42, "text");
+  EXPECT_EQ(output.lines(),
+            std::vector<std::string>{"ERROR : LOG_TEST: value 42 and text"});
+}
+
+TEST(log_tests, arguments_are_copied_test) {
+  CapturedOutput output;
+  {
+    std::string temporary = "gone by the time it is formatted";
+    LOG_ERROR("{} {}", std::string_view{temporary}, temporary.c_str());
+  }
+  const auto lines = output.lines();
+  ASSERT_EQ(lines.size(), 1);
+  EXPECT_NE(lines[0].find("gone by the time it is formatted gone"),
+            std::string::npos);
+}
+
+TEST(log_tests, disabled_levels_are_not_evaluated_test) {
+  CapturedOutput output;
+  int evaluated = 0;
+  LOG_DEBUG("{}", ++evaluated);
+  EXPECT_EQ(evaluated, NS_LOG_LEVEL == 0 ? 1 : 0);
+  EXPECT_EQ(output.lines().size(), evaluated);
+}
+
+TEST(log_tests, bad_format_test) {
+  CapturedOutput output;
+  LOG_ERROR("{} {}", 1);
+  const auto lines = output.lines();
+  ASSERT_EQ(lines.size(), 1);
+  EXPECT_NE(lines[0].find("Bad log record '{} {}'"), std::string::npos);
+}
+
+TEST(log_tests, threads_test) {
+  CapturedOutput output;
+  constexpr int THREADS = 4;
+  constexpr int RECORDS = 100;
+  std::vector<std::thread> threads;
+  for (int t = 0; t < THREADS; ++t) {
+    threads.emplace_back([t] {
+      for (int i = 0; i < RECORDS; ++i) {
+        LOG_ERROR("{} {}", t, i);
+      }
+    });
+  }
+  for (auto& thread : threads) {
+    thread.join();
+  }
+
+  // Threads are gone, their records are not.
+  const auto lines = output.lines();
+  ASSERT_EQ(lines.size(), THREADS * RECORDS);
+  // In order within a thread.
+  std::vector<int> next(THREADS);
+  for (const auto& line : lines) {
+    int t{};
+    int i{};
+    std::istringstream{line.substr(line.rfind(": ") + 2)} >> t >> i;
+    EXPECT_EQ(i, next[t]++);
+  }
+}
+
+TEST(log_tests, full_ring_drops_test) {
+  CapturedOutput output;
+  constexpr int RECORDS = 100'000;
+  std::thread thread([] {
+    for (int i = 0; i < RECORDS; ++i) {
+      LOG_ERROR("record {} of a burst much bigger than the ring", i);
+    }
+  });
+  thread.join();
+
+  // Whatever did not make it is accounted for.
+  int written = 0;
+  int dropped = 0;
+  for (const auto& line : output.lines()) {
+    const auto pos = line.find("LOG: ");
+    if (pos != std::string::npos) {
+      dropped += std::stoi(line.substr(pos + 5));
+    } else {
+      written++;
+    }
+  }
+  EXPECT_GT(dropped, 0);
+  EXPECT_EQ(written + dropped, RECORDS);
+}
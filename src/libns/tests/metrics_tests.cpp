@@ -0,0 +1,147 @@
+#include <gtest/gtest.h>
+#include <asio.hpp>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "metrics.hpp"
+#include "metrics_endpoint.hpp"
+
+namespace {
+using asio::ip::tcp;
+
+// Sends `request` to the endpoint and reads the response till the server
+// closes the connection. The endpoint runs on a thread of its own.
+std::string http_request(uint16_t port, const std::string& request) {
+  asio::io_context client_ctx;
+  tcp::socket socket{client_ctx};
+  socket.connect({asio::ip::address_v4::loopback(), port});
+  asio::write(socket, asio::buffer(request));
+  std::string response;
+  std::error_code ec;
+  asio::read(socket, asio::dynamic_buffer(response), ec);
+  EXPECT_EQ(ec, asio::error::eof);
+  return response;
+}
+
+bool contains(const std::string& s, const std::string& what) {
+  return s.find(what) != std::string::npos;
+}
+}  // namespace
+
+TEST(metrics_tests, histogram_buckets_test) {
+  // Exact below 8, then 8 buckets per power of two.
+  for (uint64_t v = 0; v < 16; ++v) {
+    EXPECT_EQ(HdrHistogram::bucket_index(v), v);
+    EXPECT_EQ(HdrHistogram::bucket_upper_bound(v), v);
+  }
+  EXPECT_EQ(HdrHistogram::bucket_index(16), 16);
+  EXPECT_EQ(HdrHistogram::bucket_index(17), 16);
+  EXPECT_EQ(HdrHistogram::bucket_upper_bound(16), 17);
+  EXPECT_EQ(HdrHistogram::bucket_index(1000), HdrHistogram::bucket_index(1023));
+  EXPECT_NE(HdrHistogram::bucket_index(1023), HdrHistogram::bucket_index(1024));
+
+  // Every value is within its bucket, and the bucket is no wider than 1/8 of
+  // the value.
+  for (uint64_t v = 1; v < (uint64_t{1} << 24); v = v * 3 / 2 + 1) {
+    const auto index = HdrHistogram::bucket_index(v);
+    const auto upper = HdrHistogram::bucket_upper_bound(index);
+    EXPECT_GE(upper, v);
+    EXPECT_LE(upper - v, v / 8);
+    if (index > 0) {
+      EXPECT_LT(HdrHistogram::bucket_upper_bound(index - 1), v);
+    }
+  }
+  EXPECT_EQ(HdrHistogram::bucket_index(uint64_t{1} << 40),
+            HdrHistogram::BucketCount - 1);
+}
+
+TEST(metrics_tests, registry_test) {
+  MetricsRegistry registry;
+  auto& counter = registry.counter("ns_test_total", "Test counter.");
+  // Same name, same metric.
+  EXPECT_EQ(&registry.counter("ns_test_total", "Whatever."), &counter);
+  counter.add();
+  counter.add(2);
+  EXPECT_EQ(counter.value(), 3);
+
+  auto& gauge = registry.gauge("ns_test_depth", "Test gauge.");
+  gauge.set(10);
+  gauge.add(-3);
+  EXPECT_EQ(gauge.value(), 7);
+
+  auto& histogram = registry.histogram("ns_test_bytes", "Test histogram.");
+  histogram.record(5);
+  histogram.record(100);
+  histogram.record(uint64_t{1} << 30);
+  const auto snapshot = histogram.snapshot();
+  EXPECT_EQ(snapshot.count, 3);
+  EXPECT_EQ(snapshot.sum, 105 + (uint64_t{1} << 30));
+
+  const auto text = registry.to_prometheus();
+  EXPECT_TRUE(contains(text,
+                       "# HELP ns_test_total Test counter.\n"
+                       "# TYPE ns_test_total counter\n"
+                       "ns_test_total 3\n"));
+  EXPECT_TRUE(contains(text, "# TYPE ns_test_depth gauge\nns_test_depth 7\n"));
+  EXPECT_TRUE(contains(text, "# TYPE ns_test_bytes histogram\n"));
+  EXPECT_FALSE(contains(text, "ns_test_bytes_bucket{le=\"0\"}"));
+  EXPECT_TRUE(contains(text, "ns_test_bytes_bucket{le=\"7\"} 1\n"));
+  EXPECT_TRUE(contains(text, "ns_test_bytes_bucket{le=\"63\"} 1\n"));
+  EXPECT_TRUE(contains(text, "ns_test_bytes_bucket{le=\"127\"} 2\n"));
+  EXPECT_TRUE(contains(text, "ns_test_bytes_bucket{le=\"8388607\"} 2\n"));
+  EXPECT_TRUE(contains(text, "ns_test_bytes_bucket{le=\"+Inf\"} 3\n"));
+  EXPECT_TRUE(contains(text, "ns_test_bytes_count 3\n"));
+}
+
+TEST(metrics_tests, concurrent_updates_test) {
+  MetricsRegistry registry;
+  auto& counter = registry.counter("ns_test_total", "");
+  auto& histogram = registry.histogram("ns_test_bytes", "");
+  constexpr int THREADS = 4;
+  constexpr int UPDATES = 100'000;
+  std::vector<std::thread> threads;
+  for (int t = 0; t < THREADS; ++t) {
+    threads.emplace_back([&] {
+      for (int i = 0; i < UPDATES; ++i) {
+        counter.add();
+        histogram.record(static_cast<uint64_t>(i));
+      }
+    });
+  }
+  for (auto& thread : threads) {
+    thread.join();
+  }
+  EXPECT_EQ(counter.value(), THREADS * UPDATES);
+  EXPECT_EQ(histogram.snapshot().count, THREADS * UPDATES);
+}
+
+TEST(metrics_tests, endpoint_test) {
+  MetricsRegistry registry;
+  registry.counter("ns_test_total", "Test counter.").add(42);
+
+  asio::io_context ctx;
+  auto endpoint = make_metrics_endpoint(ctx, 0, registry);
+  ASSERT_TRUE(endpoint);
+  ASSERT_NE(endpoint->port(), 0);
+  auto work = asio::make_work_guard(ctx);
+  std::thread io([&] { ctx.run(); });
+
+  const auto response = http_request(
+      endpoint->port(), "GET /metrics HTTP/1.1\r\nHost: localhost\r\n\r\n");
+  EXPECT_TRUE(response.starts_with("HTTP/1.1 200 OK\r\n"));
+  EXPECT_TRUE(contains(response, "Content-Type: text/plain; version=0.0.4"));
+  const auto body = registry.to_prometheus();
+  EXPECT_TRUE(contains(response, "Content-Length: " +
+                                     std::to_string(body.size()) + "\r\n"));
+  EXPECT_TRUE(response.ends_with("\r\n\r\n" + body));
+
+  EXPECT_TRUE(http_request(endpoint->port(), "GET / HTTP/1.1\r\n\r\n")
+                  .starts_with("HTTP/1.1 404 Not Found\r\n"));
+  EXPECT_TRUE(http_request(endpoint->port(), "POST /metrics HTTP/1.1\r\n\r\n")
+                  .starts_with("HTTP/1.1 405 Method Not Allowed\r\n"));
+
+  work.reset();
+  ctx.stop();
+  io.join();
+}
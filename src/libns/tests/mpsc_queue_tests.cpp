@@ -0,0 +1,70 @@
+#include <gtest/gtest.h>
+#include <memory>
+#include <thread>
+#include <vector>
+
+#include "mpsc_queue.hpp"
+
+TEST(mpsc_queue_tests, fifo_test) {
+  MpscQueue<std::unique_ptr<int>> queue{3};
+  EXPECT_EQ(queue.capacity(), 4);
+  EXPECT_FALSE(queue.pop());
+  for (int i = 0; i < 4; ++i) {
+    EXPECT_TRUE(queue.try_push(std::make_unique<int>(i)));
+  }
+
+  // Full: the value stays with the caller.
+  auto rejected = std::make_unique<int>(4);
+  EXPECT_FALSE(queue.try_push(std::move(rejected)));
+  ASSERT_TRUE(rejected);
+
+  for (int i = 0; i < 2; ++i) {
+    auto item = queue.pop();
+    ASSERT_TRUE(item);
+    EXPECT_EQ(**item, i);
+  }
+  EXPECT_TRUE(queue.try_push(std::move(rejected)));
+  for (int i = 2; i < 5; ++i) {
+    EXPECT_EQ(**queue.pop(), i);
+  }
+  EXPECT_FALSE(queue.pop());
+
+  // Whatever is left goes with the queue.
+  EXPECT_TRUE(queue.try_push(std::make_unique<int>(5)));
+}
+
+// Every item comes out once, those of each producer in the order it pushed
+// them, over many laps of the ring.
+TEST(mpsc_queue_tests, producers_test) {
+  constexpr int producers = 4;
+  constexpr int items = 100'000;
+  struct Item {
+    int producer{};
+    int value{};
+  };
+  MpscQueue<Item> queue{64};
+
+  std::vector<std::jthread> threads;
+  for (int p = 0; p < producers; ++p) {
+    threads.emplace_back([&queue, p] {
+      for (int i = 0; i < items; ++i) {
+        while (!queue.try_push(Item{p, i})) {
+          std::this_thread::yield();
+        }
+      }
+    });
+  }
+
+  std::vector<int> next(producers);
+  for (int popped = 0; popped < producers * items;) {
+    auto item = queue.pop();
+    if (!item) {
+      std::this_thread::yield();
+      continue;
+    }
+    ASSERT_EQ(item->value, next[item->producer]);
+    next[item->producer]++;
+    popped++;
+  }
+  EXPECT_FALSE(queue.pop());
+}
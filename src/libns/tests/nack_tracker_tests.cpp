@@ -0,0 +1,90 @@
+#include <gtest/gtest.h>
+#include <vector>
+
+#include "nack_tracker.hpp"
+
+namespace {
+using namespace std::chrono_literals;
+using clock_type = NackTracker::clock;
+
+const auto t0 = clock_type::time_point{} + 1h;
+
+std::vector<uint16_t> collect(NackTracker& tracker,
+                              clock_type::time_point now) {
+  std::vector<uint16_t> out;
+  tracker.collect(now, out);
+  return out;
+}
+}  // namespace
+
+TEST(nack_tracker_tests, no_requests_without_gaps_test) {
+  NackTracker tracker;
+  for (uint16_t seq = 100; seq < 110; ++seq) {
+    tracker.on_packet(seq, t0);
+  }
+  EXPECT_TRUE(collect(tracker, t0).empty());
+  EXPECT_FALSE(tracker.next_deadline().has_value());
+}
+
+TEST(nack_tracker_tests, gap_is_requested_immediately_test) {
+  NackTracker tracker;
+  tracker.on_packet(10, t0);
+  tracker.on_packet(13, t0);
+
+  EXPECT_EQ(tracker.missing_count(), 2);
+  EXPECT_EQ(tracker.next_deadline(), t0);
+  EXPECT_EQ(collect(tracker, t0), (std::vector<uint16_t>{11, 12}));
+  // Not again until retry interval passes.
+  EXPECT_TRUE(collect(tracker, t0 + 1ms).empty());
+}
+
+TEST(nack_tracker_tests, arrived_packet_is_not_requested_again_test) {
+  NackTracker tracker{{.retry_interval = 20ms}};
+  tracker.on_packet(10, t0);
+  tracker.on_packet(13, t0);
+  EXPECT_EQ(collect(tracker, t0), (std::vector<uint16_t>{11, 12}));
+
+  tracker.on_packet(12, t0 + 5ms);
+  EXPECT_EQ(tracker.next_deadline(), t0 + 20ms);
+  EXPECT_EQ(collect(tracker, t0 + 20ms), (std::vector<uint16_t>{11}));
+}
+
+TEST(nack_tracker_tests, gives_up_after_max_requests_test) {
+  NackTracker tracker{{.max_requests = 3, .retry_interval = 10ms}};
+  tracker.on_packet(1, t0);
+  tracker.on_packet(3, t0);
+
+  EXPECT_EQ(collect(tracker, t0), (std::vector<uint16_t>{2}));
+  EXPECT_EQ(collect(tracker, t0 + 10ms), (std::vector<uint16_t>{2}));
+  EXPECT_EQ(collect(tracker, t0 + 20ms), (std::vector<uint16_t>{2}));
+  EXPECT_TRUE(collect(tracker, t0 + 30ms).empty());
+  EXPECT_EQ(tracker.missing_count(), 0);
+}
+
+TEST(nack_tracker_tests, wraparound_test) {
+  NackTracker tracker;
+  tracker.on_packet(65534, t0);
+  tracker.on_packet(1, t0);
+  EXPECT_EQ(collect(tracker, t0), (std::vector<uint16_t>{65535, 0}));
+}
+
+TEST(nack_tracker_tests, big_jump_is_not_a_loss_test) {
+  NackTracker tracker{{.max_gap = 100}};
+  tracker.on_packet(10, t0);
+  tracker.on_packet(12, t0);
+  tracker.on_packet(1000, t0);
+  EXPECT_TRUE(collect(tracker, t0).empty());
+
+  tracker.on_packet(1002, t0);
+  EXPECT_EQ(collect(tracker, t0), (std::vector<uint16_t>{1001}));
+}
+
+TEST(nack_tracker_tests, old_losses_are_forgotten_test) {
+  NackTracker tracker{{.max_gap = 10}};
+  tracker.on_packet(0, t0);
+  tracker.on_packet(2, t0);
+  for (uint16_t seq = 3; seq < 20; ++seq) {
+    tracker.on_packet(seq, t0);
+  }
+  EXPECT_TRUE(collect(tracker, t0).empty());
+}
@@ -0,0 +1,156 @@
+#include <gtest/gtest.h>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "nal_sequencer.hpp"
+
+namespace {
+// Records notifications as "[" for a frame start, "]" for its end and
+// "<frame>:<type>:<first macroblock>" for a NAL.
+class Recorder : public EncoderClient {
+ public:
+  virtual void on_frame_started() override { m_events.push_back("["); }
+  virtual void on_frame_ended() override { m_events.push_back("]"); }
+  virtual void on_nal_encoded(std::span<const uint8_t> data,
+                              PacketRef buffer,
+                              NAL_Metadata meta) override {
+    EXPECT_EQ(data.size(), 1);
+    if (buffer) {
+      EXPECT_EQ(data.data(), buffer.data());
+      m_buffers.push_back(std::move(buffer));
+    }
+    m_events.push_back(std::to_string(meta.timestamp) + ":" +
+                       std::to_string(static_cast<int>(meta.nal_type)) + ":" +
+                       std::to_string(meta.first_macroblock));
+  }
+
+  std::vector<std::string> m_events;
+  std::vector<PacketRef> m_buffers;
+};
+
+void push_slice(NalSequencer& sequencer,
+                uint32_t frame,
+                uint16_t first,
+                uint16_t last) {
+  sequencer.push_nal(frame,
+                     {.timestamp = frame,
+                      .nal_type = NAL_Type::slice,
+                      .first_macroblock = first,
+                      .last_macroblock = last},
+                     std::vector<uint8_t>{0});
+}
+
+void push_header(NalSequencer& sequencer, uint32_t frame, NAL_Type type) {
+  sequencer.push_nal(frame, {.timestamp = frame, .nal_type = type},
+                     std::vector<uint8_t>{0});
+}
+
+using Events = std::vector<std::string>;
+}  // namespace
+
+TEST(nal_sequencer_tests, in_order_test) {
+  Recorder recorder;
+  NalSequencer sequencer{recorder};
+  push_header(sequencer, 0, NAL_Type::sps);
+  push_slice(sequencer, 0, 0, 9);
+  EXPECT_EQ(recorder.m_events, (Events{"[", "0:7:0", "0:1:0"}));
+  push_slice(sequencer, 0, 10, 19);
+  sequencer.end_frame(0);
+  push_slice(sequencer, 1, 0, 19);
+  sequencer.end_frame(1);
+  EXPECT_EQ(recorder.m_events, (Events{"[", "0:7:0", "0:1:0", "0:1:10", "]",
+                                       "[", "1:1:0", "]"}));
+}
+
+TEST(nal_sequencer_tests, slices_out_of_order_test) {
+  Recorder recorder;
+  NalSequencer sequencer{recorder};
+  push_slice(sequencer, 0, 20, 29);
+  push_slice(sequencer, 0, 10, 19);
+  EXPECT_TRUE(recorder.m_events.empty());
+  push_slice(sequencer, 0, 0, 9);
+  EXPECT_EQ(recorder.m_events,
+            (Events{"[", "0:1:0", "0:1:10", "0:1:20"}));
+  sequencer.end_frame(0);
+  EXPECT_EQ(recorder.m_events.back(), "]");
+}
+
+TEST(nal_sequencer_tests, frames_out_of_order_test) {
+  Recorder recorder;
+  NalSequencer sequencer{recorder, 5};
+  push_header(sequencer, 6, NAL_Type::sei);
+  push_slice(sequencer, 6, 0, 9);
+  sequencer.end_frame(6);
+  push_slice(sequencer, 7, 0, 9);
+  EXPECT_TRUE(recorder.m_events.empty());
+  push_slice(sequencer, 5, 0, 9);
+  sequencer.end_frame(5);
+  EXPECT_EQ(recorder.m_events, (Events{"[", "5:1:0", "]", "[", "6:6:0",
+                                       "6:1:0", "]", "[", "7:1:0"}));
+}
+
+// A slice that never comes does not hold the frame past its end.
+TEST(nal_sequencer_tests, missing_slice_test) {
+  Recorder recorder;
+  NalSequencer sequencer{recorder};
+  push_slice(sequencer, 0, 10, 19);
+  sequencer.end_frame(0);
+  push_slice(sequencer, 1, 0, 19);
+  EXPECT_EQ(recorder.m_events, (Events{"[", "0:1:10", "]", "[", "1:1:0"}));
+}
+
+// Slices of each frame pushed from threads of their own, as sliced threads of
+// x264 do.
+TEST(nal_sequencer_tests, threads_test) {
+  constexpr int frames = 200;
+  constexpr int slices = 4;
+  Recorder recorder;
+  NalSequencer sequencer{recorder};
+  for (uint32_t frame = 0; frame < frames; ++frame) {
+    {
+      std::vector<std::jthread> threads;
+      for (uint16_t slice = 0; slice < slices; ++slice) {
+        threads.emplace_back([&sequencer, frame, slice] {
+          push_slice(sequencer, frame, slice * 10, slice * 10 + 9);
+        });
+      }
+    }
+    sequencer.end_frame(frame);
+  }
+
+  Events expected;
+  for (int frame = 0; frame < frames; ++frame) {
+    expected.push_back("[");
+    for (int slice = 0; slice < slices; ++slice) {
+      expected.push_back(std::to_string(frame) + ":1:" +
+                         std::to_string(slice * 10));
+    }
+    expected.push_back("]");
+  }
+  EXPECT_EQ(recorder.m_events, expected);
+}
+
+// NALs in client's buffers are handed back in them.
+TEST(nal_sequencer_tests, buffers_test) {
+  PacketBufferPool pool{2, 16};
+  Recorder recorder;
+  NalSequencer sequencer{recorder};
+  for (uint16_t first : {10, 0}) {
+    auto buffer = pool.acquire();
+    buffer.data()[0] = static_cast<uint8_t>(first);
+    buffer.set_size(1);
+    sequencer.push_nal(0,
+                       {.timestamp = 0,
+                        .nal_type = NAL_Type::slice,
+                        .first_macroblock = first,
+                        .last_macroblock = static_cast<uint16_t>(first + 9)},
+                       std::move(buffer));
+  }
+  sequencer.end_frame(0);
+  ASSERT_EQ(recorder.m_buffers.size(), 2);
+  EXPECT_EQ(recorder.m_buffers[0].data()[0], 0);
+  EXPECT_EQ(recorder.m_buffers[1].data()[0], 10);
+  recorder.m_buffers.clear();
+  EXPECT_EQ(pool.available(), 2);
+}
@@ -0,0 +1,164 @@
+#include <gtest/gtest.h>
+#include <vector>
+
+#include "pacer.hpp"
+
+namespace {
+using namespace std::chrono_literals;
+using clock_type = Pacer::clock;
+
+const auto t0 = clock_type::time_point{} + 1h;
+
+// 1 MB/s, so that a 1000 byte packet takes exactly 1 ms.
+constexpr uint64_t RATE = 8'000'000;
+constexpr size_t PACKET_SIZE = 1000;
+
+class pacer_tests : public ::testing::Test {
+ protected:
+  PacketRef make_packet(uint8_t tag) {
+    auto packet = m_pool.acquire();
+    packet.data()[0] = tag;
+    packet.set_size(PACKET_SIZE);
+    return packet;
+  }
+
+  std::vector<uint8_t> pop(Pacer& pacer, clock_type::time_point now) {
+    std::vector<PacketRef> out;
+    pacer.pop_ready(now, out);
+    std::vector<uint8_t> tags;
+    for (auto& p : out) {
+      tags.push_back(p.data()[0]);
+    }
+    return tags;
+  }
+
+  PacketBufferPool m_pool{64, PACKET_SIZE};
+};
+}  // namespace
+
+TEST_F(pacer_tests, disabled_pacer_lets_everything_out_test) {
+  Pacer pacer;
+  for (uint8_t i = 0; i < 10; ++i) {
+    ASSERT_TRUE(pacer.push(make_packet(i), t0));
+  }
+  EXPECT_EQ(pacer.next_send_time(), t0);
+  EXPECT_EQ(pop(pacer, t0).size(), 10);
+  EXPECT_TRUE(pacer.empty());
+  EXPECT_FALSE(pacer.next_send_time().has_value());
+}
+
+TEST_F(pacer_tests, burst_is_spread_at_rate_test) {
+  // Burst budget of 2 ms lets two packets out right away.
+  Pacer pacer{{.rate = RATE, .max_burst = 2ms}};
+  for (uint8_t i = 0; i < 6; ++i) {
+    pacer.push(make_packet(i), t0);
+  }
+
+  EXPECT_EQ(pop(pacer, t0), (std::vector<uint8_t>{0, 1, 2}));
+  // The third one went out on the remainder of the budget, into debt.
+  EXPECT_EQ(pacer.next_send_time(), t0 + 1ms);
+  EXPECT_TRUE(pop(pacer, t0 + 999us).empty());
+  EXPECT_EQ(pop(pacer, t0 + 1ms), (std::vector<uint8_t>{3}));
+  EXPECT_EQ(pacer.next_send_time(), t0 + 2ms);
+  EXPECT_EQ(pop(pacer, t0 + 3ms), (std::vector<uint8_t>{4, 5}));
+  EXPECT_TRUE(pacer.empty());
+}
+
+TEST_F(pacer_tests, idle_budget_is_capped_test) {
+  Pacer pacer{{.rate = RATE, .max_burst = 2ms}};
+  pacer.push(make_packet(0), t0);
+  EXPECT_EQ(pop(pacer, t0).size(), 1);
+
+  // A second of silence does not buy more than max_burst worth.
+  for (uint8_t i = 0; i < 6; ++i) {
+    pacer.push(make_packet(i), t0 + 1s);
+  }
+  EXPECT_EQ(pop(pacer, t0 + 1s).size(), 3);
+}
+
+TEST_F(pacer_tests, late_packets_are_sent_over_budget_test) {
+  Pacer pacer{{.rate = RATE, .max_burst = 1ms, .max_queue_delay = 5ms}};
+  for (uint8_t i = 0; i < 20; ++i) {
+    pacer.push(make_packet(i), t0);
+  }
+  EXPECT_EQ(pop(pacer, t0).size(), 2);
+  EXPECT_EQ(pacer.next_send_time(), t0 + 1ms);
+
+  // Budget is capped at max_burst, so only two more go on budget. The rest
+  // has waited long enough.
+  EXPECT_EQ(pop(pacer, t0 + 5ms).size(), 18);
+  const auto stats = pacer.take_stats(t0 + 5ms);
+  EXPECT_EQ(stats.sent_packets, 20);
+  EXPECT_EQ(stats.late_packets, 16);
+  EXPECT_EQ(stats.max_queue_delay, 5ms);
+}
+
+TEST_F(pacer_tests, next_send_time_respects_queue_delay_test) {
+  // Slow rate, the packet debt takes 100 ms to pay off.
+  Pacer pacer{{.rate = 80'000, .max_burst = 1ms, .max_queue_delay = 30ms}};
+  pacer.push(make_packet(0), t0);
+  pacer.push(make_packet(1), t0 + 1ms);
+  EXPECT_EQ(pop(pacer, t0 + 1ms).size(), 1);
+  EXPECT_EQ(pacer.next_send_time(), t0 + 31ms);
+}
+
+TEST_F(pacer_tests, direct_sends_are_charged_test) {
+  Pacer pacer{{.rate = RATE, .max_burst = 1ms}};
+  pacer.on_sent_directly(PACKET_SIZE, t0);
+  pacer.on_sent_directly(PACKET_SIZE, t0);
+  pacer.push(make_packet(0), t0);
+  EXPECT_TRUE(pop(pacer, t0).empty());
+  EXPECT_EQ(pacer.next_send_time(), t0 + 1ms);
+}
+
+TEST_F(pacer_tests, rate_change_takes_effect_test) {
+  Pacer pacer{{.rate = RATE, .max_burst = 1ms}};
+  for (uint8_t i = 0; i < 4; ++i) {
+    pacer.push(make_packet(i), t0);
+  }
+  EXPECT_EQ(pop(pacer, t0).size(), 2);
+  EXPECT_EQ(pacer.next_send_time(), t0 + 1ms);
+
+  // Twice as fast, debt is paid off in half the time.
+  pacer.set_rate(2 * RATE, t0);
+  EXPECT_EQ(pacer.next_send_time(), t0 + 500us);
+
+  // Zero turns pacing off.
+  pacer.set_rate(0, t0 + 100us);
+  EXPECT_EQ(pop(pacer, t0 + 100us).size(), 2);
+}
+
+TEST_F(pacer_tests, full_queue_drops_test) {
+  Pacer pacer{{.rate = RATE, .queue_capacity = 4}};
+  for (uint8_t i = 0; i < 4; ++i) {
+    EXPECT_TRUE(pacer.push(make_packet(i), t0));
+  }
+  EXPECT_FALSE(pacer.push(make_packet(4), t0));
+  EXPECT_EQ(pacer.take_stats(t0).dropped_packets, 1);
+  // Dropped packet went back to the pool.
+  EXPECT_EQ(m_pool.available(), 60);
+}
+
+TEST_F(pacer_tests, stats_window_test) {
+  Pacer pacer{{.rate = RATE, .max_burst = 1ms}};
+  for (uint8_t i = 0; i < 4; ++i) {
+    pacer.push(make_packet(i), t0);
+  }
+  pop(pacer, t0);
+  pop(pacer, t0 + 1ms);
+
+  auto stats = pacer.take_stats(t0 + 1500us);
+  EXPECT_EQ(stats.sent_packets, 3);
+  EXPECT_EQ(stats.queued_packets, 1);
+  EXPECT_EQ(stats.queued_bytes, PACKET_SIZE);
+  EXPECT_EQ(stats.oldest_queue_delay, 1500us);
+  EXPECT_EQ(stats.max_queue_delay, 1ms);
+  EXPECT_EQ(stats.average_queue_delay, 333us);
+
+  pop(pacer, t0 + 2ms);
+  stats = pacer.take_stats(t0 + 2ms);
+  EXPECT_EQ(stats.sent_packets, 4);
+  EXPECT_EQ(stats.queued_packets, 0);
+  EXPECT_EQ(stats.max_queue_delay, 2ms);
+  EXPECT_EQ(stats.average_queue_delay, 2ms);
+}
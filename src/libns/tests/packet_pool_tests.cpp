@@ -0,0 +1,105 @@
+#include <gtest/gtest.h>
+#include <thread>
+#include <vector>
+
+#include "packet_pool.hpp"
+
+TEST(packet_pool_tests, acquire_until_exhausted_test) {
+  PacketBufferPool pool{3, 100};
+  EXPECT_EQ(pool.available(), 3);
+
+  std::vector<PacketRef> refs;
+  for (int i = 0; i < 3; ++i) {
+    auto ref = pool.acquire();
+    ASSERT_TRUE(ref);
+    EXPECT_EQ(ref.capacity(), 100);
+    EXPECT_EQ(ref.size(), 0);
+    refs.push_back(std::move(ref));
+  }
+  EXPECT_EQ(pool.available(), 0);
+  EXPECT_FALSE(pool.acquire());
+
+  refs.pop_back();
+  EXPECT_EQ(pool.available(), 1);
+  EXPECT_TRUE(pool.acquire());
+}
+
+TEST(packet_pool_tests, buffers_do_not_overlap_test) {
+  PacketBufferPool pool{2, 16};
+  auto a = pool.acquire();
+  auto b = pool.acquire();
+  std::fill(a.storage().begin(), a.storage().end(), 0xAA);
+  std::fill(b.storage().begin(), b.storage().end(), 0xBB);
+  for (auto byte : a.storage()) {
+    ASSERT_EQ(byte, 0xAA);
+  }
+}
+
+TEST(packet_pool_tests, buffer_returned_with_last_reference_test) {
+  PacketBufferPool pool{1, 10};
+
+  auto ref = pool.acquire();
+  ref.set_size(5);
+  auto copy = ref;
+  EXPECT_EQ(copy.size(), 5);
+  EXPECT_EQ(copy.data(), ref.data());
+
+  ref.reset();
+  EXPECT_FALSE(ref);
+  EXPECT_EQ(pool.available(), 0);
+
+  PacketRef moved = std::move(copy);
+  EXPECT_FALSE(copy);
+  EXPECT_EQ(pool.available(), 0);
+
+  moved = PacketRef{};
+  EXPECT_EQ(pool.available(), 1);
+
+  // Size is reset for the next user.
+  EXPECT_EQ(pool.acquire().size(), 0);
+}
+
+TEST(packet_pool_tests, headroom_test) {
+  PacketBufferPool pool{1, 32};
+  {
+    auto ref = pool.acquire();
+    const auto* start = ref.data();
+    ref.reserve_headroom(8);
+    EXPECT_EQ(ref.headroom(), 8);
+    EXPECT_EQ(ref.data(), start + 8);
+    EXPECT_EQ(ref.capacity(), 24);
+
+    ref.data()[0] = 0x00;
+    ref.data()[1] = 0x01;
+    ref.data()[2] = 0xAB;
+    ref.set_size(3);
+    // Start code out, header in.
+    ref.consume_front(2);
+    auto header = ref.prepend(4);
+    EXPECT_EQ(header.data(), start + 6);
+    std::fill(header.begin(), header.end(), 0xEE);
+    EXPECT_EQ(std::vector<uint8_t>(ref.bytes().begin(), ref.bytes().end()),
+              (std::vector<uint8_t>{0xEE, 0xEE, 0xEE, 0xEE, 0xAB}));
+    EXPECT_EQ(ref.headroom(), 6);
+  }
+  // Headroom is reset for the next user.
+  EXPECT_EQ(pool.acquire().headroom(), 0);
+}
+
+TEST(packet_pool_tests, references_released_from_other_threads_test) {
+  PacketBufferPool pool{64, 32};
+
+  std::vector<PacketRef> refs;
+  while (auto ref = pool.acquire()) {
+    refs.push_back(std::move(ref));
+  }
+
+  std::vector<std::jthread> threads;
+  for (int t = 0; t < 4; ++t) {
+    threads.emplace_back([copies = refs] {});
+  }
+  refs.clear();
+  threads.clear();
+
+  EXPECT_EQ(pool.available(), 64);
+}
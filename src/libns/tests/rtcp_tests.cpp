@@ -0,0 +1,296 @@
+#include <gtest/gtest.h>
+#include <vector>
+
+#include "rtcp.hpp"
+
+TEST(rtcp_tests, generic_nack_roundtrip_test) {
+  RTCP_GenericNack nack;
+  nack.sender_ssrc = 0x01020304;
+  nack.media_ssrc = 0xA0B0C0D0;
+  nack.lost = {5, 6, 9, 21, 22, 100};
+
+  std::vector<uint8_t> buffer;
+  ASSERT_FALSE(serialize_generic_nack(nack, buffer));
+  // Fixed part plus three FCI entries: 5 (6, 9, 21), 22 and 100.
+  ASSERT_EQ(buffer.size(), 12 + 3 * 4);
+
+  auto header = deserialize_rtcp_header(buffer);
+  ASSERT_TRUE(header.has_value());
+  EXPECT_EQ(header->version, 2);
+  EXPECT_EQ(header->payload_type, RTCP_PayloadType_RTPFB);
+  EXPECT_EQ(header->count, RTCP_FeedbackFormat_GenericNack);
+  EXPECT_EQ(header->size, buffer.size());
+
+  auto parsed = deserialize_generic_nack(buffer);
+  ASSERT_TRUE(parsed.has_value());
+  EXPECT_EQ(parsed->sender_ssrc, nack.sender_ssrc);
+  EXPECT_EQ(parsed->media_ssrc, nack.media_ssrc);
+  EXPECT_EQ(parsed->lost, nack.lost);
+}
+
+TEST(rtcp_tests, generic_nack_bitmask_test) {
+  RTCP_GenericNack nack;
+  nack.lost = {1000, 1001, 1016};
+
+  std::vector<uint8_t> buffer;
+  ASSERT_FALSE(serialize_generic_nack(nack, buffer));
+  ASSERT_EQ(buffer.size(), 16);
+  // PID
+  EXPECT_EQ(buffer[12], 1000 >> 8);
+  EXPECT_EQ(buffer[13], 1000 & 0xFF);
+  // BLP: bits 0 and 15.
+  EXPECT_EQ(buffer[14], 0x80);
+  EXPECT_EQ(buffer[15], 0x01);
+}
+
+TEST(rtcp_tests, generic_nack_across_wraparound_test) {
+  RTCP_GenericNack nack;
+  nack.lost = {65534, 65535, 0, 1};
+
+  std::vector<uint8_t> buffer;
+  ASSERT_FALSE(serialize_generic_nack(nack, buffer));
+  EXPECT_EQ(buffer.size(), 16);
+
+  auto parsed = deserialize_generic_nack(buffer);
+  ASSERT_TRUE(parsed.has_value());
+  EXPECT_EQ(parsed->lost, nack.lost);
+}
+
+TEST(rtcp_tests, compound_packet_test) {
+  RTCP_GenericNack first;
+  first.lost = {1};
+  RTCP_GenericNack second;
+  second.lost = {2, 40};
+
+  std::vector<uint8_t> buffer;
+  ASSERT_FALSE(serialize_generic_nack(first, buffer));
+  ASSERT_FALSE(serialize_generic_nack(second, buffer));
+
+  std::vector<std::vector<uint16_t>> lost;
+  auto ec = for_each_rtcp_packet(
+      buffer, [&](const RTCP_Header& header, std::span<const uint8_t> data) {
+        auto nack = deserialize_generic_nack(data);
+        ASSERT_TRUE(nack.has_value());
+        lost.push_back(nack->lost);
+      });
+  EXPECT_FALSE(ec);
+  EXPECT_EQ(lost, (std::vector<std::vector<uint16_t>>{{1}, {2, 40}}));
+}
+
+TEST(rtcp_tests, malformed_packets_test) {
+  std::vector<uint8_t> buffer;
+  EXPECT_TRUE(serialize_generic_nack({}, buffer));
+  EXPECT_TRUE(buffer.empty());
+
+  RTCP_GenericNack nack;
+  nack.lost = {7};
+  ASSERT_FALSE(serialize_generic_nack(nack, buffer));
+
+  // Truncated.
+  auto truncated = std::span{buffer}.first(buffer.size() - 1);
+  EXPECT_FALSE(deserialize_rtcp_header(truncated).has_value());
+  EXPECT_TRUE(for_each_rtcp_packet(truncated, [](auto&, auto) {}));
+
+  // Wrong version.
+  auto wrong_version = buffer;
+  wrong_version[0] &= 0x3F;
+  EXPECT_FALSE(deserialize_generic_nack(wrong_version).has_value());
+
+  // Some other feedback message.
+  auto pli = buffer;
+  pli[1] = 206;
+  EXPECT_FALSE(deserialize_generic_nack(pli).has_value());
+}
+
+TEST(rtcp_tests, transport_feedback_roundtrip_test) {
+  RTCP_TransportFeedback feedback;
+  feedback.sender_ssrc = 0x01020304;
+  feedback.media_ssrc = 0xA0B0C0D0;
+  feedback.base_sequence_num = 65533;
+  feedback.reference_time = -5;
+  feedback.feedback_count = 200;
+  // Small and large deltas, a reordered packet (negative delta) and losses,
+  // across sequence number wraparound and more than one status chunk.
+  feedback.arrivals = {0,    10,   std::nullopt, 300, 290, std::nullopt,
+                       1000, 1001, std::nullopt, 9000};
+
+  std::vector<uint8_t> buffer;
+  ASSERT_FALSE(serialize_transport_feedback(feedback, buffer));
+  EXPECT_EQ(buffer.size() % 4, 0);
+
+  auto header = deserialize_rtcp_header(buffer);
+  ASSERT_TRUE(header.has_value());
+  EXPECT_EQ(header->payload_type, RTCP_PayloadType_RTPFB);
+  EXPECT_EQ(header->count, RTCP_FeedbackFormat_TransportCC);
+  EXPECT_EQ(header->size, buffer.size());
+
+  auto parsed = deserialize_transport_feedback(buffer);
+  ASSERT_TRUE(parsed.has_value());
+  EXPECT_EQ(parsed->sender_ssrc, feedback.sender_ssrc);
+  EXPECT_EQ(parsed->media_ssrc, feedback.media_ssrc);
+  EXPECT_EQ(parsed->base_sequence_num, feedback.base_sequence_num);
+  EXPECT_EQ(parsed->reference_time, feedback.reference_time);
+  EXPECT_EQ(parsed->feedback_count, feedback.feedback_count);
+  EXPECT_EQ(parsed->arrivals, feedback.arrivals);
+}
+
+TEST(rtcp_tests, transport_feedback_all_chunk_kinds_test) {
+  // As another implementation may send it: run length chunk of three
+  // received packets followed by one-bit status vector.
+  const std::vector<uint8_t> packet = {
+      0x8F, 205,  0x00, 0x06,  // header, 7 words
+      0x00, 0x00, 0x00, 0x01,  // sender SSRC
+      0x00, 0x00, 0x00, 0x02,  // media SSRC
+      0x00, 100,  0x00, 5,     // base sequence number, status count
+      0x00, 0x00, 0x01, 7,     // reference time, feedback packet count
+      0x20, 0x03, 0x90, 0x00,  // run of 3 small deltas, then 0, 1
+      10,   20,   30,   40,    // deltas
+  };
+
+  auto parsed = deserialize_transport_feedback(packet);
+  ASSERT_TRUE(parsed.has_value());
+  EXPECT_EQ(parsed->base_sequence_num, 100);
+  EXPECT_EQ(parsed->reference_time, 1);
+  EXPECT_EQ(parsed->feedback_count, 7);
+  EXPECT_EQ(parsed->arrivals, (std::vector<std::optional<int64_t>>{
+                                  10, 30, 60, std::nullopt, 100}));
+}
+
+TEST(rtcp_tests, transport_feedback_truncated_test) {
+  RTCP_TransportFeedback feedback;
+  feedback.arrivals = {1, 2, 3, 1000};
+  std::vector<uint8_t> buffer;
+  ASSERT_FALSE(serialize_transport_feedback(feedback, buffer));
+
+  // Claim more packets than there are deltas for.
+  buffer[15] = 40;
+  EXPECT_FALSE(deserialize_transport_feedback(buffer).has_value());
+}
+
+TEST(rtcp_tests, transport_feedback_delta_too_large_test) {
+  RTCP_TransportFeedback feedback;
+  feedback.arrivals = {0, 40000};
+  std::vector<uint8_t> buffer{1, 2, 3};
+  EXPECT_TRUE(serialize_transport_feedback(feedback, buffer));
+  // Nothing is left behind on failure.
+  EXPECT_EQ(buffer.size(), 3);
+}
+
+TEST(rtcp_tests, sender_report_roundtrip_test) {
+  RTCP_SenderReport report;
+  report.sender_ssrc = 0x01020304;
+  report.ntp_time = 0xE1234567'89ABCDEF;
+  report.rtp_timestamp = 123456;
+  report.packet_count = 1000;
+  report.octet_count = 1'200'000;
+  report.report_blocks.push_back({.ssrc = 0xA0B0C0D0,
+                                  .fraction_lost = 25,
+                                  .cumulative_lost = 300,
+                                  .extended_highest_sequence_num = 0x10005,
+                                  .jitter = 7,
+                                  .last_sr = 0x456789AB,
+                                  .delay_since_last_sr = 65536});
+
+  std::vector<uint8_t> buffer;
+  ASSERT_FALSE(serialize_sender_report(report, buffer));
+  ASSERT_EQ(buffer.size(), 28 + 24);
+
+  auto header = deserialize_rtcp_header(buffer);
+  ASSERT_TRUE(header.has_value());
+  EXPECT_EQ(header->payload_type, RTCP_PayloadType_SR);
+  EXPECT_EQ(header->count, 1);
+  EXPECT_EQ(header->size, buffer.size());
+
+  auto parsed = deserialize_sender_report(buffer);
+  ASSERT_TRUE(parsed.has_value());
+  EXPECT_EQ(parsed->sender_ssrc, report.sender_ssrc);
+  EXPECT_EQ(parsed->ntp_time, report.ntp_time);
+  EXPECT_EQ(parsed->rtp_timestamp, report.rtp_timestamp);
+  EXPECT_EQ(parsed->packet_count, report.packet_count);
+  EXPECT_EQ(parsed->octet_count, report.octet_count);
+  ASSERT_EQ(parsed->report_blocks.size(), 1);
+  const auto& block = parsed->report_blocks[0];
+  EXPECT_EQ(block.ssrc, 0xA0B0C0D0);
+  EXPECT_EQ(block.fraction_lost, 25);
+  EXPECT_EQ(block.cumulative_lost, 300);
+  EXPECT_EQ(block.extended_highest_sequence_num, 0x10005);
+  EXPECT_EQ(block.jitter, 7);
+  EXPECT_EQ(block.last_sr, 0x456789AB);
+  EXPECT_EQ(block.delay_since_last_sr, 65536);
+
+  // Not a receiver report.
+  EXPECT_FALSE(deserialize_receiver_report(buffer).has_value());
+}
+
+TEST(rtcp_tests, receiver_report_roundtrip_test) {
+  RTCP_ReceiverReport report;
+  report.sender_ssrc = 42;
+  // Duplicates make cumulative loss negative, it is signed 24 bits on the
+  // wire.
+  report.report_blocks.push_back({.ssrc = 1, .cumulative_lost = -3});
+  report.report_blocks.push_back({.ssrc = 2, .cumulative_lost = 1 << 24});
+
+  std::vector<uint8_t> buffer;
+  ASSERT_FALSE(serialize_receiver_report(report, buffer));
+  ASSERT_EQ(buffer.size(), 8 + 2 * 24);
+
+  auto parsed = deserialize_receiver_report(buffer);
+  ASSERT_TRUE(parsed.has_value());
+  EXPECT_EQ(parsed->sender_ssrc, 42);
+  ASSERT_EQ(parsed->report_blocks.size(), 2);
+  EXPECT_EQ(parsed->report_blocks[0].ssrc, 1);
+  EXPECT_EQ(parsed->report_blocks[0].cumulative_lost, -3);
+  // Saturates rather than wraps.
+  EXPECT_EQ(parsed->report_blocks[1].cumulative_lost, 0x7FFFFF);
+
+  // Report count claims more blocks than there are.
+  buffer[0] = 2 << 6 | 3;
+  EXPECT_FALSE(deserialize_receiver_report(buffer).has_value());
+}
+
+TEST(rtcp_tests, empty_receiver_report_test) {
+  std::vector<uint8_t> buffer;
+  ASSERT_FALSE(serialize_receiver_report({.sender_ssrc = 7}, buffer));
+  ASSERT_EQ(buffer.size(), 8);
+  auto parsed = deserialize_receiver_report(buffer);
+  ASSERT_TRUE(parsed.has_value());
+  EXPECT_TRUE(parsed->report_blocks.empty());
+}
+
+TEST(rtcp_tests, ntp_time_test) {
+  using namespace std::chrono_literals;
+  // Unix epoch is 2208988800 seconds into NTP era.
+  const auto epoch = std::chrono::system_clock::time_point{};
+  EXPECT_EQ(to_ntp_time(epoch), 2'208'988'800ull << 32);
+  EXPECT_EQ(to_ntp_time(epoch + 1500ms), (2'208'988'801ull << 32) | 1u << 31);
+
+  EXPECT_EQ(compact_ntp(0x0102030405060708), 0x03040506);
+  EXPECT_EQ(to_compact_ntp_duration(1s), 65536);
+  EXPECT_EQ(to_compact_ntp_duration(-1s), 0);
+  EXPECT_EQ(from_compact_ntp_duration(65536 / 4), 250ms);
+}
+
+TEST(rtcp_tests, report_delay_is_randomized_test) {
+  using namespace std::chrono_literals;
+  std::minstd_rand random{1};
+  bool below = false;
+  bool above = false;
+  for (int i = 0; i < 100; ++i) {
+    const auto delay = rtcp_report_delay(1000ms, random);
+    EXPECT_GE(delay, 500ms);
+    EXPECT_LE(delay, 1500ms);
+    below |= delay < 1000ms;
+    above |= delay > 1000ms;
+  }
+  EXPECT_TRUE(below && above);
+}
+
+TEST(rtcp_tests, rtcp_and_rtp_demultiplexing_test) {
+  EXPECT_TRUE(is_rtcp_packet(std::vector<uint8_t>{0x80, 200, 0, 6}));
+  EXPECT_TRUE(is_rtcp_packet(std::vector<uint8_t>{0x81, 201, 0, 7}));
+  EXPECT_TRUE(is_rtcp_packet(std::vector<uint8_t>{0x8F, 205, 0, 4}));
+  // Naive payload type 78 with the marker bit set.
+  EXPECT_FALSE(is_rtcp_packet(std::vector<uint8_t>{0x80, 0x80 | 78, 0, 1}));
+  EXPECT_FALSE(is_rtcp_packet(std::vector<uint8_t>{0x80, 96, 0, 1}));
+  EXPECT_FALSE(is_rtcp_packet(std::vector<uint8_t>{0x80, 200}));
+}
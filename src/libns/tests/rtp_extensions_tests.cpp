@@ -0,0 +1,235 @@
+#include <gtest/gtest.h>
+#include <array>
+#include <vector>
+
+#include "rtp_extensions.hpp"
+
+namespace {
+using namespace std::chrono_literals;
+
+// Header with extension bit set, followed by `block`.
+std::vector<uint8_t> make_packet(std::span<const uint8_t> block) {
+  RTP_PacketHeader header;
+  header.version = 2;
+  header.extension_bit = true;
+  header.payload_type = 96;
+  std::vector<uint8_t> packet(RTP_PacketHeader_Size);
+  EXPECT_FALSE(serialize_rtp_header_to(header, packet));
+  packet.insert(packet.end(), block.begin(), block.end());
+  // Some payload after the header.
+  packet.insert(packet.end(), {0xAA, 0xBB, 0xCC});
+  return packet;
+}
+
+std::vector<RTP_ExtensionElement> elements_of(std::span<const uint8_t> packet) {
+  RTP_PacketHeader header;
+  EXPECT_TRUE(read_rtp_header(packet, header));
+  EXPECT_TRUE(header.extension.has_value());
+  std::vector<RTP_ExtensionElement> elements;
+  EXPECT_FALSE(for_each_rtp_extension(
+      *header.extension,
+      [&](const RTP_ExtensionElement& e) { elements.push_back(e); }));
+  return elements;
+}
+}  // namespace
+
+TEST(rtp_extensions_tests, transport_sequence_num_test) {
+  std::array<uint8_t, RTP_MaxExtensionBlockSize> block{};
+  const size_t size = write_rtp_extensions(
+      {.transport_sequence_num = 0xABCD}, RTP_ExtensionMap{}, block);
+  // Fixed part and a word with 3 bytes of element and a byte of padding.
+  ASSERT_EQ(size, 8);
+  auto packet = make_packet(std::span{block}.first(size));
+
+  EXPECT_EQ(rtp_header_size(packet), RTP_PacketHeader_Size + size);
+  EXPECT_EQ(find_transport_sequence_num(packet, 1), 0xABCD);
+  EXPECT_FALSE(find_transport_sequence_num(packet, 2).has_value());
+
+  EXPECT_TRUE(overwrite_transport_sequence_num(packet, 1, 7));
+  EXPECT_EQ(find_transport_sequence_num(packet, 1), 7);
+
+  // Without the extension bit there is nothing to find.
+  packet[0] &= ~0x10;
+  EXPECT_EQ(rtp_header_size(packet), RTP_PacketHeader_Size);
+  EXPECT_FALSE(find_transport_sequence_num(packet, 1).has_value());
+  EXPECT_FALSE(overwrite_transport_sequence_num(packet, 1, 7));
+}
+
+TEST(rtp_extensions_tests, one_byte_elements_test) {
+  // Padding and another element before ours, as other senders may do.
+  const std::array<uint8_t, 24> packet = {
+      0x90, 96,   0x00, 0x01,  // V=2, X=1, payload type, sequence number
+      0x00, 0x00, 0x00, 0x00,  // timestamp
+      0x00, 0x00, 0x00, 0x00,  // SSRC
+      0xBE, 0xDE, 0x00, 0x02,  // one-byte extensions, 2 words
+      0x00, 0x22, 0xAA, 0xBB,  // padding, element 2 of 3 bytes
+      0xCC, 0x11, 0x12, 0x34,  // ..., element 1 of 2 bytes
+  };
+  EXPECT_EQ(rtp_header_size(packet), 24);
+  EXPECT_EQ(find_transport_sequence_num(packet, 1), 0x1234);
+
+  const auto elements = elements_of(packet);
+  ASSERT_EQ(elements.size(), 2);
+  EXPECT_EQ(elements[0].id, 2);
+  EXPECT_EQ(elements[0].data.size(), 3);
+  EXPECT_EQ(elements[1].id, 1);
+  EXPECT_EQ(elements[1].data.size(), 2);
+}
+
+TEST(rtp_extensions_tests, two_byte_elements_test) {
+  // Id 20 does not fit the one-byte form, so the whole block goes two-byte.
+  const std::array<uint8_t, 2> small = {0x12, 0x34};
+  const std::array<uint8_t, 3> large_id = {1, 2, 3};
+  const std::array<uint8_t, 20> large_size{};
+  const std::array<RTP_ExtensionElement, 3> elements = {{
+      {.id = 1, .data = small},
+      {.id = 20, .data = large_id},
+      {.id = 5, .data = large_size},
+  }};
+
+  std::array<uint8_t, 64> block{};
+  const size_t size = write_rtp_extension_block(elements, block);
+  // 4 + 5 + 22 bytes of elements, padded to words.
+  ASSERT_EQ(size, RTP_HeaderExtensionFixed_Size + 32);
+  EXPECT_EQ(block[0], 0x10);
+  EXPECT_EQ(block[1], 0x00);
+
+  const auto packet = make_packet(std::span{block}.first(size));
+  EXPECT_EQ(rtp_header_size(packet), RTP_PacketHeader_Size + size);
+  EXPECT_EQ(find_transport_sequence_num(packet, 1), 0x1234);
+
+  const auto parsed = elements_of(packet);
+  ASSERT_EQ(parsed.size(), 3);
+  EXPECT_EQ(parsed[1].id, 20);
+  EXPECT_TRUE(std::ranges::equal(parsed[1].data, large_id));
+  EXPECT_EQ(parsed[2].id, 5);
+  EXPECT_EQ(parsed[2].data.size(), 20);
+}
+
+TEST(rtp_extensions_tests, two_byte_empty_element_test) {
+  // Zero length elements exist only in the two-byte form.
+  const std::array<RTP_ExtensionElement, 1> elements = {{{.id = 3}}};
+  std::array<uint8_t, 16> block{};
+  const size_t size = write_rtp_extension_block(elements, block);
+  ASSERT_EQ(size, 8);
+  const auto parsed = elements_of(make_packet(std::span{block}.first(size)));
+  ASSERT_EQ(parsed.size(), 1);
+  EXPECT_EQ(parsed[0].id, 3);
+  EXPECT_TRUE(parsed[0].data.empty());
+}
+
+TEST(rtp_extensions_tests, invalid_elements_test) {
+  std::array<uint8_t, 64> block{};
+  const std::array<uint8_t, 2> data{};
+  const std::array<RTP_ExtensionElement, 1> zero_id = {
+      {{.id = 0, .data = data}}};
+  EXPECT_EQ(write_rtp_extension_block(zero_id, block), 0);
+
+  const std::array<RTP_ExtensionElement, 1> element = {
+      {{.id = 1, .data = data}}};
+  EXPECT_EQ(write_rtp_extension_block(element, std::span{block}.first(7)), 0);
+  EXPECT_EQ(write_rtp_extension_block(element, std::span{block}.first(8)), 8);
+}
+
+TEST(rtp_extensions_tests, truncated_extension_test) {
+  std::array<uint8_t, 20> packet{};
+  packet[0] = 0x90;
+  packet[12] = 0xBE;
+  packet[13] = 0xDE;
+  // Claims 4 words of elements, there is only one.
+  packet[15] = 4;
+  EXPECT_FALSE(rtp_header_size(packet).has_value());
+  EXPECT_FALSE(find_transport_sequence_num(packet, 1).has_value());
+
+  // Element that runs past the end of the block.
+  const std::array<uint8_t, 4> data = {0x13, 0x00, 0x00, 0x00};
+  const RTP_HeaderExtension extension{.profile = RTP_OneByteExtensionProfile,
+                                      .data = data};
+  EXPECT_FALSE(parse_rtp_extensions(extension, {}).has_value());
+}
+
+TEST(rtp_extensions_tests, all_extensions_roundtrip_test) {
+  const RTP_Extensions extensions{
+      .transport_sequence_num = 300,
+      .abs_send_time = 0x123456,
+      .frame_marking = RTP_FrameMarking{.start_of_frame = true,
+                                        .independent = true}};
+  const RTP_ExtensionMap map;
+  std::array<uint8_t, RTP_MaxExtensionBlockSize> block{};
+  const size_t size = write_rtp_extensions(extensions, map, block);
+  ASSERT_GT(size, 0);
+
+  auto packet = make_packet(std::span{block}.first(size));
+  RTP_PacketHeader header;
+  ASSERT_TRUE(read_rtp_header(packet, header));
+  ASSERT_TRUE(header.extension.has_value());
+  auto parsed = parse_rtp_extensions(*header.extension, map);
+  ASSERT_TRUE(parsed.has_value());
+  EXPECT_EQ(parsed->transport_sequence_num, 300);
+  EXPECT_EQ(parsed->abs_send_time, 0x123456);
+  ASSERT_TRUE(parsed->frame_marking.has_value());
+  EXPECT_TRUE(parsed->frame_marking->start_of_frame);
+  EXPECT_FALSE(parsed->frame_marking->end_of_frame);
+  EXPECT_TRUE(parsed->frame_marking->independent);
+  EXPECT_FALSE(parsed->frame_marking->discardable);
+
+  // What the transmitter updates right before sending.
+  EXPECT_TRUE(overwrite_abs_send_time(packet, map.abs_send_time, 0xFEDCBA));
+  EXPECT_TRUE(set_end_of_frame(packet, map.frame_marking));
+  ASSERT_TRUE(read_rtp_header(packet, header));
+  parsed = parse_rtp_extensions(*header.extension, map);
+  ASSERT_TRUE(parsed.has_value());
+  EXPECT_EQ(parsed->transport_sequence_num, 300);
+  EXPECT_EQ(parsed->abs_send_time, 0xFEDCBA);
+  EXPECT_TRUE(parsed->frame_marking->start_of_frame);
+  EXPECT_TRUE(parsed->frame_marking->end_of_frame);
+}
+
+TEST(rtp_extensions_tests, unmapped_extensions_test) {
+  // Extensions without an id are not written and not recognized.
+  const RTP_ExtensionMap sender_map{.transport_sequence_num = 5,
+                                    .abs_send_time = 0,
+                                    .frame_marking = 7};
+  std::array<uint8_t, RTP_MaxExtensionBlockSize> block{};
+  const size_t size = write_rtp_extensions(
+      {.transport_sequence_num = 1,
+       .abs_send_time = 2,
+       .frame_marking = RTP_FrameMarking{}},
+      sender_map, block);
+  ASSERT_GT(size, 0);
+
+  const RTP_HeaderExtension extension{
+      .profile = RTP_OneByteExtensionProfile,
+      .data = std::span{block}.subspan(RTP_HeaderExtensionFixed_Size,
+                                       size - RTP_HeaderExtensionFixed_Size)};
+  const auto parsed = parse_rtp_extensions(extension, RTP_ExtensionMap{});
+  ASSERT_TRUE(parsed.has_value());
+  EXPECT_FALSE(parsed->transport_sequence_num.has_value());
+  EXPECT_FALSE(parsed->abs_send_time.has_value());
+  EXPECT_FALSE(parsed->frame_marking.has_value());
+
+  EXPECT_EQ(write_rtp_extensions({}, sender_map, block), 0);
+}
+
+TEST(rtp_extensions_tests, abs_send_time_test) {
+  EXPECT_EQ(to_abs_send_time(0us), 0);
+  // One second is 1 << 18.
+  EXPECT_EQ(to_abs_send_time(1s), 1 << 18);
+  EXPECT_EQ(to_abs_send_time(1500ms), 3 << 17);
+  // Wraps every 64 seconds.
+  EXPECT_EQ(to_abs_send_time(64s + 1s), 1 << 18);
+
+  const auto delta = [](auto from, auto to) {
+    return std::chrono::duration_cast<std::chrono::microseconds>(
+               abs_send_time_delta(to_abs_send_time(from),
+                                   to_abs_send_time(to)))
+        .count();
+  };
+  EXPECT_NEAR(delta(10s, 10s + 20ms), 20'000, 4);
+  EXPECT_NEAR(delta(10s + 20ms, 10s), -20'000, 4);
+  // Across the wrap.
+  EXPECT_NEAR(delta(63s, 65s), 2'000'000, 4);
+  EXPECT_NEAR(delta(65s, 63s), -2'000'000, 4);
+  // Exact in its own units.
+  EXPECT_EQ(abs_send_time_delta(0xFFFFFF, 1).count(), 2);
+}
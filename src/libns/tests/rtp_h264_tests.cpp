@@ -0,0 +1,222 @@
+#include <gtest/gtest.h>
+#include <cstdlib>
+#include <format>
+#include <vector>
+
+#include "rtp_h264.hpp"
+
+namespace {
+using Bytes = std::vector<uint8_t>;
+
+Bytes make_nal(uint8_t header, size_t size) {
+  Bytes nal(size);
+  nal[0] = header;
+  for (size_t i = 1; i < size; ++i) {
+    nal[i] = static_cast<uint8_t>(i * 7);
+  }
+  return nal;
+}
+
+Bytes with_start_code(const Bytes& nal) {
+  Bytes result{0, 0, 0, 1};
+  result.insert(result.end(), nal.begin(), nal.end());
+  return result;
+}
+
+std::vector<Bytes> packetize(H264_Packetizer& packetizer,
+                             const std::vector<Bytes>& nals) {
+  std::vector<Bytes> payloads;
+  auto sink = [&](std::span<const uint8_t> p) {
+    payloads.emplace_back(p.begin(), p.end());
+  };
+  for (auto& nal : nals) {
+    EXPECT_FALSE(packetizer.push_nal(nal, sink));
+  }
+  packetizer.flush(sink);
+  return payloads;
+}
+
+std::vector<Bytes> depacketize(H264_Depacketizer& depacketizer,
+                               const std::vector<Bytes>& payloads,
+                               uint16_t first_seq = 0) {
+  std::vector<Bytes> nals;
+  uint16_t seq = first_seq;
+  for (auto& p : payloads) {
+    EXPECT_FALSE(depacketizer.push_payload(
+        p, seq++, [&](std::span<const uint8_t> nal) {
+          nals.emplace_back(nal.begin(), nal.end());
+        }));
+  }
+  return nals;
+}
+}  // namespace
+
+TEST(rtp_h264_tests, strip_start_code_test) {
+  const Bytes long_code{0, 0, 0, 1, 0x65, 0xAA};
+  const Bytes short_code{0, 0, 1, 0x65, 0xAA};
+  const Bytes no_code{0x65, 0xAA};
+  const Bytes expected{0x65, 0xAA};
+
+  auto as_bytes = [](std::span<const uint8_t> s) {
+    return Bytes{s.begin(), s.end()};
+  };
+  EXPECT_EQ(as_bytes(strip_annexb_start_code(long_code)), expected);
+  EXPECT_EQ(as_bytes(strip_annexb_start_code(short_code)), expected);
+  EXPECT_EQ(as_bytes(strip_annexb_start_code(no_code)), expected);
+}
+
+TEST(rtp_h264_tests, small_nal_sent_as_single_packet_test) {
+  H264_Packetizer packetizer{100};
+  const auto slice = make_nal(0x65, 50);
+
+  auto payloads = packetize(packetizer, {slice});
+  ASSERT_EQ(payloads.size(), 1);
+  EXPECT_EQ(payloads[0], slice);
+}
+
+TEST(rtp_h264_tests, is_single_nal_unit_test) {
+  H264_Packetizer packetizer{100};
+  EXPECT_TRUE(packetizer.is_single_nal_unit(make_nal(0x65, 100)));
+  EXPECT_FALSE(packetizer.is_single_nal_unit(make_nal(0x65, 101)));
+  EXPECT_FALSE(packetizer.is_single_nal_unit(make_nal(0x67, 10)));
+  EXPECT_FALSE(packetizer.is_single_nal_unit({}));
+}
+
+TEST(rtp_h264_tests, parameter_sets_aggregated_into_stap_a_test) {
+  H264_Packetizer packetizer{100};
+  const auto sps = make_nal(0x67, 10);
+  const auto pps = make_nal(0x68, 4);
+  const auto slice = make_nal(0x65, 50);
+
+  auto payloads = packetize(packetizer, {sps, pps, slice});
+  ASSERT_EQ(payloads.size(), 2);
+
+  const auto& stap = payloads[0];
+  // NRI of both units is 3.
+  EXPECT_EQ(stap[0], 0x60 | H264_NalType_STAP_A);
+  ASSERT_EQ(stap.size(), 1 + 2 + sps.size() + 2 + pps.size());
+  EXPECT_EQ(stap[1], 0);
+  EXPECT_EQ(stap[2], sps.size());
+  EXPECT_TRUE(std::equal(sps.begin(), sps.end(), stap.begin() + 3));
+  EXPECT_EQ(stap[3 + sps.size()], 0);
+  EXPECT_EQ(stap[4 + sps.size()], pps.size());
+  EXPECT_TRUE(std::equal(pps.begin(), pps.end(), stap.begin() + 5 + sps.size()));
+
+  EXPECT_EQ(payloads[1], slice);
+}
+
+TEST(rtp_h264_tests, single_held_nal_is_not_aggregated_test) {
+  H264_Packetizer packetizer{100};
+  const auto sei = make_nal(0x06, 20);
+
+  auto payloads = packetize(packetizer, {sei});
+  ASSERT_EQ(payloads.size(), 1);
+  EXPECT_EQ(payloads[0], sei);
+}
+
+TEST(rtp_h264_tests, aggregate_does_not_exceed_max_payload_test) {
+  H264_Packetizer packetizer{40};
+  auto payloads = packetize(packetizer, {make_nal(0x06, 20), make_nal(0x06, 20),
+                                         make_nal(0x06, 20)});
+  ASSERT_EQ(payloads.size(), 3);
+  for (auto& p : payloads) {
+    EXPECT_LE(p.size(), 40);
+  }
+}
+
+TEST(rtp_h264_tests, large_nal_fragmented_into_fu_a_test) {
+  H264_Packetizer packetizer{100};
+  const auto slice = make_nal(0x65, 250);
+
+  auto payloads = packetize(packetizer, {slice});
+  // 249 bytes after NAL header, 98 per fragment.
+  ASSERT_EQ(payloads.size(), 3);
+  for (size_t i = 0; i < payloads.size(); ++i) {
+    EXPECT_LE(payloads[i].size(), 100);
+    EXPECT_EQ(payloads[i][0], 0x60 | H264_NalType_FU_A);
+    EXPECT_EQ(payloads[i][1] & 0x1F, 0x05);
+    EXPECT_EQ(static_cast<bool>(payloads[i][1] & 0x80), i == 0);
+    EXPECT_EQ(static_cast<bool>(payloads[i][1] & 0x40),
+              i == payloads.size() - 1);
+  }
+}
+
+TEST(rtp_h264_tests, depacketizer_adds_start_code_and_padding_test) {
+  H264_Depacketizer depacketizer{8};
+  const auto slice = make_nal(0x41, 30);
+
+  std::vector<Bytes> nals;
+  auto ec = depacketizer.push_payload(slice, 0, [&](auto nal) {
+    nals.emplace_back(nal.begin(), nal.end());
+    for (size_t i = 0; i < 8; ++i) {
+      EXPECT_EQ(nal.data()[nal.size() + i], 0);
+    }
+  });
+  ASSERT_FALSE(ec);
+  ASSERT_EQ(nals.size(), 1);
+  EXPECT_EQ(nals[0], with_start_code(slice));
+}
+
+TEST(rtp_h264_tests, lost_fragment_drops_nal_test) {
+  H264_Packetizer packetizer{100};
+  H264_Depacketizer depacketizer;
+  const auto big = make_nal(0x65, 300);
+  const auto small = make_nal(0x41, 30);
+
+  auto payloads = packetize(packetizer, {big, small});
+  ASSERT_EQ(payloads.size(), 5);
+
+  // Lose second fragment.
+  std::vector<Bytes> nals;
+  uint16_t seq = 100;
+  for (size_t i = 0; i < payloads.size(); ++i, ++seq) {
+    if (i == 1) {
+      continue;
+    }
+    EXPECT_FALSE(depacketizer.push_payload(payloads[i], seq, [&](auto nal) {
+      nals.emplace_back(nal.begin(), nal.end());
+    }));
+  }
+  ASSERT_EQ(nals.size(), 1);
+  EXPECT_EQ(nals[0], with_start_code(small));
+}
+
+TEST(rtp_h264_tests, malformed_stap_a_rejected_test) {
+  H264_Depacketizer depacketizer;
+  const Bytes stap{H264_NalType_STAP_A, 0x00, 0x10, 0x67, 0x01};
+  auto ec = depacketizer.push_payload(stap, 0, [](auto) { FAIL(); });
+  EXPECT_TRUE(ec);
+}
+
+TEST(rtp_h264_tests, randomized_roundtrip_test) {
+  const auto seed = time(nullptr);
+  srand(seed);
+  SCOPED_TRACE(std::format("Seed: {}", seed));
+
+  const uint8_t headers[] = {0x09, 0x67, 0x68, 0x06, 0x65, 0x41, 0x01};
+
+  for (int i = 0; i < 100; ++i) {
+    const size_t max_payload = 20 + rand() % 1400;
+    H264_Packetizer packetizer{max_payload};
+    H264_Depacketizer depacketizer;
+
+    std::vector<Bytes> nals;
+    const int nals_count = 1 + rand() % 20;
+    for (int n = 0; n < nals_count; ++n) {
+      nals.push_back(make_nal(headers[rand() % std::size(headers)],
+                              1 + rand() % 5000));
+    }
+
+    auto payloads = packetize(packetizer, nals);
+    for (auto& p : payloads) {
+      ASSERT_LE(p.size(), max_payload);
+    }
+
+    auto restored =
+        depacketize(depacketizer, payloads, static_cast<uint16_t>(rand()));
+    ASSERT_EQ(restored.size(), nals.size());
+    for (size_t n = 0; n < nals.size(); ++n) {
+      ASSERT_EQ(restored[n], with_start_code(nals[n]));
+    }
+  }
+}
@@ -0,0 +1,104 @@
+#include <gtest/gtest.h>
+#include <array>
+#include <vector>
+
+#include "rtp_history.hpp"
+
+namespace {
+using namespace std::chrono_literals;
+using clock_type = RTP_PacketHistory::clock;
+
+const auto t0 = clock_type::time_point{} + 1h;
+
+void store(RTP_PacketHistory& history,
+           uint16_t seq,
+           std::vector<uint8_t> header,
+           std::vector<uint8_t> payload,
+           clock_type::time_point now) {
+  history.store(seq,
+                std::array<std::span<const uint8_t>, 2>{header, payload}, now);
+}
+}  // namespace
+
+TEST(rtp_history_tests, stored_packet_is_concatenated_test) {
+  RTP_PacketHistory history{16, 100};
+  store(history, 7, {1, 2, 3}, {4, 5}, t0);
+
+  auto packet = history.take_for_retransmission(7, t0, 1s, 10ms);
+  ASSERT_TRUE(packet);
+  EXPECT_EQ(std::vector<uint8_t>(packet.bytes().begin(), packet.bytes().end()),
+            (std::vector<uint8_t>{1, 2, 3, 4, 5}));
+
+  EXPECT_FALSE(history.take_for_retransmission(8, t0, 1s, 10ms));
+}
+
+TEST(rtp_history_tests, shared_packet_is_kept_by_reference_test) {
+  PacketBufferPool pool{1, 100};
+  RTP_PacketHistory history{16, 100};
+  auto buffer = pool.acquire();
+  buffer.set_size(5);
+  history.store(7, buffer, t0);
+  buffer.reset();
+  EXPECT_EQ(pool.available(), 0);
+
+  auto packet = history.take_for_retransmission(7, t0, 1s, 10ms);
+  ASSERT_TRUE(packet);
+  EXPECT_EQ(packet.size(), 5);
+
+  // Pushed out by a copied one.
+  store(history, 7 + 16, {1}, {}, t0);
+  packet.reset();
+  EXPECT_EQ(pool.available(), 1);
+}
+
+TEST(rtp_history_tests, old_packets_are_pushed_out_test) {
+  RTP_PacketHistory history{4, 100};
+  for (uint16_t seq = 0; seq < 6; ++seq) {
+    store(history, seq, {static_cast<uint8_t>(seq)}, {}, t0);
+  }
+  EXPECT_FALSE(history.take_for_retransmission(0, t0, 1s, 10ms));
+  EXPECT_FALSE(history.take_for_retransmission(1, t0, 1s, 10ms));
+  for (uint16_t seq = 2; seq < 6; ++seq) {
+    auto packet = history.take_for_retransmission(seq, t0, 1s, 10ms);
+    ASSERT_TRUE(packet);
+    EXPECT_EQ(packet.bytes()[0], seq);
+  }
+}
+
+TEST(rtp_history_tests, retransmission_budget_test) {
+  RTP_PacketHistory history{16, 100};
+  store(history, 1, {1}, {}, t0);
+
+  EXPECT_FALSE(history.take_for_retransmission(1, t0 + 101ms, 100ms, 10ms));
+  EXPECT_TRUE(history.take_for_retransmission(1, t0 + 100ms, 100ms, 10ms));
+}
+
+TEST(rtp_history_tests, repeated_request_within_rtt_is_ignored_test) {
+  RTP_PacketHistory history{16, 100};
+  store(history, 1, {1}, {}, t0);
+
+  EXPECT_TRUE(history.take_for_retransmission(1, t0, 1s, 10ms));
+  EXPECT_FALSE(history.take_for_retransmission(1, t0 + 5ms, 1s, 10ms));
+  EXPECT_TRUE(history.take_for_retransmission(1, t0 + 10ms, 1s, 10ms));
+}
+
+TEST(rtp_history_tests, too_big_packet_is_not_kept_test) {
+  RTP_PacketHistory history{16, 4};
+  store(history, 1, {1, 2}, {3, 4, 5}, t0);
+  EXPECT_FALSE(history.take_for_retransmission(1, t0, 1s, 10ms));
+}
+
+TEST(rtp_history_tests, held_retransmissions_do_not_exhaust_pool_test) {
+  RTP_PacketHistory history{4, 100};
+  std::vector<PacketRef> in_flight;
+  for (uint16_t seq = 0; seq < 64; ++seq) {
+    store(history, seq, {1}, {}, t0);
+    if (auto packet = history.take_for_retransmission(seq, t0, 1s, 10ms)) {
+      in_flight.push_back(std::move(packet));
+    }
+    if (in_flight.size() > 8) {
+      in_flight.erase(in_flight.begin());
+    }
+  }
+  EXPECT_TRUE(history.take_for_retransmission(63, t0 + 20ms, 1s, 10ms));
+}
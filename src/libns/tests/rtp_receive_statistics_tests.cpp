@@ -0,0 +1,158 @@
+#include <gtest/gtest.h>
+
+#include "rtp_extensions.hpp"
+#include "rtp_receive_statistics.hpp"
+
+namespace {
+using namespace std::chrono_literals;
+using clock_type = RTP_ReceiveStatistics::clock;
+
+const auto t0 = clock_type::time_point{} + 1h;
+constexpr uint32_t SSRC = 0x1234;
+// Millisecond RTP clock.
+constexpr uint32_t CLOCK_RATE = 1000;
+}  // namespace
+
+TEST(rtp_receive_statistics_tests, nothing_received_test) {
+  RTP_ReceiveStatistics statistics{CLOCK_RATE};
+  EXPECT_FALSE(statistics.make_report_block(t0).has_value());
+  EXPECT_EQ(statistics.stats().packets_received, 0);
+}
+
+TEST(rtp_receive_statistics_tests, loss_test) {
+  RTP_ReceiveStatistics statistics{CLOCK_RATE};
+  // 10 expected, 8 received.
+  for (uint16_t seq = 100; seq < 110; ++seq) {
+    if (seq != 103 && seq != 107) {
+      statistics.on_packet(SSRC, seq, 0, 1000, t0);
+    }
+  }
+
+  auto block = statistics.make_report_block(t0);
+  ASSERT_TRUE(block.has_value());
+  EXPECT_EQ(block->ssrc, SSRC);
+  EXPECT_EQ(block->fraction_lost, 2 * 256 / 10);
+  EXPECT_EQ(block->cumulative_lost, 2);
+  EXPECT_EQ(block->extended_highest_sequence_num, 109);
+  EXPECT_EQ(block->last_sr, 0);
+
+  auto stats = statistics.stats();
+  EXPECT_EQ(stats.packets_received, 8);
+  EXPECT_EQ(stats.bytes_received, 8000);
+  EXPECT_EQ(stats.cumulative_lost, 2);
+  EXPECT_NEAR(stats.loss_fraction, 0.2, 0.01);
+
+  // Next interval is clean, one of the lost packets even comes late.
+  statistics.on_packet(SSRC, 103, 0, 1000, t0);
+  for (uint16_t seq = 110; seq < 120; ++seq) {
+    statistics.on_packet(SSRC, seq, 0, 1000, t0);
+  }
+  block = statistics.make_report_block(t0);
+  ASSERT_TRUE(block.has_value());
+  EXPECT_EQ(block->fraction_lost, 0);
+  EXPECT_EQ(block->cumulative_lost, 1);
+}
+
+TEST(rtp_receive_statistics_tests, sequence_wraparound_test) {
+  RTP_ReceiveStatistics statistics{CLOCK_RATE};
+  for (uint32_t i = 0; i < 10; ++i) {
+    statistics.on_packet(SSRC, static_cast<uint16_t>(65530 + i), 0, 1, t0);
+  }
+  auto block = statistics.make_report_block(t0);
+  ASSERT_TRUE(block.has_value());
+  // One cycle, highest number 3.
+  EXPECT_EQ(block->extended_highest_sequence_num, 65539);
+  EXPECT_EQ(block->cumulative_lost, 0);
+}
+
+TEST(rtp_receive_statistics_tests, jitter_test) {
+  RTP_ReceiveStatistics statistics{CLOCK_RATE};
+  // Frames 40 ms apart arriving exactly 40 ms apart: no jitter. The second
+  // packet of each frame comes later but does not count.
+  for (uint32_t frame = 0; frame < 20; ++frame) {
+    const auto arrival = t0 + frame * 40ms;
+    statistics.on_packet(SSRC, 2 * frame, frame * 40, 1, arrival);
+    statistics.on_packet(SSRC, 2 * frame + 1, frame * 40, 1, arrival + 5ms);
+  }
+  EXPECT_EQ(statistics.stats().jitter, 0us);
+
+  // Every other frame 10 ms late: the estimate converges towards 10 ms.
+  for (uint32_t frame = 20; frame < 200; ++frame) {
+    const auto arrival = t0 + frame * 40ms + (frame % 2 ? 10ms : 0ms);
+    statistics.on_packet(SSRC, 2 * frame, frame * 40, 1, arrival);
+  }
+  EXPECT_NEAR(statistics.stats().jitter.count(), 10'000, 500);
+  auto block = statistics.make_report_block(t0);
+  ASSERT_TRUE(block.has_value());
+  // In RTP timestamp units, milliseconds here.
+  EXPECT_NEAR(block->jitter, 10, 1);
+}
+
+TEST(rtp_receive_statistics_tests, sender_report_echo_test) {
+  RTP_ReceiveStatistics statistics{CLOCK_RATE};
+  statistics.on_packet(SSRC, 1, 0, 1, t0);
+
+  RTCP_SenderReport report;
+  report.ntp_time = 0x00001111'22220000;
+  statistics.on_sender_report(report, t0);
+
+  auto block = statistics.make_report_block(t0 + 500ms);
+  ASSERT_TRUE(block.has_value());
+  EXPECT_EQ(block->last_sr, 0x11112222);
+  EXPECT_EQ(block->delay_since_last_sr, 65536 / 2);
+}
+
+TEST(rtp_receive_statistics_tests, new_source_starts_over_test) {
+  RTP_ReceiveStatistics statistics{CLOCK_RATE};
+  statistics.on_packet(SSRC, 100, 0, 1, t0);
+  statistics.on_packet(SSRC, 200, 0, 1, t0);
+  EXPECT_EQ(statistics.stats().cumulative_lost, 99);
+
+  statistics.on_packet(SSRC + 1, 5000, 0, 1, t0);
+  auto block = statistics.make_report_block(t0);
+  ASSERT_TRUE(block.has_value());
+  EXPECT_EQ(block->ssrc, SSRC + 1);
+  EXPECT_EQ(block->cumulative_lost, 0);
+  EXPECT_EQ(statistics.stats().packets_received, 1);
+}
+
+TEST(rtp_receive_statistics_tests, delay_variation_test) {
+  RTP_ReceiveStatistics statistics{CLOCK_RATE};
+  // Sender clock far from ours, near abs-send-time wrap.
+  const auto send0 = 63s + 900ms;
+
+  // Packets 5 ms apart, transit alternating between 0 and 2 ms extra.
+  for (uint16_t i = 0; i < 200; ++i) {
+    const auto send = send0 + i * 5ms;
+    const auto arrival = t0 + i * 5ms + (i % 2 ? 2ms : 0ms);
+    statistics.on_packet(SSRC, i, i / 8, 1, arrival);
+    statistics.on_send_time(to_abs_send_time(send), arrival);
+  }
+  auto stats = statistics.stats();
+  EXPECT_NEAR(stats.delay_variation.count(), 2'000, 100);
+  EXPECT_NEAR(stats.queuing_delay.count(), 2'000, 10);
+}
+
+TEST(rtp_receive_statistics_tests, queuing_delay_test) {
+  RTP_ReceiveStatistics statistics{CLOCK_RATE};
+  // Queue builds up by 1 ms per packet, then drains.
+  for (uint16_t i = 0; i < 50; ++i) {
+    const auto arrival = t0 + i * 10ms + i * 1ms;
+    statistics.on_packet(SSRC, i, i, 1, arrival);
+    statistics.on_send_time(to_abs_send_time(i * 10ms), arrival);
+  }
+  EXPECT_NEAR(statistics.stats().queuing_delay.count(), 49'000, 10);
+
+  const uint16_t drained = 50;
+  const auto arrival = t0 + drained * 10ms;
+  statistics.on_packet(SSRC, drained, drained, 1, arrival);
+  statistics.on_send_time(to_abs_send_time(drained * 10ms), arrival);
+  EXPECT_NEAR(statistics.stats().queuing_delay.count(), 0, 10);
+}
+
+TEST(rtp_receive_statistics_tests, no_send_time_test) {
+  RTP_ReceiveStatistics statistics{CLOCK_RATE};
+  statistics.on_packet(SSRC, 1, 0, 1, t0);
+  EXPECT_EQ(statistics.stats().delay_variation.count(), 0);
+  EXPECT_EQ(statistics.stats().queuing_delay.count(), 0);
+}
@@ -36,8 +36,10 @@ TEST(rtp_tests, basic_serialize_test) {
 }
 
 TEST(rtp_tests, basic_deserialize_test) {
-  const std::array<uint8_t, RTP_PacketHeader_Size> data = {
-      0x90, 0xad, 0x32, 0x7f, 0x63, 0x16, 0x37, 0x9e, 0xfe, 0x15, 0x12, 0x4a};
+  // Extension elements are left out, just the extension header with no words.
+  const std::array<uint8_t, RTP_PacketHeader_Size + 4> data = {
+      0x90, 0xad, 0x32, 0x7f, 0x63, 0x16, 0x37, 0x9e,
+      0xfe, 0x15, 0x12, 0x4a, 0xbe, 0xde, 0x00, 0x00};
 
   RTP_PacketHeader p;
   p.version = 2;
@@ -48,6 +50,7 @@ TEST(rtp_tests, basic_deserialize_test) {
   p.sequence_num = 12927;
   p.timestamp = 1662400414;
   p.ssrc = 0xfe15124a;
+  p.extension = RTP_HeaderExtension{.profile = 0xBEDE};
 
   auto maybe_deserialized_packet = deserialize_rtp_header_from(data);
   ASSERT_TRUE(maybe_deserialized_packet.has_value());
@@ -91,8 +94,21 @@ TEST(rtp_tests, randomized_routrip_test) {
     p.sequence_num = static_cast<uint16_t>(rand() % 0xFFFF);
     p.timestamp = static_cast<uint32_t>(rand() % 0xFFFFFFFF);
     p.ssrc = static_cast<uint32_t>(rand() % 0xFFFFFFFF);
-
-    std::array<uint8_t, RTP_PacketHeader_Size> buff;
+    const int csrc_count = rand() % (RTP_MaxCsrcCount + 1);
+    for (int j = 0; j < csrc_count; ++j) {
+      p.add_csrc(static_cast<uint32_t>(rand()));
+    }
+    std::array<uint8_t, 16> extension_data;
+    for (auto& byte : extension_data) {
+      byte = static_cast<uint8_t>(rand());
+    }
+    if (p.extension_bit) {
+      p.extension = RTP_HeaderExtension{
+          .profile = static_cast<uint16_t>(rand()),
+          .data = std::span{extension_data}.first(4 * (rand() % 5))};
+    }
+
+    std::array<uint8_t, 128> buff;
 
     auto ec = serialize_rtp_header_to(p, buff);
     ASSERT_FALSE(ec);
@@ -103,6 +119,100 @@ TEST(rtp_tests, randomized_routrip_test) {
   }
 }
 
+TEST(rtp_tests, csrc_and_extension_roundtrip_test) {
+  const std::array<uint8_t, 8> extension_data = {1, 2, 3, 4, 5, 6, 7, 8};
+
+  RTP_PacketHeader p;
+  p.version = 2;
+  p.payload_type = 96;
+  p.sequence_num = 65535;
+  p.timestamp = 0xDEADBEEF;
+  p.ssrc = 42;
+  for (uint32_t i = 0; i < RTP_MaxCsrcCount; ++i) {
+    ASSERT_TRUE(p.add_csrc(0x01000000 + i));
+  }
+  EXPECT_FALSE(p.add_csrc(100));
+  p.extension = RTP_HeaderExtension{.profile = 0x1000, .data = extension_data};
+  ASSERT_EQ(p.size(), RTP_PacketHeader_Size + 4 * RTP_MaxCsrcCount + 4 + 8);
+
+  std::array<uint8_t, 128> buff{};
+  ASSERT_EQ(write_rtp_header(p, buff), p.size());
+  // Extension bit follows the extension.
+  EXPECT_EQ(buff[0], 0x9F);
+  EXPECT_EQ(buff[12], 0x01);
+  EXPECT_EQ(buff[15], 0x00);
+  EXPECT_EQ(buff[19], 0x01);
+  EXPECT_EQ(buff[72], 0x10);
+  EXPECT_EQ(buff[75], 2);
+
+  RTP_PacketHeader parsed;
+  ASSERT_TRUE(read_rtp_header(std::span{buff}.first(p.size()), parsed));
+  EXPECT_TRUE(parsed.extension_bit);
+  parsed.extension_bit = false;
+  EXPECT_EQ(parsed, p);
+  // Extension data is not copied.
+  EXPECT_EQ(parsed.extension->data.data(), buff.data() + 76);
+  EXPECT_EQ(rtp_header_size(buff), p.size());
+}
+
+TEST(rtp_tests, invalid_header_test) {
+  RTP_PacketHeader p;
+  p.version = 2;
+  p.add_csrc(1);
+  std::array<uint8_t, RTP_PacketHeader_Size + 4> buff{};
+  ASSERT_EQ(write_rtp_header(p, buff), buff.size());
+
+  // CSRC list does not fit.
+  EXPECT_EQ(write_rtp_header(p, std::span{buff}.first(RTP_PacketHeader_Size)),
+            0);
+  RTP_PacketHeader parsed;
+  EXPECT_FALSE(
+      read_rtp_header(std::span{buff}.first(RTP_PacketHeader_Size), parsed));
+  EXPECT_TRUE(serialize_rtp_header_to(p, std::span{buff}.first(14)));
+  EXPECT_FALSE(deserialize_rtp_header_from(std::span{buff}.first(14)));
+
+  // Extension data must be whole words.
+  const std::array<uint8_t, 3> odd{};
+  p.extension = RTP_HeaderExtension{.profile = 1, .data = odd};
+  std::array<uint8_t, 64> large{};
+  EXPECT_EQ(write_rtp_header(p, large), 0);
+
+  p.extension.reset();
+  p.payload_type = 128;
+  EXPECT_EQ(write_rtp_header(p, large), 0);
+}
+
+namespace {
+// Serializer and parser must be usable at compile time.
+constexpr bool constexpr_roundtrip() {
+  RTP_PacketHeader p;
+  p.version = 2;
+  p.marker_bit = true;
+  p.payload_type = 96;
+  p.sequence_num = 0x1234;
+  p.timestamp = 0x56789ABC;
+  p.ssrc = 0xCAFEBABE;
+  p.add_csrc(7);
+  const std::array<uint8_t, 4> extension_data = {0x10, 0xAA, 0x00, 0x00};
+  p.extension = RTP_HeaderExtension{.profile = 0xBEDE, .data = extension_data};
+
+  std::array<uint8_t, 24> buff{};
+  if (write_rtp_header(p, buff) != 24 || buff[0] != 0x91 || buff[1] != 0xE0 ||
+      buff[2] != 0x12 || buff[23] != 0x00 || buff[20] != 0x10) {
+    return false;
+  }
+  RTP_PacketHeader parsed;
+  return read_rtp_header(buff, parsed) &&
+         parsed.sequence_num == p.sequence_num &&
+         parsed.timestamp == p.timestamp && parsed.ssrc == p.ssrc &&
+         parsed.csrcs().size() == 1 && parsed.csrc[0] == 7 &&
+         parsed.extension && parsed.extension->profile == 0xBEDE &&
+         parsed.extension->data.size() == 4 &&
+         parsed.extension->data[1] == 0xAA;
+}
+static_assert(constexpr_roundtrip());
+}  // namespace
+
 TEST(rtp_tests, randomized_payload_header_routrip_test) {
   const auto seed = time(nullptr);
   srand(seed);
@@ -0,0 +1,166 @@
+#include <gtest/gtest.h>
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+#include <random>
+#include <vector>
+
+#include "frame_converter.hpp"
+#include "simulcast.hpp"
+
+namespace {
+using namespace std::chrono_literals;
+
+// Keeps frames it is given, optionally holding the first one till released.
+class FakeEncoder : public Encoder {
+ public:
+  explicit FakeEncoder(bool hold_first = false) : m_hold(hold_first) {}
+
+  virtual void process_frame(std::span<uint8_t> data,
+                             CapturedFrameMeta meta) override {
+    std::unique_lock lock(m_lock);
+    m_frames.emplace_back(data.begin(), data.end());
+    m_frame_ids.push_back(meta.frame_id);
+    m_changed.notify_all();
+    m_changed.wait(lock, [this] { return !m_hold; });
+  }
+
+  virtual void set_target_bitrate(uint64_t) override {}
+  virtual std::error_code reconfigure(const EncoderConfig&) override {
+    return {};
+  }
+
+  // Waits for that many frames in all.
+  bool wait_frames(size_t count) {
+    std::unique_lock lock(m_lock);
+    return m_changed.wait_for(lock, 5s,
+                              [&] { return m_frames.size() >= count; });
+  }
+
+  void release() {
+    std::lock_guard lock(m_lock);
+    m_hold = false;
+    m_changed.notify_all();
+  }
+
+  std::vector<std::vector<uint8_t>> frames() {
+    std::lock_guard lock(m_lock);
+    return m_frames;
+  }
+
+  std::vector<uint32_t> frame_ids() {
+    std::lock_guard lock(m_lock);
+    return m_frame_ids;
+  }
+
+ private:
+  std::mutex m_lock;
+  std::condition_variable m_changed;
+  bool m_hold;
+  std::vector<std::vector<uint8_t>> m_frames;
+  std::vector<uint32_t> m_frame_ids;
+};
+
+std::vector<uint8_t> random_nv12(uint32_t width, uint32_t height) {
+  std::mt19937 generator{width + height};
+  std::uniform_int_distribution<int> byte{0, 255};
+  std::vector<uint8_t> frame(frame_size(PixelFormat::NV12, width, height));
+  for (auto& b : frame) {
+    b = static_cast<uint8_t>(byte(generator));
+  }
+  return frame;
+}
+
+std::vector<uint8_t> halved(const std::vector<uint8_t>& frame,
+                            uint32_t width,
+                            uint32_t height) {
+  std::vector<uint8_t> result(
+      frame_size(PixelFormat::NV12, width / 2, height / 2));
+  EXPECT_FALSE(halve_420(frame, width, height, PixelFormat::NV12, result));
+  return result;
+}
+
+std::unique_ptr<SimulcastEncoder> make_ladder(
+    uint32_t width,
+    uint32_t height,
+    std::vector<std::pair<uint32_t, FakeEncoder*>> layers) {
+  std::vector<SimulcastLayer> result;
+  for (auto [scale, encoder] : layers) {
+    result.push_back({.scale_down_by = scale,
+                      .encoder = std::unique_ptr<Encoder>(encoder)});
+  }
+  return make_simulcast_encoder(width, height, PixelFormat::NV12,
+                                std::move(result));
+}
+}  // namespace
+
+// Renditions in any order get the frame halved as many times as their scale
+// takes, each halving from the one before.
+TEST(simulcast_tests, ladder_test) {
+  constexpr uint32_t width = 64;
+  constexpr uint32_t height = 32;
+  auto* quarter = new FakeEncoder;
+  auto* full = new FakeEncoder;
+  auto* half = new FakeEncoder;
+  auto simulcast =
+      make_ladder(width, height, {{4, quarter}, {1, full}, {2, half}});
+  ASSERT_TRUE(simulcast);
+  EXPECT_EQ(simulcast->layers_count(), 3);
+  EXPECT_EQ(&simulcast->encoder(1), full);
+
+  auto frame = random_nv12(width, height);
+  simulcast->process_frame(FrameLease{frame, {.frame_id = 3}});
+  ASSERT_TRUE(full->wait_frames(1));
+  ASSERT_TRUE(half->wait_frames(1));
+  ASSERT_TRUE(quarter->wait_frames(1));
+
+  const auto expected_half = halved(frame, width, height);
+  EXPECT_EQ(full->frames()[0], frame);
+  EXPECT_EQ(half->frames()[0], expected_half);
+  EXPECT_EQ(quarter->frames()[0], halved(expected_half, width / 2, height / 2));
+  EXPECT_EQ(quarter->frame_ids(), std::vector<uint32_t>{3});
+}
+
+// A rendition still encoding drops frames of its own, the others get them all.
+TEST(simulcast_tests, slow_layer_test) {
+  auto* fast = new FakeEncoder;
+  auto* slow = new FakeEncoder{true};
+  auto simulcast = make_ladder(32, 16, {{1, fast}, {2, slow}});
+  ASSERT_TRUE(simulcast);
+
+  auto frame = random_nv12(32, 16);
+  for (uint32_t id = 0; id < 5; ++id) {
+    simulcast->process_frame(FrameLease{frame, {.frame_id = id}});
+    ASSERT_TRUE(fast->wait_frames(id + 1));
+    // Holds on to the first one from then on.
+    ASSERT_TRUE(slow->wait_frames(1));
+  }
+  EXPECT_EQ(simulcast->dropped(0), 0);
+  EXPECT_EQ(simulcast->dropped(1), 3);
+
+  slow->release();
+  ASSERT_TRUE(slow->wait_frames(2));
+  EXPECT_EQ(slow->frame_ids(), (std::vector<uint32_t>{0, 4}));
+  EXPECT_EQ(fast->frame_ids().size(), 5);
+}
+
+TEST(simulcast_tests, bad_layers_test) {
+  EXPECT_FALSE(make_ladder(64, 32, {}));
+  EXPECT_FALSE(make_ladder(64, 32, {{3, new FakeEncoder}}));
+  EXPECT_FALSE(make_ladder(64, 32, {{2, new FakeEncoder},
+                                    {2, new FakeEncoder}}));
+  EXPECT_FALSE(make_ladder(64, 32, {{1, nullptr}}));
+  // 36x20 halves once into 18x10, which does not halve.
+  EXPECT_TRUE(make_ladder(36, 20, {{2, new FakeEncoder}}));
+  EXPECT_FALSE(make_ladder(36, 20, {{4, new FakeEncoder}}));
+
+  // Other formats only at full resolution.
+  for (uint32_t scale : {1, 2}) {
+    std::vector<SimulcastLayer> layers;
+    layers.push_back({.scale_down_by = scale,
+                      .encoder = std::make_unique<FakeEncoder>()});
+    EXPECT_EQ(static_cast<bool>(make_simulcast_encoder(
+                  64, 32, PixelFormat::YUV422_packed, std::move(layers))),
+              scale == 1);
+  }
+}
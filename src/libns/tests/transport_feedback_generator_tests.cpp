@@ -0,0 +1,87 @@
+#include <gtest/gtest.h>
+#include <vector>
+
+#include "transport_feedback_generator.hpp"
+
+namespace {
+using namespace std::chrono_literals;
+using clock_type = TransportFeedbackGenerator::clock;
+using Arrivals = std::vector<std::optional<int64_t>>;
+
+const auto t0 = clock_type::time_point{} + 1h;
+}  // namespace
+
+TEST(transport_feedback_generator_tests, nothing_to_report_test) {
+  TransportFeedbackGenerator generator;
+  RTCP_TransportFeedback feedback;
+  EXPECT_FALSE(generator.build(feedback));
+}
+
+TEST(transport_feedback_generator_tests, arrivals_and_losses_test) {
+  TransportFeedbackGenerator generator;
+  generator.on_packet(10, t0);
+  generator.on_packet(11, t0 + 1ms);
+  generator.on_packet(14, t0 + 100ms);
+  // Reordered, still in time for the report.
+  generator.on_packet(12, t0 + 101ms);
+
+  RTCP_TransportFeedback feedback;
+  ASSERT_TRUE(generator.build(feedback));
+  EXPECT_EQ(feedback.base_sequence_num, 10);
+  EXPECT_EQ(feedback.reference_time, 0);
+  EXPECT_EQ(feedback.feedback_count, 0);
+  // In 250 us units.
+  EXPECT_EQ(feedback.arrivals, (Arrivals{0, 4, 404, std::nullopt, 400}));
+
+  EXPECT_FALSE(generator.build(feedback));
+}
+
+TEST(transport_feedback_generator_tests, continues_where_left_test) {
+  TransportFeedbackGenerator generator;
+  generator.on_packet(100, t0);
+  RTCP_TransportFeedback feedback;
+  ASSERT_TRUE(generator.build(feedback));
+
+  // 101 is lost, 102 comes 100 ms later, 101 even later than that.
+  generator.on_packet(102, t0 + 100ms);
+  ASSERT_TRUE(generator.build(feedback));
+  EXPECT_EQ(feedback.base_sequence_num, 101);
+  EXPECT_EQ(feedback.feedback_count, 1);
+  // Reference time is in 64 ms units.
+  EXPECT_EQ(feedback.reference_time, 1);
+  EXPECT_EQ(feedback.arrivals, (Arrivals{std::nullopt, 144}));
+
+  // Reported lost already.
+  generator.on_packet(101, t0 + 110ms);
+  EXPECT_FALSE(generator.build(feedback));
+}
+
+TEST(transport_feedback_generator_tests, wraparound_test) {
+  TransportFeedbackGenerator generator;
+  generator.on_packet(65534, t0);
+  generator.on_packet(65535, t0);
+  generator.on_packet(1, t0);
+
+  RTCP_TransportFeedback feedback;
+  ASSERT_TRUE(generator.build(feedback));
+  EXPECT_EQ(feedback.base_sequence_num, 65534);
+  EXPECT_EQ(feedback.arrivals, (Arrivals{0, 0, std::nullopt, 0}));
+}
+
+TEST(transport_feedback_generator_tests, long_runs_are_split_test) {
+  TransportFeedbackGenerator generator;
+  const size_t count = TransportFeedbackGenerator::MaxPacketsPerFeedback + 10;
+  for (size_t i = 0; i < count; ++i) {
+    generator.on_packet(static_cast<uint16_t>(i), t0 + i * 1ms);
+  }
+
+  RTCP_TransportFeedback feedback;
+  ASSERT_TRUE(generator.build(feedback));
+  EXPECT_EQ(feedback.arrivals.size(),
+            TransportFeedbackGenerator::MaxPacketsPerFeedback);
+  ASSERT_TRUE(generator.build(feedback));
+  EXPECT_EQ(feedback.base_sequence_num,
+            TransportFeedbackGenerator::MaxPacketsPerFeedback);
+  EXPECT_EQ(feedback.arrivals.size(), 10);
+  EXPECT_FALSE(generator.build(feedback));
+}
@@ -0,0 +1,92 @@
+#include <gtest/gtest.h>
+#include <asio.hpp>
+#include <atomic>
+#include <thread>
+#include <vector>
+
+#include "impairment_proxy.hpp"
+#include "udp_receive.hpp"
+#include "udp_transmit.hpp"
+
+namespace {
+using namespace std::chrono_literals;
+
+constexpr uint16_t RECEIVER_PORT = 34710;
+constexpr uint64_t LINK_BITRATE = 1'500'000;
+constexpr uint64_t START_BITRATE = 3'000'000;
+constexpr size_t NAL_SIZE = 1200;
+constexpr auto FRAME_INTERVAL = 40ms;
+
+class CountingListener : public UDP_ReceiveListener {
+ public:
+  virtual void on_packet_received(ReceivedPacket) override { received++; }
+  std::atomic<size_t> received{};
+};
+
+// Encoder stand-in: frames of exactly the size rate control would aim for at
+// `bitrate`, 25 a second.
+void send_frames(UDP_Transmit& transmit,
+                 const std::atomic<uint64_t>& bitrate,
+                 std::chrono::milliseconds duration) {
+  const auto end = std::chrono::steady_clock::now() + duration;
+  auto next = std::chrono::steady_clock::now();
+  while (next < end) {
+    size_t frame_bytes = bitrate * FRAME_INTERVAL.count() / 8000;
+    transmit.begin_frame();
+    while (frame_bytes > 0) {
+      const size_t size = std::min(frame_bytes, NAL_SIZE);
+      VideoPacket packet;
+      packet.nal_data.assign(size, 0xAB);
+      packet.nal_meta.nal_type = NAL_Type::slice;
+      transmit.transmit(std::move(packet));
+      frame_bytes -= size;
+    }
+    transmit.end_frame();
+
+    next += FRAME_INTERVAL;
+    std::this_thread::sleep_until(next);
+  }
+}
+}  // namespace
+
+// The whole loop over real sockets: sender starts at twice what the
+// bottleneck takes and has to settle below it with the queue drained.
+TEST(udp_bwe_loopback_tests, settles_below_bottleneck_test) {
+  asio::io_context ctx;
+  ImpairmentProxy proxy{ctx, RECEIVER_PORT,
+                        {.bitrate = LINK_BITRATE, .delay = 20ms}};
+
+  auto receive = make_udp_receive(ctx, RECEIVER_PORT,
+                                  {.transport_feedback = true});
+  ASSERT_TRUE(receive);
+  CountingListener listener;
+  receive->start(listener);
+
+  std::atomic<uint64_t> media_bitrate{START_BITRATE};
+  auto transmit = make_udp_transmit(
+      ctx, "127.0.0.1", proxy.port(),
+      {.mode = UDP_TransmitMode::batched,
+       .pacer = {.rate = START_BITRATE},
+       .bwe = {.start_bitrate = START_BITRATE},
+       .on_target_bitrate =
+           [&](uint64_t bitrate) { media_bitrate = bitrate; }});
+  ASSERT_TRUE(transmit);
+  transmit->async_initialize([](std::error_code) {});
+
+  std::thread io([&] { ctx.run(); });
+  send_frames(*transmit, media_bitrate, 6s);
+  proxy.take_max_queue_delay();
+  send_frames(*transmit, media_bitrate, 3s);
+  const auto queue_delay = proxy.take_max_queue_delay();
+  ctx.stop();
+  io.join();
+
+  // Probing takes the rate a little over the link now and then, until the
+  // queue grows enough to notice.
+  const auto estimate = transmit->bandwidth_estimate();
+  EXPECT_LT(estimate.target_bitrate, LINK_BITRATE * 1.2);
+  EXPECT_GT(estimate.target_bitrate, LINK_BITRATE / 2);
+  EXPECT_LT(media_bitrate, LINK_BITRATE * 1.2);
+  EXPECT_LT(queue_delay, 150ms);
+  EXPECT_GT(listener.received, 0);
+}
@@ -0,0 +1,160 @@
+#include <gtest/gtest.h>
+#include <algorithm>
+#include <array>
+#include <asio.hpp>
+#include <chrono>
+#include <future>
+#include <mutex>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include "udp_receive.hpp"
+#include "udp_transmit.hpp"
+
+namespace {
+using namespace std::chrono_literals;
+
+constexpr uint16_t RECEIVER_PORT = 34712;
+constexpr int FRAMES = 20;
+constexpr int NALS_PER_FRAME = 5;
+constexpr size_t NAL_SIZE = 1000;
+constexpr std::array<uint8_t, 4> START_CODE{0, 0, 0, 1};
+
+struct Payload {
+  std::vector<uint8_t> data;
+  bool marker{};
+};
+
+class CollectingListener : public UDP_ReceiveListener {
+ public:
+  virtual void on_packet_received(ReceivedPacket p) override {
+    std::lock_guard lock(m_lock);
+    m_payloads.push_back(
+        {{p.payload.begin(), p.payload.end()}, p.marker});
+  }
+
+  std::vector<Payload> take_payloads() {
+    std::lock_guard lock(m_lock);
+    return std::exchange(m_payloads, {});
+  }
+
+  size_t received() {
+    std::lock_guard lock(m_lock);
+    return m_payloads.size();
+  }
+
+ private:
+  std::mutex m_lock;
+  std::vector<Payload> m_payloads;
+};
+
+// Slice NAL, without start code, telling its frame and place in it.
+std::vector<uint8_t> make_nal(int frame, int index) {
+  std::vector<uint8_t> nal(NAL_SIZE);
+  nal[0] = 0x41;
+  for (size_t i = 1; i < nal.size(); ++i) {
+    nal[i] = static_cast<uint8_t>(frame * NALS_PER_FRAME + index + i);
+  }
+  return nal;
+}
+
+// Sends NALs the way the encoder does, written into buffers of the transmit,
+// and returns the payloads that came in.
+std::vector<Payload> send_in_buffers(UDP_TransmitOptions options) {
+  asio::io_context ctx;
+  auto receive = make_udp_receive(ctx, RECEIVER_PORT);
+  EXPECT_TRUE(receive);
+  CollectingListener listener;
+  receive->start(listener);
+
+  auto transmit =
+      make_udp_transmit(ctx, "127.0.0.1", RECEIVER_PORT, std::move(options));
+  EXPECT_TRUE(transmit);
+  std::promise<std::error_code> initialized;
+  transmit->async_initialize(
+      [&initialized](std::error_code ec) { initialized.set_value(ec); });
+
+  std::thread io([&] { ctx.run(); });
+  EXPECT_FALSE(initialized.get_future().get());
+  for (int frame = 0; frame < FRAMES; ++frame) {
+    transmit->begin_frame();
+    for (int i = 0; i < NALS_PER_FRAME; ++i) {
+      const auto nal = make_nal(frame, i);
+      auto buffer = transmit->acquire_nal_buffer();
+      EXPECT_TRUE(buffer);
+      EXPECT_GE(buffer.capacity(), START_CODE.size() + nal.size());
+      auto end = std::ranges::copy(START_CODE, buffer.data()).out;
+      std::ranges::copy(nal, end);
+      buffer.set_size(START_CODE.size() + nal.size());
+
+      VideoPacket packet;
+      packet.buffer = std::move(buffer);
+      packet.nal_meta = {.timestamp = static_cast<uint32_t>(frame * 40),
+                         .nal_type = NAL_Type::slice};
+      transmit->transmit(std::move(packet));
+    }
+    transmit->end_frame();
+    // Unpaced, the whole stream at once would overflow the receive buffer.
+    std::this_thread::sleep_for(5ms);
+  }
+
+  const auto deadline = std::chrono::steady_clock::now() + 2s;
+  while (listener.received() < FRAMES * NALS_PER_FRAME &&
+         std::chrono::steady_clock::now() < deadline) {
+    std::this_thread::sleep_for(10ms);
+  }
+  ctx.stop();
+  io.join();
+  return listener.take_payloads();
+}
+
+// With `marked`, the last packet of each frame must have the marker bit.
+void expect_nals(const std::vector<Payload>& payloads,
+                 bool with_start_code,
+                 bool marked = true) {
+  ASSERT_EQ(payloads.size(), FRAMES * NALS_PER_FRAME);
+  for (int frame = 0; frame < FRAMES; ++frame) {
+    for (int i = 0; i < NALS_PER_FRAME; ++i) {
+      auto expected = make_nal(frame, i);
+      if (with_start_code) {
+        expected.insert(expected.begin(), START_CODE.begin(),
+                        START_CODE.end());
+      }
+      const auto& payload = payloads[frame * NALS_PER_FRAME + i];
+      EXPECT_EQ(payload.data, expected);
+      EXPECT_EQ(payload.marker, marked && i == NALS_PER_FRAME - 1);
+    }
+  }
+}
+}  // namespace
+
+// NALs that make a packet each go from their buffers, headers prepended. The
+// last one of a frame is held until end_frame() to get the marker bit.
+TEST(udp_nal_buffer_loopback_tests, h264_immediate_test) {
+  expect_nals(send_in_buffers({.payload_format = UDP_PayloadFormat::h264,
+                               .retransmission_history = 64}),
+              false);
+}
+
+TEST(udp_nal_buffer_loopback_tests, h264_batched_test) {
+  expect_nals(send_in_buffers({.mode = UDP_TransmitMode::batched,
+                               .payload_format = UDP_PayloadFormat::h264,
+                               .retransmission_history = 64,
+                               .fec = {.row_size = 4},
+                               .abs_send_time = true,
+                               .frame_marking = true}),
+              false);
+}
+
+// Shared with the pacer, the history and FEC all at once.
+TEST(udp_nal_buffer_loopback_tests, naive_paced_test) {
+  for (auto mode : {UDP_TransmitMode::immediate, UDP_TransmitMode::batched}) {
+    expect_nals(send_in_buffers({.mode = mode,
+                                 .retransmission_history = 64,
+                                 .fec = {.row_size = 4},
+                                 .pacer = {.rate = 50'000'000},
+                                 .abs_send_time = true}),
+                true, mode == UDP_TransmitMode::batched);
+  }
+}
@@ -0,0 +1,112 @@
+#include <gtest/gtest.h>
+#include <asio.hpp>
+#include <thread>
+#include <vector>
+
+#include "impairment_proxy.hpp"
+#include "udp_receive.hpp"
+#include "udp_transmit.hpp"
+
+namespace {
+using namespace std::chrono_literals;
+
+constexpr uint16_t RECEIVER_PORT = 34711;
+
+class NullListener : public UDP_ReceiveListener {
+ public:
+  virtual void on_packet_received(ReceivedPacket) override {}
+};
+}  // namespace
+
+// Sender and receiver reports over real sockets, with 30 ms of one-way delay
+// and every 10th packet lost on the way to the receiver.
+TEST(udp_rtcp_loopback_tests, reports_test) {
+  asio::io_context ctx;
+  ImpairmentProxy proxy{ctx, RECEIVER_PORT, {.delay = 30ms, .loss_period = 10}};
+
+  auto receive = make_udp_receive(
+      ctx, RECEIVER_PORT,
+      {.rtcp_reports = true, .rtcp_report_interval = 100ms});
+  ASSERT_TRUE(receive);
+  NullListener listener;
+  receive->start(listener);
+
+  auto transmit = make_udp_transmit(
+      ctx, "127.0.0.1", proxy.port(),
+      {.rtcp_reports = true, .rtcp_report_interval = 100ms});
+  ASSERT_TRUE(transmit);
+  transmit->async_initialize([](std::error_code) {});
+
+  std::thread io([&] { ctx.run(); });
+  // 25 frames a second, 10 packets each.
+  for (int frame = 0; frame < 50; ++frame) {
+    transmit->begin_frame();
+    for (int i = 0; i < 10; ++i) {
+      VideoPacket packet;
+      packet.nal_data.assign(1000, 0xAB);
+      packet.nal_meta.timestamp = frame * 40;
+      transmit->transmit(std::move(packet));
+    }
+    transmit->end_frame();
+    std::this_thread::sleep_for(40ms);
+  }
+  ctx.stop();
+  io.join();
+
+  // Sender reports take the same path and count towards the loss pattern, so
+  // the numbers are off by a packet or so.
+  const auto receive_stats = receive->stats();
+  EXPECT_NEAR(receive_stats.packets_received, 450, 5);
+  EXPECT_EQ(receive_stats.bytes_received,
+            receive_stats.packets_received * 1000);
+  EXPECT_NEAR(receive_stats.cumulative_lost, 50, 5);
+
+  const auto transmit_stats = transmit->stats();
+  EXPECT_EQ(transmit_stats.packets_sent, 500);
+  // Feedback comes back right away, so that is about the one-way delay.
+  EXPECT_GT(transmit_stats.rtt, 25ms);
+  EXPECT_LT(transmit_stats.rtt, 80ms);
+  EXPECT_NEAR(transmit_stats.loss_fraction, 0.1, 0.05);
+  EXPECT_GT(transmit_stats.cumulative_lost, 30);
+}
+
+// Delay variation from absolute send time, with the same fixed delay on the
+// path: packets of a frame leave back to back, so that they are spread on
+// arrival does not count as variation.
+TEST(udp_rtcp_loopback_tests, delay_variation_test) {
+  asio::io_context ctx;
+  ImpairmentProxy proxy{ctx, RECEIVER_PORT, {.delay = 30ms}};
+
+  auto receive = make_udp_receive(ctx, RECEIVER_PORT);
+  ASSERT_TRUE(receive);
+  NullListener listener;
+  receive->start(listener);
+
+  auto transmit =
+      make_udp_transmit(ctx, "127.0.0.1", proxy.port(),
+                        {.mode = UDP_TransmitMode::batched,
+                         .abs_send_time = true,
+                         .frame_marking = true});
+  ASSERT_TRUE(transmit);
+  transmit->async_initialize([](std::error_code) {});
+
+  std::thread io([&] { ctx.run(); });
+  for (int frame = 0; frame < 25; ++frame) {
+    transmit->begin_frame();
+    for (int i = 0; i < 10; ++i) {
+      VideoPacket packet;
+      packet.nal_data.assign(1000, 0xAB);
+      packet.nal_meta.timestamp = frame * 40;
+      transmit->transmit(std::move(packet));
+    }
+    transmit->end_frame();
+    std::this_thread::sleep_for(40ms);
+  }
+  ctx.stop();
+  io.join();
+
+  const auto stats = receive->stats();
+  EXPECT_EQ(stats.packets_received, 250);
+  EXPECT_LT(stats.delay_variation, 5ms);
+  EXPECT_LT(stats.queuing_delay, 10ms);
+}
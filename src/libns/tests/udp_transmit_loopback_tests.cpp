@@ -0,0 +1,263 @@
+#include <gtest/gtest.h>
+#include <algorithm>
+#include <array>
+#include <asio.hpp>
+#include <chrono>
+#include <set>
+#include <span>
+#include <vector>
+
+#include "rtp.hpp"
+#include "rtp_extensions.hpp"
+#include "udp_receive.hpp"
+#include "udp_transmit.hpp"
+
+namespace {
+using namespace std::chrono_literals;
+
+constexpr uint16_t RECEIVER_PORT = 34713;
+// Of UDP_Receive the packets are passed on to.
+constexpr uint16_t FORWARD_PORT = 34714;
+// MAX_BATCH_SIZE of UDP_Transmit.
+constexpr size_t BATCH_SIZE = 256;
+
+// Plain socket on the receiving end, so that packets are seen exactly as they
+// are on the wire.
+class RawReceiver {
+ public:
+  explicit RawReceiver(asio::io_context& ctx) : m_socket(ctx) {
+    m_socket.open(asio::ip::udp::v4());
+    m_socket.bind({asio::ip::make_address("127.0.0.1"), RECEIVER_PORT});
+    // Room for a whole batch, the socket is read only after it has been sent.
+    m_socket.set_option(asio::socket_base::receive_buffer_size(1 << 20));
+    m_socket.non_blocking(true);
+  }
+
+  // Datagrams that have arrived so far.
+  std::vector<std::vector<uint8_t>> receive() {
+    std::vector<std::vector<uint8_t>> datagrams;
+    std::array<uint8_t, 2048> buff;
+    while (true) {
+      std::error_code ec;
+      asio::ip::udp::endpoint sender;
+      const size_t size =
+          m_socket.receive_from(asio::buffer(buff), sender, {}, ec);
+      if (ec) {
+        return datagrams;
+      }
+      datagrams.emplace_back(buff.begin(), buff.begin() + size);
+    }
+  }
+
+  std::vector<RTP_PacketHeader> receive_headers() {
+    std::vector<RTP_PacketHeader> headers;
+    for (const auto& datagram : receive()) {
+      auto header = deserialize_rtp_header_from(datagram);
+      EXPECT_TRUE(header);
+      if (header) {
+        headers.push_back(*header);
+      }
+    }
+    return headers;
+  }
+
+ private:
+  asio::ip::udp::socket m_socket;
+};
+
+class SequenceListener : public UDP_ReceiveListener {
+ public:
+  virtual void on_packet_received(ReceivedPacket p) override {
+    sequence_nums.insert(p.sequence_num);
+  }
+
+  std::set<uint16_t> sequence_nums;
+};
+
+// Whether frame marking, at its default id, says the packet ends a frame.
+bool marks_end_of_frame(std::span<const uint8_t> datagram) {
+  RTP_PacketHeader header;
+  if (!read_rtp_header(datagram, header) || !header.extension) {
+    return false;
+  }
+  auto extensions = parse_rtp_extensions(*header.extension, {});
+  return extensions && extensions->frame_marking &&
+         extensions->frame_marking->end_of_frame;
+}
+
+// Non-IDR slice of `size` bytes, start code included.
+std::vector<uint8_t> make_nal(size_t size) {
+  std::vector<uint8_t> nal(size, 0xAB);
+  std::ranges::copy(std::array<uint8_t, 5>{0, 0, 0, 1, 0x41}, nal.begin());
+  return nal;
+}
+
+// Frame of slices of `nal_size` bytes, which go one packet each unless they
+// are too big for that.
+void send_frame(UDP_Transmit& transmit,
+                uint32_t timestamp,
+                size_t packets,
+                size_t nal_size = 100) {
+  transmit.begin_frame();
+  for (size_t i = 0; i < packets; ++i) {
+    VideoPacket packet;
+    packet.nal_data = make_nal(nal_size);
+    packet.nal_meta.timestamp = timestamp;
+    transmit.transmit(std::move(packet));
+  }
+  transmit.end_frame();
+}
+}  // namespace
+
+// A frame that fills the batch with its last packet still gets that packet
+// marked, it is not sent before end_frame().
+TEST(udp_transmit_loopback_tests, full_batch_marker_test) {
+  asio::io_context ctx;
+  RawReceiver receiver{ctx};
+  auto transmit = make_udp_transmit(
+      ctx, "127.0.0.1", RECEIVER_PORT,
+      {.mode = UDP_TransmitMode::batched, .frame_marking = true});
+  ASSERT_TRUE(transmit);
+
+  for (size_t packets : {BATCH_SIZE, BATCH_SIZE + 1}) {
+    send_frame(*transmit, static_cast<uint32_t>(packets), packets);
+    const auto datagrams = receiver.receive();
+    ASSERT_EQ(datagrams.size(), packets);
+    for (size_t i = 0; i < packets; ++i) {
+      auto header = deserialize_rtp_header_from(datagrams[i]);
+      ASSERT_TRUE(header);
+      EXPECT_EQ(header->marker_bit, i == packets - 1) << i;
+      EXPECT_EQ(marks_end_of_frame(datagrams[i]), i == packets - 1) << i;
+    }
+  }
+}
+
+// Batched packets are sent straight from the NALs passed to transmit(), which
+// must still be there when the batch goes out.
+TEST(udp_transmit_loopback_tests, batched_payload_test) {
+  asio::io_context ctx;
+  RawReceiver receiver{ctx};
+  auto transmit = make_udp_transmit(ctx, "127.0.0.1", RECEIVER_PORT,
+                                    {.mode = UDP_TransmitMode::batched});
+  ASSERT_TRUE(transmit);
+
+  const auto nal = make_nal(100);
+  for (uint32_t frame = 0; frame < 3; ++frame) {
+    send_frame(*transmit, frame, 10);
+    const auto datagrams = receiver.receive();
+    ASSERT_EQ(datagrams.size(), 10);
+    for (const auto& datagram : datagrams) {
+      ASSERT_EQ(datagram.size(),
+                RTP_PacketHeader_Size + RTP_PayloadHeader_Size + nal.size());
+      EXPECT_TRUE(std::ranges::equal(
+          std::span{datagram}.last(nal.size()), nal));
+    }
+  }
+}
+
+// RFC 6184 packets the way standard tools read them: without padding, and
+// with the marker bit on the last packet of each frame in either mode.
+TEST(udp_transmit_loopback_tests, h264_marker_and_padding_test) {
+  for (auto mode : {UDP_TransmitMode::immediate, UDP_TransmitMode::batched}) {
+    asio::io_context ctx;
+    RawReceiver receiver{ctx};
+    auto transmit = make_udp_transmit(
+        ctx, "127.0.0.1", RECEIVER_PORT,
+        {.mode = mode,
+         .payload_format = UDP_PayloadFormat::h264,
+         .frame_marking = true});
+    ASSERT_TRUE(transmit);
+
+    // Last one is a single NAL fragmented into FU-A packets.
+    for (auto [packets, nal_size] : {std::pair<size_t, size_t>{1, 100},
+                                     {3, 100},
+                                     {1, 3000}}) {
+      send_frame(*transmit, static_cast<uint32_t>(nal_size + packets),
+                 packets, nal_size);
+      const auto datagrams = receiver.receive();
+      ASSERT_GE(datagrams.size(), packets);
+      for (size_t i = 0; i < datagrams.size(); ++i) {
+        const bool last = i == datagrams.size() - 1;
+        auto header = deserialize_rtp_header_from(datagrams[i]);
+        ASSERT_TRUE(header);
+        EXPECT_FALSE(header->padding_bit) << i;
+        EXPECT_EQ(header->marker_bit, last) << i;
+        EXPECT_EQ(marks_end_of_frame(datagrams[i]), last) << i;
+      }
+    }
+  }
+}
+
+// FEC goes as a stream of its own, with an SSRC of its own and sequence
+// numbers that run on without gaps, as do those of media.
+TEST(udp_transmit_loopback_tests, fec_stream_test) {
+  asio::io_context ctx;
+  RawReceiver receiver{ctx};
+  auto transmit = make_udp_transmit(
+      ctx, "127.0.0.1", RECEIVER_PORT,
+      {.mode = UDP_TransmitMode::batched, .fec = {.row_size = 4, .rows = 2}});
+  ASSERT_TRUE(transmit);
+
+  std::vector<RTP_PacketHeader> media;
+  std::vector<RTP_PacketHeader> fec;
+  for (uint32_t frame = 0; frame < 3; ++frame) {
+    send_frame(*transmit, frame, 8);
+    for (const auto& header : receiver.receive_headers()) {
+      (header.payload_type == RTP_FecPayloadType ? fec : media)
+          .push_back(header);
+    }
+  }
+
+  ASSERT_EQ(media.size(), 24);
+  // Each frame is a block of two rows of four packets: two row and four column
+  // parity packets.
+  ASSERT_EQ(fec.size(), 18);
+  // Sender reports are about media only.
+  EXPECT_EQ(transmit->stats().packets_sent, media.size());
+  EXPECT_NE(media[0].ssrc, fec[0].ssrc);
+  for (const auto* stream : {&media, &fec}) {
+    for (size_t i = 0; i < stream->size(); ++i) {
+      EXPECT_EQ((*stream)[i].ssrc, stream->front().ssrc) << i;
+      EXPECT_EQ((*stream)[i].sequence_num,
+                static_cast<uint16_t>(stream->front().sequence_num + i))
+          << i;
+    }
+  }
+}
+
+// The receiver takes parity from the FEC stream and rebuilds a lost packet.
+TEST(udp_transmit_loopback_tests, fec_recovery_test) {
+  asio::io_context ctx;
+  RawReceiver receiver{ctx};
+  auto transmit = make_udp_transmit(
+      ctx, "127.0.0.1", RECEIVER_PORT,
+      {.mode = UDP_TransmitMode::batched, .fec = {.row_size = 4}});
+  ASSERT_TRUE(transmit);
+  auto receive = make_udp_receive(ctx, FORWARD_PORT, {.fec = true});
+  ASSERT_TRUE(receive);
+  SequenceListener listener;
+  receive->start(listener);
+
+  send_frame(*transmit, 0, 4);
+  const auto datagrams = receiver.receive();
+  ASSERT_EQ(datagrams.size(), 5);
+
+  // All but the second media packet go on to the receiver.
+  asio::ip::udp::socket forward{ctx, asio::ip::udp::v4()};
+  const asio::ip::udp::endpoint receive_endpoint{
+      asio::ip::make_address("127.0.0.1"), FORWARD_PORT};
+  for (size_t i = 0; i < datagrams.size(); ++i) {
+    if (i != 1) {
+      forward.send_to(asio::buffer(datagrams[i]), receive_endpoint);
+    }
+  }
+  ctx.run_for(100ms);
+
+  auto first = deserialize_rtp_header_from(datagrams[0]);
+  ASSERT_TRUE(first);
+  std::set<uint16_t> expected;
+  for (uint16_t i = 0; i < 4; ++i) {
+    expected.insert(static_cast<uint16_t>(first->sequence_num + i));
+  }
+  EXPECT_EQ(listener.sequence_nums, expected);
+}
@@ -0,0 +1,311 @@
+#include <gtest/gtest.h>
+#include <unistd.h>
+#include <chrono>
+#include <condition_variable>
+#include <filesystem>
+#include <fstream>
+#include <mutex>
+#include <set>
+#include <string>
+#include <vector>
+
+#include "video_capture.hpp"
+
+namespace {
+using namespace std::chrono_literals;
+
+// Copies of frames a capture delivers.
+class FrameCollector {
+ public:
+  VideoFrameCallback callback() {
+    return [this](std::span<uint8_t> data, CapturedFrameMeta meta) {
+      std::lock_guard lock(m_lock);
+      m_frames.emplace_back(data.begin(), data.end());
+      m_metas.push_back(meta);
+      m_added.notify_all();
+    };
+  }
+
+  // False if there are fewer than `count` frames by the deadline.
+  bool wait_for(size_t count, std::chrono::milliseconds timeout = 5s) {
+    std::unique_lock lock(m_lock);
+    return m_added.wait_for(lock, timeout,
+                            [&] { return m_frames.size() >= count; });
+  }
+
+  std::vector<std::vector<uint8_t>> frames() {
+    std::lock_guard lock(m_lock);
+    return m_frames;
+  }
+
+  std::vector<CapturedFrameMeta> metas() {
+    std::lock_guard lock(m_lock);
+    return m_metas;
+  }
+
+ private:
+  std::mutex m_lock;
+  std::condition_variable m_added;
+  std::vector<std::vector<uint8_t>> m_frames;
+  std::vector<CapturedFrameMeta> m_metas;
+};
+
+class TempFile {
+ public:
+  explicit TempFile(const std::string& contents)
+      : m_path(std::filesystem::temp_directory_path() /
+               ("ns_capture_test_" + std::to_string(::getpid()) + "_" +
+                std::to_string(s_count++))) {
+    std::ofstream{m_path, std::ios::binary} << contents;
+  }
+  ~TempFile() { std::filesystem::remove(m_path); }
+
+  const std::filesystem::path& path() const { return m_path; }
+
+ private:
+  static inline int s_count = 0;
+  std::filesystem::path m_path;
+};
+
+std::vector<std::vector<uint8_t>> capture_all(
+    SyntheticVideoCaptureOptions options) {
+  FrameCollector collector;
+  auto capture = make_synthetic_video_capture(options, collector.callback());
+  EXPECT_TRUE(capture);
+  capture->start();
+  EXPECT_TRUE(collector.wait_for(options.frame_count));
+  capture->stop();
+  return collector.frames();
+}
+}  // namespace
+
+TEST(video_capture_sources_tests, synthetic_patterns_test) {
+  for (auto pattern :
+       {SyntheticPattern::moving_bars, SyntheticPattern::bouncing_box,
+        SyntheticPattern::noise}) {
+    const SyntheticVideoCaptureOptions options{.width = 64,
+                                               .height = 32,
+                                               .fps = 0,
+                                               .pattern = pattern,
+                                               .frame_count = 5};
+    const auto frames = capture_all(options);
+    ASSERT_EQ(frames.size(), 5);
+    for (size_t i = 0; i < frames.size(); ++i) {
+      EXPECT_EQ(frames[i].size(), 64 * 32 * 2);
+      if (i > 0) {
+        // Something moves.
+        EXPECT_NE(frames[i], frames[i - 1]);
+      }
+    }
+    // Same every run.
+    EXPECT_EQ(capture_all(options), frames);
+  }
+}
+
+TEST(video_capture_sources_tests, synthetic_format_test) {
+  auto capture = make_synthetic_video_capture(
+      {.width = 320, .height = 240}, [](auto, auto) {});
+  ASSERT_TRUE(capture);
+  const auto formats = capture->enumerate_formats();
+  ASSERT_EQ(formats.size(), 1);
+  EXPECT_EQ(formats[0]->basic.width, 320);
+  EXPECT_EQ(formats[0]->basic.height, 240);
+  EXPECT_EQ(formats[0]->basic.pixel_format, PixelFormat::YUV422_packed);
+  EXPECT_DOUBLE_EQ(formats[0]->basic.interval.fps(), 30);
+  EXPECT_EQ(choose_format(formats), formats[0].get());
+  EXPECT_TRUE(capture->select_format(*formats[0]));
+  EXPECT_FALSE(capture->select_format(AbstractVideoFormatSpec{
+      AbstractVideoFormatSpec::Basic{.width = 1280, .height = 720}}));
+
+  EXPECT_FALSE(make_synthetic_video_capture({.width = 15}, [](auto, auto) {}));
+}
+
+TEST(video_capture_sources_tests, synthetic_pacing_test) {
+  FrameCollector collector;
+  auto capture = make_synthetic_video_capture(
+      {.width = 64, .height = 32, .fps = 100, .frame_count = 11},
+      collector.callback());
+  ASSERT_TRUE(capture);
+  capture->start();
+  ASSERT_TRUE(collector.wait_for(11));
+  capture->stop();
+
+  // The first one right away, then one every 10 ms.
+  const auto metas = collector.metas();
+  const auto elapsed = metas.back().timestamp - metas.front().timestamp;
+  EXPECT_GE(elapsed, 95ms);
+  EXPECT_LT(elapsed, 200ms);
+  for (size_t i = 1; i < metas.size(); ++i) {
+    EXPECT_NE(metas[i].frame_id, metas[i - 1].frame_id);
+    EXPECT_EQ(metas[i].sequence, i);
+    EXPECT_EQ(metas[i].dropped_before, 0);
+  }
+}
+
+TEST(video_capture_sources_tests, stop_test) {
+  FrameCollector collector;
+  auto capture = make_synthetic_video_capture({.width = 64, .height = 32},
+                                              collector.callback());
+  ASSERT_TRUE(capture);
+  capture->start();
+  ASSERT_TRUE(collector.wait_for(1));
+  // Does not wait for the next frame period.
+  const auto start = std::chrono::steady_clock::now();
+  capture->stop();
+  EXPECT_LT(std::chrono::steady_clock::now() - start, 30ms);
+}
+
+TEST(video_capture_sources_tests, leases_test) {
+  std::mutex lock;
+  std::condition_variable leased;
+  std::vector<FrameLease> leases;
+  auto capture = make_synthetic_video_capture(
+      {.width = 64, .height = 32, .fps = 0}, [&](FrameLease frame) {
+        std::lock_guard locked(lock);
+        leases.push_back(std::move(frame));
+        leased.notify_all();
+      });
+  ASSERT_TRUE(capture);
+  capture->start();
+  auto wait_for = [&](size_t count) {
+    std::unique_lock locked(lock);
+    return leased.wait_for(locked, 50ms,
+                           [&] { return leases.size() >= count; });
+  };
+
+  // Stalls once all buffers are held.
+  ASSERT_TRUE(wait_for(3));
+  EXPECT_FALSE(wait_for(4));
+  std::set<uint8_t*> buffers;
+  for (const auto& lease : leases) {
+    buffers.insert(lease.data().data());
+  }
+  EXPECT_EQ(buffers.size(), 3);
+
+  uint8_t* released{};
+  {
+    std::lock_guard locked(lock);
+    released = leases[1].data().data();
+    leases[1].release();
+  }
+  ASSERT_TRUE(wait_for(4));
+  EXPECT_EQ(leases[3].data().data(), released);
+  capture->stop();
+  // Before the capture is gone.
+  leases.clear();
+}
+
+TEST(video_capture_sources_tests, raw_file_test) {
+  // Three 4x2 frames, every byte of a frame is its number.
+  std::string contents;
+  for (char frame = 0; frame < 3; ++frame) {
+    contents.append(4 * 2 * 2, frame);
+  }
+  // And a partial one.
+  contents.append(5, 'x');
+  TempFile file{contents};
+
+  FrameCollector collector;
+  auto capture = make_file_video_capture(
+      file.path(), {.width = 4, .height = 2, .fps = 0, .loop = false},
+      collector.callback());
+  ASSERT_TRUE(capture);
+  capture->start();
+  ASSERT_TRUE(collector.wait_for(3));
+  // That was all.
+  EXPECT_FALSE(collector.wait_for(4, 50ms));
+  capture->stop();
+
+  const auto frames = collector.frames();
+  for (uint8_t i = 0; i < 3; ++i) {
+    EXPECT_EQ(frames[i], std::vector<uint8_t>(16, i));
+  }
+}
+
+TEST(video_capture_sources_tests, raw_file_loop_test) {
+  std::string contents;
+  for (char frame = 0; frame < 2; ++frame) {
+    contents.append(4 * 2 * 2, frame);
+  }
+  TempFile file{contents};
+
+  FrameCollector collector;
+  auto capture = make_file_video_capture(
+      file.path(), {.width = 4, .height = 2, .fps = 0}, collector.callback());
+  ASSERT_TRUE(capture);
+  capture->start();
+  ASSERT_TRUE(collector.wait_for(5));
+  capture->stop();
+
+  const auto frames = collector.frames();
+  for (uint8_t i = 0; i < 5; ++i) {
+    EXPECT_EQ(frames[i], std::vector<uint8_t>(16, i % 2));
+  }
+}
+
+TEST(video_capture_sources_tests, y4m_file_test) {
+  // 4x2, 4:2:0: 8 luma samples, then 2 of each chroma.
+  std::string contents = "YUV4MPEG2 W4 H2 F25:1 Ip A1:1 C420jpeg\n";
+  contents += "FRAME\n";
+  contents += std::string{"\x10\x11\x12\x13\x20\x21\x22\x23", 8};
+  contents += "\x80\x81\x90\x91";
+  contents += "FRAME Ixyz\n";
+  contents += std::string(8, '\x50') + "\x60\x61\x70\x71";
+  TempFile file{contents};
+
+  FrameCollector collector;
+  auto capture = make_file_video_capture(file.path(), {.fps = 0, .loop = false},
+                                         collector.callback());
+  ASSERT_TRUE(capture);
+  // Size comes from the header.
+  const auto formats = capture->enumerate_formats();
+  ASSERT_EQ(formats.size(), 1);
+  EXPECT_EQ(formats[0]->basic.width, 4);
+  EXPECT_EQ(formats[0]->basic.height, 2);
+
+  capture->start();
+  ASSERT_TRUE(collector.wait_for(2));
+  EXPECT_FALSE(collector.wait_for(3, 50ms));
+  capture->stop();
+
+  // Y U Y V, chroma row shared by both rows.
+  const auto frames = collector.frames();
+  EXPECT_EQ(frames[0], (std::vector<uint8_t>{0x10, 0x80, 0x11, 0x90, 0x12, 0x81,
+                                             0x13, 0x91, 0x20, 0x80, 0x21, 0x90,
+                                             0x22, 0x81, 0x23, 0x91}));
+  EXPECT_EQ(frames[1], (std::vector<uint8_t>{0x50, 0x60, 0x50, 0x70, 0x50, 0x61,
+                                             0x50, 0x71, 0x50, 0x60, 0x50, 0x70,
+                                             0x50, 0x61, 0x50, 0x71}));
+}
+
+TEST(video_capture_sources_tests, y4m_422_file_test) {
+  // 2x2, 4:2:2: 4 luma samples, then 2 of each chroma.
+  std::string contents = "YUV4MPEG2 W2 H2 C422\nFRAME\n";
+  contents += "\x10\x11\x20\x21\x80\x81\x90\x91";
+  TempFile file{contents};
+
+  FrameCollector collector;
+  auto capture = make_file_video_capture(file.path(), {.fps = 0, .loop = false},
+                                         collector.callback());
+  ASSERT_TRUE(capture);
+  capture->start();
+  ASSERT_TRUE(collector.wait_for(1));
+  capture->stop();
+
+  EXPECT_EQ(collector.frames()[0],
+            (std::vector<uint8_t>{0x10, 0x80, 0x11, 0x90, 0x20, 0x81, 0x21,
+                                  0x91}));
+}
+
+TEST(video_capture_sources_tests, bad_files_test) {
+  auto ignore = [](auto, auto) {};
+  EXPECT_FALSE(
+      make_file_video_capture("/nonexistent/file.yuv", {}, ignore));
+  // Smaller than a frame.
+  TempFile small{std::string(10, 'x')};
+  EXPECT_FALSE(make_file_video_capture(small.path(), {}, ignore));
+  TempFile mono{"YUV4MPEG2 W2 H2 Cmono\nFRAME\nxxxx"};
+  EXPECT_FALSE(make_file_video_capture(mono.path(), {}, ignore));
+  TempFile no_frames{"YUV4MPEG2 W2 H2\n"};
+  EXPECT_FALSE(make_file_video_capture(no_frames.path(), {}, ignore));
+}
@@ -0,0 +1,239 @@
+#include <fcntl.h>
+#include <gtest/gtest.h>
+#include <linux/videodev2.h>
+#include <sys/ioctl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#include <chrono>
+#include <condition_variable>
+#include <cstring>
+#include <mutex>
+#include <optional>
+#include <set>
+#include <string_view>
+#include <vector>
+
+#include "video_capture.hpp"
+
+// Video4Linux tests run against the vivid virtual driver (modprobe vivid),
+// they are skipped if there is no vivid device.
+
+namespace {
+using namespace std::chrono_literals;
+
+std::vector<std::filesystem::path> find_vivid_devices() {
+  std::vector<std::filesystem::path> result;
+  for (const auto& path : enumerate_video4_linux_devices()) {
+    const int fd = open(path.c_str(), O_RDWR);
+    if (fd == -1) {
+      continue;
+    }
+    struct v4l2_capability caps {};
+    const bool vivid =
+        ioctl(fd, VIDIOC_QUERYCAP, &caps) == 0 &&
+        std::string_view{reinterpret_cast<const char*>(caps.driver)} ==
+            "vivid" &&
+        (caps.device_caps & V4L2_CAP_VIDEO_CAPTURE);
+    close(fd);
+    if (vivid) {
+      result.push_back(path);
+    }
+  }
+  return result;
+}
+
+// Captures and holds on to `count` frames.
+class LeaseCollector {
+ public:
+  LeaseCollector(VideoCaptureOptions options, size_t count, size_t device = 0)
+      : m_count(count) {
+    const auto devices = find_vivid_devices();
+    if (devices.size() <= device) {
+      return;
+    }
+    m_capture = make_video_capture(
+        devices[device], options, [this](FrameLease frame) {
+          std::lock_guard lock(m_lock);
+          if (m_leases.size() < m_count) {
+            m_leases.push_back(std::move(frame));
+            m_added.notify_all();
+          }
+        });
+  }
+
+  ~LeaseCollector() {
+    if (m_capture) {
+      m_capture->stop();
+    }
+    // Before the capture is gone.
+    m_leases.clear();
+  }
+
+  VideoCapture* capture() { return m_capture.get(); }
+
+  const std::vector<FrameLease>& capture_all() {
+    auto formats = m_capture->enumerate_formats();
+    const auto* format = choose_format(formats);
+    EXPECT_TRUE(format);
+    EXPECT_TRUE(format && m_capture->select_format(*format));
+    m_capture->start();
+    std::unique_lock lock(m_lock);
+    EXPECT_TRUE(m_added.wait_for(lock, 5s,
+                                 [&] { return m_leases.size() == m_count; }));
+    return m_leases;
+  }
+
+ private:
+  size_t m_count;
+  std::mutex m_lock;
+  std::condition_variable m_added;
+  std::vector<FrameLease> m_leases;
+  std::unique_ptr<VideoCapture> m_capture;
+};
+
+std::unique_ptr<AbstractVideoFormatSpec> make_format(
+    std::optional<PixelFormat> pixel_format,
+    uint32_t width,
+    uint32_t height,
+    uint32_t fps) {
+  return std::make_unique<AbstractVideoFormatSpec>(
+      AbstractVideoFormatSpec::Basic{.width = width,
+                                     .height = height,
+                                     .pixel_format = pixel_format,
+                                     .interval = {1, fps}});
+}
+
+#define SKIP_WITHOUT_VIVID()                 \
+  if (find_vivid_devices().empty()) {        \
+    GTEST_SKIP() << "No vivid video device"; \
+  }                                          \
+  while (false)
+}  // namespace
+
+TEST(video_capture_tests, mmap_test) {
+  SKIP_WITHOUT_VIVID();
+  LeaseCollector collector{{.memory = CaptureMemory::mmap}, 3};
+  ASSERT_TRUE(collector.capture());
+  std::set<uint8_t*> buffers;
+  for (const auto& lease : collector.capture_all()) {
+    EXPECT_FALSE(lease.data().empty());
+    EXPECT_EQ(lease.dmabuf_fd(), -1);
+    buffers.insert(lease.data().data());
+  }
+  // Held ones are not reused.
+  EXPECT_EQ(buffers.size(), 3);
+}
+
+TEST(video_capture_tests, userptr_test) {
+  SKIP_WITHOUT_VIVID();
+  LeaseCollector collector{{.memory = CaptureMemory::userptr}, 3};
+  ASSERT_TRUE(collector.capture());
+  std::set<uint8_t*> buffers;
+  for (const auto& lease : collector.capture_all()) {
+    EXPECT_FALSE(lease.data().empty());
+    EXPECT_EQ(reinterpret_cast<uintptr_t>(lease.data().data()) %
+                  sysconf(_SC_PAGESIZE),
+              0);
+    buffers.insert(lease.data().data());
+  }
+  EXPECT_EQ(buffers.size(), 3);
+}
+
+TEST(video_capture_tests, dmabuf_test) {
+  SKIP_WITHOUT_VIVID();
+  LeaseCollector collector{{.export_dmabuf = true}, 2};
+  ASSERT_TRUE(collector.capture());
+  for (const auto& lease : collector.capture_all()) {
+    ASSERT_NE(lease.dmabuf_fd(), -1);
+    // Same memory through the DMABUF.
+    const auto size = lease.data().size();
+    void* mapped =
+        mmap(nullptr, size, PROT_READ, MAP_SHARED, lease.dmabuf_fd(), 0);
+    ASSERT_NE(mapped, MAP_FAILED);
+    EXPECT_EQ(std::memcmp(mapped, lease.data().data(), size), 0);
+    munmap(mapped, size);
+  }
+}
+
+TEST(video_capture_tests, driver_timestamps_test) {
+  SKIP_WITHOUT_VIVID();
+  const auto start = std::chrono::steady_clock::now();
+  LeaseCollector collector{{}, 3};
+  ASSERT_TRUE(collector.capture());
+  const auto& leases = collector.capture_all();
+  ASSERT_EQ(leases.size(), 3);
+  // vivid stamps buffers with CLOCK_MONOTONIC, so these are comparable with
+  // steady_clock.
+  for (size_t i = 0; i < leases.size(); ++i) {
+    const auto& meta = leases[i].meta();
+    EXPECT_GE(meta.timestamp, start);
+    EXPECT_LE(meta.timestamp, std::chrono::steady_clock::now());
+    EXPECT_EQ(meta.frame_id, frame_id(meta.timestamp));
+    if (i > 0) {
+      const auto& previous = leases[i - 1].meta();
+      EXPECT_GT(meta.timestamp, previous.timestamp);
+      EXPECT_EQ(meta.sequence - previous.sequence, meta.dropped_before + 1);
+    }
+  }
+}
+
+TEST(video_capture_tests, shared_reactor_test) {
+  if (find_vivid_devices().size() < 2) {
+    GTEST_SKIP() << "Needs two vivid devices (modprobe vivid n_devs=2)";
+  }
+  std::shared_ptr<CaptureReactor> reactor = make_capture_reactor();
+  ASSERT_TRUE(reactor);
+  LeaseCollector first{{.reactor = reactor}, 2, 0};
+  LeaseCollector second{{.reactor = reactor}, 2, 1};
+  ASSERT_TRUE(first.capture());
+  ASSERT_TRUE(second.capture());
+  EXPECT_EQ(first.capture_all().size(), 2);
+  EXPECT_EQ(second.capture_all().size(), 2);
+}
+
+TEST(video_capture_tests, bad_options_test) {
+  auto ignore = [](FrameLease) {};
+  EXPECT_FALSE(make_video_capture(
+      "/dev/null",
+      {.memory = CaptureMemory::userptr, .export_dmabuf = true}, ignore));
+  EXPECT_FALSE(make_video_capture("/dev/null", {.buffers_count = 1}, ignore));
+}
+
+TEST(video_capture_tests, choose_format_test) {
+  std::vector<std::unique_ptr<AbstractVideoFormatSpec>> formats;
+  formats.push_back(make_format(PixelFormat::YUV422_packed, 1280, 720, 60));
+  formats.push_back(make_format(PixelFormat::NV12, 1280, 720, 60));
+  formats.push_back(make_format(PixelFormat::NV12, 1280, 720, 30));
+  formats.push_back(make_format(PixelFormat::NV12, 640, 360, 60));
+  formats.push_back(make_format(PixelFormat::NV12, 640, 360, 30));
+  formats.push_back(make_format(PixelFormat::YUV422_packed, 640, 480, 30));
+  // Never chosen: the encoder does not take it, too large, too small.
+  formats.push_back(make_format(std::nullopt, 1280, 720, 120));
+  formats.push_back(make_format(PixelFormat::NV12, 1920, 1080, 120));
+  formats.push_back(make_format(PixelFormat::NV12, 320, 180, 120));
+
+  // Same frame rate, larger frames then fewer bytes.
+  EXPECT_EQ(choose_format(formats, {.policy = FormatPolicy::max_fps}),
+            formats[1].get());
+  // Same frame interval, smaller frames encode faster.
+  EXPECT_EQ(choose_format(formats, {.policy = FormatPolicy::min_latency}),
+            formats[3].get());
+  // Lowest frame rate and smallest frames allowed.
+  EXPECT_EQ(choose_format(formats, {.policy = FormatPolicy::min_cpu}),
+            formats[4].get());
+  // Limits are up to the caller.
+  EXPECT_EQ(choose_format(formats, {.policy = FormatPolicy::max_fps,
+                                    .max_width = 1920,
+                                    .max_height = 1080}),
+            formats[7].get());
+}
+
+TEST(video_capture_tests, choose_format_fallback_test) {
+  std::vector<std::unique_ptr<AbstractVideoFormatSpec>> formats;
+  formats.push_back(make_format(std::nullopt, 1280, 720, 30));
+  EXPECT_EQ(choose_format(formats), nullptr);
+
+  // Below minimums, but the only one there is.
+  formats.push_back(make_format(PixelFormat::YUV422_packed, 320, 180, 5));
+  EXPECT_EQ(choose_format(formats), formats[1].get());
+}
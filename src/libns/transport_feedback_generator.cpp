@@ -0,0 +1,72 @@
+#include "transport_feedback_generator.hpp"
+#include "log.hpp"
+
+LOG_MODULE_NAME("TWCC_RX");
+
+using std::chrono::duration_cast;
+using std::chrono::microseconds;
+
+int64_t TransportFeedbackGenerator::unwrap(uint16_t sequence_num) const {
+  // Same as in NackTracker: closest extended number to the highest seen one.
+  const auto delta = static_cast<int16_t>(
+      static_cast<uint16_t>(sequence_num - static_cast<uint16_t>(m_highest)));
+  return m_highest + delta;
+}
+
+void TransportFeedbackGenerator::on_packet(uint16_t sequence_num,
+                                           clock::time_point arrival) {
+  if (m_highest < 0) {
+    m_highest = sequence_num;
+    m_epoch = arrival;
+  }
+
+  const int64_t ext_seq = unwrap(sequence_num);
+  if (m_next_base && ext_seq < *m_next_base) {
+    LOG_DEBUG("Packet {} came after it has been reported lost", sequence_num);
+    return;
+  }
+  m_arrivals.emplace(ext_seq, arrival);
+  m_highest = std::max(m_highest, ext_seq);
+}
+
+bool TransportFeedbackGenerator::build(RTCP_TransportFeedback& feedback) {
+  if (m_arrivals.empty()) {
+    return false;
+  }
+
+  const auto& [first_seq, first_arrival] = *m_arrivals.begin();
+  int64_t base = m_next_base.value_or(first_seq);
+  if (first_seq - base >= static_cast<int64_t>(MaxPacketsPerFeedback)) {
+    // Long gap, e.g. sender restart. Not worth reporting packet by packet.
+    base = first_seq;
+  }
+  const int64_t last =
+      std::min(m_arrivals.rbegin()->first,
+               base + static_cast<int64_t>(MaxPacketsPerFeedback) - 1);
+
+  const int64_t unit_us = microseconds{feedback.ReferenceTimeUnit}.count();
+  const int64_t reference =
+      duration_cast<microseconds>(first_arrival - m_epoch).count() / unit_us;
+
+  feedback.base_sequence_num = static_cast<uint16_t>(base);
+  feedback.reference_time = static_cast<int32_t>(reference);
+  feedback.feedback_count = m_feedback_count++;
+  feedback.arrivals.clear();
+
+  auto it = m_arrivals.begin();
+  for (int64_t seq = base; seq <= last; ++seq) {
+    if (it == m_arrivals.end() || it->first != seq) {
+      feedback.arrivals.emplace_back();
+      continue;
+    }
+    const int64_t since_reference =
+        duration_cast<microseconds>(it->second - m_epoch).count() -
+        reference * unit_us;
+    feedback.arrivals.push_back(since_reference /
+                                feedback.DeltaUnit.count());
+    ++it;
+  }
+  m_arrivals.erase(m_arrivals.begin(), it);
+  m_next_base = last + 1;
+  return true;
+}
@@ -0,0 +1,42 @@
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+#include <map>
+#include <optional>
+
+#include "rtcp.hpp"
+
+// Records when packets arrive, by their transport-wide sequence numbers, and
+// turns that into RTCP transport feedback for the bandwidth estimator of the
+// sender. Every packet is reported once: as received, or as lost if a later
+// one has been reported before it came.
+//
+// Not thread safe. Time is passed in explicitly.
+class TransportFeedbackGenerator {
+ public:
+  using clock = std::chrono::steady_clock;
+
+  // Bounds the size of one feedback packet.
+  static constexpr size_t MaxPacketsPerFeedback = 512;
+
+  void on_packet(uint16_t sequence_num, clock::time_point arrival);
+
+  // Fills `feedback`, SSRCs aside, with packets not reported yet. Returns
+  // false if there is nothing to report. More than MaxPacketsPerFeedback
+  // packets take more than one call.
+  bool build(RTCP_TransportFeedback& feedback);
+
+ private:
+  int64_t unwrap(uint16_t sequence_num) const;
+
+  // Extended sequence number of the newest packet seen so far.
+  int64_t m_highest{-1};
+  // Received and not reported yet, keyed by extended sequence number.
+  std::map<int64_t, clock::time_point> m_arrivals;
+  // First packet of the next feedback.
+  std::optional<int64_t> m_next_base;
+  // Reference times count from the first arrival.
+  clock::time_point m_epoch;
+  uint8_t m_feedback_count{};
+};
@@ -32,3 +32,52 @@ std::ostream& operator<<(std::ostream& os, NAL_Type v) {
   os << to_string(v);
   return os;
 }
+
+std::string to_string(PixelFormat v) {
+  switch (v) {
+    case PixelFormat::YUV422_packed:
+      return "YUYV";
+    case PixelFormat::YUV422_planar:
+      return "YUV422P";
+    case PixelFormat::YUV420_planar:
+      return "I420";
+    case PixelFormat::NV12:
+      return "NV12";
+  }
+  return "unknown";
+}
+
+size_t frame_size(PixelFormat format, uint32_t width, uint32_t height) {
+  const size_t luma = size_t{width} * height;
+  switch (format) {
+    case PixelFormat::YUV422_packed:
+    case PixelFormat::YUV422_planar:
+      return luma * 2;
+    case PixelFormat::YUV420_planar:
+    case PixelFormat::NV12:
+      return luma + 2 * (size_t{(width + 1) / 2} * ((height + 1) / 2));
+  }
+  return 0;
+}
+
+uint32_t frame_id(std::chrono::steady_clock::time_point capture_time) {
+  return static_cast<uint32_t>(
+      std::chrono::duration_cast<std::chrono::milliseconds>(
+          capture_time.time_since_epoch())
+          .count());
+}
+
+std::chrono::steady_clock::time_point frame_capture_time(
+    uint32_t id,
+    std::chrono::steady_clock::time_point now) {
+  // Milliseconds of `now` with the lower 32 bits replaced, minus a wrap if
+  // that puts it ahead of `now`.
+  const auto now_ms = std::chrono::duration_cast<std::chrono::milliseconds>(
+                          now.time_since_epoch())
+                          .count();
+  auto ms = (now_ms & ~int64_t{0xFFFFFFFF}) | id;
+  if (ms > now_ms && ms >= (int64_t{1} << 32)) {
+    ms -= int64_t{1} << 32;
+  }
+  return std::chrono::steady_clock::time_point{std::chrono::milliseconds{ms}};
+}
@@ -2,14 +2,41 @@
 
 #include <array>
 #include <chrono>
+#include <compare>
+#include <cstddef>
 #include <cstdint>
 #include <functional>
 #include <iosfwd>
+#include <span>
+#include <string>
 #include <system_error>
+#include <vector>
+
+#include "packet_pool.hpp"
+
+// Identifies a frame at every stage of the pipeline, on both ends of the
+// stream: capture time in milliseconds, which also goes into RTP timestamp.
+// 2^32 milliseconds is ~49 days, frames in flight never get close to that.
+uint32_t frame_id(std::chrono::steady_clock::time_point capture_time);
+
+// Capture time of the frame `id`, the latest one not after `now`. Meaningful
+// only on the clock the frame was captured with, i.e. on the same host.
+std::chrono::steady_clock::time_point frame_capture_time(
+    uint32_t id,
+    std::chrono::steady_clock::time_point now);
 
 // Metadata of the frame coming from video capture.
 struct CapturedFrameMeta {
+  // When the frame was captured: by the driver if it says so, when it was
+  // dequeued otherwise.
   std::chrono::steady_clock::time_point timestamp;
+  // frame_id() of the timestamp.
+  uint32_t frame_id{};
+  // Number of the frame in the capture, frames lost on the way included.
+  uint32_t sequence{};
+  // Frames lost right before this one, e.g. by the driver running out of
+  // buffers.
+  uint32_t dropped_before{};
 };
 
 // Definition taken from x264 header, can be seen as abstraction for all
@@ -49,7 +76,38 @@ struct NAL_Metadata {
   uint16_t flags{};
 };
 
-enum class PixelFormat { YUV422_packed, YUV422_planar };
+enum class PixelFormat {
+  // YUYV.
+  YUV422_packed,
+  YUV422_planar,
+  // I420.
+  YUV420_planar,
+  // Y plane followed by interleaved UV one.
+  NV12
+};
+
+std::string to_string(PixelFormat v);
+
+// Bytes of a `width` x `height` frame without padding.
+size_t frame_size(PixelFormat format, uint32_t width, uint32_t height);
+
+// Time between frames in seconds, as a fraction the way Video4Linux has it.
+struct FrameInterval {
+  uint32_t numerator{1};
+  uint32_t denominator{30};
+
+  double fps() const {
+    return numerator ? static_cast<double>(denominator) / numerator : 0;
+  }
+  auto operator<=>(const FrameInterval& other) const {
+    // Cross multiplied, so 1/30 == 2/60.
+    return uint64_t{numerator} * other.denominator <=>
+           uint64_t{other.numerator} * denominator;
+  }
+  bool operator==(const FrameInterval& other) const {
+    return (*this <=> other) == 0;
+  }
+};
 
 // Represents non-working video frame.
 struct VideoFrame {
@@ -57,6 +115,8 @@ struct VideoFrame {
   int width{};
   int height{};
   std::array<const uint8_t*, 3> planes;
+  // Of the frame the encoder was given, see frame_id().
+  uint32_t frame_id{};
 };
 
 template <class T>
@@ -72,9 +132,17 @@ struct CallbackTemplate<void> {
 template <class T>
 using callback = CallbackTemplate<T>::type;
 
-// TODO: consider allocating all video packets in some fixed pool instead of
-// using general allocator.
+// NAL with start code, in a pool buffer if there is one, see
+// UDP_Transmit::acquire_nal_buffer(), in `nal_data` otherwise.
 struct VideoPacket {
   std::vector<uint8_t> nal_data;
+  PacketRef buffer;
   NAL_Metadata nal_meta;
+
+  std::span<const uint8_t> nal() const {
+    if (buffer) {
+      return buffer.bytes();
+    }
+    return nal_data;
+  }
 };
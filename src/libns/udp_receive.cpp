@@ -1,17 +1,73 @@
 #include "udp_receive.hpp"
 #include <asio.hpp>
 
+#include <sys/socket.h>
+#include <array>
+#include <cstring>
+#include <mutex>
+#include <optional>
+#include <random>
+
+#include "decoder.hpp"
+#include "fec.hpp"
+#include "frame_trace.hpp"
 #include "log.hpp"
+#include "metrics.hpp"
+#include "rtcp.hpp"
 #include "rtp.hpp"
+#include "rtp_extensions.hpp"
+#include "rtp_h264.hpp"
+#include "transport_feedback_generator.hpp"
 
 LOG_MODULE_NAME("UDP_RX");
 
 using asio::ip::udp;
 
+namespace {
+// Largest datagram we are able to receive, anything bigger is truncated by the
+// kernel and dropped.
+constexpr size_t MAX_DATAGRAM_SIZE = 1600;
+// How many datagrams one recvmmsg() call may return.
+constexpr size_t RECEIVE_BATCH_SIZE = 32;
+// Number of receive buffers. Bounds how many packets the listener can hold on
+// to (e.g. in a jitter buffer) before we start dropping incoming data.
+constexpr size_t RECEIVE_POOL_SIZE = 1024;
+
+// Of all receives of the process.
+struct ReceiveMetrics {
+  Counter& packets_received = metrics().counter(
+      "ns_rtp_packets_received_total", "RTP media packets received.");
+  Counter& bytes_received =
+      metrics().counter("ns_rtp_payload_bytes_received_total",
+                        "Payload bytes of RTP media packets received.");
+  Counter& packets_recovered = metrics().counter(
+      "ns_rtp_packets_recovered_total", "RTP media packets rebuilt by FEC.");
+  Gauge& packets_lost = metrics().gauge(
+      "ns_rtp_packets_lost", "Packets expected minus packets received.");
+};
+}  // namespace
+
 class UDP_ReceiveImpl : public UDP_Receive {
  public:
-  explicit UDP_ReceiveImpl(asio::io_context& ctx, int port)
-      : m_ctx(ctx), m_port(port), m_socket(ctx) {}
+  explicit UDP_ReceiveImpl(asio::io_context& ctx,
+                           int port,
+                           UDP_ReceiveOptions options)
+      : m_ctx(ctx),
+        m_port(port),
+        m_options(options),
+        m_socket(ctx),
+        m_pool(RECEIVE_POOL_SIZE, MAX_DATAGRAM_SIZE + DECODER_INPUT_PADDING),
+        m_fec_decoder(m_pool),
+        m_recovered_sink([this](PacketRef packet) {
+          handle_packet(std::move(packet), true);
+        }),
+        m_nack_tracker(options.nack_config),
+        m_nack_timer(ctx),
+        m_ssrc(std::random_device{}()),
+        m_feedback_timer(ctx),
+        m_statistics(RTP_VideoClockRate),
+        m_random(m_ssrc),
+        m_report_timer(ctx) {}
 
   bool initialize() {
     std::error_code ec;
@@ -28,11 +84,15 @@ class UDP_ReceiveImpl : public UDP_Receive {
       return false;
     }
 
-    LOG_DEBUG("bound to {}", m_port);
+    // The socket is drained with recvmmsg() until it would block.
+    m_socket.non_blocking(true, ec);
+    if (ec) {
+      LOG_ERROR("Failed switching socket to non-blocking mode: {}",
+                ec.message());
+      return false;
+    }
 
-    // TODO: this is something I don't know yet if we can receive multiple
-    // datagram at once.
-    m_buffer.resize(1600);
+    LOG_DEBUG("bound to {}", m_port);
 
     return true;
   }
@@ -40,138 +100,473 @@ class UDP_ReceiveImpl : public UDP_Receive {
   virtual void start(UDP_ReceiveListener& listener) override {
     m_listener = &listener;
     receive_next();
+    if (m_options.transport_feedback) {
+      schedule_transport_feedback();
+    }
+    if (m_options.rtcp_reports) {
+      schedule_receiver_report();
+    }
+  }
+
+  virtual RTP_ReceiveStats stats() override {
+    std::lock_guard lock(m_statistics_lock);
+    return m_statistics.stats();
   }
 
   void receive_next() {
     assert(m_listener != nullptr);
 
-    m_socket.async_receive_from(
-        asio::buffer(m_buffer), m_remote_endpoint, {},
-        [this](std::error_code ec, size_t bytes_received) {
-          if (ec) {
-            LOG_ERROR("async_receive_from failed: {}", ec.message());
-          } else {
-            LOG_DEBUG("received {} bytes", bytes_received);
-
-            // TODO: I doubt that just a jeader is enough. There must be more
-            // realistic minimum packet size.
-            // TODO: check if at least version looks good before parsing
-            // potential crap.
-            if (bytes_received < 12) {
-              // TODO: count this events and remove logging and just ignore.
-              LOG_ERROR("Got too small packet");
-              // TODO: refactor in a way that we don't need to write
-              // receive_next().
-              receive_next();
-              return;
-            }
-            auto maybe_rtp_header = deserialize_rtp_header_from(m_buffer);
-            if (!maybe_rtp_header.has_value()) {
-              LOG_ERROR("Got data that cannot be RTP header: {}",
-                        maybe_rtp_header.error().message());
-              receive_next();
-              return;
-            }
-            auto& rtp_header = *maybe_rtp_header;
-
-            if (rtp_header.version != 2) {
-              // TODO: should be removed from production, just count.
-              LOG_DEBUG("Wrong RTP packet, wrong version: {}",
-                        rtp_header.version);
-              receive_next();
-              return;
-            }
-
-            if (rtp_header.extension_bit) {
-              // We don't support extensions at the moment. If there was an
-              // extension we would need to change calculation of payload begin.
-              // TODO: this warning should be removed from production.
-              LOG_WARNING("Packet with extension bit set, ignoring..");
-              receive_next();
-              return;
-            }
-
-            std::span<const uint8_t> payload_header_data{
-                m_buffer.begin() + RTP_PacketHeader_Size,
-                m_buffer.begin() + RTP_PacketHeader_Size +
-                    RTP_PayloadHeader_Size};
-            auto maybe_payload_header =
-                deserialize_payload_header(payload_header_data);
-
-            if (!maybe_payload_header.has_value()) {
-              LOG_ERROR("Got data that cannot be RTP payload header: {}",
-                        maybe_payload_header.error().message());
-              receive_next();
-              return;
-            }
-            auto& payload_header = *maybe_payload_header;
-
-            // TODO: ensure that bytes_ceived is enough.
-            std::span<const uint8_t> payload_data{
-                m_buffer.begin() + RTP_PacketHeader_Size +
-                    RTP_PayloadHeader_Size,
-                m_buffer.begin() + bytes_received};
-
-            LOG_DEBUG("Got a packet of NAL type: {}",
-                      to_string(payload_header.nal_type));
-
-            VideoPacket packet;
-            packet.nal_data =
-                std::vector<uint8_t>{payload_data.begin(), payload_data.end()};
-            packet.nal_meta.nal_type = payload_header.nal_type;
-            packet.nal_meta.first_macroblock = payload_header.first_mb;
-            packet.nal_meta.last_macroblock = payload_header.last_mb;
-            packet.nal_meta.timestamp = rtp_header.timestamp;
-
-            // TODO: packets should be reordered by sequence level. There should
-            // also be a timeout.
-
-            LOG_DEBUG(
-                "Got a packet. NAL type: {}, first_mb: {}, last_mb: {}, "
-                "sequence_num: {}, timestamp: {}",
-                to_string(packet.nal_meta.nal_type),
-                packet.nal_meta.first_macroblock,
-                packet.nal_meta.last_macroblock, rtp_header.sequence_num,
-                packet.nal_meta.timestamp);
-
-            if (packet.nal_meta.nal_type != NAL_Type::slice) {
-              LOG_DEBUG("NON SLICE NAL: {}",
-                        to_string(packet.nal_meta.nal_type));
-            }
-
-            if (m_prev_seq_num == -1) {
-              // first one
-              m_prev_seq_num = rtp_header.sequence_num;
-            } else {
-              if (m_prev_seq_num + 1 != rtp_header.sequence_num) {
-                LOG_ERROR("Error, missed packet {}", m_prev_seq_num + 1);
-                // TODO: start here working on handling missing packets.
-		//                assert(false && "Missed packet");
-              }
-              m_prev_seq_num = rtp_header.sequence_num;
-            }
-
-            LOG_DEBUG("Passing packet of size {} to the listener",
-                      packet.nal_data.size());
-            m_listener->on_packet_received(std::move(packet));
+    m_socket.async_wait(udp::socket::wait_read, [this](std::error_code ec) {
+      if (ec) {
+        if (ec == asio::error::operation_aborted) {
+          return;
+        }
+        LOG_ERROR("async_wait failed: {}", ec.message());
+      } else {
+        drain_socket();
+        if (m_options.nack) {
+          send_nacks();
+        }
+      }
+      receive_next();
+    });
+  }
+
+ private:
+  // Arms empty slots with buffers from the pool and returns how many leading
+  // slots are ready for recvmmsg().
+  size_t arm_slots() {
+    for (size_t i = 0; i < RECEIVE_BATCH_SIZE; ++i) {
+      if (!m_slots[i]) {
+        m_slots[i] = m_pool.acquire();
+        if (!m_slots[i]) {
+          return i;
+        }
+      }
+    }
+    return RECEIVE_BATCH_SIZE;
+  }
+
+  // Reads everything the socket has for us in batches of up to
+  // RECEIVE_BATCH_SIZE datagrams.
+  void drain_socket() {
+    const int fd = m_socket.native_handle();
+
+    while (true) {
+      const size_t armed = arm_slots();
+      if (armed == 0) {
+        // Listener holds all the buffers. Read the datagram anyway so that
+        // the socket queue moves on, there is nothing else we can do with it.
+        std::array<uint8_t, MAX_DATAGRAM_SIZE> overflow_buffer;
+        if (::recv(fd, overflow_buffer.data(), overflow_buffer.size(), 0) ==
+            -1) {
+          if (errno == EINTR) {
+            continue;
           }
-          receive_next();
-        });
-    //    LOG_DEBUG("Ready to receive some data");
+          return;
+        }
+        LOG_WARNING("Receive pool exhausted, packet dropped");
+        continue;
+      }
+
+      for (size_t i = 0; i < armed; ++i) {
+        m_iovecs[i] = {m_slots[i].data(), MAX_DATAGRAM_SIZE};
+        m_msgs[i] = {};
+        m_msgs[i].msg_hdr.msg_iov = &m_iovecs[i];
+        m_msgs[i].msg_hdr.msg_iovlen = 1;
+        m_msgs[i].msg_hdr.msg_name = &m_addrs[i];
+        m_msgs[i].msg_hdr.msg_namelen = sizeof(m_addrs[i]);
+      }
+
+      const int n = ::recvmmsg(fd, m_msgs.data(), armed, 0, nullptr);
+      if (n == -1) {
+        if (errno == EINTR) {
+          continue;
+        }
+        if (errno != EAGAIN && errno != EWOULDBLOCK) {
+          LOG_ERROR("recvmmsg failed: {}", strerror(errno));
+        }
+        return;
+      }
+
+      // Good enough as arrival time for the whole batch, the datagrams have
+      // been queued in the socket meanwhile anyway.
+      const auto now = std::chrono::steady_clock::now();
+      for (int i = 0; i < n; ++i) {
+        if (m_msgs[i].msg_hdr.msg_flags & MSG_TRUNC) {
+          LOG_WARNING("Datagram does not fit into {} bytes, ignoring..",
+                      MAX_DATAGRAM_SIZE);
+          continue;
+        }
+        handle_datagram(std::move(m_slots[i]), m_msgs[i].msg_len, m_addrs[i],
+                        m_msgs[i].msg_hdr.msg_namelen, now);
+      }
+
+      if (static_cast<size_t>(n) < armed) {
+        // Socket has been drained.
+        return;
+      }
+    }
+  }
+
+  void handle_datagram(PacketRef buffer,
+                       size_t bytes_received,
+                       const sockaddr_storage& from,
+                       socklen_t from_size,
+                       std::chrono::steady_clock::time_point now) {
+    // TODO: I doubt that just a jeader is enough. There must be more
+    // realistic minimum packet size.
+    // TODO: check if at least version looks good before parsing
+    // potential crap.
+    if (bytes_received <= RTP_PacketHeader_Size) {
+      // TODO: count this events and remove logging and just ignore.
+      LOG_ERROR("Got too small packet");
+      return;
+    }
+    buffer.set_size(bytes_received);
+
+    if (is_rtcp_packet(buffer.bytes())) {
+      handle_rtcp(buffer.bytes(), now);
+      return;
+    }
+
+    if (m_options.transport_feedback) {
+      // Every packet that made it here counts, FEC ones included, whatever
+      // happens to it later.
+      if (auto sequence_num = find_transport_sequence_num(
+              buffer.bytes(), m_options.extensions.transport_sequence_num)) {
+        m_feedback_generator.on_packet(*sequence_num, now);
+      }
+    }
+
+    if (handle_packet(std::move(buffer), false) &&
+        (m_options.nack || m_options.transport_feedback ||
+         m_options.rtcp_reports)) {
+      // Feedback goes to wherever the media comes from.
+      std::memcpy(m_sender.data(), &from, from_size);
+      m_sender.resize(from_size);
+    }
+  }
+
+  // Returns false if the packet has been rejected. `recovered` packets come
+  // from FEC rather than from the socket.
+  bool handle_packet(PacketRef buffer, bool recovered) {
+    const auto data = buffer.bytes();
+
+    // CSRC list and extensions are parsed along, in place.
+    RTP_PacketHeader rtp_header;
+    if (!read_rtp_header(data, rtp_header)) {
+      LOG_ERROR("Got data that cannot be RTP header, size: {}", data.size());
+      return false;
+    }
+
+    if (rtp_header.version != 2) {
+      // TODO: should be removed from production, just count.
+      LOG_DEBUG("Wrong RTP packet, wrong version: {}", rtp_header.version);
+      return false;
+    }
+
+    // Payload starts after header extensions.
+    const size_t header_size = rtp_header.size();
+
+    RTP_Extensions extensions;
+    if (rtp_header.extension) {
+      auto parsed =
+          parse_rtp_extensions(*rtp_header.extension, m_options.extensions);
+      if (parsed) {
+        extensions = *parsed;
+      } else {
+        // The payload may still be fine.
+        LOG_DEBUG("Malformed header extensions: {}",
+                  parsed.error().message());
+      }
+    }
+
+    // FEC is a stream of its own, told apart by SSRC as well as by payload
+    // type. Parity on the media stream would break its sequence numbering.
+    if (rtp_header.payload_type == RTP_FecPayloadType) {
+      if (rtp_header.ssrc == m_media_ssrc) {
+        LOG_DEBUG("FEC packet on media stream, ignoring..");
+        return false;
+      }
+      m_fec_ssrc = rtp_header.ssrc;
+      if (m_options.fec) {
+        m_fec_decoder.on_fec_packet(std::move(buffer),
+                                    data.subspan(header_size),
+                                    m_recovered_sink);
+      }
+      return true;
+    }
+    if (rtp_header.ssrc == m_fec_ssrc) {
+      LOG_DEBUG("Payload type {} on FEC stream, ignoring..",
+                rtp_header.payload_type);
+      return false;
+    }
+
+    ReceivedPacket packet;
+    packet.payload_type = rtp_header.payload_type;
+    packet.nal_meta.timestamp = rtp_header.timestamp;
+    packet.sequence_num = rtp_header.sequence_num;
+    packet.marker = rtp_header.marker_bit ||
+                    (extensions.frame_marking &&
+                     extensions.frame_marking->end_of_frame);
+
+    if (rtp_header.payload_type == RTP_H264_PayloadType) {
+      packet.payload = data.subspan(header_size);
+    } else if (rtp_header.payload_type == RTP_NaivePayloadType) {
+      auto maybe_payload_header =
+          deserialize_payload_header(data.subspan(header_size));
+      if (!maybe_payload_header.has_value()) {
+        LOG_ERROR("Got data that cannot be RTP payload header: {}",
+                  maybe_payload_header.error().message());
+        return false;
+      }
+      auto& payload_header = *maybe_payload_header;
+
+      packet.payload = data.subspan(header_size + RTP_PayloadHeader_Size);
+      packet.nal_meta.nal_type = payload_header.nal_type;
+      packet.nal_meta.first_macroblock = payload_header.first_mb;
+      packet.nal_meta.last_macroblock = payload_header.last_mb;
+    } else {
+      LOG_DEBUG("Unknown payload type {}, ignoring..",
+                rtp_header.payload_type);
+      return false;
+    }
+
+    // Decoder reads a bit past the end of the data, it needs to see zeroes
+    // there rather than leftovers of some older packet.
+    std::memset(data.data() + data.size(), 0, DECODER_INPUT_PADDING);
+
+    packet.lease = buffer;
+
+    if (m_options.nack) {
+      m_nack_tracker.on_packet(packet.sequence_num,
+                               std::chrono::steady_clock::now());
+    }
+    m_media_ssrc = rtp_header.ssrc;
+    if (!recovered) {
+      const auto now = std::chrono::steady_clock::now();
+      if (m_traced_timestamp != rtp_header.timestamp) {
+        m_traced_timestamp = rtp_header.timestamp;
+        if (m_options.sender_on_same_host) {
+          trace_frame(rtp_header.timestamp, TraceStage::captured,
+                      frame_capture_time(rtp_header.timestamp, now));
+        }
+        trace_frame(rtp_header.timestamp, TraceStage::received, now);
+      }
+      m_metrics.packets_received.add();
+      m_metrics.bytes_received.add(packet.payload.size());
+
+      std::lock_guard lock(m_statistics_lock);
+      m_statistics.on_packet(rtp_header.ssrc, rtp_header.sequence_num,
+                             rtp_header.timestamp, packet.payload.size(), now);
+      if (extensions.abs_send_time) {
+        m_statistics.on_send_time(*extensions.abs_send_time, now);
+      }
+      m_metrics.packets_lost.set(m_statistics.stats().cumulative_lost);
+    } else {
+      m_metrics.packets_recovered.add();
+    }
+
+    LOG_DEBUG(
+        "Got a packet. Payload type: {}, NAL type: {}, first_mb: {}, "
+        "last_mb: {}, sequence_num: {}, timestamp: {}, size: {}",
+        packet.payload_type, to_string(packet.nal_meta.nal_type),
+        packet.nal_meta.first_macroblock, packet.nal_meta.last_macroblock,
+        rtp_header.sequence_num, packet.nal_meta.timestamp,
+        packet.payload.size());
+
+    const uint16_t sequence_num = packet.sequence_num;
+    m_listener->on_packet_received(std::move(packet));
+
+    if (m_options.fec && !recovered) {
+      // Recovered packets are already known to FEC decoder.
+      m_fec_decoder.on_media_packet(sequence_num, std::move(buffer),
+                                    m_recovered_sink);
+    }
+    return true;
+  }
+
+  void send_nacks() {
+    m_nack.lost.clear();
+    m_nack_tracker.collect(std::chrono::steady_clock::now(), m_nack.lost);
+    if (!m_nack.lost.empty()) {
+      m_nack.sender_ssrc = m_ssrc;
+      m_nack.media_ssrc = m_media_ssrc;
+      m_rtcp_buff.clear();
+      if (auto ec = serialize_generic_nack(m_nack, m_rtcp_buff); ec) {
+        LOG_ERROR("Failed serializing NACK: {}", ec.message());
+      } else {
+        m_socket.send_to(asio::buffer(m_rtcp_buff), m_sender, {}, ec);
+        if (ec) {
+          LOG_WARNING("Failed sending NACK: {}", ec.message());
+        } else {
+          LOG_DEBUG("Requested {} packet(s) starting from {}",
+                    m_nack.lost.size(), m_nack.lost.front());
+        }
+      }
+    }
+    schedule_nacks();
+  }
+
+  // Missing packets are requested again until they arrive or run out of
+  // retries, even if nothing else comes in meanwhile.
+  void schedule_nacks() {
+    const auto deadline = m_nack_tracker.next_deadline();
+    if (!deadline || deadline == m_nack_timer_deadline) {
+      return;
+    }
+
+    m_nack_timer_deadline = deadline;
+    m_nack_timer.expires_at(*deadline);
+    m_nack_timer.async_wait([this](std::error_code ec) {
+      if (ec) {
+        // Rescheduled or cancelled.
+        return;
+      }
+      m_nack_timer_deadline.reset();
+      send_nacks();
+    });
+  }
+
+  // Only sender reports are of interest, everything else the sender might
+  // add to a compound packet is skipped.
+  void handle_rtcp(std::span<const uint8_t> data,
+                   std::chrono::steady_clock::time_point now) {
+    auto ec = for_each_rtcp_packet(data, [&](const RTCP_Header& header,
+                                             std::span<const uint8_t> packet) {
+      if (header.payload_type != RTCP_PayloadType_SR) {
+        return;
+      }
+      auto report = deserialize_sender_report(packet);
+      if (!report) {
+        LOG_WARNING("Malformed sender report: {}", report.error().message());
+        return;
+      }
+      std::lock_guard lock(m_statistics_lock);
+      m_statistics.on_sender_report(*report, now);
+    });
+    if (ec) {
+      LOG_WARNING("Malformed RTCP packet: {}", ec.message());
+    }
+  }
+
+  void send_receiver_report() {
+    std::optional<RTCP_ReportBlock> block;
+    {
+      std::lock_guard lock(m_statistics_lock);
+      block = m_statistics.make_report_block(std::chrono::steady_clock::now());
+    }
+    if (!block) {
+      return;
+    }
+
+    RTCP_ReceiverReport report;
+    report.sender_ssrc = m_ssrc;
+    report.report_blocks.push_back(*block);
+    m_rtcp_buff.clear();
+    if (auto ec = serialize_receiver_report(report, m_rtcp_buff); ec) {
+      LOG_ERROR("Failed serializing receiver report: {}", ec.message());
+      return;
+    }
+    std::error_code ec;
+    m_socket.send_to(asio::buffer(m_rtcp_buff), m_sender, {}, ec);
+    if (ec) {
+      LOG_WARNING("Failed sending receiver report: {}", ec.message());
+    }
+  }
+
+  void schedule_receiver_report() {
+    m_report_timer.expires_after(
+        rtcp_report_delay(m_options.rtcp_report_interval, m_random));
+    m_report_timer.async_wait([this](std::error_code ec) {
+      if (ec) {
+        return;
+      }
+      send_receiver_report();
+      schedule_receiver_report();
+    });
+  }
+
+  // Everything that arrived since the previous report, in as many feedback
+  // packets as it takes.
+  void send_transport_feedback() {
+    while (m_feedback_generator.build(m_transport_feedback)) {
+      m_transport_feedback.sender_ssrc = m_ssrc;
+      m_transport_feedback.media_ssrc = m_media_ssrc;
+      m_rtcp_buff.clear();
+      if (auto ec =
+              serialize_transport_feedback(m_transport_feedback, m_rtcp_buff);
+          ec) {
+        LOG_ERROR("Failed serializing transport feedback: {}", ec.message());
+        continue;
+      }
+      std::error_code ec;
+      m_socket.send_to(asio::buffer(m_rtcp_buff), m_sender, {}, ec);
+      if (ec) {
+        LOG_WARNING("Failed sending transport feedback: {}", ec.message());
+      }
+    }
+  }
+
+  // Feedback goes out on a fixed interval, not per packet, the sender needs
+  // a few packets per report to see the delay trend anyway.
+  void schedule_transport_feedback() {
+    m_feedback_timer.expires_after(m_options.feedback_interval);
+    m_feedback_timer.async_wait([this](std::error_code ec) {
+      if (ec) {
+        return;
+      }
+      send_transport_feedback();
+      schedule_transport_feedback();
+    });
   }
 
  private:
   asio::io_context& m_ctx;
   int m_port{};
+  UDP_ReceiveOptions m_options;
   udp::socket m_socket;
-  udp::endpoint m_remote_endpoint;
-  std::vector<uint8_t> m_buffer;
+  PacketBufferPool m_pool;
+  // Buffers armed for the next recvmmsg() call. Slots consumed by the previous
+  // call are refilled from the pool before the next one.
+  std::array<PacketRef, RECEIVE_BATCH_SIZE> m_slots;
+  std::array<iovec, RECEIVE_BATCH_SIZE> m_iovecs{};
+  std::array<mmsghdr, RECEIVE_BATCH_SIZE> m_msgs{};
+  std::array<sockaddr_storage, RECEIVE_BATCH_SIZE> m_addrs{};
   UDP_ReceiveListener* m_listener{};
-  int m_prev_seq_num{-1};
+
+  FecDecoder m_fec_decoder;
+  FecDecoder::RecoveredSink m_recovered_sink;
+
+  NackTracker m_nack_tracker;
+  asio::steady_timer m_nack_timer;
+  std::optional<NackTracker::clock::time_point> m_nack_timer_deadline;
+  udp::endpoint m_sender;
+  uint32_t m_ssrc{};
+  uint32_t m_media_ssrc{};
+  std::optional<uint32_t> m_fec_ssrc;
+  // Frame whose first packet came in.
+  std::optional<uint32_t> m_traced_timestamp;
+  RTCP_GenericNack m_nack;
+  std::vector<uint8_t> m_rtcp_buff;
+
+  TransportFeedbackGenerator m_feedback_generator;
+  asio::steady_timer m_feedback_timer;
+  RTCP_TransportFeedback m_transport_feedback;
+
+  // Updated on io_context thread, read by stats() from anywhere.
+  std::mutex m_statistics_lock;
+  RTP_ReceiveStatistics m_statistics;
+  ReceiveMetrics m_metrics;
+  std::minstd_rand m_random;
+  asio::steady_timer m_report_timer;
 };
 
-std::unique_ptr<UDP_Receive> make_udp_receive(asio::io_context& ctx, int port) {
-  auto instance = std::make_unique<UDP_ReceiveImpl>(ctx, port);
+std::unique_ptr<UDP_Receive> make_udp_receive(asio::io_context& ctx,
+                                              int port,
+                                              UDP_ReceiveOptions options) {
+  auto instance = std::make_unique<UDP_ReceiveImpl>(ctx, port, options);
   if (!instance->initialize()) {
     LOG_ERROR("Failed to initialize UDP_Receive");
     return nullptr;
@@ -1,19 +1,77 @@
 #pragma once
 #include <asio/io_context.hpp>
+#include <chrono>
 #include <memory>
+#include <span>
 
+#include "nack_tracker.hpp"
+#include "packet_pool.hpp"
+#include "rtp_extensions.hpp"
+#include "rtp_receive_statistics.hpp"
 #include "types.hpp"
 
+// Packet handed out by UDP_Receive. The payload is a view into a receive pool
+// buffer which stays valid for as long as the lease (or any copy of it) is
+// held. Receive buffers keep DECODER_INPUT_PADDING zeroed bytes after the
+// payload.
+//
+// For RTP_NaivePayloadType the payload is a complete NAL unit which can go to
+// the decoder as is. For RTP_H264_PayloadType it is an RFC 6184 payload (single
+// NAL unit, STAP-A or FU-A) to be passed through H264_Depacketizer, and
+// nal_meta carries only the timestamp.
+struct ReceivedPacket {
+  PacketRef lease;
+  std::span<const uint8_t> payload;
+  unsigned payload_type{};
+  NAL_Metadata nal_meta;
+  uint16_t sequence_num{};
+  // Set on the last packet of a frame.
+  bool marker{};
+};
+
 class UDP_ReceiveListener {
  public:
   virtual ~UDP_ReceiveListener() = default;
-  virtual void on_packet_received(VideoPacket p) = 0;
+  virtual void on_packet_received(ReceivedPacket p) = 0;
 };
 
 class UDP_Receive {
  public:
   virtual ~UDP_Receive() = default;
   virtual void start(UDP_ReceiveListener&) = 0;
+  // Statistics of the received stream. May be called from any thread.
+  virtual RTP_ReceiveStats stats() = 0;
+};
+
+struct UDP_ReceiveOptions {
+  // Request lost packets from the sender with RTCP generic NACKs, sent back to
+  // the address packets come from. Takes effect only if the sender keeps
+  // retransmission history.
+  bool nack = false;
+  NackTrackerConfig nack_config;
+  // Rebuild lost packets from FEC packets the sender adds to the stream.
+  bool fec = false;
+  // Report arrival times of packets carrying transport-wide sequence numbers
+  // back to the sender with RTCP transport-cc feedback, for its bandwidth
+  // estimation.
+  bool transport_feedback = false;
+  std::chrono::milliseconds feedback_interval{50};
+  // RTCP receiver reports with loss and jitter of the stream, and timing of
+  // sender reports so that the sender can measure round trip time. Sent every
+  // rtcp_report_interval on average.
+  bool rtcp_reports = false;
+  std::chrono::milliseconds rtcp_report_interval{1000};
+  // Ids of RTP header extensions, must be the same as the sender's. Absolute
+  // send time feeds delay variation in stats(), frame marking lets a frame
+  // complete on its last packet even if it has no marker bit.
+  RTP_ExtensionMap extensions;
+  // The sender runs on this host, so RTP timestamps, capture time of frames
+  // (see frame_id()), are on our clock. Frames are then traced from capture
+  // rather than from arrival, see frame_trace.hpp.
+  bool sender_on_same_host = false;
 };
 
-std::unique_ptr<UDP_Receive> make_udp_receive(asio::io_context& ctx, int port);
+// UDP_Receive must outlive all the packets it has passed to the listener.
+std::unique_ptr<UDP_Receive> make_udp_receive(asio::io_context& ctx,
+                                              int port,
+                                              UDP_ReceiveOptions options = {});
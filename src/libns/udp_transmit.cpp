@@ -1,8 +1,28 @@
 #include "udp_transmit.hpp"
 #include <asio.hpp>
 #include <chrono>
+#include "bandwidth_estimator.hpp"
+#include "fec.hpp"
+#include "frame_trace.hpp"
 #include "log.hpp"
+#include "metrics.hpp"
+#include "pacer.hpp"
+#include "rtcp.hpp"
 #include "rtp.hpp"
+#include "rtp_extensions.hpp"
+#include "rtp_h264.hpp"
+#include "rtp_history.hpp"
+
+#include <sys/socket.h>
+#include <sys/uio.h>
+#include <algorithm>
+#include <atomic>
+#include <bit>
+#include <cmath>
+#include <cstring>
+#include <mutex>
+#include <optional>
+#include <random>
 
 LOG_MODULE_NAME("UDP_TX");
 
@@ -10,12 +30,116 @@ using asio::ip::udp;
 
 #define CMOVE(X) X = std::move(X)
 
+namespace {
+// Upper bound on the number of packets sent by one sendmmsg() call. A frame
+// that produces more packets than this is flushed in several calls.
+constexpr size_t MAX_BATCH_SIZE = 256;
+// RTP header, payload header and NAL.
+constexpr size_t MAX_IOVECS_PER_PACKET = 3;
+// Keeps RFC 6184 packets within usual 1500 bytes MTU, leaving room for IP, UDP
+// and RTP headers.
+constexpr size_t H264_MAX_PAYLOAD_SIZE = 1400;
+// Packets bigger than that (possible with naive payload format) are neither
+// kept for retransmission nor protected with FEC.
+constexpr size_t MAX_PROTECTED_PACKET_SIZE = 1500;
+// FEC packets of one batch above that are dropped.
+constexpr size_t MAX_FEC_BATCH_SIZE = MAX_BATCH_SIZE;
+// RTCP packets we get from the receiver are small, but let compound ones fit.
+constexpr size_t MAX_RTCP_PACKET_SIZE = 1500;
+// Fixed header followed by header extensions, if any are on.
+constexpr size_t MAX_RTP_HEADER_SIZE =
+    RTP_PacketHeader_Size + RTP_MaxExtensionBlockSize;
+// Pacer may send faster than the estimate to catch up after a burst, same as
+// in libwebrtc, only by less since our frames are VBV constrained anyway.
+constexpr double PACING_FACTOR = 1.5;
+// Smaller changes of media bitrate are not worth encoder reconfiguration.
+constexpr double TARGET_BITRATE_HYSTERESIS = 0.05;
+
+// Room left in front of NALs in their buffers for the headers: RTP header and,
+// of naive payload format, payload header.
+constexpr size_t NAL_HEADROOM = MAX_RTP_HEADER_SIZE + RTP_PayloadHeader_Size;
+// NAL of up to a datagram of payload, with the room encoders need to escape it
+// in place: x264 asks for 3/2 of the NAL and 69 bytes more.
+constexpr size_t NAL_BUFFER_CAPACITY = H264_MAX_PAYLOAD_SIZE * 3 / 2 + 5 + 64;
+// NAL buffers the encoder may be filling at once.
+constexpr size_t ENCODER_NAL_BUFFERS = 64;
+// Parity packets of one media packet, rows and columns ending with it.
+constexpr size_t MAX_DEFERRED_FEC = 2;
+
+using HeaderBuffer = std::array<uint8_t, MAX_RTP_HEADER_SIZE>;
+
+// Of all transmits of the process.
+struct TransmitMetrics {
+  Counter& packets_sent =
+      metrics().counter("ns_rtp_packets_sent_total",
+                        "RTP packets sent, media and FEC, retransmissions "
+                        "excluded.");
+  Counter& bytes_sent = metrics().counter(
+      "ns_rtp_payload_bytes_sent_total", "Payload bytes of RTP packets sent.");
+  Counter& retransmissions = metrics().counter(
+      "ns_rtp_retransmissions_total", "RTP packets sent again on NACK.");
+  Gauge& remote_packets_lost =
+      metrics().gauge("ns_rtp_remote_packets_lost",
+                      "Cumulative loss in the last receiver report.");
+  Gauge& pacer_queue =
+      metrics().gauge("ns_pacer_queue_packets", "Packets in pacer queue.");
+  Counter& pacer_drops = metrics().counter(
+      "ns_pacer_dropped_packets_total", "Packets dropped by full pacer.");
+};
+
+// Share of FEC packets relative to media ones.
+double fec_overhead(const FecConfig& config) {
+  if (config.row_size == 0) {
+    return 0;
+  }
+  // One row parity per row_size packets and, with more than one row, one
+  // column parity per `rows` packets.
+  return 1.0 / config.row_size + (config.rows > 1 ? 1.0 / config.rows : 0);
+}
+
+// FEC goes as a stream of its own, FlexFEC (RFC 8627) style, with its own
+// sequence numbers, so its SSRC must be different from the media one. Top bit
+// flipped, so consecutive media SSRCs never clash with FEC ones.
+uint32_t fec_ssrc_of(uint32_t media_ssrc) {
+  return media_ssrc ^ 0x80000000;
+}
+
+uint16_t rtp_sequence_num(std::span<const uint8_t> header) {
+  return static_cast<uint16_t>(header[2] << 8 | header[3]);
+}
+
+uint32_t abs_send_time_now() {
+  return to_abs_send_time(std::chrono::duration_cast<std::chrono::microseconds>(
+      std::chrono::steady_clock::now().time_since_epoch()));
+}
+
+// NALs that make the frame decodable on its own.
+bool is_independent(NAL_Type nal_type) {
+  return nal_type == NAL_Type::sps || nal_type == NAL_Type::pps ||
+         nal_type == NAL_Type::slice_idr;
+}
+}  // namespace
+
 class UDP_TransmitImpl : public UDP_Transmit {
  public:
   explicit UDP_TransmitImpl(asio::io_context& ctx,
                             std::string dest_host,
-                            int port)
-      : m_ctx(ctx), m_dest_host(dest_host), m_port(port), m_socket(ctx) {}
+                            int port,
+                            UDP_TransmitOptions options)
+      : m_ctx(ctx),
+        m_dest_host(dest_host),
+        m_port(port),
+        m_options(options),
+        m_socket(ctx),
+        m_packetizer(H264_MAX_PAYLOAD_SIZE),
+        m_fec(MAX_PROTECTED_PACKET_SIZE, options.fec),
+        m_fec_sink([this](auto payload) { send_fec(payload); }),
+        m_pacer_timer(ctx),
+        m_fec_overhead(fec_overhead(options.fec)),
+        m_ssrc(options.ssrc.value_or(std::random_device{}())),
+        m_fec_ssrc(fec_ssrc_of(m_ssrc)),
+        m_random(m_ssrc),
+        m_report_timer(ctx) {}
 
   bool initialize() {
     std::error_code ec;
@@ -26,78 +150,1095 @@ class UDP_TransmitImpl : public UDP_Transmit {
       return false;
     }
 
+    auto address = asio::ip::make_address(m_dest_host, ec);
+    if (ec) {
+      LOG_ERROR("Invalid destination address '{}': {}", m_dest_host,
+                ec.message());
+      return false;
+    }
+    m_endpoint = udp::endpoint{address, static_cast<unsigned short>(m_port)};
+
+    if (m_options.retransmission_history > 0 ||
+        m_options.bwe.start_bitrate > 0 || m_options.rtcp_reports) {
+      // Bind right away rather than on the first send, so that we can listen
+      // for receiver feedback before sending anything.
+      m_socket.bind(udp::endpoint(udp::v4(), 0), ec);
+      if (ec) {
+        LOG_ERROR("Failed binding transmit socket: {}", ec.message());
+        return false;
+      }
+    }
+    if (m_options.retransmission_history > 0) {
+      m_history = std::make_unique<RTP_PacketHistory>(
+          m_options.retransmission_history, MAX_PROTECTED_PACKET_SIZE);
+    }
+    if (m_options.bwe.start_bitrate > 0) {
+      m_bwe = std::make_unique<BandwidthEstimator>(m_options.bwe);
+    }
+
+    // A NAL buffer may be held by the history, the pacer queue or the batch,
+    // or be filled by the encoder.
+    m_nal_pool = std::make_unique<PacketBufferPool>(
+        std::bit_ceil(std::max<size_t>(m_options.retransmission_history, 1)) +
+            (m_options.pacer.rate > 0 ? 2 * m_options.pacer.queue_capacity
+                                      : 0) +
+            MAX_BATCH_SIZE + ENCODER_NAL_BUFFERS,
+        NAL_HEADROOM + NAL_BUFFER_CAPACITY);
+    m_deferred_fec.reserve(MAX_DEFERRED_FEC);
+
+    if (m_options.mode == UDP_TransmitMode::batched) {
+      // Reserve everything upfront so that collecting a frame does not touch
+      // the allocator.
+      m_pending.reserve(MAX_BATCH_SIZE);
+      m_pending_fec.reserve(MAX_FEC_BATCH_SIZE);
+      m_iovecs.reserve(MAX_BATCH_SIZE * MAX_IOVECS_PER_PACKET +
+                       MAX_FEC_BATCH_SIZE);
+      m_msgs.reserve(MAX_BATCH_SIZE + MAX_FEC_BATCH_SIZE);
+      m_fec_pool = std::make_unique<PacketBufferPool>(
+          MAX_FEC_BATCH_SIZE, MAX_RTP_HEADER_SIZE + m_fec.max_payload_size());
+    }
+
+    if (m_options.pacer.rate > 0) {
+      m_pacer = std::make_unique<Pacer>(m_options.pacer);
+      if (m_bwe) {
+        m_pacer->set_rate(pacing_rate(m_options.bwe.start_bitrate),
+                          Pacer::clock::now());
+      }
+      // Every queued packet holds a buffer, plus the ones popped and being
+      // sent.
+      m_paced_pool = std::make_unique<PacketBufferPool>(
+          2 * m_options.pacer.queue_capacity,
+          MAX_RTP_HEADER_SIZE + m_fec.max_payload_size());
+      m_ready.reserve(m_options.pacer.queue_capacity);
+      m_ready_iovecs.reserve(m_options.pacer.queue_capacity);
+      m_ready_msgs.reserve(m_options.pacer.queue_capacity);
+    }
+
     return true;
   }
 
-  virtual void async_initialize(callback<void> cb) override { cb({}); }
+  virtual void async_initialize(callback<void> cb) override {
+    if (m_history || m_bwe || m_options.rtcp_reports) {
+      receive_rtcp();
+    }
+    if (m_options.rtcp_reports) {
+      schedule_sender_report();
+    }
+    cb({});
+  }
+
+  virtual void begin_frame() override {
+    flush_packetizer();
+    send_held_packet();
+    if (!m_pending.empty()) {
+      // Previous frame has not been terminated with end_frame() (e.g. encoder
+      // dropped it), do not let its packets wait for another frame.
+      flush_batch();
+    }
+  }
+
+  virtual void end_frame() override {
+    flush_packetizer();
+    if (m_held) {
+      mark_last_packet(*m_held);
+      send_held_packet();
+    }
+    if (m_options.mode == UDP_TransmitMode::batched) {
+      if (!m_pending.empty()) {
+        // In batched mode we know which packet is the last one of the frame,
+        // so mark it and let the receiver release the frame without waiting
+        // for the next one.
+        mark_last_packet(m_pending.back());
+      }
+      flush_batch(true);
+    } else {
+      m_fec.flush(m_fec_sink);
+    }
+  }
+
+  virtual void set_fec_config(FecConfig config) override {
+    m_fec.set_config(config);
+    m_fec_overhead = fec_overhead(config);
+  }
+
+  virtual void set_pacing_rate(uint64_t rate) override {
+    if (!m_pacer) {
+      LOG_WARNING("Pacing is disabled, ignoring new rate");
+      return;
+    }
+    {
+      std::lock_guard lock(m_pacer_lock);
+      m_pacer->set_rate(rate, Pacer::clock::now());
+    }
+    // Queued packets may be due sooner now.
+    asio::post(m_ctx, [this] { drain_pacer(); });
+  }
+
+  virtual PacerStats pacer_stats() override {
+    if (!m_pacer) {
+      return {};
+    }
+    std::lock_guard lock(m_pacer_lock);
+    return m_pacer->take_stats(Pacer::clock::now());
+  }
+
+  virtual BandwidthEstimate bandwidth_estimate() override {
+    if (!m_bwe) {
+      return {};
+    }
+    std::lock_guard lock(m_bwe_lock);
+    return m_bwe->estimate();
+  }
+
+  virtual UDP_TransmitStats stats() override {
+    std::lock_guard lock(m_stats_lock);
+    auto stats = m_stats;
+    stats.packets_sent = m_packets_sent;
+    stats.bytes_sent = m_bytes_sent;
+    return stats;
+  }
 
   virtual void transmit(VideoPacket packet) override {
-    RTP_PacketHeader header;
-    header.version = 2;
-    header.padding_bit = 1;
-    header.extension_bit = 0;
-    header.marker_bit = 0;
-    header.payload_type = 78;
-    header.sequence_num = m_sequence_num++;
-    header.timestamp = packet.nal_meta.timestamp;
+    if (packet.nal_meta.timestamp != m_frame_timestamp) {
+      m_frame_independent = false;
+    }
+    m_frame_timestamp = packet.nal_meta.timestamp;
+    // Known from the first parameter set or IDR slice on, which in x264
+    // output come first or right after SEI.
+    m_frame_independent =
+        m_frame_independent || is_independent(packet.nal_meta.nal_type);
 
-    std::array<uint8_t, RTP_PacketHeader_Size> header_buff;
+    if (packet.buffer && transmit_in_place(packet)) {
+      return;
+    }
 
-    if (auto ec = serialize_rtp_header_to(header, header_buff); ec) {
-      LOG_ERROR("Failed serializing packet: {}", ec.message());
+    if (m_options.payload_format == UDP_PayloadFormat::h264) {
+      transmit_h264(packet);
       return;
     }
 
-    RTP_PayloadHeader payload_header;
-    payload_header.nal_type = packet.nal_meta.nal_type;
-    payload_header.first_mb = packet.nal_meta.first_macroblock;
-    payload_header.last_mb = packet.nal_meta.last_macroblock;
+    if (m_options.mode == UDP_TransmitMode::batched) {
+      if (m_pending.size() == MAX_BATCH_SIZE) {
+        // Flushed only once there is another packet, so that the last packet
+        // of the frame is always left for end_frame() to mark.
+        flush_batch();
+      }
+      auto& pending = m_pending.emplace_back();
+      pending.header_size = serialize_headers(packet, pending.header_buff,
+                                              pending.payload_header_buff);
+      if (pending.header_size == 0) {
+        m_pending.pop_back();
+        return;
+      }
+      pending.packet = std::move(packet);
+      pending.h264_payload_size = 0;
+      return;
+    }
 
+    HeaderBuffer header_buff;
     std::array<uint8_t, RTP_PayloadHeader_Size> payload_header_buff;
-
-    if (auto ec = serialize_payload_header(payload_header, payload_header_buff);
-        ec) {
-      LOG_ERROR("Failed serializing payload header: {}", ec.message());
+    const size_t header_size =
+        serialize_headers(packet, header_buff, payload_header_buff);
+    if (header_size == 0) {
       return;
     }
 
     // 2x2 bytes for macroblocks + 1 byte for nal type. 5 additional bytes in
     // total: 12 + 5 = 17 bytes header.
 
-    LOG_DEBUG("header_buff[0]: {}", header_buff[0]);
+    const std::array<std::span<const uint8_t>, 3> parts{
+        std::span{header_buff}.first(header_size), payload_header_buff,
+        packet.nal()};
+    send_packet(parts);
+    on_media_packet(parts);
+  }
+
+  virtual PacketRef acquire_nal_buffer() override {
+    auto buffer = m_nal_pool->acquire();
+    if (buffer) {
+      buffer.reserve_headroom(NAL_HEADROOM);
+    }
+    return buffer;
+  }
+
+ private:
+  struct PendingPacket {
+    // Of the packet in `buffer` if there is one, in `header_buff` otherwise.
+    std::span<uint8_t> header() {
+      if (buffer) {
+        return buffer.bytes().first(header_size);
+      }
+      return std::span{header_buff}.first(header_size);
+    }
+
+    // Whole packet, headers included, sent without copying.
+    PacketRef buffer;
+    HeaderBuffer header_buff;
+    size_t header_size{};
+    // Naive format: payload header followed by the NAL.
+    std::array<uint8_t, RTP_PayloadHeader_Size> payload_header_buff;
+    VideoPacket packet;
+    // H.264 format: copy of the payload, packetizer reuses its buffers.
+    std::array<uint8_t, H264_MAX_PAYLOAD_SIZE> h264_payload_buff;
+    size_t h264_payload_size{};
+  };
 
-    std::vector<asio::const_buffer> buffers{asio::buffer(header_buff),
-                                            asio::buffer(payload_header_buff),
-                                            asio::buffer(packet.nal_data)};
+  void mark_last_packet(PendingPacket& last) {
+    const auto header = last.header();
+    header[1] |= RTP_MarkerBitMask;
+    if (m_options.frame_marking) {
+      set_end_of_frame(header, m_options.extensions.frame_marking);
+    }
+  }
+
+  template <class Buffers>
+  void send_now(const Buffers& buffers) {
     std::error_code ec;
-    udp::endpoint endpoint{asio::ip::address::from_string("127.0.0.1"), m_port};
-    m_socket.send_to(buffers, endpoint, {}, ec);
+    m_socket.send_to(buffers, m_endpoint, {}, ec);
     if (ec) {
       if (ec != asio::error::would_block) {
         LOG_WARNING("Failed sending packet: {}", ec.message());
       } else {
         LOG_DEBUG("Buffer stalled");
       }
+    }
+  }
+
+  // Sends the packet made of `parts` right away or hands it to the pacer.
+  void send_packet(std::span<const std::span<const uint8_t>> parts) {
+    if (m_pacer) {
+      enqueue_paced(parts);
+      return;
+    }
+    std::array<asio::const_buffer, MAX_IOVECS_PER_PACKET> buffers;
+    assert(parts.size() <= buffers.size());
+    for (size_t i = 0; i < parts.size(); ++i) {
+      buffers[i] = asio::buffer(parts[i].data(), parts[i].size());
+    }
+    send_now(std::span{buffers}.first(parts.size()));
+
+    if (m_bwe) {
+      size_t size = 0;
+      for (auto part : parts) {
+        size += part.size();
+      }
+      std::lock_guard lock(m_bwe_lock);
+      on_packet_sent(parts[0], size, BandwidthEstimator::clock::now());
+    }
+  }
+
+  // Called on the encoder thread. The packet is copied into a pool buffer,
+  // sending is up to drain_pacer() on io_context thread.
+  void enqueue_paced(std::span<const std::span<const uint8_t>> parts) {
+    if (auto buffer = copy_for_pacer(parts)) {
+      enqueue_paced(std::move(buffer));
+    }
+  }
+
+  // Empty if there is no buffer for it.
+  PacketRef copy_for_pacer(std::span<const std::span<const uint8_t>> parts) {
+    auto buffer = m_paced_pool->acquire();
+    if (!buffer) {
+      LOG_WARNING("Pacer ran out of buffers, dropping packet");
+      return {};
+    }
+    size_t size = 0;
+    for (auto part : parts) {
+      if (size + part.size() > buffer.capacity()) {
+        LOG_WARNING("Packet too big for pacer, dropping");
+        return {};
+      }
+      std::memcpy(buffer.data() + size, part.data(), part.size());
+      size += part.size();
+    }
+    buffer.set_size(size);
+    return buffer;
+  }
+
+  // Media packet in a NAL buffer goes to the pacer as it is. Protection and
+  // history read it first, before drain_pacer() may stamp it on the other
+  // thread, but parity still goes after it.
+  void enqueue_paced_media(PacketRef packet) {
+    const std::array<std::span<const uint8_t>, 1> parts{packet.bytes()};
+    m_defer_fec = true;
+    on_media_packet(parts, packet);
+    m_defer_fec = false;
+    enqueue_paced(std::move(packet));
+    for (auto& parity : m_deferred_fec) {
+      enqueue_paced(std::move(parity));
+    }
+    m_deferred_fec.clear();
+  }
+
+  void enqueue_paced(PacketRef buffer) {
+    std::lock_guard lock(m_pacer_lock);
+    const bool was_empty = m_pacer->empty();
+    if (!m_pacer->push(std::move(buffer), Pacer::clock::now())) {
+      LOG_WARNING("Pacer queue is full, dropping packet");
+      m_metrics.pacer_drops.add();
+      return;
+    }
+    m_metrics.pacer_queue.set(static_cast<int64_t>(m_pacer->size()));
+    // Otherwise a drain is already scheduled, either posted or on the timer.
+    if (was_empty) {
+      asio::post(m_ctx, [this] { drain_pacer(); });
+    }
+  }
+
+  // Sends what the pacer lets out and sleeps until it lets out more. Runs on
+  // io_context thread.
+  void drain_pacer() {
+    std::optional<Pacer::clock::time_point> deadline;
+    {
+      std::lock_guard lock(m_pacer_lock);
+      m_pacer->pop_ready(Pacer::clock::now(), m_ready);
+      deadline = m_pacer->next_send_time();
+      m_metrics.pacer_queue.set(static_cast<int64_t>(m_pacer->size()));
+    }
+
+    if (!m_ready.empty()) {
+      m_ready_iovecs.clear();
+      m_ready_msgs.clear();
+      const uint32_t send_time = abs_send_time_now();
+      for (auto& p : m_ready) {
+        stamp_send_time(p.bytes(), send_time);
+        m_ready_iovecs.push_back({p.data(), p.size()});
+      }
+      for (auto& iov : m_ready_iovecs) {
+        m_ready_msgs.push_back(make_msg(&iov, 1));
+      }
+      send_msgs(m_ready_msgs);
+      m_ready.clear();
+    }
+
+    if (deadline) {
+      // Replaces the wait scheduled before, if any.
+      m_pacer_timer.expires_at(*deadline);
+      m_pacer_timer.async_wait([this](std::error_code ec) {
+        if (ec) {
+          // Rescheduled or cancelled.
+          return;
+        }
+        drain_pacer();
+      });
+    }
+  }
+
+  void transmit_h264(const VideoPacket& packet) {
+    const auto nal = strip_annexb_start_code(packet.nal());
+    auto ec = m_packetizer.push_nal(nal, [this](auto payload) {
+      send_h264_payload(payload, m_frame_timestamp);
+    });
+    if (ec) {
+      LOG_ERROR("Failed packetizing NAL: {}", ec.message());
+    }
+  }
+
+  // Sends the NAL from its buffer with the headers prepended in place, so that
+  // the buffer is the packet all the way to the socket, the history and FEC.
+  // False if the NAL does not go in a packet of its own as it is, or there is
+  // no room for the headers.
+  bool transmit_in_place(VideoPacket& packet) {
+    auto& buffer = packet.buffer;
+    HeaderBuffer header_buff;
+    size_t header_size{};
+    if (m_options.payload_format == UDP_PayloadFormat::h264) {
+      const auto nal = strip_annexb_start_code(buffer.bytes());
+      const size_t start_code_size = buffer.size() - nal.size();
+      if (!m_packetizer.is_single_nal_unit(nal) ||
+          buffer.headroom() + start_code_size < MAX_RTP_HEADER_SIZE) {
+        return false;
+      }
+      // Parameter sets held for aggregation go first.
+      flush_packetizer();
+      header_size = serialize_rtp_header(
+          RTP_H264_PayloadType, m_sequence_num++, m_frame_timestamp,
+          header_buff);
+      buffer.consume_front(start_code_size);
+    } else {
+      // Start code included, as the NAL goes to the decoder as it is.
+      if (buffer.headroom() < NAL_HEADROOM) {
+        return false;
+      }
+      std::array<uint8_t, RTP_PayloadHeader_Size> payload_header_buff;
+      header_size = serialize_headers(packet, header_buff, payload_header_buff);
+      if (header_size > 0) {
+        std::ranges::copy(payload_header_buff,
+                          buffer.prepend(payload_header_buff.size()).begin());
+      }
+    }
+    if (header_size == 0) {
+      return true;
+    }
+    std::ranges::copy(std::span{header_buff}.first(header_size),
+                      buffer.prepend(header_size).begin());
+    send_in_place(std::move(buffer), header_size);
+    return true;
+  }
+
+  void send_in_place(PacketRef packet, size_t header_size) {
+    if (m_options.mode == UDP_TransmitMode::batched) {
+      if (m_pending.size() == MAX_BATCH_SIZE) {
+        flush_batch();
+      }
+      auto& pending = m_pending.emplace_back();
+      pending.buffer = std::move(packet);
+      pending.header_size = header_size;
+      return;
+    }
+    if (m_options.payload_format == UDP_PayloadFormat::h264) {
+      // Held for the marker bit, as in send_h264_payload().
+      send_held_packet();
+      auto& held = m_held.emplace();
+      held.buffer = std::move(packet);
+      held.header_size = header_size;
+      return;
+    }
+    send_in_place_now(std::move(packet));
+  }
+
+  void send_in_place_now(PacketRef packet) {
+    if (m_pacer) {
+      enqueue_paced_media(std::move(packet));
+      return;
+    }
+    const std::array<std::span<const uint8_t>, 1> parts{packet.bytes()};
+    send_packet(parts);
+    on_media_packet(parts, std::move(packet));
+  }
+
+  // Sends out NALs packetizer holds for aggregation.
+  void flush_packetizer() {
+    if (m_options.payload_format != UDP_PayloadFormat::h264) {
+      return;
+    }
+    m_packetizer.flush([this](auto payload) {
+      send_h264_payload(payload, m_frame_timestamp);
+    });
+  }
+
+  void send_h264_payload(std::span<const uint8_t> payload, uint32_t timestamp) {
+    assert(payload.size() <= H264_MAX_PAYLOAD_SIZE);
+
+    if (m_options.mode == UDP_TransmitMode::batched) {
+      if (m_pending.size() == MAX_BATCH_SIZE) {
+        flush_batch();
+      }
+      auto& pending = m_pending.emplace_back();
+      pending.header_size = serialize_rtp_header(
+          RTP_H264_PayloadType, m_sequence_num++, timestamp,
+          pending.header_buff);
+      if (pending.header_size == 0) {
+        m_pending.pop_back();
+        return;
+      }
+      std::copy(payload.begin(), payload.end(),
+                pending.h264_payload_buff.begin());
+      pending.h264_payload_size = payload.size();
+      return;
+    }
+
+    // RFC 6184 wants the marker bit on the last packet of a frame, which is
+    // known only once the next packet comes or the frame ends. Until then the
+    // packet is held.
+    send_held_packet();
+    auto& held = m_held.emplace();
+    held.header_size = serialize_rtp_header(
+        RTP_H264_PayloadType, m_sequence_num++, timestamp, held.header_buff);
+    if (held.header_size == 0) {
+      m_held.reset();
+      return;
+    }
+    std::copy(payload.begin(), payload.end(), held.h264_payload_buff.begin());
+    held.h264_payload_size = payload.size();
+  }
+
+  void send_held_packet() {
+    if (!m_held) {
+      return;
+    }
+    if (m_held->buffer) {
+      send_in_place_now(std::move(m_held->buffer));
+    } else {
+      const std::array<std::span<const uint8_t>, 2> parts{
+          m_held->header(), std::span{m_held->h264_payload_buff}.first(
+                                m_held->h264_payload_size)};
+      send_packet(parts);
+      on_media_packet(parts);
+    }
+    m_held.reset();
+  }
+
+  // Called for every media packet in its final form, marker bit included,
+  // when it goes to the socket. `parts` concatenated make the packet, which
+  // is in `packet` too if it is sent from a NAL buffer. Parity of a group is
+  // sent after its last packet, never before.
+  void on_media_packet(std::span<const std::span<const uint8_t>> parts,
+                       PacketRef packet = {}) {
+    if (m_traced_timestamp != m_frame_timestamp) {
+      m_traced_timestamp = m_frame_timestamp;
+      trace_frame(m_frame_timestamp, TraceStage::sent);
+    }
+    const uint16_t sequence_num = rtp_sequence_num(parts[0]);
+    count_sent(parts);
+    if (m_history) {
+      const auto now = RTP_PacketHistory::clock::now();
+      if (packet) {
+        m_history->store(sequence_num, std::move(packet), now);
+      } else {
+        m_history->store(sequence_num, parts, now);
+      }
+    }
+    m_fec.add_packet(sequence_num, parts, m_fec_sink);
+  }
+
+  // FEC packets go right after the media they protect: immediately, in the
+  // same batch or into the pacer queue.
+  void send_fec(std::span<const uint8_t> fec_payload) {
+    HeaderBuffer buff;
+    const size_t header_size = serialize_rtp_header(
+        RTP_FecPayloadType, m_fec_sequence_num++, m_frame_timestamp, buff);
+    if (header_size == 0) {
+      return;
+    }
+    const auto header_buff = std::span{buff}.first(header_size);
+
+    if (m_options.mode == UDP_TransmitMode::batched && !m_pacer) {
+      if (m_pending_fec.size() == MAX_FEC_BATCH_SIZE) {
+        LOG_WARNING("Too many FEC packets in one batch, dropping");
+        return;
+      }
+      auto buffer = m_fec_pool->acquire();
+      assert(buffer);
+      std::memcpy(buffer.data(), header_buff.data(), header_buff.size());
+      std::memcpy(buffer.data() + header_buff.size(), fec_payload.data(),
+                  fec_payload.size());
+      buffer.set_size(header_buff.size() + fec_payload.size());
+      m_pending_fec.push_back(std::move(buffer));
+      return;
+    }
+
+    const std::array<std::span<const uint8_t>, 2> parts{header_buff,
+                                                        fec_payload};
+    if (m_defer_fec) {
+      if (m_deferred_fec.size() == MAX_DEFERRED_FEC) {
+        LOG_WARNING("Too many FEC packets of one media packet, dropping");
+        return;
+      }
+      if (auto buffer = copy_for_pacer(parts)) {
+        m_deferred_fec.push_back(std::move(buffer));
+      }
+      return;
+    }
+    send_packet(parts);
+  }
+
+  // For sender reports, which cover the media stream only: FEC has an SSRC of
+  // its own. The first part is the RTP header.
+  void count_sent(std::span<const std::span<const uint8_t>> parts) {
+    m_packets_sent++;
+    size_t size = 0;
+    for (auto part : parts.subspan(1)) {
+      size += part.size();
+    }
+    m_bytes_sent += size;
+    m_metrics.packets_sent.add();
+    m_metrics.bytes_sent.add(size);
+  }
+
+  // Feedback arrives on the same socket we send from. Runs on io_context
+  // thread, concurrently with transmit() called from the encoder.
+  void receive_rtcp() {
+    m_socket.async_receive_from(
+        asio::buffer(m_rtcp_buff), m_rtcp_sender,
+        [this](std::error_code ec, size_t bytes_received) {
+          if (ec) {
+            if (ec == asio::error::operation_aborted) {
+              return;
+            }
+            LOG_ERROR("Failed receiving RTCP: {}", ec.message());
+          } else {
+            handle_rtcp(std::span{m_rtcp_buff}.first(bytes_received));
+          }
+          receive_rtcp();
+        });
+  }
+
+  void handle_rtcp(std::span<const uint8_t> data) {
+    const auto now = RTP_PacketHistory::clock::now();
+    auto ec = for_each_rtcp_packet(data, [&](const RTCP_Header& header,
+                                             std::span<const uint8_t> packet) {
+      if (header.payload_type == RTCP_PayloadType_RR) {
+        handle_receiver_report(packet);
+        return;
+      }
+      if (header.payload_type != RTCP_PayloadType_RTPFB) {
+        return;
+      }
+      if (header.count == RTCP_FeedbackFormat_GenericNack && m_history) {
+        handle_generic_nack(packet, now);
+      } else if (header.count == RTCP_FeedbackFormat_TransportCC && m_bwe) {
+        handle_transport_feedback(packet, now);
+      }
+    });
+    if (ec) {
+      LOG_WARNING("Malformed RTCP packet: {}", ec.message());
+    }
+  }
+
+  void handle_receiver_report(std::span<const uint8_t> packet) {
+    auto report = deserialize_receiver_report(packet);
+    if (!report) {
+      LOG_WARNING("Malformed receiver report: {}", report.error().message());
+      return;
+    }
+    const uint32_t now =
+        compact_ntp(to_ntp_time(std::chrono::system_clock::now()));
+    for (const auto& block : report->report_blocks) {
+      if (block.ssrc != m_ssrc) {
+        continue;
+      }
+      std::lock_guard lock(m_stats_lock);
+      if (block.last_sr != 0) {
+        // RFC 3550, 6.4.1: the receiver has held our report for
+        // delay_since_last_sr, the rest of the time since we sent it is round
+        // trip. Clock steps may make it negative.
+        const auto rtt = static_cast<int32_t>(now - block.last_sr -
+                                              block.delay_since_last_sr);
+        m_stats.rtt = from_compact_ntp_duration(std::max(rtt, 0));
+      }
+      m_stats.loss_fraction = block.fraction_lost / 256.0;
+      m_stats.cumulative_lost = block.cumulative_lost;
+      m_metrics.remote_packets_lost.set(block.cumulative_lost);
+      m_stats.jitter = std::chrono::microseconds{
+          static_cast<int64_t>(block.jitter) * 1'000'000 / RTP_VideoClockRate};
+      LOG_DEBUG("Receiver report: RTT {} us, loss {}/256, jitter {}",
+                m_stats.rtt.count(), block.fraction_lost, block.jitter);
+    }
+  }
+
+  void send_sender_report() {
+    if (m_packets_sent == 0) {
+      return;
+    }
+
+    RTCP_SenderReport report;
+    report.sender_ssrc = m_ssrc;
+    const auto now = std::chrono::steady_clock::now();
+    report.ntp_time = to_ntp_time(std::chrono::system_clock::now());
+    // Same clock as the encoder stamps frames with.
+    report.rtp_timestamp = static_cast<uint32_t>(
+        std::chrono::duration_cast<std::chrono::milliseconds>(
+            now.time_since_epoch())
+            .count());
+    report.packet_count = static_cast<uint32_t>(m_packets_sent);
+    report.octet_count = static_cast<uint32_t>(m_bytes_sent);
+
+    m_report_buff.clear();
+    if (auto ec = serialize_sender_report(report, m_report_buff); ec) {
+      LOG_ERROR("Failed serializing sender report: {}", ec.message());
+      return;
+    }
+    std::error_code ec;
+    m_socket.send_to(asio::buffer(m_report_buff), m_endpoint, {}, ec);
+    if (ec) {
+      LOG_WARNING("Failed sending sender report: {}", ec.message());
+    }
+  }
+
+  void schedule_sender_report() {
+    m_report_timer.expires_after(
+        rtcp_report_delay(m_options.rtcp_report_interval, m_random));
+    m_report_timer.async_wait([this](std::error_code ec) {
+      if (ec) {
+        return;
+      }
+      send_sender_report();
+      schedule_sender_report();
+    });
+  }
+
+  void handle_generic_nack(std::span<const uint8_t> packet,
+                           RTP_PacketHistory::clock::time_point now) {
+    auto nack = deserialize_generic_nack(packet);
+    if (!nack) {
+      LOG_WARNING("Malformed generic NACK: {}", nack.error().message());
+      return;
+    }
+    for (uint16_t sequence_num : nack->lost) {
+      retransmit(sequence_num, now);
+    }
+  }
+
+  void handle_transport_feedback(std::span<const uint8_t> packet,
+                                 BandwidthEstimator::clock::time_point now) {
+    auto feedback = deserialize_transport_feedback(packet);
+    if (!feedback) {
+      LOG_WARNING("Malformed transport feedback: {}",
+                  feedback.error().message());
+      return;
+    }
+
+    uint64_t target_bitrate{};
+    {
+      std::lock_guard lock(m_bwe_lock);
+      m_bwe->on_feedback(*feedback, now);
+      target_bitrate = m_bwe->estimate().target_bitrate;
+    }
+
+    if (m_pacer) {
+      set_pacing_rate(pacing_rate(target_bitrate));
+    }
+
+    // What is left for media once FEC takes its share.
+    const auto media_bitrate =
+        static_cast<uint64_t>(target_bitrate / (1 + m_fec_overhead));
+    const double change =
+        std::abs(static_cast<double>(media_bitrate) -
+                 static_cast<double>(m_notified_bitrate));
+    if (m_notified_bitrate != 0 &&
+        change < m_notified_bitrate * TARGET_BITRATE_HYSTERESIS) {
+      return;
+    }
+    LOG_DEBUG("Target bitrate {} kbps, {} kbps for media",
+              target_bitrate / 1000, media_bitrate / 1000);
+    m_notified_bitrate = media_bitrate;
+    if (m_options.on_target_bitrate) {
+      m_options.on_target_bitrate(media_bitrate);
+    }
+  }
+
+  static uint64_t pacing_rate(uint64_t target_bitrate) {
+    return static_cast<uint64_t>(target_bitrate * PACING_FACTOR);
+  }
+
+  // Reports a packet that has just left through the socket to bandwidth
+  // estimation. `header` starts the packet. Must hold m_bwe_lock.
+  void on_packet_sent(std::span<const uint8_t> header,
+                      size_t size,
+                      BandwidthEstimator::clock::time_point now) {
+    if (auto sequence_num = find_transport_sequence_num(
+            header, m_options.extensions.transport_sequence_num)) {
+      m_bwe->on_packet_sent(*sequence_num, size, now);
+    }
+  }
+
+  void retransmit(uint16_t sequence_num,
+                  RTP_PacketHistory::clock::time_point now) {
+    auto packet = m_history->take_for_retransmission(
+        sequence_num, now, m_options.retransmission_budget, m_options.rtt);
+    if (!packet) {
+      LOG_DEBUG("Not retransmitting packet {}", sequence_num);
+      return;
+    }
+    LOG_DEBUG("Retransmitting packet {}", sequence_num);
+    m_metrics.retransmissions.add();
+    // Retransmissions skip the pacer queue, they are late already, but still
+    // count against its budget.
+    if (m_pacer) {
+      std::lock_guard lock(m_pacer_lock);
+      m_pacer->on_sent_directly(packet.size(), now);
+    }
+    if (m_bwe) {
+      // For bandwidth estimation it is another packet, it gets its own
+      // transport-wide number.
+      overwrite_transport_sequence_num(
+          packet.bytes(), m_options.extensions.transport_sequence_num,
+          m_transport_sequence_num++);
+    }
+    stamp_send_time(packet.bytes(), abs_send_time_now());
+    send_now(asio::buffer(packet.data(), packet.size()));
+    if (m_bwe) {
+      std::lock_guard lock(m_bwe_lock);
+      on_packet_sent(packet.bytes(), packet.size(), now);
+    }
+  }
+
+  // Returns size of the header, zero on failure.
+  size_t serialize_rtp_header(unsigned payload_type,
+                              uint16_t sequence_num,
+                              uint32_t timestamp,
+                              HeaderBuffer& header_buff) {
+    RTP_Extensions extensions;
+    if (m_bwe) {
+      // Numbered in the order packets are created, which is the order they
+      // are sent in, apart from retransmissions.
+      extensions.transport_sequence_num = m_transport_sequence_num++;
+    }
+    if (m_options.abs_send_time) {
+      // Stamped again if the packet is held before it is sent.
+      extensions.abs_send_time = abs_send_time_now();
+    }
+    if (m_options.frame_marking && payload_type != RTP_FecPayloadType) {
+      const bool start_of_frame =
+          !m_marked_timestamp || *m_marked_timestamp != timestamp;
+      m_marked_timestamp = timestamp;
+      extensions.frame_marking =
+          RTP_FrameMarking{.start_of_frame = start_of_frame,
+                           .independent = m_frame_independent};
+    }
+    const bool has_extensions = extensions.transport_sequence_num ||
+                                extensions.abs_send_time ||
+                                extensions.frame_marking;
+
+    RTP_PacketHeader header;
+    header.version = 2;
+    header.padding_bit = 0;
+    header.extension_bit = has_extensions;
+    header.marker_bit = 0;
+    header.payload_type = payload_type;
+    header.sequence_num = sequence_num;
+    header.timestamp = timestamp;
+    header.ssrc = payload_type == RTP_FecPayloadType ? m_fec_ssrc : m_ssrc;
+
+    if (write_rtp_header(header, header_buff) == 0) {
+      LOG_ERROR("Failed serializing RTP header, payload type: {}",
+                payload_type);
+      return 0;
+    }
+    if (!has_extensions) {
+      return RTP_PacketHeader_Size;
+    }
+
+    const size_t extensions_size = write_rtp_extensions(
+        extensions, m_options.extensions,
+        std::span{header_buff}.subspan(RTP_PacketHeader_Size));
+    if (extensions_size == 0) {
+      LOG_ERROR("Failed serializing header extensions, payload type: {}",
+                payload_type);
+      return 0;
+    }
+    return RTP_PacketHeader_Size + extensions_size;
+  }
+
+  // Updates absolute send time of a serialized packet that is about to go to
+  // the socket.
+  void stamp_send_time(std::span<uint8_t> packet, uint32_t send_time) {
+    if (m_options.abs_send_time) {
+      overwrite_abs_send_time(packet, m_options.extensions.abs_send_time,
+                              send_time);
+    }
+  }
+
+  // Returns size of the RTP header, zero on failure.
+  size_t serialize_headers(
+      const VideoPacket& packet,
+      HeaderBuffer& header_buff,
+      std::array<uint8_t, RTP_PayloadHeader_Size>& payload_header_buff) {
+    const size_t header_size =
+        serialize_rtp_header(RTP_NaivePayloadType, m_sequence_num++,
+                             packet.nal_meta.timestamp, header_buff);
+    if (header_size == 0) {
+      return 0;
+    }
+
+    RTP_PayloadHeader payload_header;
+    payload_header.nal_type = packet.nal_meta.nal_type;
+    payload_header.first_mb = packet.nal_meta.first_macroblock;
+    payload_header.last_mb = packet.nal_meta.last_macroblock;
+
+    if (auto ec = serialize_payload_header(payload_header, payload_header_buff);
+        ec) {
+      LOG_ERROR("Failed serializing payload header: {}", ec.message());
+      return 0;
+    }
+
+    return header_size;
+  }
+
+  // Sends all pending packets with as few sendmmsg() calls as possible, or
+  // queues them for the pacer. At the end of frame FEC block is closed too,
+  // its parity goes in the same batch.
+  void flush_batch(bool end_of_frame = false) {
+    m_iovecs.clear();
+    m_msgs.clear();
+
+    const uint32_t send_time = abs_send_time_now();
+    for (auto& p : m_pending) {
+      const auto header = p.header();
+      stamp_send_time(header, send_time);
+      if (p.buffer) {
+        add_to_batch(
+            std::array<std::span<const uint8_t>, 1>{p.buffer.bytes()},
+            p.buffer);
+      } else if (p.h264_payload_size > 0) {
+        add_to_batch(std::array<std::span<const uint8_t>, 2>{
+            header,
+            std::span{p.h264_payload_buff}.first(p.h264_payload_size)});
+      } else {
+        add_to_batch(std::array<std::span<const uint8_t>, 3>{
+            header, p.payload_header_buff, p.packet.nal()});
+      }
+    }
+
+    if (end_of_frame) {
+      m_fec.flush(m_fec_sink);
+    }
+    for (auto& p : m_pending_fec) {
+      stamp_send_time(p.bytes(), send_time);
+      iovec* first = m_iovecs.data() + m_iovecs.size();
+      m_iovecs.push_back({p.data(), p.size()});
+      add_msg(first);
+    }
+
+    if (!m_msgs.empty()) {
+      send_msgs(m_msgs);
+      LOG_DEBUG("batch of {} packets sent to port {}", m_msgs.size(), m_port);
+    }
+    // Only now, iovecs point into them.
+    m_pending.clear();
+    m_pending_fec.clear();
+  }
+
+  // `packet` is the packet of `parts` if it is in a NAL buffer.
+  void add_to_batch(std::span<const std::span<const uint8_t>> parts,
+                    PacketRef packet = {}) {
+    if (m_pacer) {
+      if (packet) {
+        enqueue_paced_media(std::move(packet));
+        return;
+      }
+      enqueue_paced(parts);
     } else {
-      LOG_DEBUG("packet of size {} sent to port {}", packet.nal_data.size(),
-                m_port);
+      // Vectors are reserved for MAX_BATCH_SIZE packets, so pointers into
+      // m_iovecs stay valid while we fill it.
+      iovec* first = m_iovecs.data() + m_iovecs.size();
+      for (auto part : parts) {
+        m_iovecs.push_back({const_cast<uint8_t*>(part.data()), part.size()});
+      }
+      add_msg(first);
     }
+    on_media_packet(parts, std::move(packet));
+  }
+
+  void send_msgs(std::vector<mmsghdr>& msgs) {
+    size_t sent = 0;
+    while (sent < msgs.size()) {
+      const int r = ::sendmmsg(m_socket.native_handle(), msgs.data() + sent,
+                               msgs.size() - sent, 0);
+      if (r == -1) {
+        if (errno == EINTR) {
+          continue;
+        }
+        if (errno == EAGAIN || errno == EWOULDBLOCK) {
+          LOG_DEBUG("Buffer stalled");
+        } else {
+          LOG_WARNING("Failed sending packet: {}", strerror(errno));
+        }
+        // sendmmsg() reports an error only for the first message in the
+        // batch. Drop that one packet, same as immediate mode does, and carry
+        // on with the rest.
+        ++sent;
+        continue;
+      }
+      sent += r;
+    }
+
+    if (m_bwe) {
+      const auto now = BandwidthEstimator::clock::now();
+      std::lock_guard lock(m_bwe_lock);
+      for (const auto& msg : msgs) {
+        const auto* iov = msg.msg_hdr.msg_iov;
+        size_t size = 0;
+        for (size_t i = 0; i < msg.msg_hdr.msg_iovlen; ++i) {
+          size += iov[i].iov_len;
+        }
+        on_packet_sent({static_cast<const uint8_t*>(iov[0].iov_base),
+                        iov[0].iov_len},
+                       size, now);
+      }
+    }
+  }
+
+  mmsghdr make_msg(iovec* iov, size_t iov_count) {
+    mmsghdr msg{};
+    msg.msg_hdr.msg_name = m_endpoint.data();
+    msg.msg_hdr.msg_namelen = m_endpoint.size();
+    msg.msg_hdr.msg_iov = iov;
+    msg.msg_hdr.msg_iovlen = iov_count;
+    return msg;
+  }
+
+  // Adds message made of iovecs from `first` to the end of m_iovecs.
+  void add_msg(iovec* first) {
+    const size_t count = m_iovecs.data() + m_iovecs.size() - first;
+    m_msgs.push_back(make_msg(first, count));
   }
 
  private:
   asio::io_context& m_ctx;
   std::string m_dest_host;
   int m_port{};
+  UDP_TransmitOptions m_options;
   udp::socket m_socket;
   udp::endpoint m_endpoint;
   udp::resolver m_resolver{m_ctx};
   std::atomic<unsigned> m_sequence_num{};
+  // Goes after everything that may hold its buffers.
+  std::unique_ptr<PacketBufferPool> m_nal_pool;
+  std::vector<PendingPacket> m_pending;
+  std::vector<iovec> m_iovecs;
+  std::vector<mmsghdr> m_msgs;
+  // Immediate mode, H.264 format: last packet, not sent yet.
+  std::optional<PendingPacket> m_held;
+  H264_Packetizer m_packetizer;
+  uint32_t m_frame_timestamp{};
+  // Frame marking state of the current frame.
+  bool m_frame_independent{};
+  std::optional<uint32_t> m_marked_timestamp;
+  // Frame whose first packet went out.
+  std::optional<uint32_t> m_traced_timestamp;
+  std::unique_ptr<RTP_PacketHistory> m_history;
+  FecEncoder m_fec;
+  FecEncoder::FecSink m_fec_sink;
+  uint16_t m_fec_sequence_num{};
+  // Serialized FEC packets of the current batch.
+  std::unique_ptr<PacketBufferPool> m_fec_pool;
+  std::vector<PacketRef> m_pending_fec;
+  std::array<uint8_t, MAX_RTCP_PACKET_SIZE> m_rtcp_buff;
+  udp::endpoint m_rtcp_sender;
+  // Pacer is shared between the encoder thread, which queues packets, and
+  // io_context thread, which sends them.
+  std::mutex m_pacer_lock;
+  std::unique_ptr<Pacer> m_pacer;
+  std::unique_ptr<PacketBufferPool> m_paced_pool;
+  // Parity of a media packet that goes to the pacer without copying, queued
+  // after the packet. Encoder thread only.
+  bool m_defer_fec{};
+  std::vector<PacketRef> m_deferred_fec;
+  asio::steady_timer m_pacer_timer;
+  // Used on io_context thread only.
+  std::vector<PacketRef> m_ready;
+  std::vector<iovec> m_ready_iovecs;
+  std::vector<mmsghdr> m_ready_msgs;
+
+  // Estimator learns about sends from both threads and about feedback on
+  // io_context thread.
+  std::mutex m_bwe_lock;
+  std::unique_ptr<BandwidthEstimator> m_bwe;
+  std::atomic<uint16_t> m_transport_sequence_num{};
+  std::atomic<double> m_fec_overhead;
+  // Last media bitrate passed to on_target_bitrate, io_context thread only.
+  uint64_t m_notified_bitrate{};
+
+  uint32_t m_ssrc{};
+  uint32_t m_fec_ssrc{};
+  std::minstd_rand m_random;
+  asio::steady_timer m_report_timer;
+  std::vector<uint8_t> m_report_buff;
+  std::atomic<uint64_t> m_packets_sent{};
+  std::atomic<uint64_t> m_bytes_sent{};
+  std::mutex m_stats_lock;
+  UDP_TransmitStats m_stats;
+  TransmitMetrics m_metrics;
 };
 
 std::unique_ptr<UDP_Transmit> make_udp_transmit(asio::io_context& ctx,
                                                 std::string dest_host,
-                                                int port) {
-  auto instance = std::make_unique<UDP_TransmitImpl>(ctx, dest_host, port);
+                                                int port,
+                                                UDP_TransmitOptions options) {
+  auto instance =
+      std::make_unique<UDP_TransmitImpl>(ctx, dest_host, port, options);
   if (!instance->initialize()) {
     LOG_ERROR("Failed initializing UDP_Transmit");
     return nullptr;
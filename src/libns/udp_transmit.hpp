@@ -1,9 +1,99 @@
 #pragma once
 
 #include <asio/io_context.hpp>
+#include <chrono>
+#include <functional>
 #include <memory>
+#include <optional>
+#include "bandwidth_estimator.hpp"
+#include "fec.hpp"
+#include "pacer.hpp"
+#include "rtp_extensions.hpp"
 #include "types.hpp"
 
+enum class UDP_TransmitMode {
+  // Every packet goes to the socket with its own send_to() as soon as it is
+  // passed to transmit(). With H.264 payload format a packet is held until
+  // the next one, so that the last packet of each frame carries the RTP
+  // marker bit.
+  immediate,
+  // Packets passed to transmit() between begin_frame() and end_frame() are
+  // held and sent with a single sendmmsg() call when the frame ends. The last
+  // packet of each frame carries the RTP marker bit.
+  batched
+};
+
+enum class UDP_PayloadFormat {
+  // Our own RTP_PayloadHeader followed by the NAL, one NAL per datagram. NALs
+  // must fit into a datagram.
+  naive,
+  // RFC 6184 H.264 payload: NALs bigger than a datagram are fragmented (FU-A),
+  // parameter sets and SEI are aggregated (STAP-A).
+  h264
+};
+
+struct UDP_TransmitOptions {
+  UDP_TransmitMode mode = UDP_TransmitMode::immediate;
+  UDP_PayloadFormat payload_format = UDP_PayloadFormat::naive;
+  // Of the stream, random if not set. Streams sent to the same receiver, as
+  // simulcast renditions are, must each have their own. FEC goes with this
+  // SSRC with its top bit flipped.
+  std::optional<uint32_t> ssrc;
+  // Number of recently sent packets kept to be resent on RTCP generic NACK
+  // from the receiver. Zero disables retransmissions. Packets are resent as
+  // they are, with the original sequence number.
+  size_t retransmission_history = 0;
+  // Packets sent earlier than that are not resent anymore, they would arrive
+  // after the receiver has given up on them anyway.
+  std::chrono::milliseconds retransmission_budget{150};
+  // Expected round trip time. Repeated requests for a packet that come sooner
+  // than that after it has been resent are ignored, the receiver could not
+  // have seen the retransmission yet.
+  std::chrono::milliseconds rtt{20};
+  // Parity packets sent along with media, see fec.hpp, as a stream of their
+  // own with an SSRC of their own. Disabled by default.
+  FecConfig fec;
+  // Media and FEC packets go through a token bucket rather than straight to
+  // the socket, see pacer.hpp. Queue and sends run on io_context thread, so
+  // transmit() never blocks on it. Disabled by default.
+  PacerConfig pacer;
+  // Send side bandwidth estimation from receiver transport-wide feedback, see
+  // bandwidth_estimator.hpp. Every packet then carries a transport-wide
+  // sequence number in an RTP header extension. With pacing on, pacing rate
+  // follows the estimate. Disabled by default.
+  BandwidthEstimatorConfig bwe;
+  // Ids of RTP header extensions, must be the same as the receiver's.
+  RTP_ExtensionMap extensions;
+  // Every packet carries absolute send time, stamped right before it goes to
+  // the socket, so that the receiver can follow one-way delay variation.
+  bool abs_send_time = false;
+  // Media packets carry frame marking: whether they start a frame and whether
+  // the frame is a key one. End of frame is marked too where the last packet
+  // of a frame is known: in batched mode and with H.264 payload format.
+  bool frame_marking = false;
+  // Called with the bitrate left for media out of the estimate, after FEC
+  // overhead, when it changes notably. Meant for the encoder rate control.
+  // Called on io_context thread.
+  std::function<void(uint64_t bitrate)> on_target_bitrate;
+  // RTCP sender reports, which let the receiver report back round trip time,
+  // loss and jitter of the stream, see stats(). Sent every
+  // rtcp_report_interval on average.
+  bool rtcp_reports = false;
+  std::chrono::milliseconds rtcp_report_interval{1000};
+};
+
+struct UDP_TransmitStats {
+  // Media packets, as counted in sender reports. FEC and retransmissions
+  // excluded.
+  uint64_t packets_sent{};
+  // Payload bytes, headers excluded.
+  uint64_t bytes_sent{};
+  // From the latest RTCP receiver report, zeros until there is one.
+  std::chrono::microseconds rtt{};
+  double loss_fraction{};
+  int64_t cumulative_lost{};
+  std::chrono::microseconds jitter{};
+};
 
 // TODO: How endpoints are going to find each other?
 //   How to know they IPS?
@@ -11,9 +101,34 @@ class UDP_Transmit {
  public:
   virtual ~UDP_Transmit() = default;
   virtual void async_initialize(callback<void> cb) = 0;
+  // Frame boundaries as reported by the encoder. Calls to begin_frame(),
+  // end_frame() and transmit() are expected to be serialized by the caller.
+  virtual void begin_frame() = 0;
+  virtual void end_frame() = 0;
   virtual void transmit(VideoPacket) = 0;
+  // Pool buffer for a NAL of up to a datagram of payload, with room in front
+  // of it for the headers. NALs passed to transmit() in such buffers are
+  // sent, kept for retransmission and protected with FEC without being
+  // copied. Empty if all of them are in use. May be called from any thread.
+  virtual PacketRef acquire_nal_buffer() = 0;
+  // Changes FEC protection, takes effect from the next FEC block. May be
+  // called from any thread.
+  virtual void set_fec_config(FecConfig config) = 0;
+  // Changes pacing rate, in bits per second. Has no effect if the transmit has
+  // been created without pacing. May be called from any thread.
+  virtual void set_pacing_rate(uint64_t rate) = 0;
+  // Queue delay of the pacer since the previous call. May be called from any
+  // thread.
+  virtual PacerStats pacer_stats() = 0;
+  // Latest bandwidth estimate, all zeros if estimation is disabled. May be
+  // called from any thread.
+  virtual BandwidthEstimate bandwidth_estimate() = 0;
+  // May be called from any thread.
+  virtual UDP_TransmitStats stats() = 0;
 };
 
-std::unique_ptr<UDP_Transmit> make_udp_transmit(asio::io_context&,
-                                                std::string dest_host,
-                                                int dest_port);
+std::unique_ptr<UDP_Transmit> make_udp_transmit(
+    asio::io_context&,
+    std::string dest_host,
+    int dest_port,
+    UDP_TransmitOptions options = {});
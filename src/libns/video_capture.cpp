@@ -5,16 +5,20 @@
 #include <cstring>
 #include <filesystem>
 #include <iostream>
+#include <mutex>
 #include <optional>
+#include <tuple>
+#include <utility>
 
 #include <errno.h>
 #include <fcntl.h>
 #include <sys/ioctl.h>
 #include <sys/mman.h>
 #include <unistd.h>
-#include <thread>
 
+#include "frame_trace.hpp"
 #include "log.hpp"
+#include "metrics.hpp"
 #include "video_capture.hpp"
 
 LOG_MODULE_NAME("CAPTURE");
@@ -23,10 +27,18 @@ namespace {
 struct BufferView {
   void* start{};
   size_t length{};
+  // Exported DMABUF, if asked for.
+  int dmabuf_fd{-1};
 };
 }  // namespace
 
-constexpr int V4L_BUFFERS_COUNT = 5;
+// Offered out of frame size ranges of devices, if they are in the range.
+constexpr std::pair<uint32_t, uint32_t> COMMON_FRAME_SIZES[] = {
+    {640, 360}, {640, 480}, {1280, 720}, {1920, 1080}};
+
+// Of x86-64 and arm64 with 4 KiB pages. User pointer buffers take whole ones,
+// a 720p YUYV frame takes one.
+constexpr size_t HUGE_PAGE_SIZE = 2 << 20;
 
 struct Video4LinuxVideoFormat : public AbstractVideoFormatSpec {
   explicit Video4LinuxVideoFormat(AbstractVideoFormatSpec::Basic basic,
@@ -54,17 +66,35 @@ int xioctl(int fd, int request, void* arg) {
 //  3) https://github.com/kmdouglass/v4l2-examples
 //  4)
 //  https://stackoverflow.com/questions/10634537/v4l2-difference-between-enque-deque-and-queueing-of-the-buffer
-class VideoCaptureImpl : public VideoCapture {
+//
+// Dequeued buffers are lent to the callback and queued back to the driver
+// once the lease is released, on whatever thread that happens.
+class VideoCaptureImpl : public VideoCapture, public FrameLender {
  public:
   explicit VideoCaptureImpl(std::filesystem::path video_dev_fpath,
-                            std::function<void(std::span<uint8_t>)> on_frame)
+                            VideoCaptureOptions options,
+                            FrameLeaseCallback on_frame)
       : m_video_dev_fpath(std::move(video_dev_fpath)),
+        m_options(options),
         m_on_frame(std::move(on_frame)) {}
 
   bool initialize() {
+    if (m_options.buffers_count < 2) {
+      LOG_ERROR("Need at least 2 capture buffers, {} asked for",
+                m_options.buffers_count);
+      return false;
+    }
+    if (m_options.export_dmabuf &&
+        m_options.memory != CaptureMemory::mmap) {
+      LOG_ERROR("Only buffers of the driver can be exported as DMABUF");
+      return false;
+    }
+
     // What if we enumrate video devices first and let user select the
     // device.
-    m_v4l_fd = open(m_video_dev_fpath.c_str(), O_RDWR);
+    // Non-blocking: the reactor may report it readable with no frame to
+    // dequeue.
+    m_v4l_fd = open(m_video_dev_fpath.c_str(), O_RDWR | O_NONBLOCK);
     if (m_v4l_fd == -1) {
       LOG_ERROR("failed opening /dev/video0: {}", strerror(errno));
       return false;
@@ -73,9 +103,15 @@ class VideoCaptureImpl : public VideoCapture {
   }
 
  public:
-  virtual ~VideoCaptureImpl() override { close_v4l_fd(); }
+  virtual ~VideoCaptureImpl() override {
+    stop();
+    close_v4l_fd();
+    release_buffers();
+  }
 
   void close_v4l_fd() {
+    // Not while a lease is being returned.
+    std::lock_guard lock(m_requeue_lock);
     if (m_v4l_fd != -1) {
       if (close(m_v4l_fd) == -1) {
         LOG_ERROR("ERROR: failed closing v4l descriptor. Ignoring..");
@@ -145,82 +181,28 @@ class VideoCaptureImpl : public VideoCapture {
   virtual std::vector<std::unique_ptr<AbstractVideoFormatSpec>>
   enumerate_formats() override {
     std::vector<std::unique_ptr<AbstractVideoFormatSpec>> result;
-    struct v4l2_fmtdesc fmtdesc = {0};
-    fmtdesc.index = 0;
+    struct v4l2_fmtdesc fmtdesc {};
     fmtdesc.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
 
-    while (ioctl(m_v4l_fd, VIDIOC_ENUM_FMT, &fmtdesc) == 0) {
-      const char c = fmtdesc.flags & 1 ? 'C' : ' ';
-      const char e = fmtdesc.flags & 2 ? 'E' : ' ';
-
+    for (; ioctl(m_v4l_fd, VIDIOC_ENUM_FMT, &fmtdesc) == 0; fmtdesc.index++) {
+      const char c = fmtdesc.flags & V4L2_FMT_FLAG_COMPRESSED ? 'C' : ' ';
+      const char e = fmtdesc.flags & V4L2_FMT_FLAG_EMULATED ? 'E' : ' ';
       LOG_DEBUG("{}{} {}", c, e, (const char*)fmtdesc.description);
-      fmtdesc.index++;
-
-      result.emplace_back(std::make_unique<Video4LinuxVideoFormat>(
-          Video4LinuxVideoFormat::Basic{.width = 1280, .height = 720},
-          fmtdesc.pixelformat));
-      // result.back()->basic.width = frmsize.discrete.width; //
-      // result.back()->basic.height = frmsize.discrete.height;
-      // result.back()->basic.width = 100;
-      // result.back()->basic.height = 200;
-
-      // Frame sizes
-      struct v4l2_frmsizeenum frmsize {};
-      frmsize.pixel_format = fmtdesc.pixelformat;
-      frmsize.index = 0;
-      std::string sep = "";
-      std::string frame_sizes_s;
-      while (ioctl(m_v4l_fd, VIDIOC_ENUM_FRAMESIZES, &frmsize) >= 0) {
-        if (frmsize.type == V4L2_FRMSIZE_TYPE_DISCRETE) {
-          frame_sizes_s += sep + std::format("{}x{}", frmsize.discrete.width,
-                                             frmsize.discrete.height);
-        } else if (frmsize.type == V4L2_FRMSIZE_TYPE_STEPWISE) {
-          auto this_size =
-              std::format("{}x{} (stepwise)", frmsize.discrete.width,
-                          frmsize.discrete.height);
-          frame_sizes_s += sep + this_size;
-          LOG_DEBUG("{}", this_size);
-        } else {
-          LOG_WARNING("Other framesize type");
-        }
 
-        if (frmsize.type == V4L2_FRMSIZE_TYPE_DISCRETE) {
-          // Frame intervals
-          LOG_DEBUG("Frame intervals for size {}x{}: ", frmsize.discrete.width,
-                    frmsize.discrete.height);
-          struct v4l2_frmivalenum frame_interval {
-            0
-          };
-          frame_interval.index = 0;
-          frame_interval.pixel_format = fmtdesc.pixelformat;
-          frame_interval.width = frmsize.discrete.width;
-          frame_interval.height = frmsize.discrete.height;
-
-          std::string intervals_str;
-          while (ioctl(m_v4l_fd, VIDIOC_ENUM_FRAMEINTERVALS, &frame_interval) ==
-                 0) {
-            if (frame_interval.type == V4L2_FRMIVAL_TYPE_DISCRETE) {
-              LOG_DEBUG("DISCRETE: {}/{}", frame_interval.discrete.numerator,
-                        frame_interval.discrete.denominator);
-              // Accroding to the docs ot makes sense to increase index only for
-              // discrete type.
-              frame_interval.index++;
-            } else if (frame_interval.type == V4L2_FRMIVAL_TYPE_CONTINUOUS) {
-              LOG_DEBUG("CONTINOUS");
-            } else if (frame_interval.type == V4L2_FRMIVAL_TYPE_STEPWISE) {
-              auto& sw = frame_interval.stepwise;
-              LOG_DEBUG("STEPWISE:  MIN: {}/{}, MAX: {}/{}, STEP: {}/{}",
-                        sw.min.numerator, sw.min.denominator, sw.max.numerator,
-                        sw.max.denominator, sw.step.numerator,
-                        sw.step.denominator);
-            }
-          }
-
-        }  // if discrete
-        sep = ", ";
-        frmsize.index++;
+      const auto pixel_format = to_pixel_format(fmtdesc.pixelformat);
+      for (const auto& [width, height] :
+           enumerate_frame_sizes(fmtdesc.pixelformat)) {
+        for (const auto& interval :
+             enumerate_frame_intervals(fmtdesc.pixelformat, width, height)) {
+          result.emplace_back(std::make_unique<Video4LinuxVideoFormat>(
+              Video4LinuxVideoFormat::Basic{.width = width,
+                                            .height = height,
+                                            .pixel_format = pixel_format,
+                                            .interval = interval},
+              fmtdesc.pixelformat));
+          LOG_DEBUG("  {}", to_string(*result.back()));
+        }
       }
-      LOG_DEBUG("Frame sizes: {}", frame_sizes_s);
     }
 
     return result;
@@ -240,8 +222,6 @@ class VideoCaptureImpl : public VideoCapture {
       return false;
     }
 
-    // TODO: why this must be hardcoded? I guess it can be part of public
-    // part of FormatSpec.
     fmt.fmt.pix.width = f.basic.width;
     fmt.fmt.pix.height = f.basic.height;
     fmt.fmt.pix.pixelformat = p->pixel_format;
@@ -251,22 +231,140 @@ class VideoCaptureImpl : public VideoCapture {
       LOG_ERROR("Could not set format description: {}", strerror(errno));
       return false;
     }
+    // The driver adjusts what it cannot do instead of failing.
+    if (fmt.fmt.pix.width != f.basic.width ||
+        fmt.fmt.pix.height != f.basic.height ||
+        fmt.fmt.pix.pixelformat != p->pixel_format) {
+      LOG_ERROR("Device captures {}x{} instead of {}", fmt.fmt.pix.width,
+                fmt.fmt.pix.height, to_string(f));
+      return false;
+    }
+    // Frames are passed on as they are, the encoder expects rows without
+    // padding.
+    if (f.basic.pixel_format) {
+      const uint32_t row_size =
+          *f.basic.pixel_format == PixelFormat::YUV422_packed
+              ? f.basic.width * 2
+              : f.basic.width;
+      if (fmt.fmt.pix.bytesperline != row_size) {
+        LOG_ERROR("Rows of {} are padded to {} bytes", to_string(f),
+                  fmt.fmt.pix.bytesperline);
+        return false;
+      }
+    }
 
-    LOG_DEBUG("Format selected");
+    set_frame_interval(f.basic.interval);
+    LOG_DEBUG("Format selected: {}", to_string(f));
 
     return true;
   }
 
+  static std::optional<PixelFormat> to_pixel_format(uint32_t fourcc) {
+    switch (fourcc) {
+      case V4L2_PIX_FMT_YUYV:
+        return PixelFormat::YUV422_packed;
+      case V4L2_PIX_FMT_YUV422P:
+        return PixelFormat::YUV422_planar;
+      case V4L2_PIX_FMT_YUV420:
+        return PixelFormat::YUV420_planar;
+      case V4L2_PIX_FMT_NV12:
+        return PixelFormat::NV12;
+      default:
+        return std::nullopt;
+    }
+  }
+
+  // Discrete sizes as they are. Out of a range, the common sizes within it
+  // and the largest one.
+  std::vector<std::pair<uint32_t, uint32_t>> enumerate_frame_sizes(
+      uint32_t fourcc) {
+    std::vector<std::pair<uint32_t, uint32_t>> result;
+    struct v4l2_frmsizeenum frmsize {};
+    frmsize.pixel_format = fourcc;
+    for (; ioctl(m_v4l_fd, VIDIOC_ENUM_FRAMESIZES, &frmsize) == 0;
+         frmsize.index++) {
+      if (frmsize.type == V4L2_FRMSIZE_TYPE_DISCRETE) {
+        result.emplace_back(frmsize.discrete.width, frmsize.discrete.height);
+        continue;
+      }
+      // Continuous and stepwise ones come as a single range.
+      const auto& sw = frmsize.stepwise;
+      auto fits = [&](uint32_t width, uint32_t height) {
+        return width >= sw.min_width && width <= sw.max_width &&
+               height >= sw.min_height && height <= sw.max_height &&
+               (width - sw.min_width) % std::max(sw.step_width, 1u) == 0 &&
+               (height - sw.min_height) % std::max(sw.step_height, 1u) == 0;
+      };
+      for (const auto& [width, height] : COMMON_FRAME_SIZES) {
+        if (fits(width, height)) {
+          result.emplace_back(width, height);
+        }
+      }
+      result.emplace_back(sw.max_width, sw.max_height);
+      break;
+    }
+    return result;
+  }
+
+  // Discrete intervals as they are. Out of a range, the shortest and the
+  // longest one.
+  std::vector<FrameInterval> enumerate_frame_intervals(uint32_t fourcc,
+                                                       uint32_t width,
+                                                       uint32_t height) {
+    std::vector<FrameInterval> result;
+    struct v4l2_frmivalenum frmival {};
+    frmival.pixel_format = fourcc;
+    frmival.width = width;
+    frmival.height = height;
+    for (; ioctl(m_v4l_fd, VIDIOC_ENUM_FRAMEINTERVALS, &frmival) == 0;
+         frmival.index++) {
+      if (frmival.type == V4L2_FRMIVAL_TYPE_DISCRETE) {
+        result.push_back({frmival.discrete.numerator,
+                          frmival.discrete.denominator});
+        continue;
+      }
+      const auto& sw = frmival.stepwise;
+      result.push_back({sw.min.numerator, sw.min.denominator});
+      result.push_back({sw.max.numerator, sw.max.denominator});
+      break;
+    }
+    if (result.empty()) {
+      LOG_DEBUG("No frame intervals of {}x{}, assuming 30 fps", width, height);
+      result.push_back({});
+    }
+    return result;
+  }
+
+  void set_frame_interval(FrameInterval interval) {
+    struct v4l2_streamparm parm {};
+    parm.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+    if (ioctl(m_v4l_fd, VIDIOC_G_PARM, &parm) == -1 ||
+        !(parm.parm.capture.capability & V4L2_CAP_TIMEPERFRAME)) {
+      LOG_DEBUG("Frame interval can not be set");
+      return;
+    }
+    parm.parm.capture.timeperframe.numerator = interval.numerator;
+    parm.parm.capture.timeperframe.denominator = interval.denominator;
+    if (ioctl(m_v4l_fd, VIDIOC_S_PARM, &parm) == -1) {
+      LOG_WARNING("Failed setting frame interval: {}", strerror(errno));
+      return;
+    }
+    const FrameInterval actual{parm.parm.capture.timeperframe.numerator,
+                               parm.parm.capture.timeperframe.denominator};
+    if (actual != interval) {
+      LOG_WARNING("Device captures at {} fps instead of {}", actual.fps(),
+                  interval.fps());
+    }
+  }
+
   void start_capture() {
     LOG_DEBUG("Starting capturing");
+    // Sequence starts over with each VIDIOC_STREAMON.
+    m_last_sequence.reset();
 
     struct v4l2_buffer buffer;
     for (size_t i = 0; i < m_allocated_buffers_count; ++i) {
-      memset(&buffer, 0, sizeof(buffer));
-      buffer.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
-      buffer.memory = V4L2_MEMORY_MMAP;
-      buffer.index = i;
-
+      prepare_buffer(buffer, i);
       if (xioctl(m_v4l_fd, VIDIOC_QBUF, &buffer) == -1) {
         LOG_ERROR("IDIOC_QBUF failed for buff {}: {}", i, strerror(errno));
         // TODO: handle errors.
@@ -287,15 +385,33 @@ class VideoCaptureImpl : public VideoCapture {
   bool is_closing() const {
     return m_v4l_fd == -1;
   }
-  // Returns true of frame is read successfully.
-  // TODO: write a message explaining this.
+
+  // For VIDIOC_QBUF of buffer `index`.
+  void prepare_buffer(struct v4l2_buffer& buffer, size_t index) const {
+    memset(&buffer, 0, sizeof(buffer));
+    buffer.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+    buffer.index = index;
+    if (m_options.memory == CaptureMemory::userptr) {
+      buffer.memory = V4L2_MEMORY_USERPTR;
+      buffer.m.userptr =
+          reinterpret_cast<unsigned long>(m_buffers[index].start);
+      buffer.length = m_buffers[index].length;
+    } else {
+      buffer.memory = V4L2_MEMORY_MMAP;
+    }
+  }
+
+  // Returns true if frame is read successfully, false if there was none
+  // ready, empty on errors.
   std::optional<bool> read_frame() {
     static int frame_num = 0;
     struct v4l2_buffer buff;
     memset(&buff, 0, sizeof(buff));
 
     buff.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
-    buff.memory = V4L2_MEMORY_MMAP;
+    buff.memory = m_options.memory == CaptureMemory::userptr
+                      ? V4L2_MEMORY_USERPTR
+                      : V4L2_MEMORY_MMAP;
 
     // read_frame() expected to be called once select reported ready state
     // which means that there are buffers (at least one) ready with frame
@@ -306,13 +422,21 @@ class VideoCaptureImpl : public VideoCapture {
         return std::nullopt;
       }
       if (errno == EAGAIN) {
-        return std::nullopt;
+        return false;
       } else {
         LOG_ERROR("VIDIOC_DQBUF failed: {}", strerror(errno));
         return std::nullopt;
       }
     }
 
+    {
+      std::lock_guard lock(m_requeue_lock);
+      if (--m_queued_buffers == 0) {
+        // Reported readable all the time otherwise, till a lease comes back.
+        m_reactor->set_enabled(m_v4l_fd, false);
+      }
+    }
+
     // NOTE:
     // Processing image means that we may want to do some automated post
     // processing of videostream in order to make things better visible.
@@ -327,23 +451,64 @@ class VideoCaptureImpl : public VideoCapture {
 
     // LOG_DEBUG("Processing image from buffer ({}) ... (simulated) [{}]",
     //           buff.index, frame_num++);
-    const auto buffer_data = static_cast<uint8_t*>(m_buffers[buff.index].start);
-    const size_t buffer_data_size = m_buffers[buff.index].length;
-    m_on_frame({buffer_data, buffer_data + buffer_data_size});
+    const auto& view = m_buffers[buff.index];
+    const auto buffer_data = static_cast<uint8_t*>(view.start);
+    // User pointer buffers are bigger than frames.
+    const size_t buffer_data_size =
+        buff.bytesused != 0 ? buff.bytesused : view.length;
+    // The buffer goes back to the driver with VIDIOC_QBUF in return_frame()
+    // once whoever holds the lease is done with it.
+    m_on_frame(FrameLease{{buffer_data, buffer_data + buffer_data_size},
+                          make_frame_meta(buff),
+                          this,
+                          buff.index,
+                          view.dmabuf_fd});
 
-    // After processing we put the buffer back with VIDIOC_QBUF so it can be
-    // used.
-    if (xioctl(m_v4l_fd, VIDIOC_QBUF, &buff) == -1) {
-      if (is_closing()) {
-        return std::nullopt;
+    return true;
+  }
+
+  CapturedFrameMeta make_frame_meta(const struct v4l2_buffer& buff) {
+    // Time the driver took the frame, usually at the end of exposure. It is
+    // CLOCK_MONOTONIC, which steady_clock is on Linux.
+    std::optional<std::chrono::steady_clock::time_point> timestamp;
+    if ((buff.flags & V4L2_BUF_FLAG_TIMESTAMP_MASK) ==
+        V4L2_BUF_FLAG_TIMESTAMP_MONOTONIC) {
+      timestamp = std::chrono::steady_clock::time_point{
+          std::chrono::seconds{buff.timestamp.tv_sec} +
+          std::chrono::microseconds{buff.timestamp.tv_usec}};
+    }
+
+    // Driver counts frames it had no buffer for too.
+    uint32_t dropped_before = 0;
+    if (m_last_sequence) {
+      const uint32_t gap = buff.sequence - *m_last_sequence;
+      if (gap > 1 && gap < (uint32_t{1} << 31)) {
+        dropped_before = gap - 1;
+        LOG_DEBUG("Driver dropped {} frames before {}", dropped_before,
+                  buff.sequence);
       }
+    }
+    m_last_sequence = buff.sequence;
+
+    return make_captured_frame_meta(buff.sequence, dropped_before, timestamp);
+  }
 
+  virtual void return_frame(size_t slot) override {
+    struct v4l2_buffer buff;
+    prepare_buffer(buff, slot);
+
+    std::lock_guard lock(m_requeue_lock);
+    if (is_closing()) {
+      return;
+    }
+    if (xioctl(m_v4l_fd, VIDIOC_QBUF, &buff) == -1) {
+      // TODO: handle error, the buffer is lost to capture.
       LOG_ERROR("VIDIOC_QBUF failed: {}", strerror(errno));
-      // TODO: handle error.
-      return std::nullopt;
+      return;
+    }
+    if (m_queued_buffers++ == 0) {
+      m_reactor->set_enabled(m_v4l_fd, true);
     }
-
-    return true;
   }
 
   virtual void start() override {
@@ -356,29 +521,66 @@ class VideoCaptureImpl : public VideoCapture {
 
     LOG_DEBUG("Initializing device buffers");
 
+    const bool buffers_ready = m_options.memory == CaptureMemory::userptr
+                                   ? allocate_user_buffers()
+                                   : map_device_buffers();
+    if (!buffers_ready) {
+      // TODO: report error via error code.
+      release_buffers();
+      return;
+    }
+
+    LOG_DEBUG("Device buffers initialized");
+
+    start_capture();
+
+    m_queued_buffers = m_allocated_buffers_count;
+    m_reactor = m_options.reactor;
+    if (!m_reactor) {
+      m_reactor = make_capture_reactor();
+      if (!m_reactor) {
+        // TODO: report error via error code.
+        return;
+      }
+    }
+    if (auto ec = m_reactor->add(m_v4l_fd, [this] { on_readable(); })) {
+      LOG_ERROR("Failed waiting for frames: {}", ec.message());
+      m_reactor.reset();
+    }
+  }
+
+  // On the reactor thread.
+  void on_readable() {
+    if (auto maybe_res = read_frame(); !maybe_res && !is_closing()) {
+      LOG_ERROR("read_frame failed, capture stops");
+      // TODO: report error.
+      m_reactor->remove(m_v4l_fd);
+    }
+  }
+
+  // Buffers of the driver, mapped into our memory.
+  bool map_device_buffers() {
     struct v4l2_requestbuffers reqbuf;
 
     memset(&reqbuf, 0, sizeof(reqbuf));
     reqbuf.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
     reqbuf.memory = V4L2_MEMORY_MMAP;
-    reqbuf.count = V4L_BUFFERS_COUNT;
+    reqbuf.count = m_options.buffers_count;
 
     if (ioctl(m_v4l_fd, VIDIOC_REQBUFS, &reqbuf) == -1) {
       if (errno == EINVAL) {
         LOG_ERROR("Video capturing or mmap-streaming is not supported: {}",
                   strerror(errno));
       } else {
-        // TODO: report error via error code.
         LOG_ERROR("VIDIOC_REQBUFS failed: {}", strerror(errno));
-        return;
       }
+      return false;
     }
 
-    if (reqbuf.count < 5) {
+    if (reqbuf.count < 2) {
       LOG_ERROR("Failed allocating all requested buffers: {}", strerror(errno));
-      // TODO: report error via error code.
-      return;
-    } else if (reqbuf.count < V4L_BUFFERS_COUNT) {
+      return false;
+    } else if (reqbuf.count < m_options.buffers_count) {
       LOG_WARNING("Not all buffers have been allocated");
     }
 
@@ -396,86 +598,130 @@ class VideoCaptureImpl : public VideoCapture {
       // Request buffer information
       if (ioctl(m_v4l_fd, VIDIOC_QUERYBUF, &buffer)) {
         LOG_ERROR("VIDIOC_QUERYBUF failed for {}: {}", i, strerror(errno));
-        // TODO: report error.
-        return;
+        return false;
       }
 
-      m_buffers[i].length = buffer.length;
-      m_buffers[i].start = mmap(NULL, buffer.length, PROT_READ | PROT_WRITE,
-                                MAP_SHARED, m_v4l_fd, buffer.m.offset);
-      if (m_buffers[i].start == MAP_FAILED) {
+      void* start = mmap(NULL, buffer.length, PROT_READ | PROT_WRITE,
+                         MAP_SHARED, m_v4l_fd, buffer.m.offset);
+      if (start == MAP_FAILED) {
         LOG_ERROR("mmap of buffer {} failed: {}", i, strerror(errno));
-        // TODO: report error.
-        return;
+        return false;
       }
+      m_buffers[i].start = start;
+      m_buffers[i].length = buffer.length;
 
       LOG_DEBUG("Mapped buffer {}", i);
-    }
 
-    LOG_DEBUG("Device buffers initialized");
+      if (m_options.export_dmabuf) {
+        struct v4l2_exportbuffer expbuf;
+        memset(&expbuf, 0, sizeof(expbuf));
+        expbuf.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+        expbuf.index = i;
+        expbuf.flags = O_RDONLY | O_CLOEXEC;
+        if (xioctl(m_v4l_fd, VIDIOC_EXPBUF, &expbuf) == -1) {
+          LOG_ERROR("VIDIOC_EXPBUF failed for {}: {}", i, strerror(errno));
+          return false;
+        }
+        m_buffers[i].dmabuf_fd = expbuf.fd;
+      }
+    }
 
     m_allocated_buffers_count = allocated_buffers_count;
+    return true;
+  }
 
-    start_capture();
+  // Buffers of our own the driver writes frames into, on huge pages if there
+  // are any reserved, transparent huge pages otherwise. Not every driver can
+  // do that.
+  bool allocate_user_buffers() {
+    struct v4l2_format fmt;
+    memset(&fmt, 0, sizeof(fmt));
+    fmt.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+    if (ioctl(m_v4l_fd, VIDIOC_G_FMT, &fmt) == -1) {
+      LOG_ERROR("VIDIOC_G_FMT failed: {}", strerror(errno));
+      return false;
+    }
 
-    m_working_thread = std::jthread{[this](std::stop_token stoken) {
-      // Reading loop.
-      while (!stoken.stop_requested()) {
-        fd_set fds;
-        struct timeval tv;
-
-        FD_ZERO(&fds);
-        FD_SET(m_v4l_fd, &fds);
-        tv.tv_sec = 2;
-        tv.tv_usec = 0;
-
-        int r = select(m_v4l_fd + 1, &fds, NULL, NULL, &tv);
-        if (r == -1) {
-          if (errno == EINTR) {
-            continue;
-          } else {
-            LOG_ERROR("select failed: {}", r);
-            // TODO: handle error.
-            return;
-          }
-        } else if (r == 0) {
-          LOG_ERROR("select timeout");
-          // TODO: handle error.
-          return;
-        }
+    struct v4l2_requestbuffers reqbuf;
+    memset(&reqbuf, 0, sizeof(reqbuf));
+    reqbuf.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+    reqbuf.memory = V4L2_MEMORY_USERPTR;
+    reqbuf.count = m_options.buffers_count;
+    if (ioctl(m_v4l_fd, VIDIOC_REQBUFS, &reqbuf) == -1) {
+      LOG_ERROR("User pointer streaming is not supported: {}",
+                strerror(errno));
+      return false;
+    }
+    if (reqbuf.count < 2) {
+      LOG_ERROR("Failed allocating all requested buffers");
+      return false;
+    }
 
-        if (auto maybe_res = read_frame(); maybe_res) {
-          if (!*maybe_res) {
-            // TODO: *************** ???????????? ******************
-          }
-        } else if (!is_closing()) {
-          LOG_ERROR("read_frame failed");
-          // TODO: handle error.
-          return;
+    const size_t length = (fmt.fmt.pix.sizeimage + HUGE_PAGE_SIZE - 1) /
+                          HUGE_PAGE_SIZE * HUGE_PAGE_SIZE;
+    m_buffers.resize(reqbuf.count);
+    for (auto& b : m_buffers) {
+      void* start = mmap(nullptr, length, PROT_READ | PROT_WRITE,
+                         MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+      if (start == MAP_FAILED) {
+        start = mmap(nullptr, length, PROT_READ | PROT_WRITE,
+                     MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if (start == MAP_FAILED) {
+          LOG_ERROR("Failed allocating capture buffer: {}", strerror(errno));
+          return false;
         }
+        madvise(start, length, MADV_HUGEPAGE);
       }
-      LOG_DEBUG("Capture worker thread has stopped");
-    }};
+      b.start = start;
+      b.length = length;
+    }
+
+    LOG_DEBUG("Allocated {} buffers of {} bytes", m_buffers.size(), length);
+    m_allocated_buffers_count = reqbuf.count;
+    return true;
+  }
+
+  // Driver must be done with them: streaming off or device closed.
+  void release_buffers() {
+    for (auto& b : m_buffers) {
+      if (b.dmabuf_fd != -1) {
+        close(b.dmabuf_fd);
+      }
+      if (b.start) {
+        munmap(b.start, b.length);
+      }
+    }
+    m_buffers.clear();
+    m_allocated_buffers_count = 0;
   }
 
   virtual void stop() override {
-    if (m_working_thread.joinable()) {
-      LOG_DEBUG("Requesting worker thread to stop");
-      m_working_thread.request_stop();
-      // Closing v4l to unblock select.
+    if (m_reactor) {
+      LOG_DEBUG("Stopping capture");
+      // No frames are passed to the callback once it returns.
+      m_reactor->remove(m_v4l_fd);
+      // Leases returned later see it closed.
       close_v4l_fd();
-      m_working_thread.join();
+      m_reactor.reset();
     }
   }
 
  private:
   std::filesystem::path m_video_dev_fpath;
+  VideoCaptureOptions m_options;
   int m_v4l_fd{-1};
   unsigned m_allocated_buffers_count{};
   // Buffers we are sharing with v4l driver.
   std::vector<BufferView> m_buffers;
-  std::function<void(std::span<uint8_t>)> m_on_frame;
-  std::jthread m_working_thread;
+  // Keeps the descriptor from closing under VIDIOC_QBUF of a lease, and
+  // guards the count below.
+  std::mutex m_requeue_lock;
+  // Owned by the driver. None means there is nothing to wait for.
+  unsigned m_queued_buffers{};
+  FrameLeaseCallback m_on_frame;
+  std::shared_ptr<CaptureReactor> m_reactor;
+  // Of the last frame dequeued.
+  std::optional<uint32_t> m_last_sequence;
 };
 
 // TODO: make it a free function.
@@ -493,11 +739,131 @@ std::vector<std::filesystem::path> enumerate_video4_linux_devices() {
   return result;
 }
 
-std::unique_ptr<VideoCapture> make_video_capture(
-    std::filesystem::path p,
-    std::function<void(std::span<uint8_t>)> on_frame) {
-  auto impl =
-      std::make_unique<VideoCaptureImpl>(std::move(p), std::move(on_frame));
+std::string to_string(const AbstractVideoFormatSpec& format) {
+  return std::format(
+      "{} {}x{} @ {:.4g} fps",
+      format.basic.pixel_format ? to_string(*format.basic.pixel_format)
+                                : "unsupported",
+      format.basic.width, format.basic.height, format.basic.interval.fps());
+}
+
+const AbstractVideoFormatSpec* choose_format(
+    const std::vector<std::unique_ptr<AbstractVideoFormatSpec>>& formats,
+    const FormatPreferences& preferences) {
+  // Rough cost of x264 with "faster" preset on a single core: ~9 ms for a 720p
+  // YUYV frame.
+  constexpr double ENCODE_SECONDS_PER_BYTE = 5e-9;
+
+  struct Candidate {
+    const AbstractVideoFormatSpec* format;
+    double fps;
+    size_t pixels;
+    size_t bytes;
+  };
+  std::vector<Candidate> candidates;
+  std::vector<Candidate> preferred;
+  for (const auto& format : formats) {
+    const auto& basic = format->basic;
+    if (!basic.pixel_format || basic.width > preferences.max_width ||
+        basic.height > preferences.max_height) {
+      continue;
+    }
+    const Candidate candidate{
+        .format = format.get(),
+        .fps = basic.interval.fps(),
+        .pixels = size_t{basic.width} * basic.height,
+        .bytes =
+            frame_size(*basic.pixel_format, basic.width, basic.height)};
+    candidates.push_back(candidate);
+    if (basic.width >= preferences.min_width &&
+        basic.height >= preferences.min_height &&
+        candidate.fps >= preferences.min_fps) {
+      preferred.push_back(candidate);
+    }
+  }
+  if (!preferred.empty()) {
+    candidates = std::move(preferred);
+  }
+
+  // Whether `a` is better than `b`.
+  auto better = [&](const Candidate& a, const Candidate& b) {
+    switch (preferences.policy) {
+      case FormatPolicy::max_fps:
+        return std::tuple{a.fps, a.pixels, -static_cast<double>(a.bytes)} >
+               std::tuple{b.fps, b.pixels, -static_cast<double>(b.bytes)};
+      case FormatPolicy::min_latency: {
+        auto latency = [&](const Candidate& c) {
+          return (c.fps > 0 ? 1 / c.fps : 0) +
+                 c.bytes * ENCODE_SECONDS_PER_BYTE;
+        };
+        return std::tuple{latency(a), b.pixels} <
+               std::tuple{latency(b), a.pixels};
+      }
+      case FormatPolicy::min_cpu:
+        return std::tuple{a.bytes * a.fps, b.pixels} <
+               std::tuple{b.bytes * b.fps, a.pixels};
+    }
+    return false;
+  };
+  const auto best =
+      std::min_element(candidates.begin(), candidates.end(), better);
+  return best == candidates.end() ? nullptr : best->format;
+}
+
+CapturedFrameMeta make_captured_frame_meta(
+    uint32_t sequence,
+    uint32_t dropped_before,
+    std::optional<std::chrono::steady_clock::time_point> timestamp) {
+  static Counter& frames_captured = metrics().counter(
+      "ns_frames_captured_total", "Frames out of video captures.");
+  static Counter& frames_lost = metrics().counter(
+      "ns_capture_frames_lost_total",
+      "Frames video captures lost before they were dequeued.");
+  static HdrHistogram& dequeue_delay = metrics().histogram(
+      "ns_capture_dequeue_delay_us",
+      "Time from driver timestamp till the frame was dequeued, in "
+      "microseconds.");
+
+  const auto now = std::chrono::steady_clock::now();
+  if (timestamp) {
+    dequeue_delay.record(static_cast<uint64_t>(std::max<int64_t>(
+        std::chrono::duration_cast<std::chrono::microseconds>(now - *timestamp)
+            .count(),
+        0)));
+  }
+  const auto captured = timestamp.value_or(now);
+  const auto id = frame_id(captured);
+  frames_captured.add();
+  frames_lost.add(dropped_before);
+  trace_frame(id, TraceStage::captured, captured);
+  return CapturedFrameMeta{.timestamp = captured,
+                           .frame_id = id,
+                           .sequence = sequence,
+                           .dropped_before = dropped_before};
+}
+
+FrameLeaseCallback lease_for_call(VideoFrameCallback on_frame) {
+  return [on_frame = std::move(on_frame)](FrameLease frame) {
+    on_frame(frame.data(), frame.meta());
+  };
+}
+
+std::unique_ptr<VideoCapture> make_video_capture(std::filesystem::path p,
+                                                 VideoFrameCallback on_frame) {
+  return make_video_capture(std::move(p), lease_for_call(std::move(on_frame)));
+}
+
+std::unique_ptr<VideoCapture> make_video_capture(std::filesystem::path p,
+                                                 FrameLeaseCallback on_frame) {
+  return make_video_capture(std::move(p), VideoCaptureOptions{},
+                            std::move(on_frame));
+}
+
+std::unique_ptr<VideoCapture> make_video_capture(std::filesystem::path p,
+                                                 VideoCaptureOptions options,
+                                                 FrameLeaseCallback on_frame) {
+  auto impl = std::make_unique<VideoCaptureImpl>(std::move(p), options,
+                                                 std::move(on_frame));
   if (!impl->initialize()) {
     LOG_ERROR("failed initializing video capture");
     return nullptr;
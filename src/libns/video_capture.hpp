@@ -4,8 +4,13 @@
 #include <filesystem>
 #include <functional>
 #include <memory>
+#include <optional>
+#include <span>
+#include <string>
 #include <vector>
 
+#include "capture_reactor.hpp"
+#include "frame_mailbox.hpp"
 #include "types.hpp"
 
 // This video format spec in fact should be retrieved from enumeration phase.
@@ -19,6 +24,9 @@ struct AbstractVideoFormatSpec {
   struct Basic {
     uint32_t width{};
     uint32_t height{};
+    // Not set for formats the encoder does not take, e.g. MJPEG.
+    std::optional<PixelFormat> pixel_format;
+    FrameInterval interval;
   } basic;
   AbstractVideoFormatSpec(Basic basic) : basic(basic) {}
 };
@@ -28,15 +36,152 @@ class VideoCapture {
   virtual ~VideoCapture() = default;
 
   virtual void print_capabilities() = 0;
+  // Every pixel format, frame size and frame interval the capture offers.
   virtual std::vector<std::unique_ptr<AbstractVideoFormatSpec>>
   enumerate_formats() = 0;
+  // One of enumerate_formats(). Fails if the device would capture frames of
+  // another size or pixel format, a different frame rate is only warned about.
   virtual bool select_format(const AbstractVideoFormatSpec&) = 0;
   virtual void start() = 0;
   virtual void stop() = 0;
 };
 
+// E.g. "NV12 1280x720 @ 30 fps".
+std::string to_string(const AbstractVideoFormatSpec& format);
+
+// What choose_format() goes for.
+enum class FormatPolicy {
+  // Highest frame rate, then the largest frames.
+  max_fps,
+  // Least time from the start of exposure till the frame is encoded: the frame
+  // interval plus the time to encode the frame, which grows with its size.
+  min_latency,
+  // Fewest bytes per second to encode.
+  min_cpu
+};
+
+struct FormatPreferences {
+  FormatPolicy policy = FormatPolicy::min_latency;
+  // Frames larger than that are never chosen.
+  uint32_t max_width = 1280;
+  uint32_t max_height = 720;
+  // Smaller frames and lower frame rates are chosen only if there is nothing
+  // else.
+  uint32_t min_width = 640;
+  uint32_t min_height = 360;
+  double min_fps = 15;
+};
+
+// Out of `formats` of a capture, the one the encoder takes that `preferences`
+// like best, nullptr if the encoder takes none of them.
+const AbstractVideoFormatSpec* choose_format(
+    const std::vector<std::unique_ptr<AbstractVideoFormatSpec>>& formats,
+    const FormatPreferences& preferences = {});
+
+// Called on the capture thread with a frame of the selected format, packed
+// YUYV 4:2:2 unless a capture says otherwise, the data is valid only for the
+// time of the call.
+using VideoFrameCallback =
+    std::function<void(std::span<uint8_t>, CapturedFrameMeta)>;
+// Same, but the frame stays valid till the lease is released, e.g. by the
+// encoder thread taking it from FrameMailbox. Captures have a few buffers
+// only: while all of them are leased out, frames are not captured.
+using FrameLeaseCallback = std::function<void(FrameLease)>;
+
 std::vector<std::filesystem::path> enumerate_video4_linux_devices();
 
-std::unique_ptr<VideoCapture> make_video_capture(
+// Where Video4Linux capture buffers come from.
+enum class CaptureMemory {
+  // Allocated by the driver and mapped into our memory.
+  mmap,
+  // Allocated by us, page aligned and on huge pages where possible, and
+  // filled by the driver. Not every driver supports it.
+  userptr
+};
+
+struct VideoCaptureOptions {
+  CaptureMemory memory = CaptureMemory::mmap;
+  // Asked for, the driver may give fewer. Those leased out are not available
+  // to the driver.
+  unsigned buffers_count = 5;
+  // Exports buffers as DMABUF, see FrameLease::dmabuf_fd(). Only buffers of
+  // the driver can be exported.
+  bool export_dmabuf = false;
+  // Thread frames are dequeued and passed to the callback on, may be shared
+  // by several captures. A reactor of its own if not set.
+  std::shared_ptr<CaptureReactor> reactor;
+};
+
+std::unique_ptr<VideoCapture> make_video_capture(std::filesystem::path p,
+                                                 VideoFrameCallback on_frame);
+std::unique_ptr<VideoCapture> make_video_capture(std::filesystem::path p,
+                                                 FrameLeaseCallback on_frame);
+std::unique_ptr<VideoCapture> make_video_capture(std::filesystem::path p,
+                                                 VideoCaptureOptions options,
+                                                 FrameLeaseCallback on_frame);
+
+// Frames of file and synthetic captures below are produced by their own
+// thread, paced to the frame rate. Frame rate of zero means as fast as the
+// callback returns.
+
+struct FileVideoCaptureOptions {
+  // Of raw files. Y4M ones say it in their header.
+  uint32_t width = 1280;
+  uint32_t height = 720;
+  // Frame rate of the file if it is Y4M, 30 otherwise, if not set.
+  std::optional<double> fps;
+  // Starts over at the end of the file, otherwise capture stops there.
+  bool loop = true;
+};
+
+// Replays a file: either raw YUYV frames back to back (e.g. what ffmpeg
+// writes with -f rawvideo -pix_fmt yuyv422), or Y4M with 4:2:0 or 4:2:2
+// planar frames. Raw frames are passed straight from the mapped file, Y4M ones
+// are converted into YUYV first.
+std::unique_ptr<VideoCapture> make_file_video_capture(
     std::filesystem::path p,
-    std::function<void(std::span<uint8_t>)> on_frame);
+    FileVideoCaptureOptions options,
+    VideoFrameCallback on_frame);
+std::unique_ptr<VideoCapture> make_file_video_capture(
+    std::filesystem::path p,
+    FileVideoCaptureOptions options,
+    FrameLeaseCallback on_frame);
+
+enum class SyntheticPattern {
+  // Color bars sliding sideways.
+  moving_bars,
+  // Box bouncing around a gradient.
+  bouncing_box,
+  // Random pixels, nothing is predictable. Worst case for the encoder.
+  noise
+};
+
+struct SyntheticVideoCaptureOptions {
+  uint32_t width = 1280;
+  uint32_t height = 720;
+  double fps = 30;
+  SyntheticPattern pattern = SyntheticPattern::moving_bars;
+  // Of moving patterns.
+  uint32_t pixels_per_frame = 4;
+  // Capture stops after that many frames unless it is zero.
+  uint64_t frame_count = 0;
+};
+
+// Generates frames, the same ones every run.
+std::unique_ptr<VideoCapture> make_synthetic_video_capture(
+    SyntheticVideoCaptureOptions options,
+    VideoFrameCallback on_frame);
+std::unique_ptr<VideoCapture> make_synthetic_video_capture(
+    SyntheticVideoCaptureOptions options,
+    FrameLeaseCallback on_frame);
+
+// For VideoCapture implementations: metadata of frame `sequence`, captured at
+// `timestamp` or, if not known, right now. Counts and traces the frame.
+CapturedFrameMeta make_captured_frame_meta(
+    uint32_t sequence,
+    uint32_t dropped_before = 0,
+    std::optional<std::chrono::steady_clock::time_point> timestamp = {});
+
+// For VideoCapture implementations: passes frames to `on_frame` and releases
+// them as soon as it returns.
+FrameLeaseCallback lease_for_call(VideoFrameCallback on_frame);
@@ -0,0 +1,596 @@
+// VideoCapture implementations that need no camera: file replay and
+// synthetic patterns.
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <algorithm>
+#include <array>
+#include <cassert>
+#include <cmath>
+#include <charconv>
+#include <condition_variable>
+#include <cstring>
+#include <mutex>
+#include <string_view>
+#include <thread>
+
+#include "defs.hpp"
+#include "log.hpp"
+#include "video_capture.hpp"
+
+LOG_MODULE_NAME("CAPTURE");
+
+namespace {
+struct SourceVideoFormat : public AbstractVideoFormatSpec {
+  using AbstractVideoFormatSpec::AbstractVideoFormatSpec;
+};
+
+// Produces frames of a subclass on a thread of its own, one per frame period.
+// If the callback is late, frames do not pile up: the next one is due one
+// period after the late one. Frames are drawn into a few buffers lent to the
+// callback in turn. Subclasses must stop() in their destructors, the thread
+// calls them.
+class GeneratedVideoCapture : public VideoCapture, public FrameLender {
+ public:
+  GeneratedVideoCapture(double fps, FrameLeaseCallback on_frame)
+      : m_fps(fps), m_on_frame(std::move(on_frame)) {}
+
+  virtual void print_capabilities() override {
+    LOG_DEBUG("{}, {}x{} YUYV at {} fps", description(), m_width, m_height,
+              m_fps);
+  }
+
+  virtual std::vector<std::unique_ptr<AbstractVideoFormatSpec>>
+  enumerate_formats() override {
+    std::vector<std::unique_ptr<AbstractVideoFormatSpec>> result;
+    // Whole frames per 1000 seconds, as close as it gets to fractional rates.
+    const FrameInterval interval{
+        m_fps > 0 ? 1000u : 0u,
+        static_cast<uint32_t>(std::lround(m_fps * 1000))};
+    result.emplace_back(std::make_unique<SourceVideoFormat>(
+        AbstractVideoFormatSpec::Basic{
+            .width = m_width,
+            .height = m_height,
+            .pixel_format = PixelFormat::YUV422_packed,
+            .interval = interval}));
+    return result;
+  }
+
+  virtual bool select_format(const AbstractVideoFormatSpec& f) override {
+    if (f.basic.width != m_width || f.basic.height != m_height ||
+        f.basic.pixel_format != PixelFormat::YUV422_packed) {
+      LOG_ERROR("{} has only {}x{} YUYV frames", description(), m_width,
+                m_height);
+      return false;
+    }
+    return true;
+  }
+
+  virtual void start() override {
+    assert(!m_working_thread.joinable());
+    for (auto& slot : m_slots) {
+      slot.data.resize(size_t{m_width} * m_height * 2);
+    }
+    m_working_thread =
+        std::jthread{[this](std::stop_token stoken) { run(stoken); }};
+  }
+
+  virtual void stop() override {
+    if (m_working_thread.joinable()) {
+      m_working_thread.request_stop();
+      m_working_thread.join();
+    }
+  }
+
+  virtual void return_frame(size_t slot) override {
+    {
+      std::lock_guard lock(m_slots_lock);
+      m_slots[slot].leased = false;
+    }
+    m_slot_returned.notify_one();
+  }
+
+ protected:
+  // Next frame, empty once there are no more. Either drawn into `buffer` of
+  // frame size, or data of its own that stays valid as long as the capture.
+  virtual std::span<uint8_t> next_frame(std::span<uint8_t> buffer) = 0;
+  virtual std::string description() const = 0;
+
+  uint32_t m_width{};
+  uint32_t m_height{};
+  double m_fps{};
+
+ private:
+  void run(std::stop_token stoken) {
+    using clock = std::chrono::steady_clock;
+    const auto period =
+        m_fps > 0 ? std::chrono::duration_cast<clock::duration>(
+                        std::chrono::duration<double>{1 / m_fps})
+                  : clock::duration{};
+    auto deadline = clock::now();
+    std::mutex lock;
+    std::condition_variable_any wake;
+    while (!stoken.stop_requested()) {
+      if (period > clock::duration{}) {
+        // Nobody notifies, only stop requests wake it up early.
+        std::unique_lock locked{lock};
+        wake.wait_until(locked, stoken, deadline, [] { return false; });
+        if (stoken.stop_requested()) {
+          break;
+        }
+        deadline = std::max(deadline + period, clock::now());
+      }
+
+      // Like a camera out of buffers, stalls while all frames are leased out.
+      const auto slot = acquire_slot(stoken);
+      if (!slot) {
+        break;
+      }
+      const auto frame = next_frame(m_slots[*slot].data);
+      if (frame.empty()) {
+        LOG_INFO("{} has no more frames", description());
+        return_frame(*slot);
+        break;
+      }
+      if (frame.data() == m_slots[*slot].data.data()) {
+        m_on_frame(FrameLease{frame, make_captured_frame_meta(m_sequence++),
+                              this, *slot});
+      } else {
+        return_frame(*slot);
+        m_on_frame(FrameLease{frame, make_captured_frame_meta(m_sequence++)});
+      }
+    }
+    LOG_DEBUG("Capture worker thread has stopped");
+  }
+
+  // Empty once stop is requested.
+  std::optional<size_t> acquire_slot(std::stop_token stoken) {
+    std::unique_lock lock(m_slots_lock);
+    auto free_slot = [this] {
+      return std::find_if(m_slots.begin(), m_slots.end(),
+                          [](const Slot& s) { return !s.leased; });
+    };
+    if (!m_slot_returned.wait(lock, stoken,
+                              [&] { return free_slot() != m_slots.end(); })) {
+      return std::nullopt;
+    }
+    const auto slot = free_slot();
+    slot->leased = true;
+    return slot - m_slots.begin();
+  }
+
+  // Frame buffers, enough for one in the mailbox, one being encoded and one
+  // being drawn.
+  struct Slot {
+    std::vector<uint8_t> data;
+    bool leased{};
+  };
+  std::mutex m_slots_lock;
+  std::condition_variable_any m_slot_returned;
+  std::array<Slot, 3> m_slots;
+  uint32_t m_sequence{};
+  FrameLeaseCallback m_on_frame;
+  std::jthread m_working_thread;
+};
+
+// Y4M header: "YUV4MPEG2" followed by space separated parameters, each a
+// letter and a value. Frames are "FRAME" line followed by planes.
+struct Y4M_Header {
+  uint32_t width{};
+  uint32_t height{};
+  std::optional<double> fps;
+  // Otherwise 4:2:2.
+  bool chroma_420 = true;
+};
+
+expected<Y4M_Header> parse_y4m_header(std::string_view line) {
+  constexpr std::string_view SIGNATURE = "YUV4MPEG2";
+  if (!line.starts_with(SIGNATURE)) {
+    return unexpected{make_error_code(std::errc::invalid_argument)};
+  }
+  line.remove_prefix(SIGNATURE.size());
+
+  auto parse_number = [](std::string_view s, uint32_t& out) {
+    const auto [ptr, ec] = std::from_chars(s.data(), s.data() + s.size(), out);
+    return ec == std::errc{} && ptr == s.data() + s.size();
+  };
+
+  Y4M_Header header;
+  while (!line.empty()) {
+    const auto end = std::min(line.find(' ', 1), line.size());
+    auto token = line.substr(0, end);
+    line.remove_prefix(end);
+    if (token.starts_with(' ')) {
+      token.remove_prefix(1);
+    }
+    if (token.empty()) {
+      continue;
+    }
+    const auto value = token.substr(1);
+    switch (token[0]) {
+      case 'W':
+        if (!parse_number(value, header.width)) {
+          return unexpected{make_error_code(std::errc::invalid_argument)};
+        }
+        break;
+      case 'H':
+        if (!parse_number(value, header.height)) {
+          return unexpected{make_error_code(std::errc::invalid_argument)};
+        }
+        break;
+      case 'F': {
+        const auto colon = value.find(':');
+        uint32_t num{};
+        uint32_t den{};
+        if (colon == std::string_view::npos ||
+            !parse_number(value.substr(0, colon), num) ||
+            !parse_number(value.substr(colon + 1), den) || den == 0) {
+          return unexpected{make_error_code(std::errc::invalid_argument)};
+        }
+        header.fps = static_cast<double>(num) / den;
+        break;
+      }
+      case 'C':
+        if (value.starts_with("420")) {
+          header.chroma_420 = true;
+        } else if (value == "422") {
+          header.chroma_420 = false;
+        } else {
+          return unexpected{make_error_code(std::errc::not_supported)};
+        }
+        break;
+      default:
+        // Interlacing, aspect ratio and extensions do not matter to us.
+        break;
+    }
+  }
+  if (header.width == 0 || header.height == 0 || header.width % 2 != 0) {
+    return unexpected{make_error_code(std::errc::invalid_argument)};
+  }
+  return header;
+}
+
+// Interleaves planar 4:2:0 or 4:2:2 into YUYV. 4:2:0 chroma rows are used
+// twice.
+void planar_to_yuyv(const uint8_t* planes,
+                    uint32_t width,
+                    uint32_t height,
+                    bool chroma_420,
+                    uint8_t* out) {
+  const size_t chroma_width = width / 2;
+  const size_t chroma_height = chroma_420 ? (height + 1) / 2 : height;
+  const uint8_t* y_plane = planes;
+  const uint8_t* u_plane = y_plane + size_t{width} * height;
+  const uint8_t* v_plane = u_plane + chroma_width * chroma_height;
+  for (size_t row = 0; row < height; ++row) {
+    const size_t chroma_row = chroma_420 ? row / 2 : row;
+    const uint8_t* y = y_plane + row * width;
+    const uint8_t* u = u_plane + chroma_row * chroma_width;
+    const uint8_t* v = v_plane + chroma_row * chroma_width;
+    for (size_t x = 0; x < chroma_width; ++x) {
+      out[0] = y[2 * x];
+      out[1] = u[x];
+      out[2] = y[2 * x + 1];
+      out[3] = v[x];
+      out += 4;
+    }
+  }
+}
+
+class FileVideoCapture : public GeneratedVideoCapture {
+ public:
+  FileVideoCapture(std::filesystem::path path,
+                   FileVideoCaptureOptions options,
+                   FrameLeaseCallback on_frame)
+      : GeneratedVideoCapture(options.fps.value_or(30), std::move(on_frame)),
+        m_path(std::move(path)),
+        m_options(options) {}
+
+  ~FileVideoCapture() override {
+    stop();
+    if (m_data != MAP_FAILED) {
+      munmap(m_data, m_size);
+    }
+  }
+
+  bool initialize() {
+    const int fd = open(m_path.c_str(), O_RDONLY);
+    if (fd == -1) {
+      LOG_ERROR("Failed opening {}: {}", m_path.string(), strerror(errno));
+      return false;
+    }
+    struct stat st {};
+    if (fstat(fd, &st) == -1 || st.st_size == 0) {
+      LOG_ERROR("Failed getting size of {}: {}", m_path.string(),
+                st.st_size == 0 ? "empty" : strerror(errno));
+      close(fd);
+      return false;
+    }
+    m_size = static_cast<size_t>(st.st_size);
+    // Private and writable: the callback gets non-const data, whatever it
+    // writes stays in its own copy of the page.
+    m_data = mmap(nullptr, m_size, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (m_data == MAP_FAILED) {
+      LOG_ERROR("Failed mapping {}: {}", m_path.string(), strerror(errno));
+      return false;
+    }
+    madvise(m_data, m_size, MADV_SEQUENTIAL);
+
+    const std::string_view contents{static_cast<const char*>(m_data), m_size};
+    if (contents.starts_with("YUV4MPEG2")) {
+      return index_y4m(contents);
+    }
+
+    m_width = m_options.width;
+    m_height = m_options.height;
+    const size_t frame_size = size_t{m_width} * m_height * 2;
+    for (size_t offset = 0; offset + frame_size <= m_size;
+         offset += frame_size) {
+      m_frames.push_back(offset);
+    }
+    if (m_frames.empty()) {
+      LOG_ERROR("{} is smaller than a {}x{} YUYV frame", m_path.string(),
+                m_width, m_height);
+      return false;
+    }
+    m_frame_size = frame_size;
+    if (m_size % frame_size != 0) {
+      LOG_WARNING("{} ends with a partial frame, ignoring it",
+                  m_path.string());
+    }
+    return true;
+  }
+
+ protected:
+  virtual std::span<uint8_t> next_frame(std::span<uint8_t> buffer) override {
+    if (m_next == m_frames.size()) {
+      if (!m_options.loop) {
+        return {};
+      }
+      m_next = 0;
+    }
+    auto* frame = static_cast<uint8_t*>(m_data) + m_frames[m_next++];
+    if (!m_y4m) {
+      return {frame, m_frame_size};
+    }
+    planar_to_yuyv(frame, m_width, m_height, m_y4m->chroma_420, buffer.data());
+    return buffer;
+  }
+
+  virtual std::string description() const override {
+    return m_path.string();
+  }
+
+ private:
+  bool index_y4m(std::string_view contents) {
+    const auto header_end = contents.find('\n');
+    auto header = parse_y4m_header(contents.substr(0, header_end));
+    if (header_end == std::string_view::npos || !header) {
+      LOG_ERROR("{} has no valid Y4M header", m_path.string());
+      return false;
+    }
+    m_y4m = *header;
+    m_width = header->width;
+    m_height = header->height;
+    if (!m_options.fps && header->fps) {
+      m_fps = *header->fps;
+    }
+
+    const size_t luma_size = size_t{m_width} * m_height;
+    const size_t chroma_size = header->chroma_420
+                                   ? (m_width / 2) * ((m_height + 1) / 2)
+                                   : (m_width / 2) * m_height;
+    m_frame_size = luma_size + 2 * chroma_size;
+    size_t offset = header_end + 1;
+    while (contents.substr(offset).starts_with("FRAME")) {
+      const auto line_end = contents.find('\n', offset);
+      if (line_end == std::string_view::npos ||
+          line_end + 1 + m_frame_size > contents.size()) {
+        LOG_WARNING("{} ends with a partial frame, ignoring it",
+                    m_path.string());
+        break;
+      }
+      m_frames.push_back(line_end + 1);
+      offset = line_end + 1 + m_frame_size;
+    }
+    if (m_frames.empty()) {
+      LOG_ERROR("{} has no frames", m_path.string());
+      return false;
+    }
+    return true;
+  }
+
+  std::filesystem::path m_path;
+  FileVideoCaptureOptions m_options;
+  void* m_data{MAP_FAILED};
+  size_t m_size{};
+  // Of a frame in the file.
+  size_t m_frame_size{};
+  // Offsets of frames in the file.
+  std::vector<size_t> m_frames;
+  size_t m_next{};
+  std::optional<Y4M_Header> m_y4m;
+};
+
+// YUYV macropixel: two pixels of the same color.
+struct YUYV {
+  uint8_t y{};
+  uint8_t u{};
+  uint8_t v{};
+};
+
+// 75% color bars of ITU-R BT.801, in BT.601 limited range.
+constexpr std::array<YUYV, 8> COLOR_BARS{{{180, 128, 128},
+                                          {162, 44, 142},
+                                          {131, 156, 44},
+                                          {112, 72, 58},
+                                          {84, 184, 198},
+                                          {65, 100, 212},
+                                          {35, 212, 114},
+                                          {16, 128, 128}}};
+
+void fill(uint8_t* out, size_t pixels, YUYV color) {
+  for (size_t i = 0; i < pixels / 2; ++i) {
+    out[4 * i] = color.y;
+    out[4 * i + 1] = color.u;
+    out[4 * i + 2] = color.y;
+    out[4 * i + 3] = color.v;
+  }
+}
+
+class SyntheticVideoCapture : public GeneratedVideoCapture {
+ public:
+  SyntheticVideoCapture(SyntheticVideoCaptureOptions options,
+                        FrameLeaseCallback on_frame)
+      : GeneratedVideoCapture(options.fps, std::move(on_frame)),
+        m_options(options) {}
+
+  ~SyntheticVideoCapture() override { stop(); }
+
+  bool initialize() {
+    m_width = m_options.width;
+    m_height = m_options.height;
+    if (m_width < 16 || m_height < 16 || m_width % 2 != 0) {
+      LOG_ERROR("Bad synthetic frame size {}x{}", m_width, m_height);
+      return false;
+    }
+    const size_t row_size = size_t{m_width} * 2;
+
+    switch (m_options.pattern) {
+      case SyntheticPattern::moving_bars:
+        // Two widths of bars, a row at any offset is a copy from it.
+        m_background.resize(row_size * 2);
+        for (size_t x = 0; x < size_t{m_width} * 2; x += 2) {
+          const auto bar = (x % m_width) * COLOR_BARS.size() / m_width;
+          fill(m_background.data() + x * 2, 2, COLOR_BARS[bar]);
+        }
+        break;
+      case SyntheticPattern::bouncing_box:
+        // Luma gradient from top to bottom.
+        m_background.resize(row_size * m_height);
+        for (size_t row = 0; row < m_height; ++row) {
+          const auto luma = static_cast<uint8_t>(16 + row * 219 / m_height);
+          fill(m_background.data() + row * row_size, m_width,
+               {luma, 128, 128});
+        }
+        break;
+      case SyntheticPattern::noise:
+        break;
+    }
+    return true;
+  }
+
+ protected:
+  virtual std::span<uint8_t> next_frame(std::span<uint8_t> buffer) override {
+    if (m_options.frame_count != 0 && m_frame_num == m_options.frame_count) {
+      return {};
+    }
+    const uint64_t shift = m_frame_num * m_options.pixels_per_frame;
+    switch (m_options.pattern) {
+      case SyntheticPattern::moving_bars:
+        draw_bars(buffer.data(), shift);
+        break;
+      case SyntheticPattern::bouncing_box:
+        draw_box(buffer.data(), shift);
+        break;
+      case SyntheticPattern::noise:
+        draw_noise(buffer);
+        break;
+    }
+    m_frame_num++;
+    return buffer;
+  }
+
+  virtual std::string description() const override {
+    return "Synthetic capture";
+  }
+
+ private:
+  void draw_bars(uint8_t* frame, uint64_t shift) {
+    // Whole macropixels only.
+    const size_t offset = (shift % m_width) & ~size_t{1};
+    const size_t row_size = size_t{m_width} * 2;
+    for (size_t row = 0; row < m_height; ++row) {
+      std::memcpy(frame + row * row_size,
+                  m_background.data() + offset * 2, row_size);
+    }
+  }
+
+  void draw_box(uint8_t* frame, uint64_t shift) {
+    std::memcpy(frame, m_background.data(), m_background.size());
+
+    // Bounces off the edges: position along a path twice the free space
+    // long, folded back.
+    const size_t side = (m_height / 4) & ~size_t{1};
+    auto bounce = [](uint64_t distance, size_t space) {
+      const auto folded = distance % (2 * space);
+      return folded < space ? folded : 2 * space - folded;
+    };
+    const size_t left = bounce(shift, m_width - side) & ~size_t{1};
+    const size_t top = bounce(shift * 3 / 4, m_height - side);
+    const size_t row_size = size_t{m_width} * 2;
+    for (size_t row = top; row < top + side; ++row) {
+      fill(frame + row * row_size + left * 2, side, COLOR_BARS[5]);
+    }
+  }
+
+  void draw_noise(std::span<uint8_t> frame) {
+    // xorshift64, seeded by the frame number.
+    uint64_t state = 0x9E3779B97F4A7C15ull * (m_frame_num + 1);
+    for (size_t i = 0; i < frame.size(); i += 8) {
+      state ^= state << 13;
+      state ^= state >> 7;
+      state ^= state << 17;
+      std::memcpy(frame.data() + i, &state,
+                  std::min<size_t>(8, frame.size() - i));
+    }
+  }
+
+  SyntheticVideoCaptureOptions m_options;
+  uint64_t m_frame_num{};
+  // Whatever the pattern draws from.
+  std::vector<uint8_t> m_background;
+};
+}  // namespace
+
+std::unique_ptr<VideoCapture> make_file_video_capture(
+    std::filesystem::path p,
+    FileVideoCaptureOptions options,
+    VideoFrameCallback on_frame) {
+  return make_file_video_capture(std::move(p), options,
+                                 lease_for_call(std::move(on_frame)));
+}
+
+std::unique_ptr<VideoCapture> make_file_video_capture(
+    std::filesystem::path p,
+    FileVideoCaptureOptions options,
+    FrameLeaseCallback on_frame) {
+  auto impl = std::make_unique<FileVideoCapture>(std::move(p), options,
+                                                 std::move(on_frame));
+  if (!impl->initialize()) {
+    LOG_ERROR("failed initializing file video capture");
+    return nullptr;
+  }
+  return impl;
+}
+
+std::unique_ptr<VideoCapture> make_synthetic_video_capture(
+    SyntheticVideoCaptureOptions options,
+    VideoFrameCallback on_frame) {
+  return make_synthetic_video_capture(options,
+                                      lease_for_call(std::move(on_frame)));
+}
+
+std::unique_ptr<VideoCapture> make_synthetic_video_capture(
+    SyntheticVideoCaptureOptions options,
+    FrameLeaseCallback on_frame) {
+  auto impl =
+      std::make_unique<SyntheticVideoCapture>(options, std::move(on_frame));
+  if (!impl->initialize()) {
+    LOG_ERROR("failed initializing synthetic video capture");
+    return nullptr;
+  }
+  return impl;
+}
@@ -9,8 +9,10 @@
 #include <cstdlib>
 #include <cstring>
 #include <filesystem>
+#include <frame_trace.hpp>
 #include <iostream>
 #include <log.hpp>
+#include <metrics_endpoint.hpp>
 #include "./ui_mainwindow.h"
 
 LOG_MODULE_NAME("RCV_APP")
@@ -22,36 +24,114 @@ bool MainWindow::initialize() {
     return false;
   }
 
-  m_udp_receive = make_udp_receive(m_ctx, 34000);
+  m_udp_receive = make_udp_receive(m_ctx, 34000,
+                                   {.nack = true,
+                                    .fec = true,
+                                    .transport_feedback = true,
+                                    .rtcp_reports = true,
+                                    // stream_transmit sends to 127.0.0.1.
+                                    .sender_on_same_host = true});
   if (!m_udp_receive) {
     LOG_ERROR("failed creating udp receive");
     return false;
   }
 
+  // Receiving goes on without it. Next to the port of stream_transmit, so
+  // that both can run on the same host.
+  m_metrics_endpoint = make_metrics_endpoint(m_ctx, 9465);
+
   return true;
 }
 
 void MainWindow::start() {
   m_udp_receive->start(*this);
+  schedule_stats_log();
 }
 
 void MainWindow::stop() {}
 
-void MainWindow::on_packet_received(VideoPacket p) /*override*/ {
+void MainWindow::on_packet_received(ReceivedPacket p) /*override*/ {
   m_packets_received++;
 
-  m_decoder->decode_packet(p);
+  m_jitter_buffer.insert(std::move(p), std::chrono::steady_clock::now());
+  schedule_jitter_buffer_poll();
+}
+
+void MainWindow::on_frame_released(std::span<ReceivedPacket> packets,
+                                   bool complete) /*override*/ {
+  if (!complete) {
+    LOG_DEBUG("Decoding incomplete frame of {} packets", packets.size());
+  }
+
+  for (auto& p : packets) {
+    if (p.payload_type == RTP_H264_PayloadType) {
+      auto ec = m_depacketizer.push_payload(
+          p.payload, p.sequence_num,
+          [this, &p](auto nal) {
+            m_decoder->decode_packet(nal, p.nal_meta.timestamp);
+          });
+      if (ec) {
+        LOG_WARNING("Failed depacketizing payload: {}", ec.message());
+      }
+      continue;
+    }
+
+    m_decoder->decode_packet(p.payload, p.nal_meta.timestamp);
 
-  if (p.nal_meta.nal_type == NAL_Type::slice &&
-      p.nal_meta.first_macroblock == 0) {
-    m_decoder->decode_packet(p);
+    if (p.nal_meta.nal_type == NAL_Type::slice &&
+        p.nal_meta.first_macroblock == 0) {
+      m_decoder->decode_packet(p.payload, p.nal_meta.timestamp);
+    }
   }
 
-  // TODO: we don't need to update on every packet received, but rathar on each
-  // frame.
   update();
 }
 
+void MainWindow::schedule_jitter_buffer_poll() {
+  const auto deadline = m_jitter_buffer.next_deadline();
+  if (!deadline || deadline == m_jitter_timer_deadline) {
+    return;
+  }
+
+  m_jitter_timer_deadline = deadline;
+  m_jitter_timer.expires_at(*deadline);
+  m_jitter_timer.async_wait([this](std::error_code ec) {
+    if (ec) {
+      // Rescheduled or cancelled.
+      return;
+    }
+    m_jitter_timer_deadline.reset();
+    m_jitter_buffer.poll(std::chrono::steady_clock::now());
+    schedule_jitter_buffer_poll();
+  });
+}
+
+void MainWindow::schedule_stats_log() {
+  m_stats_timer.expires_after(std::chrono::seconds{5});
+  m_stats_timer.async_wait([this](std::error_code ec) {
+    if (ec) {
+      return;
+    }
+    const auto stats = m_udp_receive->stats();
+    const auto jitter_buffer = m_jitter_buffer.stats();
+    LOG_INFO(
+        "Received {} packets, lost {} ({:.1f}% lately), jitter {} ms, "
+        "delay variation {} ms, queuing delay {} ms, jitter buffer delay {} "
+        "ms",
+        stats.packets_received, stats.cumulative_lost,
+        stats.loss_fraction * 100, stats.jitter.count() / 1000.0,
+        stats.delay_variation.count() / 1000.0,
+        stats.queuing_delay.count() / 1000.0,
+        std::chrono::duration_cast<std::chrono::milliseconds>(
+            jitter_buffer.target_delay)
+            .count());
+    for (const auto& stage : frame_tracer().take_report()) {
+      LOG_INFO("Latency {}", to_string(stage));
+    }
+    schedule_stats_log();
+  });
+}
+
 void MainWindow::on_frame(const VideoFrame& f) /*override*/ {
   LOG_DEBUG("Got a frame");
 
@@ -68,6 +148,7 @@ void MainWindow::on_frame(const VideoFrame& f) /*override*/ {
   // format is going to be ARGB32 (0xAARRGGBB).
   // 422 planar description can be found in:
   // https://www.kernel.org/doc/html/v4.10/media/uapi/v4l/pixfmt-yuv422m.html
+  // 420 planar one has half as many chroma rows.
   std::unique_ptr<uchar[]> image_buffer{new uchar[f.width * f.height * 4]};
 
   const uint8_t* Y_plane = f.planes[0];
@@ -84,15 +165,20 @@ void MainWindow::on_frame(const VideoFrame& f) /*override*/ {
     B = static_cast<uint8_t>(round(Bd));
   };
 
-  assert(f.pixel_format == PixelFormat::YUV422_planar);
+  assert(f.pixel_format == PixelFormat::YUV422_planar ||
+         f.pixel_format == PixelFormat::YUV420_planar);
+  const bool subsampled_rows = f.pixel_format == PixelFormat::YUV420_planar;
+  const size_t chroma_width = (f.width + 1) / 2;
 
   for (size_t x = 0; x < f.width; ++x) {
     for (size_t y = 0; y < f.height; ++y) {
       const size_t offset = y * f.width + x;
+      const size_t chroma_offset =
+          (subsampled_rows ? y / 2 : y) * chroma_width + x / 2;
 
       const auto Y = Y_plane[offset];
-      const auto U = U_plane[offset / 2];
-      const auto V = V_plane[offset / 2];
+      const auto U = U_plane[chroma_offset];
+      const auto V = V_plane[chroma_offset];
 
       uint8_t R, G, B;
       yuv_to_rgb(Y, U, V, R, G, B);
@@ -104,11 +190,14 @@ void MainWindow::on_frame(const VideoFrame& f) /*override*/ {
     }
   }
 
+  trace_frame(f.frame_id, TraceStage::converted);
+
   std::lock_guard locked{m_current_frame_lock};
   m_current_frame_data = std::move(image_buffer);
   m_current_frame_img =
       QImage{static_cast<const uchar*>(m_current_frame_data.get()), f.width,
              f.height, QImage::Format_ARGB32};
+  m_current_frame_id = f.frame_id;
 
   update();
 }
@@ -121,6 +210,9 @@ void MainWindow::paintEvent(QPaintEvent* event) /*override*/ {
   // The current approach locks decoder in paintEvent.
   std::scoped_lock slock{m_current_frame_lock};
   painter.drawImage(rect(), m_current_frame_img);
+  if (m_current_frame_id) {
+    trace_frame(*m_current_frame_id, TraceStage::rendered);
+  }
 
   // srand(42);
   // QBrush brush{QColor{135, 135, 135, 100}};
@@ -3,9 +3,14 @@
 
 #include <QMainWindow>
 #include <asio/io_context.hpp>
+#include <asio/steady_timer.hpp>
 #include <cstdio>
 #include <decoder.hpp>
+#include <jitter_buffer.hpp>
+#include <metrics_endpoint.hpp>
 #include <mutex>
+#include <optional>
+#include <rtp_h264.hpp>
 #include <string>
 #include <thread>
 #include <udp_receive.hpp>
@@ -19,6 +24,7 @@ QT_END_NAMESPACE
 
 class MainWindow : public QMainWindow,
                    public UDP_ReceiveListener,
+                   JitterBufferListener,
                    DecoderListener {
   Q_OBJECT
 
@@ -35,7 +41,11 @@ class MainWindow : public QMainWindow,
   void stop();
 
  public:  // UDP_ReceiveListener
-  virtual void on_packet_received(VideoPacket p) override;
+  virtual void on_packet_received(ReceivedPacket p) override;
+
+ public:  // JitterBufferListener
+  virtual void on_frame_released(std::span<ReceivedPacket> packets,
+                                 bool complete) override;
 
  public:  // DecoderListener
   virtual void on_frame(const VideoFrame& f) override;
@@ -48,6 +58,10 @@ class MainWindow : public QMainWindow,
   size_t get_framebuff_size() const { return m_width * m_height * 3; }
   void closeEvent(QCloseEvent* bar) override { stop(); }
 
+ private:
+  void schedule_jitter_buffer_poll();
+  void schedule_stats_log();
+
  private:
   Ui::MainWindow* ui{};
   int m_width{};
@@ -56,11 +70,22 @@ class MainWindow : public QMainWindow,
   size_t m_readbuff_size{};
   std::unique_ptr<Decoder> m_decoder;
   std::unique_ptr<UDP_Receive> m_udp_receive;
+  std::unique_ptr<MetricsEndpoint> m_metrics_endpoint;
   asio::io_context& m_ctx;
   int m_packets_received{};
 
+  // Holds leases of UDP_Receive buffers, so must be declared (and destroyed)
+  // after it. Accessed only from asio thread.
+  JitterBuffer m_jitter_buffer{*this};
+  asio::steady_timer m_jitter_timer{m_ctx};
+  std::optional<JitterBuffer::clock::time_point> m_jitter_timer_deadline;
+  H264_Depacketizer m_depacketizer{DECODER_INPUT_PADDING};
+  asio::steady_timer m_stats_timer{m_ctx};
+
   std::mutex m_current_frame_lock;
   QImage m_current_frame_img;
   std::unique_ptr<uchar[]> m_current_frame_data;
+  // Of the image above, if there is one.
+  std::optional<uint32_t> m_current_frame_id;
 };
 #endif  // MAINWINDOW_H
@@ -1,5 +1,12 @@
 
+#include <charconv>
 #include <chrono>
+#include <format>
+#include <random>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <vector>
 
 #include <asio.hpp>
 #include <asio/io_context.hpp>
@@ -8,7 +15,12 @@
 
 #include "decoder.hpp"
 #include "encoder.hpp"
+#include "frame_converter.hpp"
+#include "frame_mailbox.hpp"
+#include "frame_trace.hpp"
 #include "log.hpp"
+#include "metrics_endpoint.hpp"
+#include "simulcast.hpp"
 #include "types.hpp"
 #include "udp_receive.hpp"
 #include "udp_transmit.hpp"
@@ -39,109 +51,320 @@ class FPS_Counter {
   std::atomic<int> m_frames_captured{};
 };
 
-class StreamTransmitApp : public EncoderClient, public DecoderListener {
+// Stream of one resolution of the simulcast ladder, sent to a port and with an
+// SSRC of its own.
+class Rendition : public EncoderClient {
  public:
-  explicit StreamTransmitApp(asio::io_context& ctx) : m_ctx(ctx) {}
+  explicit Rendition(std::string name)
+      : m_name(name), m_encode_fps(std::move(name)) {}
+
+  bool initialize(asio::io_context& ctx,
+                  int port,
+                  uint32_t ssrc,
+                  uint64_t bitrate) {
+    m_udp_transmit = make_udp_transmit(
+        ctx, "127.0.0.1", port,
+        {.mode = UDP_TransmitMode::batched,
+         .payload_format = UDP_PayloadFormat::h264,
+         .ssrc = ssrc,
+         .retransmission_history = 1024,
+         .fec = {.row_size = 10},
+         // Follows bandwidth estimation once feedback comes in.
+         .pacer = {.rate = 4 * bitrate},
+         .bwe = {.start_bitrate = bitrate},
+         .abs_send_time = true,
+         .frame_marking = true,
+         .on_target_bitrate =
+             [this](uint64_t bitrate) {
+               m_encoder->set_target_bitrate(bitrate);
+             },
+         .rtcp_reports = true});
+    if (!m_udp_transmit) {
+      LOG_ERROR("Failed creating UDP transmit of {}", m_name);
+      return false;
+    }
+    LOG_INFO("Sending {} to port {} with SSRC {}", m_name, port, ssrc);
+    return true;
+  }
 
-  virtual void on_frame(const VideoFrame& f) override {
-    LOG_DEBUG("Got video frame");
+  // Of the rendition, for the simulcast encoder to own. Retuned by bandwidth
+  // estimation of the rendition's own stream.
+  std::unique_ptr<Encoder> create_encoder(const EncoderConfig& config) {
+    auto encoder = make_encoder(*this, config);
+    m_encoder = encoder.get();
+    return encoder;
   }
 
-  bool initialize() {
-    m_encoder = make_encoder(*this);
-    if (!m_encoder) {
-      LOG_ERROR("Failed creating encoder");
-      return false;
-    }
+  const std::string& name() const { return m_name; }
+  UDP_Transmit& transmit() { return *m_udp_transmit; }
 
-    auto devs = enumerate_video4_linux_devices();
-    if (devs.empty()) {
-      LOG_ERROR("No v4l2 devices found");
-      return false;
-    }
-    LOG_DEBUG("Video4Linux devices:");
-    for (auto& x : devs) {
-      cout << x << "\n";
+  virtual void on_frame_started() override {
+    LOG_DEBUG("Application: Frame of {} started", m_name);
+    m_udp_transmit->begin_frame();
+  }
+
+  virtual void on_frame_ended() override {
+    LOG_DEBUG("Application: Frame of {} finished", m_name);
+    m_udp_transmit->end_frame();
+    m_encode_fps.take_sample();
+  }
+
+  // NALs too big for it are copied, as they are split into several packets
+  // anyway.
+  virtual PacketRef nal_buffer(size_t) override {
+    return m_udp_transmit->acquire_nal_buffer();
+  }
+
+  virtual void on_nal_encoded(std::span<const uint8_t> data,
+                              PacketRef buffer,
+                              NAL_Metadata meta) override {
+    VideoPacket packet;
+    if (buffer) {
+      packet.buffer = std::move(buffer);
+    } else {
+      packet.nal_data.assign(data.begin(), data.end());
     }
+    packet.nal_meta = meta;
+    packet.nal_meta.timestamp = meta.timestamp;
+    m_udp_transmit->transmit(std::move(packet));
+  }
 
-    m_capture = make_video_capture(devs[0], [this](std::span<uint8_t> data) {
-      m_capture_fps.take_sample();
+ private:
+  std::string m_name;
+  std::unique_ptr<UDP_Transmit> m_udp_transmit;
+  Encoder* m_encoder{};
+  FPS_Counter m_encode_fps;
+};
 
-      // WARNING: called from other thread!
-      const auto ts = std::chrono::steady_clock::now();
-      m_encoder->process_frame(data, CapturedFrameMeta{.timestamp = ts});
+class StreamTransmitApp : public DecoderListener {
+ public:
+  // Source is "synthetic", a YUYV or Y4M file to replay, or the first
+  // Video4Linux device if empty. Renditions after the first one each halve
+  // the resolution of the one before.
+  StreamTransmitApp(asio::io_context& ctx,
+                    std::string source,
+                    uint32_t renditions_count)
+      : m_ctx(ctx),
+        m_source(std::move(source)),
+        m_renditions_count(renditions_count) {}
+
+  virtual void on_frame(const VideoFrame& f) override {
+    LOG_DEBUG("Got video frame");
+  }
+
+  bool initialize() {
+    // Capture thread only hands frames over, encoding is done by
+    // m_encode_thread so that a slow encode does not hold up capture.
+    m_capture = make_capture([this](FrameLease frame) {
+      m_capture_fps.take_sample();
+      m_mailbox.put(std::move(frame));
     });
     if (!m_capture) {
       LOG_ERROR("Failed creating videocapture");
-      return -1;
+      return false;
     }
 
     m_capture->print_capabilities();
 
-    LOG_DEBUG("Available formats:");
-    auto formats = m_capture->enumerate_formats();
-    if (formats.empty()) {
-      LOG_ERROR("No available video formats");
-      return -1;
+    const auto formats = m_capture->enumerate_formats();
+    const auto* format = choose_format(formats);
+    if (!format) {
+      LOG_ERROR("None of {} video formats can be encoded", formats.size());
+      return false;
     }
-    // TODO: find format we really want and need instead of random last one.
-    m_capture->select_format(*formats.back());
-
-    constexpr int port = 34000;
-
-    m_udp_transmit = make_udp_transmit(m_ctx, "127.0.0.1", port);
-    if (!m_udp_transmit) {
-      LOG_ERROR("Failed creating UDP transmit");
+    LOG_INFO("Capturing {}", to_string(*format));
+    if (!m_capture->select_format(*format)) {
+      LOG_ERROR("Failed selecting video format");
       return false;
     }
 
-    return true;
-  }
-
-  virtual void on_frame_started() override {
-    LOG_DEBUG("Application: Frame started");
-  }
+    // 4:2:2 frames are converted into 4:2:0, which is cheaper to encode and
+    // to decode, others are encoded as they are captured.
+    auto pixel_format = *format->basic.pixel_format;
+    if (pixel_format == PixelFormat::YUV422_packed) {
+      pixel_format = PixelFormat::NV12;
+      m_converter = std::make_unique<FrameConverter>(
+          pixel_format, format->basic.width, format->basic.height);
+      LOG_INFO("Converting frames into {} with {}", to_string(pixel_format),
+               to_string(simd_level()));
+    }
+    // Consecutive SSRCs, so that a relay tells renditions of one source.
+    const uint32_t first_ssrc = std::random_device{}();
+    std::vector<SimulcastLayer> layers;
+    for (uint32_t i = 0; i < m_renditions_count; ++i) {
+      const uint32_t scale = 1u << i;
+      const uint32_t width = format->basic.width / scale;
+      const uint32_t height = format->basic.height / scale;
+      // A quarter of the pixels takes about a quarter of the bitrate.
+      const uint64_t bitrate = FULL_RESOLUTION_BITRATE / (scale * scale);
+      auto rendition = std::make_unique<Rendition>(std::format("{}p", height));
+      if (!rendition->initialize(m_ctx, FIRST_PORT + i, first_ssrc + i,
+                                 bitrate)) {
+        return false;
+      }
+      // Sliced threads take all cores to each frame of full resolution
+      // without adding latency, smaller ones make do with a thread.
+      auto encoder =
+          rendition->create_encoder({.width = width,
+                                     .height = height,
+                                     .pixel_format = pixel_format,
+                                     .interval = format->basic.interval,
+                                     .bitrate_kbps = static_cast<unsigned>(
+                                         bitrate / 1000),
+                                     .threads = scale == 1 ? 0u : 1u,
+                                     .sliced_threads = scale == 1});
+      if (!encoder) {
+        LOG_ERROR("Failed creating encoder of {}", rendition->name());
+        return false;
+      }
+      layers.push_back({.scale_down_by = scale, .encoder = std::move(encoder)});
+      m_renditions.push_back(std::move(rendition));
+    }
+    m_simulcast =
+        make_simulcast_encoder(format->basic.width, format->basic.height,
+                               pixel_format, std::move(layers));
+    if (!m_simulcast) {
+      LOG_ERROR("Failed creating simulcast encoder");
+      return false;
+    }
 
-  virtual void on_frame_ended() override {
-    LOG_DEBUG("Application: Frame finished");
-    m_encode_fps.take_sample();
-  }
+    // Streaming goes on without it.
+    m_metrics_endpoint = make_metrics_endpoint(m_ctx, METRICS_PORT);
 
-  virtual void on_nal_encoded(std::span<const uint8_t> data,
-                              NAL_Metadata meta) override {
-    VideoPacket packet;
-    packet.nal_data.assign(data.begin(), data.end());
-    packet.nal_meta = meta;
-    packet.nal_meta.timestamp = meta.timestamp;
-    m_udp_transmit->transmit(std::move(packet));
+    return true;
   }
 
   void async_start_streaming(callback<void> cb) {
     LOG_INFO("Starting Streaming..");
-    m_udp_transmit->async_initialize([cb = std::move(cb), this](auto ec) {
+    async_initialize_transmits(0, [cb = std::move(cb), this](auto ec) {
       if (ec) {
         LOG_ERROR("Failed initializing UDP transmit: {}", ec.message());
         cb(ec);
         return;
       }
 
+      m_encode_thread = std::jthread{[this](std::stop_token stoken) {
+        while (auto frame = m_mailbox.take(stoken)) {
+          if (m_converter) {
+            // Capture buffer goes back right away.
+            frame = m_converter->convert(frame);
+            if (!frame) {
+              continue;
+            }
+          }
+          // Renditions encode on threads of their own.
+          m_simulcast->process_frame(std::move(frame));
+        }
+      }};
       m_capture->start();
+      schedule_stats_log();
       cb({});
     });
   }
 
-  void stop() { m_capture->stop(); }
+  void stop() {
+    m_capture->stop();
+    m_mailbox.close();
+    if (m_encode_thread.joinable()) {
+      m_encode_thread.join();
+    }
+  }
 
  private:
+  // Transmits of renditions from `index` on, one after another.
+  void async_initialize_transmits(size_t index, callback<void> cb) {
+    if (index == m_renditions.size()) {
+      cb({});
+      return;
+    }
+    m_renditions[index]->transmit().async_initialize(
+        [this, index, cb = std::move(cb)](std::error_code ec) mutable {
+          if (ec) {
+            cb(ec);
+            return;
+          }
+          async_initialize_transmits(index + 1, std::move(cb));
+        });
+  }
+
+  std::unique_ptr<VideoCapture> make_capture(FrameLeaseCallback on_frame) {
+    if (m_source == "synthetic") {
+      LOG_INFO("Capturing synthetic frames");
+      return make_synthetic_video_capture({}, std::move(on_frame));
+    }
+    if (!m_source.empty()) {
+      LOG_INFO("Replaying {}", m_source);
+      return make_file_video_capture(m_source, {}, std::move(on_frame));
+    }
+
+    auto devs = enumerate_video4_linux_devices();
+    if (devs.empty()) {
+      LOG_ERROR("No v4l2 devices found, try \"synthetic\" source instead");
+      return nullptr;
+    }
+    LOG_DEBUG("Video4Linux devices:");
+    for (auto& x : devs) {
+      cout << x << "\n";
+    }
+    return make_video_capture(devs[0], std::move(on_frame));
+  }
+
+  void schedule_stats_log() {
+    m_stats_timer.expires_after(5s);
+    m_stats_timer.async_wait([this](std::error_code ec) {
+      if (ec) {
+        return;
+      }
+      for (size_t i = 0; i < m_renditions.size(); ++i) {
+        auto& rendition = *m_renditions[i];
+        const auto stats = rendition.transmit().stats();
+        LOG_INFO("{}: Sent {} packets, RTT {} ms, loss {:.1f}%, jitter {} ms, "
+                 "dropped {} frames",
+                 rendition.name(), stats.packets_sent,
+                 stats.rtt.count() / 1000.0, stats.loss_fraction * 100,
+                 stats.jitter.count() / 1000.0, m_simulcast->dropped(i));
+      }
+      LOG_INFO("Dropped {} captured frames", m_mailbox.dropped());
+      for (const auto& stage : frame_tracer().take_report()) {
+        LOG_INFO("Latency {}", to_string(stage));
+      }
+      schedule_stats_log();
+    });
+  }
+
+  // Where Prometheus scrapes us.
+  static constexpr uint16_t METRICS_PORT = 9464;
+  // Of the full resolution rendition, the others are sent to the next ones.
+  static constexpr int FIRST_PORT = 34000;
+  static constexpr uint64_t FULL_RESOLUTION_BITRATE = 2'000'000;
+
   asio::io_context& m_ctx;
-  std::unique_ptr<Encoder> m_encoder;
+  std::string m_source;
+  uint32_t m_renditions_count;
+  std::unique_ptr<MetricsEndpoint> m_metrics_endpoint;
+  // Clients of encoders of m_simulcast, lending them NAL buffers, so go
+  // before it.
+  std::vector<std::unique_ptr<Rendition>> m_renditions;
   std::unique_ptr<VideoCapture> m_capture;
-  std::unique_ptr<UDP_Transmit> m_udp_transmit;
+  // Lends frames to m_encode_thread and m_simulcast.
+  std::unique_ptr<FrameConverter> m_converter;
+  // Holds leases of m_capture and m_converter, so goes after them.
+  std::unique_ptr<SimulcastEncoder> m_simulcast;
+  // Holds a lease of m_capture and feeds the others, so goes after them.
+  FrameMailbox m_mailbox;
+  std::jthread m_encode_thread;
   FPS_Counter m_capture_fps{"Capture"};
-  FPS_Counter m_encode_fps{"Encoder"};
+  asio::steady_timer m_stats_timer{m_ctx};
 };
 
-int main() {
+// Down to 160x90 from 1280x720.
+constexpr uint32_t MAX_RENDITIONS = 4;
+
+// Usage: stream_transmit [synthetic | FILE] [RENDITIONS]
+//
+// RENDITIONS of simulcast, 1 by default: full resolution, then half, then a
+// quarter and so on, each to the next port.
+int main(int argc, char* argv[]) {
   asio::io_context ctx;
 
   // Even though we have multothreaded pulling from eventloop all the handlers
@@ -159,7 +382,19 @@ int main() {
   asio::steady_timer t{strand_};
   asio::post(strand_, [] {});
 
-  StreamTransmitApp app{ctx};
+  uint32_t renditions_count = 1;
+  if (argc > 2) {
+    const std::string_view arg = argv[2];
+    const auto [end, ec] = std::from_chars(arg.data(), arg.data() + arg.size(),
+                                           renditions_count);
+    if (ec != std::errc{} || end != arg.data() + arg.size() ||
+        renditions_count < 1 || renditions_count > MAX_RENDITIONS) {
+      LOG_ERROR("Renditions must be 1 to {}, not {}", MAX_RENDITIONS, arg);
+      return -1;
+    }
+  }
+
+  StreamTransmitApp app{ctx, argc > 1 ? argv[1] : "", renditions_count};
   if (!app.initialize()) {
     LOG_ERROR("Failed initializating app. Exiting..");
     return -1;